@@ -855,6 +855,7 @@ TypeId BuiltinTypes::makeStringMetatable()
                      oneStringPack,
                  })}},
         {"packsize", {makeFunction(*arena, stringType, {}, {}, {}, {}, {numberType})}},
+        {"builder", {arena->addType(FunctionType{arena->addTypePack({optionalNumber}), arena->addTypePack({anyType})})}},
         {"unpack", {arena->addType(FunctionType{
                        arena->addTypePack(TypePack{{stringType, stringType, optionalNumber}}),
                        anyTypePack,
@@ -0,0 +1,419 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+#include "HeapSnapshot.h"
+
+#include "lua.h"
+
+#include "Luau/DenseHash.h"
+
+#include "FileUtils.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+
+// Reader for heap snapshots written by lua_heapsnapshot; see lgcdebug.c for the format description
+enum SnapshotRecord
+{
+    SnapshotEnd = 0,
+    SnapshotObject = 1,
+    SnapshotRoot = 2,
+    SnapshotCategory = 3,
+};
+
+struct SnapshotEntry
+{
+    uint64_t id = 0;
+    uint8_t type = 0;
+    uint8_t memcat = 0;
+    uint64_t size = 0;
+
+    uint32_t edgeStart = 0;
+    uint32_t edgeCount = 0;
+
+    int name = -1; // index into Snapshot::names
+};
+
+struct Snapshot
+{
+    std::vector<SnapshotEntry> objects;
+    std::vector<uint64_t> edges;
+    std::vector<std::string> names;
+    std::vector<uint64_t> roots;
+    std::string categories[256];
+
+    Luau::DenseHashMap<uint64_t, uint32_t> index{0};
+
+    // filled by markReachable
+    std::vector<bool> reachable;
+};
+
+struct SnapshotReader
+{
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+    bool error = false;
+
+    uint8_t byte()
+    {
+        if (pos >= size)
+        {
+            error = true;
+            return 0;
+        }
+
+        return data[pos++];
+    }
+
+    uint64_t varint()
+    {
+        uint64_t result = 0;
+
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t b = byte();
+            result |= uint64_t(b & 127) << shift;
+
+            if ((b & 128) == 0)
+                return result;
+        }
+
+        error = true;
+        return 0;
+    }
+
+    uint64_t delta(uint64_t base)
+    {
+        uint64_t v = varint();
+        return base + ((v >> 1) ^ (0 - (v & 1)));
+    }
+
+    std::string string()
+    {
+        uint64_t len = varint();
+
+        if (len > size - pos)
+        {
+            error = true;
+            return std::string();
+        }
+
+        std::string result(reinterpret_cast<const char*>(data + pos), size_t(len));
+        pos += size_t(len);
+        return result;
+    }
+};
+
+static bool loadSnapshot(const char* path, Snapshot& snapshot)
+{
+    std::optional<std::string> source = readFile(path);
+    if (!source)
+    {
+        fprintf(stderr, "Error opening %s\n", path);
+        return false;
+    }
+
+    SnapshotReader reader = {reinterpret_cast<const uint8_t*>(source->data()), source->size()};
+
+    if (source->size() < 4 || memcmp(source->data(), "LHS1", 4) != 0)
+    {
+        fprintf(stderr, "Error loading %s: not a heap snapshot\n", path);
+        return false;
+    }
+
+    reader.pos = 4;
+
+    uint64_t lastId = 0;
+
+    for (;;)
+    {
+        uint8_t kind = reader.byte();
+
+        if (reader.error || kind == SnapshotEnd)
+            break;
+
+        if (kind == SnapshotObject)
+        {
+            SnapshotEntry entry;
+            entry.id = reader.delta(lastId);
+
+            uint8_t type = reader.byte();
+            entry.type = type & 127;
+            entry.memcat = reader.byte();
+            entry.size = reader.varint();
+
+            uint64_t edgeCount = reader.varint();
+
+            entry.edgeStart = uint32_t(snapshot.edges.size());
+            entry.edgeCount = uint32_t(edgeCount);
+
+            for (uint64_t i = 0; i < edgeCount && !reader.error; ++i)
+                snapshot.edges.push_back(reader.delta(entry.id));
+
+            if (type & 128)
+            {
+                entry.name = int(snapshot.names.size());
+                snapshot.names.push_back(reader.string());
+            }
+
+            lastId = entry.id;
+
+            snapshot.index[entry.id] = uint32_t(snapshot.objects.size());
+            snapshot.objects.push_back(entry);
+        }
+        else if (kind == SnapshotRoot)
+        {
+            snapshot.roots.push_back(reader.varint());
+            reader.string();
+        }
+        else if (kind == SnapshotCategory)
+        {
+            uint64_t memcat = reader.varint();
+            reader.varint();
+            std::string name = reader.string();
+
+            if (memcat < 256)
+                snapshot.categories[memcat] = name;
+        }
+        else
+        {
+            reader.error = true;
+        }
+    }
+
+    if (reader.error)
+    {
+        fprintf(stderr, "Error loading %s: snapshot is truncated or corrupted\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+// objects that are not reachable from the roots are garbage that wasn't collected yet and are excluded from the totals
+static void markReachable(Snapshot& snapshot)
+{
+    snapshot.reachable.assign(snapshot.objects.size(), false);
+
+    std::vector<uint32_t> queue;
+
+    for (uint64_t root : snapshot.roots)
+        if (const uint32_t* index = snapshot.index.find(root))
+            queue.push_back(*index);
+
+    while (!queue.empty())
+    {
+        uint32_t index = queue.back();
+        queue.pop_back();
+
+        if (snapshot.reachable[index])
+            continue;
+
+        snapshot.reachable[index] = true;
+
+        const SnapshotEntry& entry = snapshot.objects[index];
+
+        for (uint32_t i = 0; i < entry.edgeCount; ++i)
+            if (const uint32_t* target = snapshot.index.find(snapshot.edges[entry.edgeStart + i]))
+                if (!snapshot.reachable[*target])
+                    queue.push_back(*target);
+    }
+}
+
+static const char* getTypeName(uint8_t type)
+{
+    switch (type)
+    {
+    case LUA_TSTRING:
+        return "string";
+    case LUA_TTABLE:
+        return "table";
+    case LUA_TFUNCTION:
+        return "function";
+    case LUA_TUSERDATA:
+        return "userdata";
+    case LUA_TTHREAD:
+        return "thread";
+    case LUA_TPROTO:
+        return "proto";
+    case LUA_TUPVAL:
+        return "upvalue";
+    default:
+        return "unknown";
+    }
+}
+
+// Luau doesn't track allocation sites, so functions are attributed to their prototypes (source:line) and other objects to their type
+static std::string getSite(const Snapshot& snapshot, const SnapshotEntry& entry)
+{
+    if (entry.name >= 0)
+        return std::string(getTypeName(entry.type)) + " " + snapshot.names[entry.name];
+
+    if (entry.type == LUA_TFUNCTION)
+    {
+        for (uint32_t i = 0; i < entry.edgeCount; ++i)
+        {
+            const uint32_t* target = snapshot.index.find(snapshot.edges[entry.edgeStart + i]);
+
+            if (target && snapshot.objects[*target].type == LUA_TPROTO && snapshot.objects[*target].name >= 0)
+                return "function " + snapshot.names[snapshot.objects[*target].name];
+        }
+    }
+
+    return getTypeName(entry.type);
+}
+
+struct DiffStats
+{
+    uint64_t oldSize = 0;
+    uint64_t oldCount = 0;
+    uint64_t newSize = 0;
+    uint64_t newCount = 0;
+
+    int64_t delta() const
+    {
+        return int64_t(newSize) - int64_t(oldSize);
+    }
+};
+
+static void addStats(Luau::DenseHashMap<std::string, DiffStats>& map, const std::string& key, uint64_t size, bool isNew)
+{
+    DiffStats& stats = map[key];
+
+    if (isNew)
+    {
+        stats.newSize += size;
+        stats.newCount++;
+    }
+    else
+    {
+        stats.oldSize += size;
+        stats.oldCount++;
+    }
+}
+
+static void collectStats(const Snapshot& snapshot, bool isNew, Luau::DenseHashMap<std::string, DiffStats>& categories,
+    Luau::DenseHashMap<std::string, DiffStats>& sites)
+{
+    for (size_t i = 0; i < snapshot.objects.size(); ++i)
+    {
+        if (!snapshot.reachable[i])
+            continue;
+
+        const SnapshotEntry& entry = snapshot.objects[i];
+
+        const std::string& categoryName = snapshot.categories[entry.memcat];
+        addStats(categories, categoryName.empty() ? std::to_string(entry.memcat) : categoryName, entry.size, isNew);
+        addStats(sites, getSite(snapshot, entry), entry.size, isNew);
+    }
+}
+
+static void printStats(const char* title, const Luau::DenseHashMap<std::string, DiffStats>& map, size_t limit)
+{
+    std::vector<std::pair<std::string, DiffStats>> sorted;
+
+    for (auto& [key, stats] : map)
+        if (stats.delta() != 0 || stats.newCount != stats.oldCount)
+            sorted.push_back({key, stats});
+
+    std::sort(sorted.begin(), sorted.end(),
+        [](const std::pair<std::string, DiffStats>& l, const std::pair<std::string, DiffStats>& r)
+        {
+            return l.second.delta() > r.second.delta();
+        });
+
+    printf("%s:\n", title);
+    printf("%14s %14s %14s %10s  %s\n", "delta", "old bytes", "new bytes", "objects", "name");
+
+    for (size_t i = 0; i < sorted.size() && i < limit; ++i)
+    {
+        const DiffStats& stats = sorted[i].second;
+
+        printf("%+14lld %14llu %14llu %+10lld  %s\n", (long long)stats.delta(), (unsigned long long)stats.oldSize, (unsigned long long)stats.newSize,
+            (long long)stats.newCount - (long long)stats.oldCount, sorted[i].first.c_str());
+    }
+
+    if (sorted.size() > limit)
+        printf("... %d more\n", int(sorted.size() - limit));
+
+    printf("\n");
+}
+
+static void snapshotWriter(void* ud, const void* data, size_t size)
+{
+    fwrite(data, 1, size, static_cast<FILE*>(ud));
+}
+
+void heapSnapshotDump(lua_State* L, const char* path)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f)
+    {
+        fprintf(stderr, "Error opening heap snapshot %s\n", path);
+        return;
+    }
+
+    // only keep reachable objects in the snapshot
+    lua_gc(L, LUA_GCCOLLECT, 0);
+
+    lua_heapsnapshot(L, snapshotWriter, f, nullptr);
+
+    fclose(f);
+
+    printf("Heap snapshot written to %s (%d KB heap)\n", path, int(lua_totalbytes(L, -1) / 1024));
+}
+
+int heapSnapshotDiff(const char* oldPath, const char* newPath)
+{
+    Snapshot oldSnapshot;
+    Snapshot newSnapshot;
+
+    if (!loadSnapshot(oldPath, oldSnapshot) || !loadSnapshot(newPath, newSnapshot))
+        return 1;
+
+    markReachable(oldSnapshot);
+    markReachable(newSnapshot);
+
+    Luau::DenseHashMap<std::string, DiffStats> categories{""};
+    Luau::DenseHashMap<std::string, DiffStats> sites{""};
+
+    collectStats(oldSnapshot, false, categories, sites);
+    collectStats(newSnapshot, true, categories, sites);
+
+    // note: sizes are shallow sizes of reachable objects, so an object that keeps others alive is only charged for itself
+    printStats("Live size by memory category", categories, 256);
+    printStats("Live size by allocation site", sites, 50);
+
+    return 0;
+}
+
+void allocHistogramDump(lua_State* L, const char* path)
+{
+    // sizes up to 512 bytes get their own entries, the last entry counts all larger allocations
+    std::vector<size_t> counts(514);
+    int count = lua_getallochistogram(L, counts.data(), int(counts.size()));
+
+    FILE* f = fopen(path, "w");
+    if (!f)
+    {
+        fprintf(stderr, "Error opening allocation histogram %s\n", path);
+        return;
+    }
+
+    uint64_t total = 0;
+
+    for (int size = 1; size < count; ++size)
+    {
+        if (counts[size])
+            fprintf(f, "%d %llu\n", size, (unsigned long long)counts[size]);
+
+        total += counts[size];
+    }
+
+    fclose(f);
+
+    printf("Allocation histogram written to %s (%llu allocations)\n", path, (unsigned long long)total);
+}
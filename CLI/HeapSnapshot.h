@@ -0,0 +1,9 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+#pragma once
+
+struct lua_State;
+
+void heapSnapshotDump(lua_State* L, const char* path);
+int heapSnapshotDiff(const char* oldPath, const char* newPath);
+
+void allocHistogramDump(lua_State* L, const char* path);
@@ -12,10 +12,12 @@
 #include "Coverage.h"
 #include "FileUtils.h"
 #include "Flags.h"
+#include "HeapSnapshot.h"
 #include "Profiler.h"
 
 #include "isocline.h"
 
+#include <algorithm>
 #include <memory>
 
 #ifdef _WIN32
@@ -60,6 +62,46 @@ constexpr int MaxTraversalLimit = 50;
 
 static bool codegen = false;
 
+// GC step telemetry, aggregated by collector state for --gcstats
+struct GCStateStats
+{
+    size_t steps = 0;
+    size_t work = 0;
+    double time = 0;
+    double maxtime = 0;
+};
+
+constexpr int MaxGCStates = 8;
+
+static GCStateStats gcStateStats[MaxGCStates];
+
+static void gcstepCallback(lua_State* L, const lua_GCStepInfo* info)
+{
+    if (unsigned(info->state) >= MaxGCStates)
+        return;
+
+    GCStateStats& stats = gcStateStats[info->state];
+
+    stats.steps++;
+    stats.work += info->work;
+    stats.time += info->duration;
+    stats.maxtime = std::max(stats.maxtime, info->duration);
+}
+
+static void gcStatsDump()
+{
+    printf("%-8s %10s %14s %12s %12s\n", "state", "steps", "work", "time (ms)", "max (ms)");
+
+    for (int i = 0; i < MaxGCStates; ++i)
+    {
+        const char* name = lua_gcstatename(i);
+        const GCStateStats& stats = gcStateStats[i];
+
+        if (name && stats.steps)
+            printf("%-8s %10zu %14zu %12.3f %12.3f\n", name, stats.steps, stats.work, stats.time * 1000, stats.maxtime * 1000);
+    }
+}
+
 // Ctrl-C handling
 static void sigintCallback(lua_State* L, int gc)
 {
@@ -811,13 +853,18 @@ static void displayHelp(const char* argv0)
     printf("Available modes:\n");
     printf("  omitted: compile and run input files one by one\n");
     printf("  --compile[=format]: compile input files and output resulting bytecode/assembly (binary, text, remarks, codegen)\n");
+    printf("  --heapdiff <old> <new>: compare two heap snapshots and report growth of live objects by memory category and allocation site\n");
     printf("\n");
     printf("Available options:\n");
+    printf("  --allochistogram: record sizes of all heap allocations and output the histogram to allochistogram.out\n");
+    printf("  --bgsweep: sweep the heap on a helper thread in addition to the incremental sweep\n");
     printf("  --coverage: collect code coverage while running the code and output results to coverage.out\n");
     printf("  -h, --help: Display this usage message.\n");
     printf("  -i, --interactive: Run an interactive REPL after executing the last script specified.\n");
     printf("  -O<n>: compile with optimization level n (default 1, n should be between 0 and 2).\n");
     printf("  -g<n>: compile with debug level n (default 1, n should be between 0 and 2).\n");
+    printf("  --gcstats: output the number, work and duration of incremental GC steps in each collector state after running the code\n");
+    printf("  --heapsnapshot: collect garbage after running the code and output a heap snapshot to heap.snap\n");
     printf("  --profile[=N]: profile the code using N Hz sampling (default 10000) and output results to profile.out\n");
     printf("  --timetrace: record compiler time tracing information into trace.json\n");
     printf("  --codegen: execute code using native code generation\n");
@@ -839,6 +886,10 @@ int replMain(int argc, char** argv)
     CompileFormat compileFormat{};
     int profile = 0;
     bool coverage = false;
+    bool heapsnapshot = false;
+    bool allochistogram = false;
+    bool bgsweep = false;
+    bool gcstats = false;
     bool interactive = false;
 
     // Set the mode if the user has explicitly specified one.
@@ -893,6 +944,16 @@ int replMain(int argc, char** argv)
             return 1;
         }
     }
+    else if (argc >= 2 && strcmp(argv[1], "--heapdiff") == 0)
+    {
+        if (argc != 4)
+        {
+            fprintf(stderr, "Error: '--heapdiff' requires two heap snapshot paths.\n");
+            return 1;
+        }
+
+        return heapSnapshotDiff(argv[2], argv[3]);
+    }
 
     for (int i = argStart; i < argc; i++)
     {
@@ -941,6 +1002,22 @@ int replMain(int argc, char** argv)
         {
             coverage = true;
         }
+        else if (strcmp(argv[i], "--heapsnapshot") == 0)
+        {
+            heapsnapshot = true;
+        }
+        else if (strcmp(argv[i], "--allochistogram") == 0)
+        {
+            allochistogram = true;
+        }
+        else if (strcmp(argv[i], "--bgsweep") == 0)
+        {
+            bgsweep = true;
+        }
+        else if (strcmp(argv[i], "--gcstats") == 0)
+        {
+            gcstats = true;
+        }
         else if (strcmp(argv[i], "--timetrace") == 0)
         {
             FFlag::DebugLuauTimeTracing.value = true;
@@ -1026,6 +1103,15 @@ int replMain(int argc, char** argv)
         if (coverage)
             coverageInit(L);
 
+        if (allochistogram)
+            lua_setallochistogram(L, 1);
+
+        if (bgsweep)
+            lua_gc(L, LUA_GCBACKGROUNDSWEEP, 1);
+
+        if (gcstats)
+            lua_callbacks(L)->gcstep = gcstepCallback;
+
         int failed = 0;
 
         for (size_t i = 0; i < files.size(); ++i)
@@ -1043,6 +1129,15 @@ int replMain(int argc, char** argv)
         if (coverage)
             coverageDump("coverage.out");
 
+        if (heapsnapshot)
+            heapSnapshotDump(L, "heap.snap");
+
+        if (allochistogram)
+            allocHistogramDump(L, "allochistogram.out");
+
+        if (gcstats)
+            gcStatsDump();
+
         return failed ? 1 : 0;
     }
     case CliMode::Unknown:
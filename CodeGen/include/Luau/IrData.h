@@ -34,8 +34,8 @@ enum class IrCmd : uint8_t
     // A: Rn or Kn
     LOAD_POINTER,
 
-    // Load a double number from TValue
-    // A: Rn or Kn
+    // Load a double number from TValue or packed table array
+    // A: Rn or Kn or pointer (double)
     LOAD_DOUBLE,
 
     // Load an int from TValue
@@ -58,6 +58,11 @@ enum class IrCmd : uint8_t
     // B: unsigned int
     GET_ARR_ADDR,
 
+    // Get pointer (double) to packed table array at index
+    // A: pointer (Table)
+    // B: unsigned int
+    GET_PACKED_ADDR,
+
     // Get pointer (LuaNode) to table node element at the active cached slot index
     // A: pointer (Table)
     GET_SLOT_NODE_ADDR,
@@ -72,8 +77,8 @@ enum class IrCmd : uint8_t
     // B: pointer
     STORE_POINTER,
 
-    // Store a double number into TValue
-    // A: Rn
+    // Store a double number into TValue or packed table array
+    // A: Rn or pointer (double)
     // B: double
     STORE_DOUBLE,
 
@@ -265,6 +270,12 @@ enum class IrCmd : uint8_t
     // B: block
     CHECK_ARRAY_SIZE,
 
+    // Guard against index overflowing the packed table array size; tables without a packed array part always fail the check
+    // A: pointer (Table)
+    // B: int
+    // C: block
+    CHECK_PACKED_SIZE,
+
     // Guard against cached table node slot not matching the actual table node slot for a key
     // A: pointer (LuaNode)
     // B: Kn
@@ -122,6 +122,7 @@ inline bool hasResult(IrCmd cmd)
     case IrCmd::LOAD_NODE_VALUE_TV:
     case IrCmd::LOAD_ENV:
     case IrCmd::GET_ARR_ADDR:
+    case IrCmd::GET_PACKED_ADDR:
     case IrCmd::GET_SLOT_NODE_ADDR:
     case IrCmd::ADD_INT:
     case IrCmd::SUB_INT:
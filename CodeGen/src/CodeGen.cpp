@@ -20,6 +20,7 @@
 #include "NativeState.h"
 
 #include "lapi.h"
+#include "lvm.h"
 
 #include <memory>
 
@@ -98,7 +99,7 @@ static int emitInst(AssemblyBuilderX64& build, NativeState& data, ModuleHelpers&
         emitInstSetGlobal(build, pc, i, next, fallback);
         break;
     case LOP_NAMECALL:
-        emitInstNameCall(build, pc, i, proto->k, next, fallback);
+        emitInstNameCall(build, pc, proto->k, fallback);
         break;
     case LOP_CALL:
         emitInstCall(build, helpers, pc, i);
@@ -693,7 +694,7 @@ void create(lua_State* L)
     ecb->setbreakpoint = onSetBreakpoint;
 }
 
-static void gatherFunctions(std::vector<Proto*>& results, Proto* proto)
+static void gatherFunctions(lua_State* L, std::vector<Proto*>& results, Proto* proto)
 {
     if (results.size() <= size_t(proto->bytecodeid))
         results.resize(proto->bytecodeid + 1);
@@ -704,8 +705,15 @@ static void gatherFunctions(std::vector<Proto*>& results, Proto* proto)
 
     results[proto->bytecodeid] = proto;
 
+    // functions loaded with luau_loadlazy need their code decoded before it can be compiled
+    if (proto->lazy & PROTO_LAZYCODE)
+        luau_loadcode(L, proto);
+
+    // superinstructions are specific to the interpreter
+    luau_unfusecode(L, proto);
+
     for (int i = 0; i < proto->sizep; i++)
-        gatherFunctions(results, proto->p[i]);
+        gatherFunctions(L, results, proto->p[i]);
 }
 
 void compile(lua_State* L, int idx)
@@ -721,7 +729,7 @@ void compile(lua_State* L, int idx)
     NativeState* data = getNativeState(L);
 
     std::vector<Proto*> protos;
-    gatherFunctions(protos, clvalue(func)->l.p);
+    gatherFunctions(L, protos, clvalue(func)->l.p);
 
     ModuleHelpers helpers;
     assembleHelpers(build, helpers);
@@ -774,7 +782,7 @@ std::string getAssembly(lua_State* L, int idx, AssemblyOptions options)
     initFallbackTable(data);
 
     std::vector<Proto*> protos;
-    gatherFunctions(protos, clvalue(func)->l.p);
+    gatherFunctions(L, protos, clvalue(func)->l.p);
 
     ModuleHelpers helpers;
     assembleHelpers(build, helpers);
@@ -15,10 +15,54 @@ namespace CodeGen
 
 bool forgLoopNodeIter(lua_State* L, Table* h, int index, TValue* ra)
 {
+    int sizearray = h->sizearray;
+
+    // packed array portion has no holes; the rest of the table is numbered after its capacity
+    if (ispacked(h))
+    {
+        if (unsigned(index) < unsigned(h->numbers->size))
+        {
+            setpvalue(ra + 2, reinterpret_cast<void*>(uintptr_t(index + 1)));
+            setnvalue(ra + 3, double(index + 1));
+            setnvalue(ra + 4, gpacked(h, index));
+
+            return true;
+        }
+
+        sizearray = h->numbers->capacity;
+
+        if (unsigned(index) < unsigned(sizearray))
+            index = sizearray;
+    }
+
+    // tables with a shape have fields instead of the hash portion
+    if (isshaped(h))
+    {
+        TableShape* shape = gfields(h)->shape;
+
+        while (unsigned(index - sizearray) < unsigned(shape->nfields))
+        {
+            TValue* e = gfield(h, index - sizearray);
+
+            if (!ttisnil(e))
+            {
+                setpvalue(ra + 2, reinterpret_cast<void*>(uintptr_t(index + 1)));
+                setsvalue(L, ra + 3, gshapekey(shape, index - sizearray));
+                setobj(L, ra + 4, e);
+
+                return true;
+            }
+
+            index++;
+        }
+    }
+
+    luaC_checkweak(L, h);
+
     // then we advance index through the hash portion
-    while (unsigned(index - h->sizearray) < unsigned(1 << h->lsizenode))
+    while (unsigned(index - sizearray) < unsigned(1 << h->lsizenode))
     {
-        LuaNode* n = &h->node[index - h->sizearray];
+        LuaNode* n = &h->node[index - sizearray];
 
         if (!ttisnil(gval(n)))
         {
@@ -83,6 +127,9 @@ Closure* callProlog(lua_State* L, TValue* ra, StkId argtop, int nresults)
 
     Closure* ccl = clvalue(ra);
 
+    if (!ccl->isC && LUAU_UNLIKELY(ccl->l.p->lazy & PROTO_LAZYCODE))
+        luau_loadcode(L, ccl->l.p);
+
     CallInfo* ci = incr_ci(L);
     ci->func = ra;
     ci->base = ra + 1;
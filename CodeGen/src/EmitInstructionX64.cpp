@@ -69,14 +69,12 @@ void emitInstMove(AssemblyBuilderX64& build, const Instruction* pc)
     build.vmovups(luauReg(ra), xmm0);
 }
 
-void emitInstNameCall(AssemblyBuilderX64& build, const Instruction* pc, int pcpos, const TValue* k, Label& next, Label& fallback)
+void emitInstNameCall(AssemblyBuilderX64& build, const Instruction* pc, const TValue* k, Label& fallback)
 {
     int ra = LUAU_INSN_A(*pc);
     int rb = LUAU_INSN_B(*pc);
     uint32_t aux = pc[1];
 
-    Label secondfpath;
-
     jumpIfTagIsNot(build, rb, LUA_TTABLE, fallback);
 
     RegisterX64 table = r8;
@@ -93,21 +91,8 @@ void emitInstNameCall(AssemblyBuilderX64& build, const Instruction* pc, int pcpo
     build.shl(rax, kLuaNodeSizeLog2);
     build.add(node, rax);
 
-    jumpIfNodeKeyNotInExpectedSlot(build, rax, node, luauConstantValue(aux), secondfpath);
-
-    setLuauReg(build, xmm0, ra + 1, luauReg(rb));
-    setLuauReg(build, xmm0, ra, luauNodeValue(node));
-    build.jmp(next);
-
-    build.setLabel(secondfpath);
-
-    jumpIfNodeHasNext(build, node, fallback);
-    callGetFastTmOrFallback(build, table, TM_INDEX, fallback);
-    jumpIfTagIsNot(build, rax, LUA_TTABLE, fallback);
-
-    build.mov(table, qword[rax + offsetof(TValue, value)]);
-
-    getTableNodeAtCachedSlot(build, rax, node, table, pcpos);
+    // methods that come from the metatable are found through the namecall cache of the instruction, which the fallback shares with the
+    // interpreter; the C operand is the cache site, so it can't be used as a slot hint for the __index table
     jumpIfNodeKeyNotInExpectedSlot(build, rax, node, luauConstantValue(aux), fallback);
 
     setLuauReg(build, xmm0, ra + 1, luauReg(rb));
@@ -1190,7 +1175,7 @@ void emitinstForGLoop(AssemblyBuilderX64& build, const Instruction* pc, int pcpo
     // while (unsigned(index) < unsigned(sizearray))
     Label arrayLoop = build.setLabel();
     build.cmp(dwordReg(index), dword[table + offsetof(Table, sizearray)]);
-    build.jcc(ConditionX64::NotBelow, isIpairsIter ? loopExit : skipArray);
+    build.jcc(ConditionX64::NotBelow, skipArray);
 
     // If element is nil, we increment the index; if it's not, we still need 'index + 1' inside
     build.inc(index);
@@ -1212,7 +1197,29 @@ void emitinstForGLoop(AssemblyBuilderX64& build, const Instruction* pc, int pcpo
 
     build.jmp(loopRepeat);
 
-    if (!isIpairsIter)
+    if (isIpairsIter)
+    {
+        build.setLabel(skipArray);
+
+        // Packed array part has sizearray == 0 and is traversed by the helper; ipairs-style traversal ends with the packed elements
+        build.cmp(dword[table + offsetof(Table, sizearray)], 0);
+        build.jcc(ConditionX64::NotEqual, loopExit);
+        build.mov(rax, qword[table + offsetof(Table, numbers)]);
+        build.test(rax, rax);
+        build.jcc(ConditionX64::Zero, loopExit);
+        // tables with a shape keep tagged fields in the same slot
+        build.test(byte[table + offsetof(Table, shaped)], 1);
+        build.jcc(ConditionX64::NotZero, loopExit);
+        build.cmp(dword[rax + offsetof(TableNumbers, size)], dwordReg(index));
+        build.jcc(ConditionX64::BelowEqual, loopExit);
+
+        build.mov(rArg1, rState);
+        // rArg2 and rArg3 are already set
+        build.lea(rArg4, luauRegAddress(ra));
+        build.call(qword[rNativeContext + offsetof(NativeContext, forgLoopNodeIter)]);
+        build.jmp(loopRepeat);
+    }
+    else
     {
         build.setLabel(skipArrayNil);
 
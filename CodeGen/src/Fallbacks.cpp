@@ -93,6 +93,12 @@ const Instruction* execute_LOP_GETTABLEKS(lua_State* L, const Instruction* pc, S
             setobj2s(L, ra, gval(n));
             return pc;
         }
+        // fast-path: table has a shape and value is in expected field
+        else if (isshaped(h) && gfieldkey(h, LUAU_INSN_C(insn)) == tsvalue(kv) && !ttisnil(gfield(h, LUAU_INSN_C(insn))))
+        {
+            setobj2s(L, ra, gfield(h, LUAU_INSN_C(insn)));
+            return pc;
+        }
         else if (!h->metatable)
         {
             // fast-path: value is not in expected slot, but the table lookup doesn't involve metatable
@@ -212,6 +218,13 @@ const Instruction* execute_LOP_SETTABLEKS(lua_State* L, const Instruction* pc, S
             luaC_barriert(L, h, ra);
             return pc;
         }
+        // fast-path: table has a shape and value is in expected field
+        else if (isshaped(h) && gfieldkey(h, LUAU_INSN_C(insn)) == tsvalue(kv) && !ttisnil(gfield(h, LUAU_INSN_C(insn))) && !h->readonly)
+        {
+            setobj2t(L, gfield(h, LUAU_INSN_C(insn)), ra);
+            luaC_barriert(L, h, ra);
+            return pc;
+        }
         else if (fastnotm(h->metatable, TM_NEWINDEX) && !h->readonly)
         {
             VM_PROTECT_PC(); // set may fail
@@ -325,8 +338,7 @@ const Instruction* execute_LOP_NAMECALL(lua_State* L, const Instruction* pc, Stk
         // for predictive lookups
         LuaNode* n = &h->node[tsvalue(kv)->hash & (sizenode(h) - 1)];
 
-        const TValue* mt = 0;
-        const LuaNode* mtn = 0;
+        const TValue* method = 0;
 
         // fast-path: key is in the table in expected slot
         if (ttisstring(gkey(n)) && tsvalue(gkey(n)) == tsvalue(kv) && !ttisnil(gval(n)))
@@ -335,33 +347,32 @@ const Instruction* execute_LOP_NAMECALL(lua_State* L, const Instruction* pc, Stk
             setobj2s(L, ra + 1, rb);
             setobj2s(L, ra, gval(n));
         }
-        // fast-path: key is absent from the base, table has an __index table, and it has the result in the expected slot
-        else if (gnext(n) == 0 && (mt = fasttm(L, hvalue(rb)->metatable, TM_INDEX)) && ttistable(mt) &&
-                 (mtn = &hvalue(mt)->node[LUAU_INSN_C(insn) & hvalue(mt)->nodemask8]) && ttisstring(gkey(mtn)) && tsvalue(gkey(mtn)) == tsvalue(kv) &&
-                 !ttisnil(gval(mtn)))
+        // fast-path: key is absent from the base, and the cache of this instruction has the method for the metatable
+        // note: tables with a shape have no hash part, so their fields need a lookup, as do keys that collide with other keys
+        else if (((!isshaped(h) && gnext(n) == 0) || ttisnil(luaH_getstr(h, tsvalue(kv)))) &&
+                 (method = luaV_namecallcached(L->global, cl->l.p, LUAU_INSN_C(insn), h->metatable)))
         {
             // note: order of copies allows rb to alias ra+1 or ra
             setobj2s(L, ra + 1, rb);
-            setobj2s(L, ra, gval(mtn));
+            setobj2s(L, ra, method);
         }
         else
         {
             // slow-path: handles full table lookup
             setobj2s(L, ra + 1, rb);
-            L->cachedslot = LUAU_INSN_C(insn);
             VM_PROTECT(luaV_gettable(L, rb, kv, ra));
-            // save cachedslot to accelerate future lookups; patches currently executing instruction since pc-2 rolls back two pc++
-            VM_PATCH_C(pc - 2, L->cachedslot);
             // recompute ra since stack might have been reallocated
             ra = VM_REG(LUAU_INSN_A(insn));
             if (ttisnil(ra))
                 luaG_methoderror(L, ra + 1, tsvalue(kv));
+            // record the __index chain in the cache of this instruction to accelerate future lookups
+            VM_PROTECT(luaV_cachenamecall(L, cl->l.p, LUAU_INSN_C(insn), ra + 1, tsvalue(kv)));
         }
     }
     else
     {
         Table* mt = ttisuserdata(rb) ? uvalue(rb)->metatable : L->global->mt[ttype(rb)];
-        const TValue* tmi = 0;
+        const TValue* method = 0;
 
         // fast-path: metatable with __namecall
         if (const TValue* fn = fasttm(L, mt, TM_NAMECALL))
@@ -372,42 +383,24 @@ const Instruction* execute_LOP_NAMECALL(lua_State* L, const Instruction* pc, Stk
 
             L->namecall = tsvalue(kv);
         }
-        else if ((tmi = fasttm(L, mt, TM_INDEX)) && ttistable(tmi))
+        // fast-path: the cache of this instruction has the method for the metatable
+        else if ((method = luaV_namecallcached(L->global, cl->l.p, LUAU_INSN_C(insn), mt)))
         {
-            Table* h = hvalue(tmi);
-            int slot = LUAU_INSN_C(insn) & h->nodemask8;
-            LuaNode* n = &h->node[slot];
-
-            // fast-path: metatable with __index that has method in expected slot
-            if (LUAU_LIKELY(ttisstring(gkey(n)) && tsvalue(gkey(n)) == tsvalue(kv) && !ttisnil(gval(n))))
-            {
-                // note: order of copies allows rb to alias ra+1 or ra
-                setobj2s(L, ra + 1, rb);
-                setobj2s(L, ra, gval(n));
-            }
-            else
-            {
-                // slow-path: handles slot mismatch
-                setobj2s(L, ra + 1, rb);
-                L->cachedslot = slot;
-                VM_PROTECT(luaV_gettable(L, rb, kv, ra));
-                // save cachedslot to accelerate future lookups; patches currently executing instruction since pc-2 rolls back two pc++
-                VM_PATCH_C(pc - 2, L->cachedslot);
-                // recompute ra since stack might have been reallocated
-                ra = VM_REG(LUAU_INSN_A(insn));
-                if (ttisnil(ra))
-                    luaG_methoderror(L, ra + 1, tsvalue(kv));
-            }
+            // note: order of copies allows rb to alias ra+1 or ra
+            setobj2s(L, ra + 1, rb);
+            setobj2s(L, ra, method);
         }
         else
         {
-            // slow-path: handles non-table __index
+            // slow-path: handles __index tables that aren't cached yet and non-table __index
             setobj2s(L, ra + 1, rb);
             VM_PROTECT(luaV_gettable(L, rb, kv, ra));
             // recompute ra since stack might have been reallocated
             ra = VM_REG(LUAU_INSN_A(insn));
             if (ttisnil(ra))
                 luaG_methoderror(L, ra + 1, tsvalue(kv));
+            // record the __index chain in the cache of this instruction to accelerate future lookups
+            VM_PROTECT(luaV_cachenamecall(L, cl->l.p, LUAU_INSN_C(insn), ra + 1, tsvalue(kv)));
         }
     }
 
@@ -38,8 +38,13 @@
 #define VM_KV(i) (LUAU_ASSERT(unsigned(i) < unsigned(cl->l.p->sizek)), &k[i])
 #define VM_UV(i) (LUAU_ASSERT(unsigned(i) < unsigned(cl->nupvalues)), &cl->l.uprefs[i])
 
-#define VM_PATCH_C(pc, slot) *const_cast<Instruction*>(pc) = ((uint8_t(slot) << 24) | (0x00ffffffu & *(pc)))
-#define VM_PATCH_E(pc, slot) *const_cast<Instruction*>(pc) = ((uint32_t(slot) << 8) | (0x000000ffu & *(pc)))
+// see VM_CANPATCH in lvmexecute.c
+#define VM_CANPATCH(pc) (!cl->l.p->shared && (pc) >= cl->l.p->code && (pc) < cl->l.p->code + cl->l.p->sizecode)
+
+#define VM_PATCH_C(pc, slot) \
+    (VM_CANPATCH(pc) ? (void)(*const_cast<Instruction*>(pc) = ((uint8_t(slot) << 24) | (0x00ffffffu & *(pc)))) : (void)0)
+#define VM_PATCH_E(pc, slot) \
+    (VM_CANPATCH(pc) ? (void)(*const_cast<Instruction*>(pc) = ((uint32_t(slot) << 8) | (0x000000ffu & *(pc)))) : (void)0)
 
 #define VM_INTERRUPT() \
     { \
@@ -88,6 +88,8 @@ const char* getCmdName(IrCmd cmd)
         return "LOAD_ENV";
     case IrCmd::GET_ARR_ADDR:
         return "GET_ARR_ADDR";
+    case IrCmd::GET_PACKED_ADDR:
+        return "GET_PACKED_ADDR";
     case IrCmd::GET_SLOT_NODE_ADDR:
         return "GET_SLOT_NODE_ADDR";
     case IrCmd::STORE_TAG:
@@ -176,6 +178,8 @@ const char* getCmdName(IrCmd cmd)
         return "CHECK_SAFE_ENV";
     case IrCmd::CHECK_ARRAY_SIZE:
         return "CHECK_ARRAY_SIZE";
+    case IrCmd::CHECK_PACKED_SIZE:
+        return "CHECK_PACKED_SIZE";
     case IrCmd::CHECK_SLOT_MATCH:
         return "CHECK_SLOT_MATCH";
     case IrCmd::INTERRUPT:
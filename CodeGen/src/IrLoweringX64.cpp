@@ -213,6 +213,8 @@ void IrLoweringX64::lowerInst(IrInst& inst, uint32_t index, IrBlock& next)
             build.vmovsd(inst.regX64, luauRegValue(inst.a.index));
         else if (inst.a.kind == IrOpKind::VmConst)
             build.vmovsd(inst.regX64, luauConstantValue(inst.a.index));
+        else if (inst.a.kind == IrOpKind::Inst)
+            build.vmovsd(inst.regX64, qword[regOp(inst.a)]);
         else
             LUAU_ASSERT(!"Unsupported instruction form");
         break;
@@ -271,6 +273,30 @@ void IrLoweringX64::lowerInst(IrInst& inst, uint32_t index, IrBlock& next)
             LUAU_ASSERT(!"Unsupported instruction form");
         }
         break;
+    case IrCmd::GET_PACKED_ADDR:
+        if (inst.b.kind == IrOpKind::Inst)
+        {
+            inst.regX64 = allocGprRegOrReuse(SizeX64::qword, index, {inst.b});
+
+            if (dwordReg(inst.regX64) != regOp(inst.b))
+                build.mov(dwordReg(inst.regX64), regOp(inst.b));
+
+            build.shl(dwordReg(inst.regX64), 3);
+            build.add(inst.regX64, qword[regOp(inst.a) + offsetof(Table, numbers)]);
+            build.lea(inst.regX64, addr[inst.regX64 + offsetof(TableNumbers, values)]);
+        }
+        else if (inst.b.kind == IrOpKind::Constant)
+        {
+            inst.regX64 = allocGprRegOrReuse(SizeX64::qword, index, {inst.a});
+
+            build.mov(inst.regX64, qword[regOp(inst.a) + offsetof(Table, numbers)]);
+            build.lea(inst.regX64, addr[inst.regX64 + int(offsetof(TableNumbers, values) + uintOp(inst.b) * sizeof(double))]);
+        }
+        else
+        {
+            LUAU_ASSERT(!"Unsupported instruction form");
+        }
+        break;
     case IrCmd::GET_SLOT_NODE_ADDR:
     {
         inst.regX64 = allocGprReg(SizeX64::qword);
@@ -294,24 +320,28 @@ void IrLoweringX64::lowerInst(IrInst& inst, uint32_t index, IrBlock& next)
         build.mov(luauRegValue(inst.a.index), regOp(inst.b));
         break;
     case IrCmd::STORE_DOUBLE:
-        LUAU_ASSERT(inst.a.kind == IrOpKind::VmReg);
+    {
+        // If we have a register, we assume it's a pointer to a packed table array element
+        LUAU_ASSERT(inst.a.kind == IrOpKind::VmReg || inst.a.kind == IrOpKind::Inst);
+        OperandX64 dst = inst.a.kind == IrOpKind::VmReg ? luauRegValue(inst.a.index) : qword[regOp(inst.a)];
 
         if (inst.b.kind == IrOpKind::Constant)
         {
             ScopedReg tmp{*this, SizeX64::xmmword};
 
             build.vmovsd(tmp.reg, build.f64(doubleOp(inst.b)));
-            build.vmovsd(luauRegValue(inst.a.index), tmp.reg);
+            build.vmovsd(dst, tmp.reg);
         }
         else if (inst.b.kind == IrOpKind::Inst)
         {
-            build.vmovsd(luauRegValue(inst.a.index), regOp(inst.b));
+            build.vmovsd(dst, regOp(inst.b));
         }
         else
         {
             LUAU_ASSERT(!"Unsupported instruction form");
         }
         break;
+    }
     case IrCmd::STORE_INT:
     {
         LUAU_ASSERT(inst.a.kind == IrOpKind::VmReg);
@@ -784,6 +814,30 @@ void IrLoweringX64::lowerInst(IrInst& inst, uint32_t index, IrBlock& next)
 
         build.jcc(ConditionX64::BelowEqual, labelOp(inst.c));
         break;
+    case IrCmd::CHECK_PACKED_SIZE:
+    {
+        ScopedReg tmp{*this, SizeX64::qword};
+
+        // packed array part is only used by tables that have sizearray == 0
+        build.cmp(dword[regOp(inst.a) + offsetof(Table, sizearray)], 0);
+        build.jcc(ConditionX64::NotEqual, labelOp(inst.c));
+        build.mov(tmp.reg, qword[regOp(inst.a) + offsetof(Table, numbers)]);
+        build.test(tmp.reg, tmp.reg);
+        build.jcc(ConditionX64::Zero, labelOp(inst.c));
+        // tables with a shape keep tagged fields in the same slot
+        build.test(byte[regOp(inst.a) + offsetof(Table, shaped)], 1);
+        build.jcc(ConditionX64::NotZero, labelOp(inst.c));
+
+        if (inst.b.kind == IrOpKind::Inst)
+            build.cmp(dword[tmp.reg + offsetof(TableNumbers, size)], regOp(inst.b));
+        else if (inst.b.kind == IrOpKind::Constant)
+            build.cmp(dword[tmp.reg + offsetof(TableNumbers, size)], uintOp(inst.b));
+        else
+            LUAU_ASSERT(!"Unsupported instruction form");
+
+        build.jcc(ConditionX64::BelowEqual, labelOp(inst.c));
+        break;
+    }
     case IrCmd::CHECK_SLOT_MATCH:
     {
         LUAU_ASSERT(inst.b.kind == IrOpKind::VmConst);
@@ -896,7 +950,7 @@ void IrLoweringX64::lowerInst(IrInst& inst, uint32_t index, IrBlock& next)
         LUAU_ASSERT(inst.b.kind == IrOpKind::VmReg);
         LUAU_ASSERT(inst.c.kind == IrOpKind::VmReg);
 
-        emitInstNameCall(build, pc, uintOp(inst.a), proto->k, blockOp(inst.d).label, blockOp(inst.e).label);
+        emitInstNameCall(build, pc, proto->k, blockOp(inst.e).label);
         break;
     }
     case IrCmd::LOP_CALL:
@@ -637,6 +637,7 @@ void translateInstForGLoopIpairs(IrBuilder& build, const Instruction* pc, int pc
     IrOp fallback = build.block(IrBlockKind::Fallback);
 
     IrOp hasElem = build.block(IrBlockKind::Internal);
+    IrOp packed = build.block(IrBlockKind::Internal);
 
     build.inst(IrCmd::INTERRUPT, build.constUint(pcpos));
 
@@ -649,8 +650,8 @@ void translateInstForGLoopIpairs(IrBuilder& build, const Instruction* pc, int pc
 
     IrOp elemPtr = build.inst(IrCmd::GET_ARR_ADDR, table, index);
 
-    // Terminate if array has ended
-    build.inst(IrCmd::CHECK_ARRAY_SIZE, table, index, loopExit);
+    // Terminate if array has ended, unless the array part is packed
+    build.inst(IrCmd::CHECK_ARRAY_SIZE, table, index, packed);
 
     // Terminate if element is nil
     IrOp elemTag = build.inst(IrCmd::LOAD_TAG, elemPtr);
@@ -674,6 +675,24 @@ void translateInstForGLoopIpairs(IrBuilder& build, const Instruction* pc, int pc
 
     build.inst(IrCmd::JUMP, loopRepeat);
 
+    // Packed array part has no holes, so traversal terminates when it ends
+    build.beginBlock(packed);
+
+    build.inst(IrCmd::CHECK_PACKED_SIZE, table, index, loopExit);
+
+    IrOp packedPtr = build.inst(IrCmd::GET_PACKED_ADDR, table, index);
+    IrOp packedNextIndex = build.inst(IrCmd::ADD_INT, index, build.constInt(1));
+
+    build.inst(IrCmd::STORE_INT, build.vmReg(ra + 2), packedNextIndex);
+
+    build.inst(IrCmd::STORE_DOUBLE, build.vmReg(ra + 3), build.inst(IrCmd::INT_TO_NUM, packedNextIndex));
+    build.inst(IrCmd::STORE_TAG, build.vmReg(ra + 3), build.constTag(LUA_TNUMBER));
+
+    build.inst(IrCmd::STORE_DOUBLE, build.vmReg(ra + 4), build.inst(IrCmd::LOAD_DOUBLE, packedPtr));
+    build.inst(IrCmd::STORE_TAG, build.vmReg(ra + 4), build.constTag(LUA_TNUMBER));
+
+    build.inst(IrCmd::JUMP, loopRepeat);
+
     build.beginBlock(fallback);
     build.inst(IrCmd::LOP_FORGLOOP_FALLBACK, build.constUint(pcpos), loopRepeat, loopExit);
 
@@ -689,13 +708,14 @@ void translateInstGetTableN(IrBuilder& build, const Instruction* pc, int pcpos)
     int c = LUAU_INSN_C(*pc);
 
     IrOp fallback = build.block(IrBlockKind::Fallback);
+    IrOp packed = build.block(IrBlockKind::Internal);
 
     IrOp tb = build.inst(IrCmd::LOAD_TAG, build.vmReg(rb));
     build.inst(IrCmd::CHECK_TAG, tb, build.constTag(LUA_TTABLE), fallback);
 
     IrOp vb = build.inst(IrCmd::LOAD_POINTER, build.vmReg(rb));
 
-    build.inst(IrCmd::CHECK_ARRAY_SIZE, vb, build.constUint(c), fallback);
+    build.inst(IrCmd::CHECK_ARRAY_SIZE, vb, build.constUint(c), packed);
     build.inst(IrCmd::CHECK_NO_METATABLE, vb, fallback);
 
     IrOp arrEl = build.inst(IrCmd::GET_ARR_ADDR, vb, build.constUint(c));
@@ -705,6 +725,17 @@ void translateInstGetTableN(IrBuilder& build, const Instruction* pc, int pcpos)
     build.inst(IrCmd::STORE_TVALUE, build.vmReg(ra), arrElTval);
 
     IrOp next = build.blockAtInst(pcpos + 1);
+    build.inst(IrCmd::JUMP, next);
+
+    // Packed elements are never nil, so metatable doesn't need to be checked
+    build.beginBlock(packed);
+
+    build.inst(IrCmd::CHECK_PACKED_SIZE, vb, build.constUint(c), fallback);
+
+    IrOp packedEl = build.inst(IrCmd::GET_PACKED_ADDR, vb, build.constUint(c));
+    build.inst(IrCmd::STORE_DOUBLE, build.vmReg(ra), build.inst(IrCmd::LOAD_DOUBLE, packedEl));
+    build.inst(IrCmd::STORE_TAG, build.vmReg(ra), build.constTag(LUA_TNUMBER));
+
     FallbackStreamScope scope(build, fallback, next);
 
     build.inst(IrCmd::SET_SAVEDPC, build.constUint(pcpos + 1));
@@ -719,13 +750,14 @@ void translateInstSetTableN(IrBuilder& build, const Instruction* pc, int pcpos)
     int c = LUAU_INSN_C(*pc);
 
     IrOp fallback = build.block(IrBlockKind::Fallback);
+    IrOp packed = build.block(IrBlockKind::Internal);
 
     IrOp tb = build.inst(IrCmd::LOAD_TAG, build.vmReg(rb));
     build.inst(IrCmd::CHECK_TAG, tb, build.constTag(LUA_TTABLE), fallback);
 
     IrOp vb = build.inst(IrCmd::LOAD_POINTER, build.vmReg(rb));
 
-    build.inst(IrCmd::CHECK_ARRAY_SIZE, vb, build.constUint(c), fallback);
+    build.inst(IrCmd::CHECK_ARRAY_SIZE, vb, build.constUint(c), packed);
     build.inst(IrCmd::CHECK_NO_METATABLE, vb, fallback);
     build.inst(IrCmd::CHECK_READONLY, vb, fallback);
 
@@ -738,6 +770,20 @@ void translateInstSetTableN(IrBuilder& build, const Instruction* pc, int pcpos)
     build.inst(IrCmd::BARRIER_TABLE_FORWARD, vb, build.vmReg(ra));
 
     IrOp next = build.blockAtInst(pcpos + 1);
+    build.inst(IrCmd::JUMP, next);
+
+    // Packed elements are never nil, so metatable doesn't need to be checked; values other than numbers are stored by the fallback
+    build.beginBlock(packed);
+
+    build.inst(IrCmd::CHECK_PACKED_SIZE, vb, build.constUint(c), fallback);
+    build.inst(IrCmd::CHECK_READONLY, vb, fallback);
+
+    IrOp ta = build.inst(IrCmd::LOAD_TAG, build.vmReg(ra));
+    build.inst(IrCmd::CHECK_TAG, ta, build.constTag(LUA_TNUMBER), fallback);
+
+    IrOp packedEl = build.inst(IrCmd::GET_PACKED_ADDR, vb, build.constUint(c));
+    build.inst(IrCmd::STORE_DOUBLE, packedEl, build.inst(IrCmd::LOAD_DOUBLE, build.vmReg(ra)));
+
     FallbackStreamScope scope(build, fallback, next);
 
     build.inst(IrCmd::SET_SAVEDPC, build.constUint(pcpos + 1));
@@ -752,6 +798,7 @@ void translateInstGetTable(IrBuilder& build, const Instruction* pc, int pcpos)
     int rc = LUAU_INSN_C(*pc);
 
     IrOp fallback = build.block(IrBlockKind::Fallback);
+    IrOp packed = build.block(IrBlockKind::Internal);
 
     IrOp tb = build.inst(IrCmd::LOAD_TAG, build.vmReg(rb));
     build.inst(IrCmd::CHECK_TAG, tb, build.constTag(LUA_TTABLE), fallback);
@@ -766,7 +813,7 @@ void translateInstGetTable(IrBuilder& build, const Instruction* pc, int pcpos)
 
     index = build.inst(IrCmd::SUB_INT, index, build.constInt(1));
 
-    build.inst(IrCmd::CHECK_ARRAY_SIZE, vb, index, fallback);
+    build.inst(IrCmd::CHECK_ARRAY_SIZE, vb, index, packed);
     build.inst(IrCmd::CHECK_NO_METATABLE, vb, fallback);
 
     IrOp arrEl = build.inst(IrCmd::GET_ARR_ADDR, vb, index);
@@ -776,6 +823,17 @@ void translateInstGetTable(IrBuilder& build, const Instruction* pc, int pcpos)
     build.inst(IrCmd::STORE_TVALUE, build.vmReg(ra), arrElTval);
 
     IrOp next = build.blockAtInst(pcpos + 1);
+    build.inst(IrCmd::JUMP, next);
+
+    // Packed elements are never nil, so metatable doesn't need to be checked
+    build.beginBlock(packed);
+
+    build.inst(IrCmd::CHECK_PACKED_SIZE, vb, index, fallback);
+
+    IrOp packedEl = build.inst(IrCmd::GET_PACKED_ADDR, vb, index);
+    build.inst(IrCmd::STORE_DOUBLE, build.vmReg(ra), build.inst(IrCmd::LOAD_DOUBLE, packedEl));
+    build.inst(IrCmd::STORE_TAG, build.vmReg(ra), build.constTag(LUA_TNUMBER));
+
     FallbackStreamScope scope(build, fallback, next);
 
     build.inst(IrCmd::SET_SAVEDPC, build.constUint(pcpos + 1));
@@ -790,6 +848,7 @@ void translateInstSetTable(IrBuilder& build, const Instruction* pc, int pcpos)
     int rc = LUAU_INSN_C(*pc);
 
     IrOp fallback = build.block(IrBlockKind::Fallback);
+    IrOp packed = build.block(IrBlockKind::Internal);
 
     IrOp tb = build.inst(IrCmd::LOAD_TAG, build.vmReg(rb));
     build.inst(IrCmd::CHECK_TAG, tb, build.constTag(LUA_TTABLE), fallback);
@@ -804,7 +863,7 @@ void translateInstSetTable(IrBuilder& build, const Instruction* pc, int pcpos)
 
     index = build.inst(IrCmd::SUB_INT, index, build.constInt(1));
 
-    build.inst(IrCmd::CHECK_ARRAY_SIZE, vb, index, fallback);
+    build.inst(IrCmd::CHECK_ARRAY_SIZE, vb, index, packed);
     build.inst(IrCmd::CHECK_NO_METATABLE, vb, fallback);
     build.inst(IrCmd::CHECK_READONLY, vb, fallback);
 
@@ -817,6 +876,20 @@ void translateInstSetTable(IrBuilder& build, const Instruction* pc, int pcpos)
     build.inst(IrCmd::BARRIER_TABLE_FORWARD, vb, build.vmReg(ra));
 
     IrOp next = build.blockAtInst(pcpos + 1);
+    build.inst(IrCmd::JUMP, next);
+
+    // Packed elements are never nil, so metatable doesn't need to be checked; values other than numbers are stored by the fallback
+    build.beginBlock(packed);
+
+    build.inst(IrCmd::CHECK_PACKED_SIZE, vb, index, fallback);
+    build.inst(IrCmd::CHECK_READONLY, vb, fallback);
+
+    IrOp ta = build.inst(IrCmd::LOAD_TAG, build.vmReg(ra));
+    build.inst(IrCmd::CHECK_TAG, ta, build.constTag(LUA_TNUMBER), fallback);
+
+    IrOp packedEl = build.inst(IrCmd::GET_PACKED_ADDR, vb, index);
+    build.inst(IrCmd::STORE_DOUBLE, packedEl, build.inst(IrCmd::LOAD_DOUBLE, build.vmReg(ra)));
+
     FallbackStreamScope scope(build, fallback, next);
 
     build.inst(IrCmd::SET_SAVEDPC, build.constUint(pcpos + 1));
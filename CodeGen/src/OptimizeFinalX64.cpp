@@ -82,7 +82,7 @@ static void optimizeMemoryOperandsX64(IrFunction& function, IrBlock& block)
             {
                 IrInst& num = function.instOp(inst.a);
 
-                if (num.useCount == 1 && num.cmd == IrCmd::LOAD_DOUBLE)
+                if (num.useCount == 1 && num.cmd == IrCmd::LOAD_DOUBLE && (num.a.kind == IrOpKind::VmReg || num.a.kind == IrOpKind::VmConst))
                     replace(function, inst.a, num.a);
             }
             break;
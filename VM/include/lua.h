@@ -113,12 +113,23 @@ typedef unsigned lua_Unsigned;
 ** state manipulation
 */
 LUA_API lua_State* lua_newstate(lua_Alloc f, void* ud);
+// sizes of page allocator size classes: up to LUA_SIZECLASSES ascending multiples of 8, the last one must be 512; returns NULL if invalid
+LUA_API lua_State* lua_newstatewithsizeclasses(lua_Alloc f, void* ud, const int* sizes, int count);
 LUA_API void lua_close(lua_State* L);
 LUA_API lua_State* lua_newthread(lua_State* L);
 LUA_API lua_State* lua_mainthread(lua_State* L);
 LUA_API void lua_resetthread(lua_State* L);
 LUA_API int lua_isthreadreset(lua_State* L);
 
+// state snapshots are relocatable copies of an initialized heap that new states can be created from without running the initialization again;
+// the state must be idle (not inside any call) and userdata payloads are copied as is, so they can't hold pointers to other objects of the state
+// returns NULL if the state can't be captured; the snapshot is independent from the state and uses its allocator
+typedef struct lua_StateSnapshot lua_StateSnapshot;
+
+LUA_API lua_StateSnapshot* lua_snapshotstate(lua_State* L);
+LUA_API lua_State* lua_newstatefromsnapshot(const lua_StateSnapshot* snapshot, lua_Alloc f, void* ud);
+LUA_API void lua_freestatesnapshot(lua_StateSnapshot* snapshot);
+
 /*
 ** basic stack manipulation
 */
@@ -181,6 +192,7 @@ LUA_API void lua_pushvector(lua_State* L, float x, float y, float z, float w);
 LUA_API void lua_pushvector(lua_State* L, float x, float y, float z);
 #endif
 LUA_API void lua_pushlstring(lua_State* L, const char* s, size_t l);
+LUA_API void lua_pushsubstring(lua_State* L, int idx, size_t offset, size_t len);
 LUA_API void lua_pushstring(lua_State* L, const char* s);
 LUA_API const char* lua_pushvfstring(lua_State* L, const char* fmt, va_list argp);
 LUA_API LUA_PRINTF_ATTR(2, 3) const char* lua_pushfstringL(lua_State* L, const char* fmt, ...);
@@ -224,6 +236,17 @@ LUA_API int lua_setfenv(lua_State* L, int idx);
 ** `load' and `call' functions (load and run Luau bytecode)
 */
 LUA_API int luau_load(lua_State* L, const char* chunkname, const char* data, size_t size, int env);
+// functions are decoded on first use; data is copied unless copy is 0, in which case it must stay valid until the state is closed
+LUA_API int luau_loadlazy(lua_State* L, const char* chunkname, const char* data, size_t size, int env, int copy);
+
+// programs are immutable images of a bytecode module that can be loaded into any number of states, including ones that run on different threads;
+// code is shared between all states that load the program, and each state only decodes constants and debug info of the functions it runs
+typedef struct lua_Program lua_Program;
+
+LUA_API lua_Program* luau_newprogram(const char* chunkname, const char* data, size_t size, lua_Alloc f, void* ud);
+LUA_API void luau_retainprogram(lua_Program* program);
+LUA_API void luau_releaseprogram(lua_Program* program);
+LUA_API int luau_loadprogram(lua_State* L, lua_Program* program, int env);
 LUA_API void lua_call(lua_State* L, int nargs, int nresults);
 LUA_API int lua_pcall(lua_State* L, int nargs, int nresults, int errfunc);
 
@@ -289,9 +312,56 @@ enum lua_GCOp
     LUA_GCSETGOAL,
     LUA_GCSETSTEPMUL,
     LUA_GCSETSTEPSIZE,
+
+    /*
+    ** tune the size of the page cache (in pages) and read its statistics
+    **
+    ** when the last object in a heap page is freed, the page is kept in a cache of empty pages instead of being freed immediately;
+    ** pages that stay unused in the cache for an entire GC cycle are released at the end of the cycle.
+    ** setting the size to 0 disables the cache; the hit and miss counters count page allocations that were / were not served from the cache
+    */
+    LUA_GCSETPAGECACHE,
+    LUA_GCPAGECACHEHITS,
+    LUA_GCPAGECACHEMISSES,
+
+    /*
+    ** switch between incremental and generational collection modes; both return the previous mode (LUA_GCINC or LUA_GCGEN)
+    **
+    ** in generational mode, objects that survive a collection become old and most cycles are minor collections that only mark
+    ** objects allocated since the previous cycle; a minor collection starts after the heap grows by the percentage specified as
+    ** data (0 keeps the current setting). old objects are reclaimed by major collections, which happen automatically once the
+    ** heap that survives minor collections doubles compared to the heap size after the previous major collection.
+    ** mode change takes effect at the start of the next collection cycle.
+    */
+    LUA_GCINC,
+    LUA_GCGEN,
+
+    /*
+    ** enable (data = 1) or disable (data = 0) background sweeping; returns 1 if it was enabled before
+    **
+    ** when enabled, a helper thread takes heap pages without free blocks ahead of the incremental sweep and frees dead objects that
+    ** don't need finalization in them; the sweep then only visits the objects that are left, reducing sweep assist time.
+    ** this option has no effect when the VM is built without thread support (LUA_BACKGROUND_SWEEP=0).
+    */
+    LUA_GCBACKGROUNDSWEEP,
+
+    /*
+    ** enable (data != 0) or disable (data == 0) allocation of heap pages from an arena; returns 1 if the arena was enabled before
+    **
+    ** when enabled, pages are carved out of large chunks of memory that are requested from the OS directly and are eligible for
+    ** transparent huge pages, which reduces TLB misses when collecting large heaps. pages of dead objects are returned to the arena;
+    ** at the end of a GC cycle, chunks that have no live pages are released and pages that stayed free for the entire cycle are
+    ** decommitted (a full collection decommits all free pages).
+    ** the resident size of the arena and the part of it that is not used by live pages (slack) are reported in KB.
+    ** this option has no effect when the VM is built without arena support (LUA_PAGE_ARENA=0).
+    */
+    LUA_GCPAGEARENA,
+    LUA_GCPAGEARENARESIDENT,
+    LUA_GCPAGEARENASLACK,
 };
 
 LUA_API int lua_gc(lua_State* L, int what, int data);
+LUA_API const char* lua_gcstatename(int state);
 
 /*
 ** memory statistics
@@ -301,6 +371,35 @@ LUA_API int lua_gc(lua_State* L, int what, int data);
 LUA_API void lua_setmemcat(lua_State* L, int category);
 LUA_API size_t lua_totalbytes(lua_State* L, int category);
 
+/*
+** allocation size histogram, used to derive size classes for lua_newstatewithsizeclasses (see tools/sizeclasses.py)
+** while enabled, every heap allocation is counted by its requested size; disabling the histogram discards the counts.
+** lua_getallochistogram stores counts for sizes 0..count-2 and the number of all larger allocations in counts[count-1];
+** it returns the number of entries written, which is smaller than count when the histogram is disabled or doesn't have that many
+*/
+LUA_API void lua_setallochistogram(lua_State* L, int enabled);
+LUA_API int lua_getallochistogram(lua_State* L, size_t* counts, int count);
+
+/*
+** heap snapshot
+** writes a compact binary description of all objects in the heap and references between them through the writer callback;
+** the format is documented in lgcdebug.c. for most precise results, run a full collection before taking a snapshot.
+** categoryname, if not NULL, provides the names that are recorded for memory categories. the writer may raise an error, which
+** aborts the snapshot and is propagated to the caller.
+*/
+typedef void (*lua_SnapshotWriter)(void* ud, const void* data, size_t size);
+
+LUA_API void lua_heapsnapshot(lua_State* L, lua_SnapshotWriter writer, void* ud, const char* (*categoryname)(lua_State* L, uint8_t memcat));
+
+/*
+** memory limits for a memory category; 0 means no limit
+** when the soft limit is exceeded, memcatlimit callback is called and the collector runs a step at the next opportunity;
+** the callback is called again after a collection cycle ends with the category below the soft limit.
+** allocations that would exceed the hard limit fail with LUA_ERRMEM; they keep failing until the collector frees enough memory
+** in the category, which can be forced with LUA_GCCOLLECT after the error is caught.
+*/
+LUA_API void lua_setmemcatlimit(lua_State* L, int category, size_t softlimit, size_t hardlimit);
+
 /*
 ** miscellaneous functions
 */
@@ -418,6 +517,18 @@ struct lua_Debug
 
 // }======================================================================
 
+/* Information about a single incremental GC step, reported via lua_Callbacks::gcstep.
+ * State is the collector state at the start of the step; lua_gcstatename can be used to get its name. */
+struct lua_GCStepInfo
+{
+    int state;       // collector state at the start of the step
+    int assist;      // 1 if the step was performed as an allocation assist, 0 if it was requested via lua_gc
+    double duration; // time spent in the step, in seconds
+    size_t work;     // amount of work performed by the step, in the same units as LUA_GCSTEP step size
+    size_t heapsize; // total heap size in bytes at the end of the step
+};
+typedef struct lua_GCStepInfo lua_GCStepInfo;
+
 /* Callbacks that can be used to reconfigure behavior of the VM dynamically.
  * These are shared between all coroutines.
  *
@@ -437,6 +548,9 @@ struct lua_Callbacks
     void (*debugstep)(lua_State* L, lua_Debug* ar);      // gets called after each instruction in single step mode
     void (*debuginterrupt)(lua_State* L, lua_Debug* ar); // gets called when thread execution is interrupted by break in another thread
     void (*debugprotectederror)(lua_State* L);           // gets called when protected call results in an error
+
+    void (*gcstep)(lua_State* L, const lua_GCStepInfo* info); // gets called after each incremental GC step; must not allocate GC memory
+    void (*memcatlimit)(lua_State* L, int category, size_t bytes); // gets called when memory category goes over the soft limit; must not allocate
 };
 typedef struct lua_Callbacks lua_Callbacks;
 
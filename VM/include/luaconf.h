@@ -104,6 +104,11 @@
 #define LUA_MINSTRTABSIZE 32
 #endif
 
+// minimum number of string table buckets migrated per string allocation or GC step when the string table is resized incrementally
+#ifndef LUA_STRTABREHASHSTEP
+#define LUA_STRTABREHASHSTEP 16
+#endif
+
 // maximum number of captures supported by pattern matching
 #ifndef LUA_MAXCAPTURES
 #define LUA_MAXCAPTURES 32
@@ -114,6 +119,69 @@
 #define LUA_CUSTOM_EXECUTION 0
 #endif
 
+// enables support for allocating heap pages from OS memory arenas (see LUA_GCPAGEARENA); requires mmap on non-Windows platforms
+#ifndef LUA_PAGE_ARENA
+#if defined(__EMSCRIPTEN__)
+#define LUA_PAGE_ARENA 0
+#else
+#define LUA_PAGE_ARENA 1
+#endif
+#endif
+
+// enables support for background sweeping on a helper thread (see LUA_GCBACKGROUNDSWEEP); requires pthreads on non-Windows platforms
+#ifndef LUA_BACKGROUND_SWEEP
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define LUA_BACKGROUND_SWEEP 0
+#else
+#define LUA_BACKGROUND_SWEEP 1
+#endif
+#endif
+
+// enables open addressing for hash parts of tables with more than 16 nodes: each node has a control byte with a hash fragment, and lookups
+// scan control bytes of 16 nodes at a time (using SSE2 where available) instead of following collision chains
+#ifndef LUA_TABLE_CONTROLBYTES
+#define LUA_TABLE_CONTROLBYTES 0
+#endif
+
+// maximum number of fields in tables with a shape (tables created from constructor templates); tables that grow past this limit, or get
+// a key that isn't a string, switch to a regular hash part. Must be at most 255; 0 disables shapes
+#ifndef LUA_TABLE_SHAPEFIELDS
+#define LUA_TABLE_SHAPEFIELDS 64
+#endif
+
+// enables packed array parts: tables that get a number at index 1 before having an array part store their array as raw doubles, until
+// they get a value that isn't a number or a hole
+#ifndef LUA_TABLE_PACKNUMBERS
+#define LUA_TABLE_PACKNUMBERS 1
+#endif
+
+// substrings that end at the end of their source string reference the source instead of copying it if they are at least
+// LUA_STRING_SLICEMIN bytes long and at least 1/LUA_STRING_SLICERATIO of the source, which bounds the memory kept alive by slices
+#ifndef LUA_STRING_SLICEMIN
+#define LUA_STRING_SLICEMIN 256
+#endif
+
+#ifndef LUA_STRING_SLICERATIO
+#define LUA_STRING_SLICERATIO 4
+#endif
+
+// enables superinstructions: hot instruction pairs are fused into VM-internal opcodes when functions are loaded, which saves a dispatch
+// for the second instruction of each pair
+#ifndef LUA_FUSED_OPCODES
+#define LUA_FUSED_OPCODES 1
+#endif
+
+// number of receiver metatables that each method call site (NAMECALL) remembers the method lookup for
+#ifndef LUA_NAMECALL_CACHESIZE
+#define LUA_NAMECALL_CACHESIZE 4
+#endif
+
+// number of objects marked after the start of the last pass over tables with weak keys that the collector records; they are looked up
+// in these tables in batches to mark the values they keep alive
+#ifndef LUA_EPHEMERON_MARKS
+#define LUA_EPHEMERON_MARKS 256
+#endif
+
 // }==================================================================
 
 /*
@@ -16,6 +16,7 @@
 #include "ltable.h"
 #include "lfunc.h"
 #include "lgc.h"
+#include "lmem.h"
 #include "ldo.h"
 #include "ludata.h"
 #include "lvm.h"
@@ -72,7 +73,7 @@ const char* luau_ident = "$Luau: Copyright (C) 2019-2022 Roblox Corporation $\n"
 #define updateatom(L, ts) \
     { \
         if (ts->atom == ATOM_UNDEF) \
-            ts->atom = L->global->cb.useratom ? L->global->cb.useratom(ts->data, ts->len) : -1; \
+            ts->atom = L->global->cb.useratom ? L->global->cb.useratom(getstr(ts), ts->len) : -1; \
     }
 
 static Table* getcurrenv(lua_State* L)
@@ -616,6 +617,20 @@ void lua_pushlstring(lua_State* L, const char* s, size_t len)
     api_incr_top(L);
 }
 
+void lua_pushsubstring(lua_State* L, int idx, size_t offset, size_t len)
+{
+    luaC_checkGC(L);
+    luaC_threadbarrier(L);
+    const TValue* o = index2addr(L, idx);
+    api_check(L, ttisstring(o));
+    TString* ts = tsvalue(o);
+    api_check(L, offset <= ts->len && len <= ts->len - offset);
+    // suffixes can reference the data of the original string
+    TString* sub = offset + len == ts->len ? (offset == 0 ? ts : luaS_newsuffix(L, ts, offset)) : luaS_newlstr(L, getstr(ts) + offset, len);
+    setsvalue(L, L->top, sub);
+    api_incr_top(L);
+}
+
 void lua_pushstring(lua_State* L, const char* s)
 {
     if (s == NULL)
@@ -722,7 +737,8 @@ int lua_rawget(lua_State* L, int idx)
     luaC_threadbarrier(L);
     StkId t = index2addr(L, idx);
     api_check(L, ttistable(t));
-    setobj2s(L, L->top - 1, luaH_get(hvalue(t), L->top - 1));
+    if (!luaH_getpacked(hvalue(t), L->top - 1, L->top - 1))
+        setobj2s(L, L->top - 1, luaH_get(hvalue(t), L->top - 1));
     return ttype(L->top - 1);
 }
 
@@ -731,7 +747,13 @@ int lua_rawgeti(lua_State* L, int idx, int n)
     luaC_threadbarrier(L);
     StkId t = index2addr(L, idx);
     api_check(L, ttistable(t));
-    setobj2s(L, L->top, luaH_getnum(hvalue(t), n));
+    Table* h = hvalue(t);
+    if (ispacked(h) && (unsigned)(n - 1) < (unsigned)(h->numbers->size))
+    {
+        setnvalue(L->top, gpacked(h, n - 1));
+    }
+    else
+        setobj2s(L, L->top, luaH_getnum(h, n));
     api_incr_top(L);
     return ttype(L->top - 1);
 }
@@ -858,8 +880,11 @@ void lua_rawset(lua_State* L, int idx)
     api_check(L, ttistable(t));
     if (hvalue(t)->readonly)
         luaG_readonlyerror(L);
-    setobj2t(L, luaH_set(L, hvalue(t), L->top - 2), L->top - 1);
-    luaC_barriert(L, hvalue(t), L->top - 1);
+    if (!luaH_setpacked(L, hvalue(t), L->top - 2, L->top - 1))
+    {
+        setobj2t(L, luaH_set(L, hvalue(t), L->top - 2), L->top - 1);
+        luaC_barriert(L, hvalue(t), L->top - 1);
+    }
     L->top -= 2;
 }
 
@@ -870,8 +895,13 @@ void lua_rawseti(lua_State* L, int idx, int n)
     api_check(L, ttistable(o));
     if (hvalue(o)->readonly)
         luaG_readonlyerror(L);
-    setobj2t(L, luaH_setnum(L, hvalue(o), n), L->top - 1);
-    luaC_barriert(L, hvalue(o), L->top - 1);
+    TValue k;
+    setnvalue(&k, n);
+    if (!luaH_setpacked(L, hvalue(o), &k, L->top - 1))
+    {
+        setobj2t(L, luaH_setnum(L, hvalue(o), n), L->top - 1);
+        luaC_barriert(L, hvalue(o), L->top - 1);
+    }
     L->top--;
 }
 
@@ -1161,12 +1191,66 @@ int lua_gc(lua_State* L, int what, int data)
         g->gcstepsize = data << 10;
         break;
     }
+    case LUA_GCSETPAGECACHE:
+    {
+        res = g->pagecachelimit;
+        g->pagecachelimit = data < 0 ? 0 : data;
+        luaM_trimpagecache(L);
+        break;
+    }
+    case LUA_GCPAGECACHEHITS:
+    {
+        res = g->pagecachehits > INT_MAX ? INT_MAX : cast_int(g->pagecachehits);
+        break;
+    }
+    case LUA_GCPAGECACHEMISSES:
+    {
+        res = g->pagecachemisses > INT_MAX ? INT_MAX : cast_int(g->pagecachemisses);
+        break;
+    }
+    case LUA_GCINC:
+    {
+        res = g->gcgen ? LUA_GCGEN : LUA_GCINC;
+        g->gcgen = 0;
+        break;
+    }
+    case LUA_GCGEN:
+    {
+        res = g->gcgen ? LUA_GCGEN : LUA_GCINC;
+        g->gcgen = 1;
+        if (data > 0)
+            g->gcgenminormul = data;
+        break;
+    }
+    case LUA_GCBACKGROUNDSWEEP:
+    {
+        res = luaC_setbgsweep(L, data);
+        break;
+    }
+    case LUA_GCPAGEARENA:
+    {
+        res = luaM_setpagearena(L, data);
+        break;
+    }
+    case LUA_GCPAGEARENARESIDENT:
+    case LUA_GCPAGEARENASLACK:
+    {
+        size_t resident, slack;
+        luaM_getpagearenastats(L, &resident, &slack);
+        res = cast_int((what == LUA_GCPAGEARENARESIDENT ? resident : slack) >> 10);
+        break;
+    }
     default:
         res = -1; // invalid option
     }
     return res;
 }
 
+const char* lua_gcstatename(int state)
+{
+    return luaC_statename(state);
+}
+
 /*
 ** miscellaneous functions
 */
@@ -1203,6 +1287,24 @@ int lua_rawiter(lua_State* L, int idx, int iter)
     Table* h = hvalue(t);
     int sizearray = h->sizearray;
 
+    // packed array portion has no holes; the rest of the table is numbered after its capacity
+    if (ispacked(h))
+    {
+        if ((unsigned)(iter) < (unsigned)(h->numbers->size))
+        {
+            StkId top = L->top;
+            setnvalue(top + 0, (double)(iter + 1));
+            setnvalue(top + 1, gpacked(h, iter));
+            api_update_top(L, top + 2);
+            return iter + 1;
+        }
+
+        sizearray = h->numbers->capacity;
+
+        if ((unsigned)(iter) < (unsigned)(sizearray))
+            iter = sizearray;
+    }
+
     // first we advance iter through the array portion
     for (; (unsigned)(iter) < (unsigned)(sizearray); ++iter)
     {
@@ -1218,6 +1320,28 @@ int lua_rawiter(lua_State* L, int idx, int iter)
         }
     }
 
+    // tables with a shape have fields instead of the hash portion
+    if (isshaped(h))
+    {
+        TableShape* shape = gfields(h)->shape;
+
+        for (; (unsigned)(iter - sizearray) < (unsigned)(shape->nfields); ++iter)
+        {
+            TValue* e = gfield(h, iter - sizearray);
+
+            if (!ttisnil(e))
+            {
+                StkId top = L->top;
+                setsvalue(L, top + 0, gshapekey(shape, iter - sizearray));
+                setobj2s(L, top + 1, e);
+                api_update_top(L, top + 2);
+                return iter + 1;
+            }
+        }
+    }
+
+    luaC_checkweak(L, h);
+
     int sizenode = 1 << h->lsizenode;
 
     // then we advance iter through the hash portion
@@ -1282,7 +1406,7 @@ void* lua_newuserdatadtor(lua_State* L, size_t sz, void (*dtor)(void*))
     return u->data;
 }
 
-static const char* aux_upvalue(StkId fi, int n, TValue** val)
+static const char* aux_upvalue(lua_State* L, StkId fi, int n, TValue** val)
 {
     Closure* f;
     if (!ttisfunction(fi))
@@ -1302,6 +1426,8 @@ static const char* aux_upvalue(StkId fi, int n, TValue** val)
             return NULL;
         TValue* r = &f->l.uprefs[n - 1];
         *val = ttisupval(r) ? upvalue(r)->v : r;
+        if (p->lazy & PROTO_LAZYDEBUG)
+            luau_loaddebug(L, p);
         if (!(1 <= n && n <= p->sizeupvalues)) // don't have a name for this upvalue
             return "";
         return getstr(p->upvalues[n - 1]);
@@ -1312,7 +1438,7 @@ const char* lua_getupvalue(lua_State* L, int funcindex, int n)
 {
     luaC_threadbarrier(L);
     TValue* val;
-    const char* name = aux_upvalue(index2addr(L, funcindex), n, &val);
+    const char* name = aux_upvalue(L, index2addr(L, funcindex), n, &val);
     if (name)
     {
         setobj2s(L, L->top, val);
@@ -1326,7 +1452,7 @@ const char* lua_setupvalue(lua_State* L, int funcindex, int n)
     api_checknelems(L, 1);
     StkId fi = index2addr(L, funcindex);
     TValue* val;
-    const char* name = aux_upvalue(fi, n, &val);
+    const char* name = aux_upvalue(L, fi, n, &val);
     if (name)
     {
         L->top--;
@@ -1438,6 +1564,27 @@ size_t lua_totalbytes(lua_State* L, int category)
     return category < 0 ? L->global->totalbytes : L->global->memcatbytes[category];
 }
 
+void lua_setallochistogram(lua_State* L, int enabled)
+{
+    luaM_setallochistogram(L, enabled);
+}
+
+int lua_getallochistogram(lua_State* L, size_t* counts, int count)
+{
+    return luaM_getallochistogram(L, counts, count);
+}
+
+void lua_heapsnapshot(lua_State* L, lua_SnapshotWriter writer, void* ud, const char* (*categoryname)(lua_State* L, uint8_t memcat))
+{
+    luaC_dumpsnapshot(L, writer, ud, categoryname);
+}
+
+void lua_setmemcatlimit(lua_State* L, int category, size_t softlimit, size_t hardlimit)
+{
+    api_check(L, (unsigned)(category) < LUA_MEMORY_CATEGORIES);
+    luaM_setmemcatlimit(L, (uint8_t)(category), softlimit, hardlimit);
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -974,7 +974,8 @@ static int luauF_rawget(lua_State* L, StkId res, TValue* arg0, int nresults, Stk
 {
     if (nparams >= 2 && nresults <= 1 && ttistable(arg0))
     {
-        setobj2s(L, res, luaH_get(hvalue(arg0), args));
+        if (!luaH_getpacked(hvalue(arg0), args, res))
+            setobj2s(L, res, luaH_get(hvalue(arg0), args));
         return 1;
     }
 
@@ -998,8 +999,11 @@ static int luauF_rawset(lua_State* L, StkId res, TValue* arg0, int nresults, Stk
             return -1;
 
         setobj2s(L, res, arg0);
-        setobj2t(L, luaH_set(L, t, args), args + 1);
-        luaC_barriert(L, t, args + 1);
+        if (!luaH_setpacked(L, t, args, args + 1))
+        {
+            setobj2t(L, luaH_set(L, t, args), args + 1);
+            luaC_barriert(L, t, args + 1);
+        }
         return 1;
     }
 
@@ -1015,8 +1019,13 @@ static int luauF_tinsert(lua_State* L, StkId res, TValue* arg0, int nresults, St
             return -1;
 
         int pos = luaH_getn(t) + 1;
-        setobj2t(L, luaH_setnum(L, t, pos), args);
-        luaC_barriert(L, t, args);
+        TValue k;
+        setnvalue(&k, pos);
+        if (!luaH_setpacked(L, t, &k, args))
+        {
+            setobj2t(L, luaH_setnum(L, t, pos), args);
+            luaC_barriert(L, t, args);
+        }
         return 0;
     }
 
@@ -1043,6 +1052,13 @@ static int luauF_tunpack(lua_State* L, StkId res, TValue* arg0, int nresults, St
             expandstacklimit(L, res + n);
             return n;
         }
+        else if (ispacked(t) && n >= 0 && n <= t->numbers->size && cast_int(L->stack_last - res) >= n && n + nparams <= LUAI_MAXCSTACK)
+        {
+            for (int i = 0; i < n; ++i)
+                setnvalue(res + i, gpacked(t, i));
+            expandstacklimit(L, res + n);
+            return n;
+        }
     }
 
     return -1;
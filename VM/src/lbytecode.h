@@ -4,3 +4,30 @@
 
 // This is a forwarding header for Luau bytecode definition
 #include "Luau/Bytecode.h"
+
+/*
+ * Superinstructions are VM-internal opcodes that never appear in serialized bytecode. When a function is loaded, the opcode byte of the
+ * first instruction of a hot pair is replaced with a fused opcode whose handler executes both instructions with a single dispatch; the
+ * second instruction is left intact, so jumps to it, line info and debuginsn keep working, and luau_unfusecode restores the original
+ * opcodes before anything that inspects code (breakpoints, native code generation) needs them.
+ */
+enum LuauFusedOpcode
+{
+    // MOVE A B; MOVE A' B'
+    LOP_FUSED_MOVE_MOVE = LOP__COUNT,
+
+    // MOVE A B; GETTABLEKS A' B' C' AUX'
+    LOP_FUSED_MOVE_GETTABLEKS,
+
+    // LOADK A D; ADD A' B' C'
+    LOP_FUSED_LOADK_ADD,
+
+    // GETTABLEKS A B C AUX followed by GETTABLEKS, MOVE, ADD or CALL
+    LOP_FUSED_GETTABLEKS_GETTABLEKS,
+    LOP_FUSED_GETTABLEKS_MOVE,
+    LOP_FUSED_GETTABLEKS_ADD,
+    LOP_FUSED_GETTABLEKS_CALL,
+
+    // Enum entry for number of opcodes including fused opcodes, not a valid opcode by itself!
+    LOP_FUSED__COUNT
+};
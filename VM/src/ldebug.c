@@ -8,6 +8,7 @@
 #include "lgc.h"
 #include "ldo.h"
 #include "lbytecode.h"
+#include "lvm.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -32,7 +33,11 @@ static int currentpc(lua_State* L, CallInfo* ci)
 
 static int currentline(lua_State* L, CallInfo* ci)
 {
-    return luaG_getline(ci_func(ci)->l.p, currentpc(L, ci));
+    Proto* p = ci_func(ci)->l.p;
+    if (p->lazy & PROTO_LAZYDEBUG)
+        luau_loaddebug(L, p);
+
+    return luaG_getline(p, currentpc(L, ci));
 }
 
 static Proto* getluaproto(CallInfo* ci)
@@ -75,6 +80,8 @@ const char* lua_getlocal(lua_State* L, int level, int n)
 
     CallInfo* ci = L->ci - level;
     Proto* fp = getluaproto(ci);
+    if (fp && (fp->lazy & PROTO_LAZYDEBUG))
+        luau_loaddebug(L, fp);
     const LocVar* var = fp ? luaF_getlocal(fp, n, currentpc(L, ci)) : NULL;
     if (var)
     {
@@ -92,6 +99,8 @@ const char* lua_setlocal(lua_State* L, int level, int n)
 
     CallInfo* ci = L->ci - level;
     Proto* fp = getluaproto(ci);
+    if (fp && (fp->lazy & PROTO_LAZYDEBUG))
+        luau_loaddebug(L, fp);
     const LocVar* var = fp ? luaF_getlocal(fp, n, currentpc(L, ci)) : NULL;
     if (var)
         setobj2s(L, ci->base + var->reg, L->top - 1);
@@ -353,9 +362,16 @@ void luaG_breakpoint(lua_State* L, Proto* p, int line, int enable)
             if (luaG_getline(p, i) != line)
                 continue;
 
+            // code of functions loaded from a lua_Program is shared with other states
+            if (p->shared)
+                luaF_unshareproto(L, p);
+
             // lazy copy of the original opcode array; done when the first breakpoint is set
             if (!p->debuginsn)
             {
+                // a fused instruction would execute the next one without dispatching it, skipping a breakpoint there
+                luau_unfusecode(L, p);
+
                 p->debuginsn = luaM_newarray(L, p->sizecode, uint8_t, p->memcat);
                 for (int j = 0; j < p->sizecode; ++j)
                     p->debuginsn[j] = LUAU_INSN_OP(p->code[j]);
@@ -472,6 +488,9 @@ int lua_breakpoint(lua_State* L, int funcindex, int line, int enabled)
     api_check(L, ttisfunction(func) && !clvalue(func)->isC);
 
     Proto* p = clvalue(func)->l.p;
+    // breakpoints can be set in functions that haven't run yet
+    luau_loadall(L, p);
+
     // Find line number to add the breakpoint to.
     int target = getnextline(p, line);
 
@@ -516,6 +535,7 @@ void lua_getcoverage(lua_State* L, int funcindex, void* context, lua_Coverage ca
     api_check(L, ttisfunction(func) && !clvalue(func)->isC);
 
     Proto* p = clvalue(func)->l.p;
+    luau_loadall(L, p);
 
     size_t size = getmaxline(p) + 1;
     if (size == 0)
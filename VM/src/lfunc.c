@@ -5,6 +5,9 @@
 #include "lstate.h"
 #include "lmem.h"
 #include "lgc.h"
+#include "lvm.h"
+
+#include <string.h>
 
 #ifdef __clang__
 #pragma clang diagnostic push
@@ -37,6 +40,13 @@ Proto* luaF_newproto(lua_State* L)
     f->source = NULL;
     f->debugname = NULL;
     f->debuginsn = NULL;
+    f->chunk = NULL;
+    f->namecache = NULL;
+    f->sizenamecache = 0;
+    f->lazycode = 0;
+    f->lazydebug = 0;
+    f->lazy = 0;
+    f->shared = 0;
 
 #if LUA_CUSTOM_EXECUTION
     f->execdata = NULL;
@@ -151,15 +161,22 @@ void luaF_closeupval(lua_State* L, UpVal* uv, int dead)
 
 void luaF_freeproto(lua_State* L, Proto* f, lua_Page* page)
 {
-    luaM_freearray(L, f->code, f->sizecode, Instruction, f->memcat);
+    if (!f->shared)
+    {
+        luaM_freearray(L, f->code, f->sizecode, Instruction, f->memcat);
+        if (f->lineinfo)
+            luaM_freearray(L, f->lineinfo, f->sizelineinfo, uint8_t, f->memcat);
+    }
     luaM_freearray(L, f->p, f->sizep, Proto*, f->memcat);
     luaM_freearray(L, f->k, f->sizek, TValue, f->memcat);
-    if (f->lineinfo)
-        luaM_freearray(L, f->lineinfo, f->sizelineinfo, uint8_t, f->memcat);
     luaM_freearray(L, f->locvars, f->sizelocvars, struct LocVar, f->memcat);
     luaM_freearray(L, f->upvalues, f->sizeupvalues, TString*, f->memcat);
     if (f->debuginsn)
         luaM_freearray(L, f->debuginsn, f->sizecode, uint8_t, f->memcat);
+    if (f->chunk)
+        luau_releasechunk(L, f);
+    if (f->namecache)
+        luaM_freearray(L, f->namecache, f->sizenamecache, NamecallSite, f->memcat);
 
 #if LUA_CUSTOM_EXECUTION
     if (f->execdata)
@@ -172,6 +189,30 @@ void luaF_freeproto(lua_State* L, Proto* f, lua_Page* page)
     luaM_freegco(L, f, sizeof(Proto), f->memcat, page);
 }
 
+void luaF_unshareproto(lua_State* L, Proto* f)
+{
+    LUAU_ASSERT(f->shared);
+
+    Instruction* code = luaM_newarray(L, f->sizecode, Instruction, f->memcat);
+    memcpy(code, f->code, f->sizecode * sizeof(Instruction));
+
+    uint8_t* lineinfo = NULL;
+    if (f->lineinfo)
+    {
+        lineinfo = luaM_newarray(L, f->sizelineinfo, uint8_t, f->memcat);
+        memcpy(lineinfo, f->lineinfo, f->sizelineinfo);
+    }
+
+    // abslineinfo is allocated after lineinfo in the same block
+    f->code = code;
+    if (lineinfo)
+    {
+        f->abslineinfo = (int*)(lineinfo + ((uint8_t*)f->abslineinfo - f->lineinfo));
+        f->lineinfo = lineinfo;
+    }
+    f->shared = 0;
+}
+
 void luaF_freeclosure(lua_State* L, Closure* c, lua_Page* page)
 {
     int size = c->isC ? sizeCclosure(c->nupvalues) : sizeLclosure(c->nupvalues);
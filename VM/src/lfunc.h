@@ -7,6 +7,11 @@
 #define sizeCclosure(n) (offsetof(Closure, c.upvals) + sizeof(TValue) * (n))
 #define sizeLclosure(n) (offsetof(Closure, l.uprefs) + sizeof(TValue) * (n))
 
+// code and line info of shared functions are owned by their lua_Program
+#define sizeproto(p) \
+    (sizeof(Proto) + ((p)->shared ? 0 : sizeof(Instruction) * (p)->sizecode + (p)->sizelineinfo) + sizeof(Proto*) * (p)->sizep + \
+        sizeof(TValue) * (p)->sizek + sizeof(LocVar) * (p)->sizelocvars + sizeof(TString*) * (p)->sizeupvalues)
+
 struct lua_State;
 struct lua_Page;
 
@@ -17,6 +22,7 @@ LUAI_FUNC UpVal* luaF_findupval(struct lua_State* L, StkId level);
 LUAI_FUNC void luaF_close(struct lua_State* L, StkId level);
 LUAI_FUNC void luaF_closeupval(struct lua_State* L, UpVal* uv, int dead);
 LUAI_FUNC void luaF_freeproto(struct lua_State* L, Proto* f, struct lua_Page* page);
+LUAI_FUNC void luaF_unshareproto(struct lua_State* L, Proto* f);
 LUAI_FUNC void luaF_freeclosure(struct lua_State* L, Closure* c, struct lua_Page* page);
 LUAI_FUNC void luaF_freeupval(struct lua_State* L, UpVal* uv, struct lua_Page* page);
 LUAI_FUNC const LocVar* luaF_getlocal(const Proto* func, int local_number, int pc);
@@ -10,6 +10,7 @@
 #include "ldo.h"
 #include "lmem.h"
 #include "ludata.h"
+#include "lvm.h"
 
 #include <string.h>
 
@@ -21,7 +22,7 @@
 #endif
 
 /*
- * Luau uses an incremental non-generational non-moving mark&sweep garbage collector.
+ * Luau uses an incremental non-moving mark&sweep garbage collector, with an optional generational mode (see below).
  *
  * The collector runs in three stages: mark, atomic and sweep. Mark and sweep are incremental and try to do a limited amount
  * of work every GC step; atomic is ran once per the GC cycle and is indivisible. In either case, the work happens during GC
@@ -97,9 +98,23 @@
  * Most references that GC deals with are strong, and as such they fit neatly into the incremental marking scheme. Some, however, are
  * weak - notably, tables can be marked as having weak keys/values (using __mode metafield). During incremental marking, we don't know
  * for certain if a given object is alive - if it's marked as black, it definitely was reachable during marking, but if it's marked as
- * white, we don't know if it's actually unreachable. Because of this, we need to defer weak table handling to the atomic phase; after
- * all objects are marked, we traverse all weak tables (that are linked into special weak table lists using `gclist` during marking),
- * and remove all entries that have white keys or values. If keys or values are strong, they are marked normally.
+ * white, we don't know if it's actually unreachable. Because of this, we need to defer weak table handling until all objects are marked;
+ * weak tables are linked into a special weak table list using `gclist` during marking, and entries that have white keys or values are
+ * removed from them once marking completes. If keys or values are strong, they are marked normally. Tables with weak keys and strong
+ * values are ephemerons: a value is only marked once its key is found to be reachable through other means, so that an entry whose value
+ * refers to its own key can still be collected. Since marking a value can make keys in other tables reachable, ephemerons are marked
+ * in passes over all weak tables until a pass doesn't mark anything new.
+ *
+ * A pass runs incrementally at the end of propagateagain stage, one table per visit. Tables with weak keys stay black after they are
+ * traversed (other weak tables stay gray), so barriers mark what is stored in them later. Keys that were unmarked when their table was
+ * traversed are flagged; when such a key is marked after the start of the pass, it is recorded and later looked up in the tables with
+ * weak keys, in GC steps and once more in the atomic phase, instead of visiting all entries again. Another pass is only needed when
+ * the record overflows or the lookups cost more than a pass would.
+ *
+ * Tables with weak values are cleared in the atomic phase: once current white is flipped, the mutator must not be able to read an
+ * unmarked object from them, and table reads don't have barriers. Tables with weak keys are cleared incrementally after the atomic
+ * phase (GCSclearweak stage), before the sweep frees their dead keys: lookups can only find entries by a key that the mutator holds,
+ * so they never reach an entry with a dead key, and iteration, cloning and resizing, which visit all entries, clear the table first.
  *
  * The simplified scheme described above isn't fully accurate because of threads, upvalues and strings.
  *
@@ -121,10 +136,27 @@
  * as black (doing so would violate the GC invariant), and they are kept in a special global list (global_State::uvhead) which is traversed
  * during atomic phase. This is needed because an open upvalue might point to a stack location in a dead thread that never marked the stack
  * slot - upvalues like this are identified since they don't have `markedopen` bit set during thread traversal and closed in `clearupvals`.
+ *
+ * Generational mode (enabled with LUA_GCGEN) uses the same incremental stages, but objects that survive a mark phase keep their color
+ * during the sweep ("sticky" marks) instead of being painted white again: they become old. Objects allocated after that are white
+ * (young). The next cycle is then a minor collection: it doesn't reset the gray lists and only needs to traverse the young objects
+ * reachable from roots and from old objects that were modified since they became old. To find the latter, barriers keep working
+ * outside of the mark phase (see keepgeninvariant): a forward barrier marks the young referent, which is then traversed during the
+ * next mark, and a backward barrier places the old object on the `grayagain` list, which is preserved until the next minor mark.
+ * Threads and weak tables are always rescanned by minor collections: threads are kept gray, since unmarked open upvalues are closed
+ * during the atomic phase, and weak tables are carried over to the next cycle via `grayagain` so that their dead entries are cleared.
+ * Old objects are only freed by major collections, which are regular non-sticky cycles that happen once the heap that survives minor
+ * collections grows enough compared to the heap size after the last major collection (see LUAI_GCGENMAJORMUL).
  */
 
 #define GC_SWEEPPAGESTEPCOST 16
 
+// maximum number of GC steps it takes to finish an incremental string table resize when no new strings are created
+#define GC_STRTABREHASHSTEPS 64
+
+// maximum number of marking passes over ephemerons before atomic; later passes only happen when marked objects weren't recorded
+#define GC_WEAKPASSES 4
+
 #define GC_INTERRUPT(state) \
     { \
         void (*interrupt)(lua_State*, int) = g->cb.interrupt; \
@@ -139,7 +171,9 @@
 #define white2gray(x) reset2bits((x)->gch.marked, WHITE0BIT, WHITE1BIT)
 #define black2gray(x) resetbit((x)->gch.marked, BLACKBIT)
 
-#define stringmark(s) reset2bits((s)->marked, WHITE0BIT, WHITE1BIT)
+// slices are marked together with their parent, which is never a slice
+#define stringmark(s) \
+    (reset2bits((s)->marked, WHITE0BIT, WHITE1BIT), (s)->slice ? (void)reset2bits(gslice(s)->parent->marked, WHITE0BIT, WHITE1BIT) : (void)0)
 
 #define markvalue(g, o) \
     { \
@@ -180,6 +214,10 @@ static void recordGcStateStep(global_State* g, int startgcstate, double seconds,
     case GCSatomic:
         g->gcmetrics.currcycle.atomictime += seconds;
         break;
+    case GCSclearweak:
+        g->gcmetrics.currcycle.clearweaktime += seconds;
+        g->gcmetrics.currcycle.clearweakwork += work;
+        break;
     case GCSsweep:
         g->gcmetrics.currcycle.sweeptime += seconds;
         g->gcmetrics.currcycle.sweepwork += work;
@@ -238,14 +276,99 @@ static void removeentry(LuaNode* n)
         setttype(gkey(n), LUA_TDEADKEY); // dead key; remove it
 }
 
+static void reallymarkobject(global_State* g, GCObject* o);
+
+// number of lookups of recorded objects that costs about as much as another pass over the entries of tables with weak keys
+static size_t weakkeybudget(global_State* g)
+{
+    size_t budget = 0;
+
+    for (GCObject* o = g->weak; o; o = gco2h(o)->gclist)
+        if (testbit(o->gch.marked, WEAKKEYBIT))
+            budget += sizenode(gco2h(o));
+
+    return budget;
+}
+
+/*
+** Mark values of ephemerons whose keys are recorded objects. The record is emptied first, so that the objects this marks are recorded
+** in turn; if they don't fit, or the budget of lookups runs out, the record overflows and the tables have to be traversed instead.
+*/
+static size_t markweakkeys(global_State* g)
+{
+    GCObject* keys[LUA_EPHEMERON_MARKS];
+    size_t work = 0;
+
+    g->weakrecord = 2;
+
+    while (g->weakkeycount > 0 && g->weakkeycount <= LUA_EPHEMERON_MARKS)
+    {
+        int count = g->weakkeycount;
+        memcpy(keys, g->weakkeys, count * sizeof(GCObject*));
+        g->weakkeycount = 0;
+
+        for (int i = 0; i < count && g->weakkeycount <= LUA_EPHEMERON_MARKS; i++)
+        {
+            TValue k;
+            k.value.gc = keys[i];
+            k.tt = keys[i]->gch.tt;
+
+            for (GCObject* o = g->weak; o; o = gco2h(o)->gclist)
+            {
+                if (!testbit(o->gch.marked, WEAKKEYBIT))
+                    continue;
+
+                if (g->weakbudget == 0)
+                {
+                    g->weakkeycount = LUA_EPHEMERON_MARKS + 1;
+                    break;
+                }
+
+                const TValue* v = luaH_get(gco2h(o), &k);
+                if (iscollectable(v) && iswhite(gcvalue(v)))
+                    reallymarkobject(g, gcvalue(v));
+
+                g->weakbudget--;
+                work += sizeof(LuaNode);
+            }
+        }
+    }
+
+    g->weakrecord = 1;
+    return work;
+}
+
+// keys of ephemerons that were found unmarked are recorded when they are marked after the start of the last pass over weak tables
+static void recordweakkey(global_State* g, GCObject* o)
+{
+    resetbit(o->gch.marked, EPHEMERONKEYBIT);
+
+    if (!g->weakrecord)
+        return;
+
+    // a full record is looked up right away, unless the objects were marked by the lookups themselves or by a barrier
+    if (g->weakkeycount == LUA_EPHEMERON_MARKS && g->weakrecord == 1)
+        markweakkeys(g);
+
+    if (g->weakkeycount < LUA_EPHEMERON_MARKS)
+        g->weakkeys[g->weakkeycount++] = o;
+    else
+        g->weakkeycount = LUA_EPHEMERON_MARKS + 1;
+}
+
 static void reallymarkobject(global_State* g, GCObject* o)
 {
     LUAU_ASSERT(iswhite(o) && !isdead(g, o));
     white2gray(o);
+    if (testbit(o->gch.marked, EPHEMERONKEYBIT))
+        recordweakkey(g, o);
     switch (o->gch.tt)
     {
     case LUA_TSTRING:
     {
+        TString* ts = gco2ts(o);
+        if (ts->slice)
+            markobject(g, gslice(ts)->parent);
         return;
     }
     case LUA_TUSERDATA:
@@ -303,11 +426,50 @@ static const char* gettablemode(global_State* g, Table* h)
     return NULL;
 }
 
+/*
+** Tables with weak keys keep the mode they were traversed with until they are cleared. Mode changes of other weak tables after the
+** traversal make their references strong; keys only stay weak together with values, as an ephemeron that wasn't traversed as one
+** would not be revisited by atomic.
+*/
+static void getweakmode(global_State* g, Table* h, int* weakkey, int* weakvalue)
+{
+    if (testbit(h->marked, WEAKKEYBIT))
+    {
+        *weakkey = 1;
+        *weakvalue = 0;
+        return;
+    }
+
+    const char* modev = gettablemode(g, h);
+    *weakvalue = modev && strchr(modev, 'v') != NULL;
+    *weakkey = *weakvalue && strchr(modev, 'k') != NULL;
+}
+
+/*
+** The next function tells whether a key or value can be cleared from
+** a weak table. Non-collectable objects are never removed from weak
+** tables. Strings behave as `values', so are never removed too. for
+** other objects: if really collected, cannot keep them.
+*/
+static int isobjcleared(GCObject* o)
+{
+    if (o->gch.tt == LUA_TSTRING)
+    {
+        stringmark(&o->ts); // strings are `values', so are never weak
+        return 0;
+    }
+
+    return iswhite(o);
+}
+
+#define iscleared(o) (iscollectable(o) && isobjcleared(gcvalue(o)))
+
 static int traversetable(global_State* g, Table* h)
 {
     int i;
     int weakkey = 0;
     int weakvalue = 0;
+    LUAU_ASSERT(!testbit(h->marked, WEAKKEYBIT));
     if (h->metatable)
         markobject(g, cast_to(Table*, h->metatable));
 
@@ -321,6 +483,10 @@ static int traversetable(global_State* g, Table* h)
         {                         // is really weak?
             h->gclist = g->weak;  // must be cleared after GC, ...
             g->weak = obj2gco(h); // ... so put in the appropriate list
+
+            // ephemerons stay black, see luaC_barriertable
+            if (!weakvalue)
+                l_setbit(h->marked, WEAKKEYBIT);
         }
     }
 
@@ -332,6 +498,18 @@ static int traversetable(global_State* g, Table* h)
         while (i--)
             markvalue(g, &h->array[i]);
     }
+    if (isshaped(h))
+    {
+        // keys of fields are strings, so they are never weak and values of ephemerons are always marked
+        TableShape* shape = gfields(h)->shape;
+        i = shape->nfields;
+        while (i--)
+        {
+            stringmark(gshapekey(shape, i));
+            if (!weakvalue)
+                markvalue(g, gfield(h, i));
+        }
+    }
     i = sizenode(h);
     while (i--)
     {
@@ -344,11 +522,104 @@ static int traversetable(global_State* g, Table* h)
             LUAU_ASSERT(!ttisnil(gkey(n)));
             if (!weakkey)
                 markvalue(g, gkey(n));
-            if (!weakvalue)
+            // values of ephemerons are only marked when the key is alive, see markweaktable; the key is recorded once it's marked
+            if (!weakvalue && (!weakkey || !iscleared(gkey(n))))
+            {
                 markvalue(g, gval(n));
+            }
+            else if (!weakvalue)
+            {
+                l_setbit(gcvalue(gkey(n))->gch.marked, EPHEMERONKEYBIT);
+            }
+        }
+    }
+    return weakvalue;
+}
+
+/*
+** Mark strong references of a weak table that is already in the weak list: keys of tables with weak values, and values of
+** tables with weak keys (ephemerons) whose keys are alive. Returns 1 if any object was marked, in which case keys of other
+** ephemerons might have become alive as well.
+*/
+static int markweaktable(global_State* g, Table* h)
+{
+    int marked = 0;
+    int weakkey, weakvalue;
+    getweakmode(g, h, &weakkey, &weakvalue);
+
+    // a backward barrier turned the table gray; now that its references are marked again, barriers can resume marking new ones
+    if (testbit(h->marked, WEAKKEYBIT))
+        gray2black(obj2gco(h));
+
+    if (h->metatable && iswhite(obj2gco(h->metatable)))
+    {
+        reallymarkobject(g, obj2gco(h->metatable));
+        marked = 1;
+    }
+
+    if (!weakvalue)
+    {
+        int i = h->sizearray;
+        while (i--)
+        {
+            TValue* o = &h->array[i];
+            if (iscollectable(o) && iswhite(gcvalue(o)))
+            {
+                reallymarkobject(g, gcvalue(o));
+                marked = 1;
+            }
         }
     }
-    return weakkey || weakvalue;
+
+    if (weakkey && weakvalue)
+        return marked;
+
+    if (isshaped(h) && !weakvalue)
+    {
+        int i = gfields(h)->shape->nfields;
+        while (i--)
+        {
+            TValue* o = gfield(h, i);
+            if (iscollectable(o) && iswhite(gcvalue(o)))
+            {
+                reallymarkobject(g, gcvalue(o));
+                marked = 1;
+            }
+        }
+    }
+
+    int i = sizenode(h);
+    while (i--)
+    {
+        LuaNode* n = gnode(h, i);
+
+        if (ttisnil(gval(n)))
+            continue;
+
+        if (!weakkey && iscollectable(gkey(n)) && iswhite(gcvalue(gkey(n))))
+        {
+            reallymarkobject(g, gcvalue(gkey(n)));
+            marked = 1;
+        }
+
+        if (!weakvalue && weakkey && iscleared(gkey(n)))
+        {
+            l_setbit(gcvalue(gkey(n))->gch.marked, EPHEMERONKEYBIT);
+        }
+        else if (!weakvalue && iscollectable(gval(n)) && iswhite(gcvalue(gval(n))))
+        {
+            reallymarkobject(g, gcvalue(gval(n)));
+            marked = 1;
+        }
+    }
+
+    return marked;
+}
+
+static size_t tablesize(Table* h)
+{
+    return sizeof(Table) + sizeof(TValue) * (size_t)h->sizearray + sizeof(LuaNode) * (size_t)sizenode(h) +
+           (isshaped(h) ? sizefields(gfields(h)->size) : 0) + (ispacked(h) ? sizenumbers(h->numbers->capacity) : 0);
 }
 
 /*
@@ -362,6 +633,11 @@ static void traverseproto(global_State* g, Proto* f)
         stringmark(f->source);
     if (f->debugname)
         stringmark(f->debugname);
+    if (f->chunk)
+    {
+        markobject(g, f->chunk->env);
+        markobject(g, f->chunk->gt);
+    }
     for (i = 0; i < f->sizek; i++) // mark literals
         markvalue(g, &f->k[i]);
     for (i = 0; i < f->sizeupvalues; i++)
@@ -461,9 +737,9 @@ static size_t propagatemark(global_State* g)
     {
         Table* h = gco2h(o);
         g->gray = h->gclist;
-        if (traversetable(g, h)) // table is weak?
+        if (traversetable(g, h)) // table has weak values?
             black2gray(o);       // keep it gray
-        return sizeof(Table) + sizeof(TValue) * h->sizearray + sizeof(LuaNode) * (size_t)(sizenode(h));
+        return tablesize(h);
     }
     case LUA_TFUNCTION:
     {
@@ -482,7 +758,8 @@ static size_t propagatemark(global_State* g)
         traversestack(g, th);
 
         // active threads will need to be rescanned later to mark new stack writes so we mark them gray again
-        if (active)
+        // in generational mode, all threads stay gray so that minor collections rescan them and set markedopen for their upvalues
+        if (active || g->gcgenmark)
         {
             th->gclist = g->grayagain;
             g->grayagain = o;
@@ -506,8 +783,7 @@ static size_t propagatemark(global_State* g)
         Proto* p = gco2p(o);
         g->gray = p->gclist;
         traverseproto(g, p);
-        return sizeof(Proto) + sizeof(Instruction) * p->sizecode + sizeof(Proto*) * p->sizep + sizeof(TValue) * p->sizek + p->sizelineinfo +
-               sizeof(LocVar) * p->sizelocvars + sizeof(TString*) * p->sizeupvalues;
+        return sizeproto(p);
     }
     default:
         LUAU_ASSERT(0);
@@ -526,79 +802,201 @@ static size_t propagateall(global_State* g)
 }
 
 /*
-** The next function tells whether a key or value can be cleared from
-** a weak table. Non-collectable objects are never removed from weak
-** tables. Strings behave as `values', so are never removed too. for
-** other objects: if really collected, cannot keep them.
+** clear collected entries from a weak table
 */
-static int isobjcleared(GCObject* o)
+static size_t cleartable(lua_State* L, Table* h)
 {
-    if (o->gch.tt == LUA_TSTRING)
+    int i = h->sizearray;
+    while (i--)
     {
-        stringmark(&o->ts); // strings are `values', so are never weak
-        return 0;
+        TValue* o = &h->array[i];
+        if (iscleared(o))   // value was collected?
+            setnilvalue(o); // remove value
     }
-
-    return iswhite(o);
-}
-
-#define iscleared(o) (iscollectable(o) && isobjcleared(gcvalue(o)))
-
-/*
-** clear collected entries from weaktables
-*/
-static size_t cleartable(lua_State* L, GCObject* l)
-{
-    (void)sizeof(L);
-    size_t work = 0;
-    while (l)
+    if (isshaped(h))
     {
-        Table* h = gco2h(l);
-        work += sizeof(Table) + sizeof(TValue) * (size_t)h->sizearray + sizeof(LuaNode) * (size_t)sizenode(h);
-
-        int i = h->sizearray;
+        i = gfields(h)->shape->nfields;
         while (i--)
         {
-            TValue* o = &h->array[i];
+            TValue* o = gfield(h, i);
             if (iscleared(o))   // value was collected?
                 setnilvalue(o); // remove value
         }
-        i = sizenode(h);
-        int activevalues = 0;
-        while (i--)
-        {
-            LuaNode* n = gnode(h, i);
+    }
+    i = sizenode(h);
+    int activevalues = 0;
+    while (i--)
+    {
+        LuaNode* n = gnode(h, i);
 
-            // non-empty entry?
-            if (!ttisnil(gval(n)))
+        // non-empty entry?
+        if (!ttisnil(gval(n)))
+        {
+            // can we clear key or value?
+            if (iscleared(gkey(n)) || iscleared(gval(n)))
             {
-                // can we clear key or value?
-                if (iscleared(gkey(n)) || iscleared(gval(n)))
-                {
-                    setnilvalue(gval(n)); // remove value ...
-                    removeentry(n);       // remove entry from table
-                }
-                else
-                {
-                    activevalues++;
-                }
+                setnilvalue(gval(n)); // remove value ...
+                removeentry(n);       // remove entry from table
+            }
+            else
+            {
+                activevalues++;
             }
         }
+    }
 
-        const char* modev = gettablemode(L->global, h);
-        if (modev)
+    const char* modev = gettablemode(L->global, h);
+    if (modev)
+    {
+        // are we allowed to shrink this weak table?
+        if (strchr(modev, 's'))
         {
-            // are we allowed to shrink this weak table?
-            if (strchr(modev, 's'))
-            {
-                // shrink at 37.5% occupancy
-                if (activevalues < sizenode(h) * 3 / 8)
-                    luaH_resizehash(L, h, activevalues);
-            }
+            // shrink at 37.5% occupancy
+            if (activevalues < sizenode(h) * 3 / 8)
+                luaH_resizehash(L, h, activevalues);
+        }
+    }
+
+    return tablesize(h);
+}
+
+// mark values that are reachable through alive keys of ephemerons until no new objects are found
+static size_t convergeephemerons(global_State* g)
+{
+    size_t work = 0;
+    int marked;
+
+    do
+    {
+        marked = 0;
+
+        for (GCObject* o = g->weak; o; o = gco2h(o)->gclist)
+        {
+            if (!testbit(o->gch.marked, WEAKKEYBIT))
+                continue;
+
+            marked |= markweaktable(g, gco2h(o));
+            work += tablesize(gco2h(o));
         }
 
-        l = h->gclist;
+        // traversal can find more weak tables; they are added to the front of the list and are visited by the next pass
+        work += propagateall(g);
+    } while (marked);
+
+    return work;
+}
+
+// mark values of ephemerons whose keys were marked after the start of the last pass over weak tables; the tables are traversed until
+// no new objects are found if some of these objects weren't recorded
+static size_t settleephemerons(global_State* g)
+{
+    size_t work = 0;
+
+    while (g->weakkeycount > 0 && g->weakkeycount <= LUA_EPHEMERON_MARKS)
+    {
+        work += markweakkeys(g);
+        work += propagateall(g);
     }
+
+    g->weakrecord = 0;
+
+    if (g->weakkeycount > LUA_EPHEMERON_MARKS)
+        work += convergeephemerons(g);
+
+    return work;
+}
+
+// entry of a table with weak keys whose key is dead after atomic
+#define isdeadkey(g, n) (!ttisnil(gval(n)) && iscollectable(gkey(n)) && isdead(g, gcvalue(gkey(n))))
+
+static size_t clearweaknodes(global_State* g, Table* h, int from, int to)
+{
+    for (int i = from; i < to; i++)
+    {
+        LuaNode* n = gnode(h, i);
+
+        if (isdeadkey(g, n))
+        {
+            setnilvalue(gval(n)); // remove value ...
+            removeentry(n);       // remove entry from table
+        }
+    }
+
+    return (to - from) * sizeof(LuaNode);
+}
+
+// the table was unlinked from `weak' after its dead keys were removed
+static size_t finishweak(lua_State* L, Table* h, int shrink)
+{
+    global_State* g = L->global;
+
+    resetbit(h->marked, WEAKKEYBIT);
+
+    // weak tables stay gray; minor collection needs to traverse them again to clear entries that refer to dead young objects
+    if (g->gcsticky)
+    {
+        black2gray(obj2gco(h));
+        h->gclist = g->grayagain;
+        g->grayagain = obj2gco(h);
+    }
+
+    const char* modev = gettablemode(g, h);
+
+    // are we allowed to shrink this weak table?
+    if (shrink && modev && strchr(modev, 's'))
+    {
+        int activevalues = 0;
+        for (int i = 0; i < sizenode(h); i++)
+            activevalues += !ttisnil(gval(gnode(h, i)));
+
+        // shrink at 37.5% occupancy
+        if (activevalues < sizenode(h) * 3 / 8)
+            luaH_resizehash(L, h, activevalues);
+
+        return sizenode(h) * sizeof(LuaNode);
+    }
+
+    return 0;
+}
+
+/*
+** Remove entries with dead keys from the table at the front of `weak', a part at a time. In the meantime, newkey can move an entry
+** from the part that wasn't cleared yet to a free position; free positions are taken from `lastfree' down, so the positions that were
+** taken since the last step are checked again. Entries of hash parts with control bytes never move. Resizing a table, like iterating
+** it, clears it at once (see luaC_clearweak).
+*/
+static size_t clearweakstep(lua_State* L, size_t limit)
+{
+    global_State* g = L->global;
+    Table* h = gco2h(g->weak);
+    size_t work = 0;
+
+    if (g->weaknode != h->node)
+    {
+        g->weaknode = h->node;
+        g->weakindex = sizenode(h);
+        g->weaklastfree = h->lastfree;
+    }
+
+    if (!hasctrl(h) && h->lastfree < g->weaklastfree && g->weakindex < g->weaklastfree)
+        work += clearweaknodes(g, h, h->lastfree > g->weakindex ? h->lastfree : g->weakindex, g->weaklastfree);
+
+    g->weaklastfree = h->lastfree;
+
+    while (g->weakindex > 0 && work < limit)
+    {
+        g->weakindex--;
+        work += clearweaknodes(g, h, g->weakindex, g->weakindex + 1);
+    }
+
+    if (g->weakindex == 0)
+    {
+        g->weak = h->gclist;
+        g->weaknode = NULL;
+
+        work += finishweak(L, h, /* shrink= */ 1);
+    }
+
     return work;
 }
 
@@ -638,7 +1036,7 @@ static void shrinkbuffers(lua_State* L)
     global_State* g = L->global;
     // check size of string hash
     if (g->strt.nuse < cast_to(uint32_t, g->strt.size / 4) && g->strt.size > LUA_MINSTRTABSIZE * 2)
-        luaS_resize(L, g->strt.size / 2); // table is too big
+        luaS_startresize(L, g->strt.size / 2); // table is too big
 }
 
 static void shrinkbuffersfull(lua_State* L)
@@ -652,6 +1050,27 @@ static void shrinkbuffersfull(lua_State* L)
         luaS_resize(L, hashsize); // table is too big
 }
 
+static int clearnamecachegco(void* context, lua_Page* page, GCObject* gco)
+{
+    if (gco->gch.tt == LUA_TPROTO && gco2p(gco)->namecache)
+        memset(gco2p(gco)->namecache, 0, gco2p(gco)->sizenamecache * sizeof(NamecallSite));
+
+    return 0;
+}
+
+// once all epochs are used, namecall caches stop accepting entries (see luaH_watch); at the end of the collection, all cache entries are
+// dropped so that epochs can start over
+static void restartnamecallepoch(lua_State* L)
+{
+    global_State* g = L->global;
+
+    if (g->namecallepoch == UINT32_MAX)
+    {
+        luaM_visitgco(L, L, clearnamecachegco);
+        g->namecallepoch = 1;
+    }
+}
+
 static int deletegco(void* context, lua_Page* page, GCObject* gco)
 {
     lua_State* L = (lua_State*)context;
@@ -685,9 +1104,19 @@ static void markmt(global_State* g)
 static void markroot(lua_State* L)
 {
     global_State* g = L->global;
-    g->gray = NULL;
-    g->grayagain = NULL;
+
+    g->gcgenmark = g->gcgen;
+    g->gcminor = g->gcsticky;
+
+    // minor collection starts with objects recorded by barriers since the last mark; old objects are black and are not traversed again
+    if (!g->gcminor)
+    {
+        g->gray = NULL;
+        g->grayagain = NULL;
+    }
     g->weak = NULL;
+    g->weakcursor = NULL;
+    g->weakrecord = 0;
     markobject(g, g->mainthread);
     // make global table be traversed before main stack
     markobject(g, g->mainthread->gt);
@@ -749,6 +1178,14 @@ static size_t clearupvals(lua_State* L)
     return work;
 }
 
+static int needsmajor(global_State* g)
+{
+    // the heap that survived the last minor collection approximates the size of the old generation
+    size_t base = g->gcgenmajorbase;
+
+    return g->gcstats.endtotalsizebytes > base + (base / 100) * g->gcgenmajormul;
+}
+
 static size_t atomic(lua_State* L)
 {
     global_State* g = L->global;
@@ -760,6 +1197,9 @@ static size_t atomic(lua_State* L)
     double currts = lua_clock();
 #endif
 
+    // in generational mode, survivors of this mark become old unless the old generation has grown enough to need a major collection
+    g->gcsticky = g->gcgenmark && !(g->gcminor && needsmajor(g));
+
     // remark occasional upvalues of (maybe) dead threads
     work += remarkupvals(g);
     // traverse objects caught by write barrier and by 'remarkupvals'
@@ -769,18 +1209,11 @@ static size_t atomic(lua_State* L)
     g->gcmetrics.currcycle.atomictimeupval += recordGcDeltaTime(currts);
 #endif
 
-    // remark weak tables
-    g->gray = g->weak;
-    g->weak = NULL;
     LUAU_ASSERT(!iswhite(obj2gco(g->mainthread)));
     markobject(g, L); // mark running thread
     markmt(g);        // mark basic metatables (again)
     work += propagateall(g);
 
-#ifdef LUAI_GCMETRICS
-    g->gcmetrics.currcycle.atomictimeweak += recordGcDeltaTime(currts);
-#endif
-
     // remark gray again
     g->gray = g->grayagain;
     g->grayagain = NULL;
@@ -790,9 +1223,57 @@ static size_t atomic(lua_State* L)
     g->gcmetrics.currcycle.atomictimegray += recordGcDeltaTime(currts);
 #endif
 
-    // remove collected objects from weak tables
-    work += cleartable(L, g->weak);
-    g->weak = NULL;
+    // objects marked from here on are looked up in tables with weak keys at most as many times as another pass would visit entries
+    g->weakbudget = weakkeybudget(g);
+
+    // remark weak tables: mark strong references that were added after traversal; tables with weak keys are black, so barriers have
+    // marked references added to them unless a backward barrier turned them gray
+    for (GCObject* o = g->weak; o; o = gco2h(o)->gclist)
+    {
+        Table* h = gco2h(o);
+        const char* modev = gettablemode(g, h);
+
+        // references of a table that lost weak keys become strong, and the table is cleared now like tables with weak values
+        if (testbit(h->marked, WEAKKEYBIT) && (!modev || !strchr(modev, 'k')))
+            resetbit(h->marked, WEAKKEYBIT);
+
+        if (!testbit(h->marked, WEAKKEYBIT) || isgray(o))
+        {
+            markweaktable(g, h);
+            work += tablesize(h);
+        }
+    }
+    work += propagateall(g);
+
+    // mark values of ephemerons whose keys were marked late
+    work += settleephemerons(g);
+
+#ifdef LUAI_GCMETRICS
+    g->gcmetrics.currcycle.atomictimeweak += recordGcDeltaTime(currts);
+#endif
+
+    // remove collected objects from tables with weak values; tables with weak keys are cleared after atomic
+    for (GCObject** p = &g->weak; *p;)
+    {
+        Table* h = gco2h(*p);
+
+        if (testbit(h->marked, WEAKKEYBIT))
+        {
+            p = &h->gclist;
+            continue;
+        }
+
+        work += cleartable(L, h);
+        *p = h->gclist;
+
+        // weak tables stay gray; minor collection needs to traverse them again to clear entries that refer to dead young objects
+        if (g->gcsticky)
+        {
+            black2gray(obj2gco(h));
+            h->gclist = g->grayagain;
+            g->grayagain = obj2gco(h);
+        }
+    }
 
 #ifdef LUAI_GCMETRICS
     g->gcmetrics.currcycle.atomictimeclear += recordGcDeltaTime(currts);
@@ -808,7 +1289,10 @@ static size_t atomic(lua_State* L)
     // flip current white
     g->currentwhite = cast_byte(otherwhite(g));
     g->sweepgcopage = g->allgcopages;
-    g->gcstate = GCSsweep;
+
+    // tables with weak keys have to be cleared before the sweep frees their dead keys
+    g->weaknode = NULL;
+    g->gcstate = g->weak ? GCSclearweak : GCSsweep;
 
     return work;
 }
@@ -830,6 +1314,7 @@ static int sweepgcopage(lua_State* L, lua_Page* page)
     LUAU_ASSERT(testbit(deadmask, FIXEDBIT)); // make sure we never sweep fixed objects
 
     int newwhite = luaC_white(g);
+    int sticky = g->gcsticky;
 
     for (char* pos = start; pos != end; pos += blockSize)
     {
@@ -843,8 +1328,9 @@ static int sweepgcopage(lua_State* L, lua_Page* page)
         if ((gco->gch.marked ^ WHITEBITS) & deadmask)
         {
             LUAU_ASSERT(!isdead(g, gco));
-            // make it white (for next cycle)
-            gco->gch.marked = cast_byte((gco->gch.marked & maskmarks) | newwhite);
+            // make it white (for next cycle), unless it becomes old
+            if (!sticky)
+                gco->gch.marked = cast_byte((gco->gch.marked & maskmarks) | newwhite);
         }
         else
         {
@@ -889,25 +1375,58 @@ static size_t gcstep(lua_State* L, size_t limit)
             g->gray = g->grayagain;
             g->grayagain = NULL;
 
+            // start marking passes over ephemerons once the gray list is empty; until then, marked objects aren't recorded
+            g->weakcursor = NULL;
+            g->weakpasses = 0;
+            g->weakkeycount = LUA_EPHEMERON_MARKS + 1;
+
             g->gcstate = GCSpropagateagain;
         }
         break;
     }
     case GCSpropagateagain:
     {
-        while (g->gray && cost < limit)
+        while (cost < limit)
         {
-            cost += propagatemark(g);
-        }
+            if (g->weakkeycount > 0 && g->weakkeycount <= LUA_EPHEMERON_MARKS)
+            {
+                // objects recorded by barriers since the last step are looked up first
+                cost += markweakkeys(g);
+            }
+            else if (g->gray)
+            {
+                cost += propagatemark(g);
+            }
+            else if (g->weakcursor)
+            {
+                // values of ephemerons with alive keys are marked ahead of atomic; keys marked later are recorded and looked up
+                Table* h = gco2h(g->weakcursor);
+                g->weakcursor = h->gclist;
 
-        if (!g->gray) // no more `gray' objects
-        {
+                markweaktable(g, h);
+                cost += tablesize(h);
+            }
+            else if (g->weakkeycount > LUA_EPHEMERON_MARKS && g->weakpasses < GC_WEAKPASSES)
+            {
+                // some objects marked since the start of the last pass weren't recorded, so they can only be found by visiting the
+                // tables again; weak tables traversed in the meantime are at the front of the list
+                g->weakcursor = g->weak;
+                g->weakpasses++;
+
+                g->weakrecord = 1;
+                g->weakkeycount = 0;
+                g->weakbudget = weakkeybudget(g);
+            }
+            else // no more `gray' objects
+            {
 #ifdef LUAI_GCMETRICS
-            g->gcmetrics.currcycle.propagateagainwork =
-                g->gcmetrics.currcycle.explicitwork + g->gcmetrics.currcycle.assistwork - g->gcmetrics.currcycle.propagatework;
+                g->gcmetrics.currcycle.propagateagainwork =
+                    g->gcmetrics.currcycle.explicitwork + g->gcmetrics.currcycle.assistwork - g->gcmetrics.currcycle.propagatework;
 #endif
 
-            g->gcstate = GCSatomic;
+                g->gcstate = GCSatomic;
+                break;
+            }
         }
         break;
     }
@@ -923,29 +1442,50 @@ static size_t gcstep(lua_State* L, size_t limit)
 
         cost = atomic(L); // finish mark phase
 
-        LUAU_ASSERT(g->gcstate == GCSsweep);
+        LUAU_ASSERT(g->gcstate == GCSclearweak || g->gcstate == GCSsweep);
+        break;
+    }
+    case GCSclearweak:
+    {
+        while (g->weak && cost < limit)
+            cost += clearweakstep(L, limit - cost);
+
+        if (!g->weak)
+            g->gcstate = GCSsweep;
         break;
     }
     case GCSsweep:
     {
+        double sweepstart = lua_clock();
+
         while (g->sweepgcopage && cost < limit)
         {
             lua_Page* next = luaM_getnextgcopage(g->sweepgcopage); // page sweep might destroy the page
 
-            int steps = sweepgcopage(L, g->sweepgcopage);
+            // pages that were handed off to the background sweep only need to be visited if some objects are left in them
+            int steps = luaC_bgsweeppage(L, g->sweepgcopage) ? 1 : sweepgcopage(L, g->sweepgcopage);
 
             g->sweepgcopage = next;
             cost += steps * GC_SWEEPPAGESTEPCOST;
         }
 
+        // let the helper sweep the next batch of pages while the application is running
+        if (g->sweepgcopage)
+            luaC_bgsweeppost(L, g->sweepgcopage);
+
+        g->gcstats.sweeptime += lua_clock() - sweepstart;
+
         // nothing more to sweep?
         if (g->sweepgcopage == NULL)
         {
             // don't forget to visit main thread, it's the only object not allocated in GCO pages
             LUAU_ASSERT(!isdead(g, obj2gco(g->mainthread)));
-            makewhite(g, obj2gco(g->mainthread)); // make it white (for next cycle)
+            if (!g->gcsticky)
+                makewhite(g, obj2gco(g->mainthread)); // make it white (for next cycle)
 
             shrinkbuffers(L);
+            luaM_trimpagecache(L);
+            restartnamecallepoch(L);
 
             g->gcstate = GCSpause; // end collection
         }
@@ -1021,6 +1561,11 @@ size_t luaC_step(lua_State* L, int assist)
 
     GC_INTERRUPT(0);
 
+    // string table resize makes progress even when no new strings are created; the work is proportional to the size of the table so
+    // that large tables don't keep both bucket arrays for long
+    if (g->strt.oldhash)
+        luaS_rehash(L, LUA_STRTABREHASHSTEP + g->strt.oldsize / GC_STRTABREHASHSTEPS);
+
     // at the start of the new cycle
     if (g->gcstate == GCSpause)
         g->gcstats.starttimestamp = lua_clock();
@@ -1032,14 +1577,15 @@ size_t luaC_step(lua_State* L, int assist)
     double lasttimestamp = lua_clock();
 #endif
 
+    // step timing is only measured when somebody is listening
+    double steptimestamp = g->cb.gcstep ? lua_clock() : 0.0;
+
     int lastgcstate = g->gcstate;
 
     size_t work = gcstep(L, lim);
 
 #ifdef LUAI_GCMETRICS
     recordGcStateStep(g, lastgcstate, lua_clock() - lasttimestamp, assist, work);
-#else
-    (void)sizeof(assist);
 #endif
 
     size_t actualstepsize = work * 100 / g->gcstepmul;
@@ -1049,14 +1595,22 @@ size_t luaC_step(lua_State* L, int assist)
     {
         // at the end of a collection cycle, set goal based on gcgoal setting
         size_t heapgoal = (g->totalbytes / 100) * g->gcgoal;
-        size_t heaptrigger = getheaptrigger(g, heapgoal);
 
-        g->GCthreshold = heaptrigger;
+        if (!g->gcminor)
+            g->gcgenmajorbase = g->totalbytes;
+
+        // minor collection only needs to wait for the young generation to grow
+        if (g->gcsticky)
+            g->GCthreshold = g->totalbytes + (g->totalbytes / 100) * g->gcgenminormul;
+        else
+            g->GCthreshold = getheaptrigger(g, heapgoal);
 
         g->gcstats.heapgoalsizebytes = heapgoal;
         g->gcstats.endtimestamp = lua_clock();
         g->gcstats.endtotalsizebytes = g->totalbytes;
 
+        luaM_rearmmemcatlimits(L);
+
 #ifdef LUAI_GCMETRICS
         finishGcCycleMetrics(g);
 #endif
@@ -1070,6 +1624,19 @@ size_t luaC_step(lua_State* L, int assist)
             g->GCthreshold -= debt;
     }
 
+    void (*gcstep)(lua_State*, const lua_GCStepInfo*) = g->cb.gcstep;
+    if (LUAU_UNLIKELY(!!gcstep))
+    {
+        lua_GCStepInfo info;
+        info.state = lastgcstate;
+        info.assist = assist;
+        info.duration = lua_clock() - steptimestamp;
+        info.work = work;
+        info.heapsize = g->totalbytes;
+
+        gcstep(L, &info);
+    }
+
     GC_INTERRUPT(lastgcstate);
 
     return actualstepsize;
@@ -1084,14 +1651,30 @@ void luaC_fullgc(lua_State* L)
         startGcCycleMetrics(g);
 #endif
 
-    if (keepinvariant(g))
+    // tables with weak keys refer to dead objects until they are cleared
+    while (g->gcstate == GCSclearweak)
+        gcstep(L, SIZE_MAX);
+
+    if (keepinvariant(g) || g->gcsticky)
     {
+        // full collection is always a major one
+        g->gcsticky = 0;
+
+        // sweep restarts from the first page
+        luaC_bgsweepcancel(L);
+
+        // tables with weak keys leave the weak list
+        for (GCObject* o = g->weak; o; o = gco2h(o)->gclist)
+            resetbit(o->gch.marked, WEAKKEYBIT);
+
         // reset sweep marks to sweep all elements (returning them to white)
         g->sweepgcopage = g->allgcopages;
         // reset other collector lists
         g->gray = NULL;
         g->grayagain = NULL;
         g->weak = NULL;
+        g->weakcursor = NULL;
+        g->weakrecord = 0;
         g->gcstate = GCSsweep;
     }
     LUAU_ASSERT(g->gcstate == GCSpause || g->gcstate == GCSsweep);
@@ -1122,9 +1705,12 @@ void luaC_fullgc(lua_State* L)
     }
     // reclaim as much buffer memory as possible (shrinkbuffers() called during sweep is incremental)
     shrinkbuffersfull(L);
+    luaM_freepagecache(L);
 
     size_t heapgoalsizebytes = (g->totalbytes / 100) * g->gcgoal;
 
+    g->gcgenmajorbase = g->totalbytes;
+
     // trigger cannot be correctly adjusted after a forced full GC.
     // we will try to place it so that we can reach the goal based on
     // the rate at which we run the GC relative to allocation rate
@@ -1138,21 +1724,33 @@ void luaC_fullgc(lua_State* L)
 
     g->gcstats.heapgoalsizebytes = heapgoalsizebytes;
 
+    luaM_rearmmemcatlimits(L);
+
 #ifdef LUAI_GCMETRICS
     finishGcCycleMetrics(g);
 #endif
 }
 
+// barriers can run in the middle of a table update where lookups would miss entries, so objects they mark are only recorded
+static void barriermark(global_State* g, GCObject* v)
+{
+    uint8_t weakrecord = g->weakrecord;
+
+    g->weakrecord = weakrecord ? 2 : 0;
+    reallymarkobject(g, v);
+    g->weakrecord = weakrecord;
+}
+
 void luaC_barrierf(lua_State* L, GCObject* o, GCObject* v)
 {
     global_State* g = L->global;
     LUAU_ASSERT(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o));
-    LUAU_ASSERT(g->gcstate != GCSpause);
+    LUAU_ASSERT(g->gcstate != GCSpause || g->gcsticky);
     // must keep invariant?
-    if (keepinvariant(g))
-        reallymarkobject(g, v); // restore invariant
-    else                        // don't mind
-        makewhite(g, o);        // mark as white just to avoid other barriers
+    if (keepgeninvariant(g))
+        barriermark(g, v); // restore invariant
+    else if (!g->sweepjob) // don't mind
+        makewhite(g, o);   // mark as white just to avoid other barriers
 }
 
 void luaC_barriertable(lua_State* L, Table* t, GCObject* v)
@@ -1164,12 +1762,25 @@ void luaC_barriertable(lua_State* L, Table* t, GCObject* v)
     if (g->gcstate == GCSpropagateagain)
     {
         LUAU_ASSERT(isblack(o) && iswhite(v) && !isdead(g, v) && !isdead(g, o));
-        reallymarkobject(g, v);
+        barriermark(g, v);
         return;
     }
 
     LUAU_ASSERT(isblack(o) && !isdead(g, o));
-    LUAU_ASSERT(g->gcstate != GCSpause);
+    LUAU_ASSERT(g->gcstate != GCSpause || g->gcsticky);
+
+    // tables with weak keys stay black in the weak list until they are cleared, so new references are marked instead
+    if (testbit(o->gch.marked, WEAKKEYBIT))
+    {
+        if (keepgeninvariant(g))
+            barriermark(g, v);
+        return;
+    }
+
+    // black objects can be in pages owned by the background sweep, which reads their headers; the object stays black until swept
+    if (g->sweepjob)
+        return;
+
     black2gray(o); // make table gray (again)
     t->gclist = g->grayagain;
     g->grayagain = o;
@@ -1179,13 +1790,45 @@ void luaC_barrierback(lua_State* L, GCObject* o, GCObject** gclist)
 {
     global_State* g = L->global;
     LUAU_ASSERT(isblack(o) && !isdead(g, o));
-    LUAU_ASSERT(g->gcstate != GCSpause);
+    LUAU_ASSERT(g->gcstate != GCSpause || g->gcsticky);
+
+    // tables with weak keys are already in the weak list; as a gray table, it is visited again by the next pass or by atomic
+    if (o->gch.tt == LUA_TTABLE && testbit(o->gch.marked, WEAKKEYBIT))
+    {
+        if (keepgeninvariant(g))
+            black2gray(o);
+        return;
+    }
+
+    // see luaC_barriertable
+    if (g->sweepjob)
+        return;
 
     black2gray(o); // make object gray (again)
     *gclist = g->grayagain;
     g->grayagain = o;
 }
 
+// remove entries with dead keys from a table that hasn't been cleared after atomic yet, before its keys can be observed
+void luaC_clearweak(lua_State* L, Table* h)
+{
+    global_State* g = L->global;
+    LUAU_ASSERT(g->gcstate == GCSclearweak && testbit(h->marked, WEAKKEYBIT));
+
+    GCObject** p = &g->weak;
+    while (*p != obj2gco(h))
+        p = &gco2h(*p)->gclist;
+
+    *p = h->gclist;
+
+    // the table at the front of the list might be partially cleared
+    if (p == &g->weak)
+        g->weaknode = NULL;
+
+    clearweaknodes(g, h, 0, sizenode(h));
+    finishweak(L, h, /* shrink= */ 0);
+}
+
 void luaC_upvalclosed(lua_State* L, UpVal* uv)
 {
     global_State* g = L->global;
@@ -1195,12 +1838,12 @@ void luaC_upvalclosed(lua_State* L, UpVal* uv)
 
     if (isgray(o))
     {
-        if (keepinvariant(g))
+        if (keepgeninvariant(g))
         {
             gray2black(o); // closed upvalues need barrier
             luaC_barrier(L, uv, uv->v);
         }
-        else
+        else if (!g->sweepjob)
         { // sweep phase: sweep it (turning it into white)
             makewhite(g, o);
             LUAU_ASSERT(g->gcstate != GCSpause);
@@ -1250,6 +1893,9 @@ const char* luaC_statename(int state)
     case GCSatomic:
         return "atomic";
 
+    case GCSclearweak:
+        return "clearweak";
+
     case GCSsweep:
         return "sweep";
 
@@ -9,9 +9,16 @@
 /*
 ** Default settings for GC tunables (settable via lua_gc)
 */
-#define LUAI_GCGOAL 200    // 200% (allow heap to double compared to live heap size)
-#define LUAI_GCSTEPMUL 200 // GC runs 'twice the speed' of memory allocation
-#define LUAI_GCSTEPSIZE 1  // GC runs every KB of memory allocation
+#define LUAI_GCGOAL 200      // 200% (allow heap to double compared to live heap size)
+#define LUAI_GCSTEPMUL 200   // GC runs 'twice the speed' of memory allocation
+#define LUAI_GCSTEPSIZE 1    // GC runs every KB of memory allocation
+#define LUAI_GCPAGECACHE 16  // keep up to 16 empty pages (~256 KB) around for reuse
+
+/*
+** Default settings for generational mode (settable via lua_gc)
+*/
+#define LUAI_GCGENMINORMUL 20  // minor collection starts after the heap grows by 20% since the last collection
+#define LUAI_GCGENMAJORMUL 100 // major collection happens when the old generation doubles since the last major collection
 
 /*
 ** Possible states of the Garbage Collector
@@ -20,7 +27,8 @@
 #define GCSpropagate 1
 #define GCSpropagateagain 2
 #define GCSatomic 3
-#define GCSsweep 4
+#define GCSclearweak 4
+#define GCSsweep 5
 
 /*
 ** macro to tell when main invariant (white objects cannot point to black
@@ -31,6 +39,12 @@
 */
 #define keepinvariant(g) ((g)->gcstate == GCSpropagate || (g)->gcstate == GCSpropagateagain || (g)->gcstate == GCSatomic)
 
+/*
+** in generational mode, objects that survived a mark phase stay black (old) after the sweep, so the invariant must be kept outside
+** of the mark phase as well: barriers record old objects that point to new (white) ones so that minor collections can find them.
+*/
+#define keepgeninvariant(g) (keepinvariant(g) || (g)->gcsticky)
+
 /*
 ** some useful bit tricks
 */
@@ -52,12 +66,18 @@
 ** bit 1 - object is white (type 1)
 ** bit 2 - object is black
 ** bit 3 - object is fixed (should not be collected)
+** bit 4 - table is referenced by a namecall cache (see luaH_watch)
+** bit 5 - table has weak keys and is in the `weak' list, where it stays black (see traversetable)
+** bit 6 - object is an unmarked key of a table with weak keys that was traversed; it is recorded when marked (see recordweakkey)
 */
 
 #define WHITE0BIT 0
 #define WHITE1BIT 1
 #define BLACKBIT 2
 #define FIXEDBIT 3
+#define WATCHEDBIT 4
+#define WEAKKEYBIT 5
+#define EPHEMERONKEYBIT 6
 #define WHITEBITS bit2mask(WHITE0BIT, WHITE1BIT)
 
 #define iswhite(x) test2bits((x)->gch.marked, WHITE0BIT, WHITE1BIT)
@@ -117,6 +137,13 @@
             luaC_barrierback(L, obj2gco(L), &L->gclist); \
     } while(0)
 
+// tables with weak keys are cleared incrementally after the mark; code that can observe their keys has to finish the table first
+#define luaC_checkweak(L, h) \
+    do { \
+        if (testbit((h)->marked, WEAKKEYBIT) && (L)->global->gcstate == GCSclearweak) \
+            luaC_clearweak(L, h); \
+    } while(0)
+
 #define luaC_init(L, o, tt_) \
     do { \
         o->marked = luaC_white(L->global); \
@@ -132,7 +159,17 @@ LUAI_FUNC void luaC_upvalclosed(lua_State* L, UpVal* uv);
 LUAI_FUNC void luaC_barrierf(lua_State* L, GCObject* o, GCObject* v);
 LUAI_FUNC void luaC_barriertable(lua_State* L, Table* t, GCObject* v);
 LUAI_FUNC void luaC_barrierback(lua_State* L, GCObject* o, GCObject** gclist);
+LUAI_FUNC void luaC_clearweak(lua_State* L, Table* h);
 LUAI_FUNC void luaC_validate(lua_State* L);
 LUAI_FUNC void luaC_dump(lua_State* L, void* file, const char* (*categoryName)(lua_State* L, uint8_t memcat));
+LUAI_FUNC void luaC_dumpsnapshot(lua_State* L, lua_SnapshotWriter writer, void* ud, const char* (*categoryName)(lua_State* L, uint8_t memcat));
 LUAI_FUNC int64_t luaC_allocationrate(lua_State* L);
 LUAI_FUNC const char* luaC_statename(int state);
+
+typedef struct lua_SweepWorker lua_SweepWorker;
+
+LUAI_FUNC int luaC_setbgsweep(lua_State* L, int enabled);
+LUAI_FUNC void luaC_bgsweeppost(lua_State* L, struct lua_Page* first);
+LUAI_FUNC int luaC_bgsweeppage(lua_State* L, struct lua_Page* page);
+LUAI_FUNC void luaC_bgsweepcancel(lua_State* L);
+LUAI_FUNC void luaC_bgsweepwait(lua_State* L);
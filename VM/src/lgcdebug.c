@@ -2,6 +2,7 @@
 // This code is based on Lua 5.x implementation licensed under MIT License; see lua_LICENSE.txt for details
 #include "lgc.h"
 
+#include "ldo.h"
 #include "lfunc.h"
 #include "lmem.h"
 #include "lobject.h"
@@ -9,6 +10,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "ludata.h"
+#include "lvm.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -30,7 +32,7 @@ static void validateobjref(global_State* g, GCObject* f, GCObject* t)
 {
     LUAU_ASSERT(!isdead(g, t));
 
-    if (keepinvariant(g))
+    if (keepgeninvariant(g))
     {
         // basic incremental invariant: black can't point to white
         LUAU_ASSERT(!(isblack(f) && iswhite(t)));
@@ -58,12 +60,51 @@ static void validatetable(global_State* g, Table* h)
     for (int i = 0; i < h->sizearray; ++i)
         validateref(g, obj2gco(h), &h->array[i]);
 
+    if (ispacked(h))
+    {
+        LUAU_ASSERT(h->numbers->size <= h->numbers->capacity);
+
+        // keys up to the capacity of the packed array part (plus one to keep the boundary) can't be in the hash part, even as removed entries
+        for (int i = 0; i < sizenode; ++i)
+        {
+            LuaNode* n = &h->node[i];
+            LUAU_ASSERT(!ttisnumber(gkey(n)) || nvalue(gkey(n)) < 1 || nvalue(gkey(n)) > h->numbers->capacity + 1);
+        }
+    }
+
+    if (isshaped(h))
+    {
+        TableShape* shape = gfields(h)->shape;
+
+        LUAU_ASSERT(h->node == &luaH_dummynode && h->sizearray == 0);
+        LUAU_ASSERT(shape->nfields <= gfields(h)->size && shape->refs > 0);
+        LUAU_ASSERT(shape->nfields == 0 || (shape->keys->refs > 0 && shape->nfields <= shape->keys->size));
+
+        for (int i = 0; i < shape->nfields; ++i)
+        {
+            if (!ttisnil(gfield(h, i)))
+            {
+                validateobjref(g, obj2gco(h), obj2gco(gshapekey(shape, i)));
+                validateref(g, obj2gco(h), gfield(h, i));
+            }
+        }
+    }
+
     for (int i = 0; i < sizenode; ++i)
     {
         LuaNode* n = &h->node[i];
 
         LUAU_ASSERT(ttype(gkey(n)) != LUA_TDEADKEY || ttisnil(gval(n)));
-        LUAU_ASSERT(i + gnext(n) >= 0 && i + gnext(n) < sizenode);
+#if LUA_TABLE_CONTROLBYTES
+        if (hasctrl(h))
+        {
+            // nodes are occupied until the table is resized, and gnext only tells that the node is occupied
+            LUAU_ASSERT(gnext(n) == !ttisnil(gkey(n)));
+            LUAU_ASSERT((gctrl(h)[i] == LUAH_CTRLEMPTY) == ttisnil(gkey(n)));
+        }
+        else
+#endif
+            LUAU_ASSERT(i + gnext(n) >= 0 && i + gnext(n) < sizenode);
 
         if (!ttisnil(gval(n)))
         {
@@ -71,6 +112,17 @@ static void validatetable(global_State* g, Table* h)
             k.tt = gkey(n)->tt;
             k.value = gkey(n)->value;
 
+            // ephemerons in the weak list are black, but only keep values of alive keys marked; dead keys are removed after atomic
+            if (testbit(h->marked, WEAKKEYBIT))
+            {
+                if (!iscollectable(&k) || !isdead(g, gcvalue(&k)))
+                {
+                    LUAU_ASSERT(!iscollectable(&k) || ttype(&k) == gcvalue(&k)->gch.tt);
+                    LUAU_ASSERT(!iscollectable(gval(n)) || !isdead(g, gcvalue(gval(n))));
+                }
+                continue;
+            }
+
             validateref(g, obj2gco(h), &k);
             validateref(g, obj2gco(h), gval(n));
         }
@@ -132,6 +184,12 @@ static void validateproto(global_State* g, Proto* f)
     if (f->debugname)
         validateobjref(g, obj2gco(f), obj2gco(f->debugname));
 
+    if (f->chunk)
+    {
+        validateobjref(g, obj2gco(f), obj2gco(f->chunk->env));
+        validateobjref(g, obj2gco(f), obj2gco(f->chunk->gt));
+    }
+
     for (int i = 0; i < f->sizek; ++i)
         validateref(g, obj2gco(f), &f->k[i]);
 
@@ -148,18 +206,31 @@ static void validateproto(global_State* g, Proto* f)
             validateobjref(g, obj2gco(f), obj2gco(f->locvars[i].varname));
 }
 
+static void validateslice(global_State* g, TString* ts)
+{
+    TString* parent = gslice(ts)->parent;
+
+    validateobjref(g, obj2gco(ts), obj2gco(parent));
+
+    // slices reference a zero-terminated suffix of a string that owns its data
+    LUAU_ASSERT(!parent->slice);
+    LUAU_ASSERT(gslice(ts)->data >= parent->data && gslice(ts)->data + ts->len == parent->data + parent->len);
+}
+
 static void validateobj(global_State* g, GCObject* o)
 {
-    // dead objects can only occur during sweep
+    // dead objects can only occur after atomic
     if (isdead(g, o))
     {
-        LUAU_ASSERT(g->gcstate == GCSsweep);
+        LUAU_ASSERT(g->gcstate == GCSclearweak || g->gcstate == GCSsweep);
         return;
     }
 
     switch (o->gch.tt)
     {
     case LUA_TSTRING:
+        if (gco2ts(o)->slice)
+            validateslice(g, gco2ts(o));
         break;
 
     case LUA_TTABLE:
@@ -194,7 +265,7 @@ static void validateobj(global_State* g, GCObject* o)
 
 static void validategraylist(global_State* g, GCObject* o)
 {
-    if (!keepinvariant(g))
+    if (!keepgeninvariant(g))
         return;
 
     while (o)
@@ -222,6 +293,24 @@ static void validategraylist(global_State* g, GCObject* o)
     }
 }
 
+static void validateweaklist(global_State* g, GCObject* o)
+{
+    while (o)
+    {
+        LUAU_ASSERT(o->gch.tt == LUA_TTABLE);
+
+        // tables with weak keys are black unless a backward barrier made them gray, other weak tables are gray until they are cleared
+        if (keepgeninvariant(g) && !testbit(o->gch.marked, WEAKKEYBIT))
+            LUAU_ASSERT(isgray(o));
+
+        // after atomic, only tables with weak keys are left
+        if (g->gcstate == GCSclearweak)
+            LUAU_ASSERT(testbit(o->gch.marked, WEAKKEYBIT) && !isdead(g, o));
+
+        o = gco2h(o)->gclist;
+    }
+}
+
 static int validategco(void* context, lua_Page* page, GCObject* gco)
 {
     lua_State* L = (lua_State*)context;
@@ -235,6 +324,10 @@ void luaC_validate(lua_State* L)
 {
     global_State* g = L->global;
 
+    // pages owned by the background sweep can be visited once the helper is done with them; picking up the results would change the
+    // heap size that the caller might have just checked against the GC threshold
+    luaC_bgsweepwait(L);
+
     LUAU_ASSERT(!isdead(g, obj2gco(g->mainthread)));
     checkliveness(g, &g->registry);
 
@@ -242,7 +335,7 @@ void luaC_validate(lua_State* L)
         if (g->mt[i])
             LUAU_ASSERT(!isdead(g, obj2gco(g->mt[i])));
 
-    validategraylist(g, g->weak);
+    validateweaklist(g, g->weak);
     validategraylist(g, g->gray);
     validategraylist(g, g->grayagain);
 
@@ -294,14 +387,27 @@ static void dumpstringdata(FILE* f, const char* data, size_t len)
 
 static void dumpstring(FILE* f, TString* ts)
 {
-    fprintf(f, "{\"type\":\"string\",\"cat\":%d,\"size\":%d,\"data\":\"", ts->memcat, (int)(sizestring(ts->len)));
-    dumpstringdata(f, ts->data, ts->len);
-    fprintf(f, "\"}");
+    fprintf(f, "{\"type\":\"string\",\"cat\":%d,\"size\":%d,\"data\":\"", ts->memcat, (int)(sizetstring(ts)));
+    dumpstringdata(f, getstr(ts), ts->len);
+    fprintf(f, "\"");
+
+    if (ts->slice)
+    {
+        fprintf(f, ",\"parent\":");
+        dumpref(f, obj2gco(gslice(ts)->parent));
+    }
+    fprintf(f, "}");
+}
+
+static size_t tablesize(Table* h)
+{
+    return sizeof(Table) + (h->node == &luaH_dummynode ? 0 : sizenodebytes(h->lsizenode)) + h->sizearray * sizeof(TValue) +
+           (isshaped(h) ? sizefields(gfields(h)->size) : 0) + (ispacked(h) ? sizenumbers(h->numbers->capacity) : 0);
 }
 
 static void dumptable(FILE* f, Table* h)
 {
-    size_t size = sizeof(Table) + (h->node == &luaH_dummynode ? 0 : sizenode(h) * sizeof(LuaNode)) + h->sizearray * sizeof(TValue);
+    size_t size = tablesize(h);
 
     fprintf(f, "{\"type\":\"table\",\"cat\":%d,\"size\":%d", h->memcat, (int)(size));
 
@@ -337,6 +443,34 @@ static void dumptable(FILE* f, Table* h)
 
         fprintf(f, "]");
     }
+    if (isshaped(h))
+    {
+        fprintf(f, ",\"pairs\":[");
+
+        int first = 1;
+
+        for (int i = 0; i < gfields(h)->shape->nfields; ++i)
+        {
+            const TValue* v = gfield(h, i);
+
+            if (!ttisnil(v))
+            {
+                if (!first)
+                    fputc(',', f);
+                first = 0;
+
+                dumpref(f, obj2gco(gshapekey(gfields(h)->shape, i)));
+                fputc(',', f);
+
+                if (iscollectable(v))
+                    dumpref(f, gcvalue(v));
+                else
+                    fprintf(f, "null");
+            }
+        }
+
+        fprintf(f, "]");
+    }
     if (h->sizearray)
     {
         fprintf(f, ",\"array\":[");
@@ -424,7 +558,7 @@ static void dumpthread(FILE* f, lua_State* th)
         Proto* p = tcl->l.p;
 
         fprintf(f, ",\"source\":\"");
-        dumpstringdata(f, p->source->data, p->source->len);
+        dumpstringdata(f, getstr(p->source), p->source->len);
         fprintf(f, "\",\"line\":%d", p->linedefined);
     }
 
@@ -463,7 +597,7 @@ static void dumpthread(FILE* f, lua_State* th)
                     Proto* p = cl->l.p;
                     fprintf(f, "\"frame:");
                     if (p->source)
-                        dumpstringdata(f, p->source->data, p->source->len);
+                        dumpstringdata(f, getstr(p->source), p->source->len);
                     fprintf(f, ":%d:%s\"", p->linedefined, p->debugname ? getstr(p->debugname) : "");
                 }
             }
@@ -488,15 +622,14 @@ static void dumpthread(FILE* f, lua_State* th)
 
 static void dumpproto(FILE* f, Proto* p)
 {
-    size_t size = sizeof(Proto) + sizeof(Instruction) * p->sizecode + sizeof(Proto*) * p->sizep + sizeof(TValue) * p->sizek + p->sizelineinfo +
-                  sizeof(LocVar) * p->sizelocvars + sizeof(TString*) * p->sizeupvalues;
+    size_t size = sizeproto(p);
 
     fprintf(f, "{\"type\":\"proto\",\"cat\":%d,\"size\":%d", p->memcat, (int)(size));
 
     if (p->source)
     {
         fprintf(f, ",\"source\":\"");
-        dumpstringdata(f, p->source->data, p->source->len);
+        dumpstringdata(f, getstr(p->source), p->source->len);
         fprintf(f, "\",\"line\":%d", p->abslineinfo ? p->abslineinfo[0] : 0);
     }
 
@@ -583,6 +716,8 @@ void luaC_dump(lua_State* L, void* file, const char* (*categoryName)(lua_State*
     global_State* g = L->global;
     FILE* f = (FILE*)(file);
 
+    luaC_bgsweepwait(L);
+
     fprintf(f, "{\"objects\":{\n");
 
     dumpgco(f, NULL, obj2gco(g->mainthread));
@@ -617,6 +752,401 @@ void luaC_dump(lua_State* L, void* file, const char* (*categoryName)(lua_State*
     fprintf(f, "}}\n");
 }
 
+/*
+ * Binary heap snapshot is a compact alternative to luaC_dump for large heaps. It is written as a stream of records through a writer
+ * callback, and doesn't allocate GC memory. Type and memcat are stored as bytes, all other integers are LEB128 varints; signed values
+ * use zigzag encoding.
+ *
+ * The stream starts with the magic "LHS1", followed by records that start with a record kind byte:
+ *
+ * - object: id delta, type, memcat, size, edge count, edge deltas, [name]
+ *   object id is the address of the object; it's encoded as a delta from the previous object id, and edges are encoded as deltas from
+ *   the id of the object that refers to them. If the type byte has the top bit set, the object has a name: for prototypes this is
+ *   "source:line", followed by the function name if it has one; for C functions it's the debug name.
+ * - root: id, name
+ * - category: memcat, size in bytes, name
+ * - end
+ */
+
+#define SNAPSHOT_BUFFER 4096
+
+enum SnapshotRecord
+{
+    SnapshotEnd = 0,
+    SnapshotObject = 1,
+    SnapshotRoot = 2,
+    SnapshotCategory = 3,
+};
+
+typedef struct SnapshotState
+{
+    lua_State* L;
+    lua_SnapshotWriter writer;
+    void* ud;
+    const char* (*categoryName)(lua_State* L, uint8_t memcat);
+
+    uintptr_t lastid; // id of the last object record, for delta encoding
+    uintptr_t id;     // id of the current object, for delta encoding of its edges
+
+    int counting; // edge visitor only counts the edges without writing them out
+    size_t edges;
+
+    size_t pos;
+    uint8_t buffer[SNAPSHOT_BUFFER];
+} SnapshotState;
+
+static void snapflush(SnapshotState* s)
+{
+    if (s->pos)
+        s->writer(s->ud, s->buffer, s->pos);
+    s->pos = 0;
+}
+
+static void snapbytes(SnapshotState* s, const void* data, size_t size)
+{
+    if (s->pos + size > SNAPSHOT_BUFFER)
+    {
+        snapflush(s);
+
+        // large blobs bypass the buffer
+        if (size > SNAPSHOT_BUFFER)
+        {
+            s->writer(s->ud, data, size);
+            return;
+        }
+    }
+
+    memcpy(s->buffer + s->pos, data, size);
+    s->pos += size;
+}
+
+static void snapbyte(SnapshotState* s, uint8_t value)
+{
+    if (s->pos == SNAPSHOT_BUFFER)
+        snapflush(s);
+
+    s->buffer[s->pos++] = value;
+}
+
+static void snapvarint(SnapshotState* s, uint64_t value)
+{
+    do
+    {
+        uint8_t byte = value & 127;
+        value >>= 7;
+        snapbyte(s, byte | (value ? 128 : 0));
+    } while (value);
+}
+
+static void snapdelta(SnapshotState* s, uintptr_t value, uintptr_t base)
+{
+    int64_t delta = (int64_t)(value - base);
+    snapvarint(s, ((uint64_t)(delta) << 1) ^ (uint64_t)(delta >> 63));
+}
+
+static void snapstring(SnapshotState* s, const char* data, size_t len)
+{
+    snapvarint(s, len);
+    snapbytes(s, data, len);
+}
+
+static void snapedge(SnapshotState* s, GCObject* o)
+{
+    if (s->counting)
+        s->edges++;
+    else
+        snapdelta(s, (uintptr_t)o, s->id);
+}
+
+static void snapedges(SnapshotState* s, TValue* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        if (iscollectable(&data[i]))
+            snapedge(s, gcvalue(&data[i]));
+}
+
+static size_t snapobjedges(SnapshotState* s, GCObject* o)
+{
+    s->edges = 0;
+
+    switch (o->gch.tt)
+    {
+    case LUA_TSTRING:
+        if (gco2ts(o)->slice)
+            snapedge(s, obj2gco(gslice(gco2ts(o))->parent));
+        break;
+
+    case LUA_TTABLE:
+    {
+        Table* h = gco2h(o);
+
+        if (h->node != &luaH_dummynode)
+        {
+            for (int i = 0; i < sizenode(h); ++i)
+            {
+                LuaNode* n = &h->node[i];
+
+                if (!ttisnil(&n->val))
+                {
+                    if (iscollectable(&n->key))
+                        snapedge(s, gcvalue(&n->key));
+                    if (iscollectable(&n->val))
+                        snapedge(s, gcvalue(&n->val));
+                }
+            }
+        }
+
+        if (isshaped(h))
+        {
+            for (int i = 0; i < gfields(h)->shape->nfields; ++i)
+            {
+                if (!ttisnil(gfield(h, i)))
+                {
+                    snapedge(s, obj2gco(gshapekey(gfields(h)->shape, i)));
+                    if (iscollectable(gfield(h, i)))
+                        snapedge(s, gcvalue(gfield(h, i)));
+                }
+            }
+        }
+
+        snapedges(s, h->array, h->sizearray);
+
+        if (h->metatable)
+            snapedge(s, obj2gco(h->metatable));
+        break;
+    }
+
+    case LUA_TFUNCTION:
+    {
+        Closure* cl = gco2cl(o);
+
+        snapedge(s, obj2gco(cl->env));
+
+        if (cl->isC)
+        {
+            snapedges(s, cl->c.upvals, cl->nupvalues);
+        }
+        else
+        {
+            snapedge(s, obj2gco(cl->l.p));
+            snapedges(s, cl->l.uprefs, cl->nupvalues);
+        }
+        break;
+    }
+
+    case LUA_TUSERDATA:
+    {
+        Udata* u = gco2u(o);
+
+        if (u->metatable)
+            snapedge(s, obj2gco(u->metatable));
+        break;
+    }
+
+    case LUA_TTHREAD:
+    {
+        lua_State* th = gco2th(o);
+
+        snapedge(s, obj2gco(th->gt));
+        snapedges(s, th->stack, th->top - th->stack);
+        break;
+    }
+
+    case LUA_TPROTO:
+    {
+        Proto* p = gco2p(o);
+
+        snapedges(s, p->k, p->sizek);
+
+        if (p->chunk)
+        {
+            snapedge(s, obj2gco(p->chunk->env));
+            snapedge(s, obj2gco(p->chunk->gt));
+        }
+
+        for (int i = 0; i < p->sizep; ++i)
+            snapedge(s, obj2gco(p->p[i]));
+        break;
+    }
+
+    case LUA_TUPVAL:
+    {
+        UpVal* uv = gco2uv(o);
+
+        if (iscollectable(uv->v))
+            snapedge(s, gcvalue(uv->v));
+        break;
+    }
+
+    default:
+        LUAU_ASSERT(0);
+    }
+
+    return s->edges;
+}
+
+static size_t snapobjsize(GCObject* o)
+{
+    switch (o->gch.tt)
+    {
+    case LUA_TSTRING:
+        return sizetstring(gco2ts(o));
+
+    case LUA_TTABLE:
+        return tablesize(gco2h(o));
+
+    case LUA_TFUNCTION:
+    {
+        Closure* cl = gco2cl(o);
+        return cl->isC ? sizeCclosure(cl->nupvalues) : sizeLclosure(cl->nupvalues);
+    }
+
+    case LUA_TUSERDATA:
+        return sizeudata(gco2u(o)->len);
+
+    case LUA_TTHREAD:
+    {
+        lua_State* th = gco2th(o);
+        return sizeof(lua_State) + sizeof(TValue) * th->stacksize + sizeof(CallInfo) * th->size_ci;
+    }
+
+    case LUA_TPROTO:
+    {
+        Proto* p = gco2p(o);
+        return sizeproto(p);
+    }
+
+    case LUA_TUPVAL:
+        return sizeof(UpVal);
+
+    default:
+        LUAU_ASSERT(0);
+        return 0;
+    }
+}
+
+static void snapobjname(SnapshotState* s, GCObject* o)
+{
+    if (o->gch.tt == LUA_TPROTO)
+    {
+        Proto* p = gco2p(o);
+
+        char name[LUA_IDSIZE + 64];
+        const char* source = p->source ? getstr(p->source) : "";
+        if (p->debugname)
+            snprintf(name, sizeof(name), "%s:%d %s", source, p->linedefined, getstr(p->debugname));
+        else
+            snprintf(name, sizeof(name), "%s:%d", source, p->linedefined);
+
+        snapstring(s, name, strlen(name));
+    }
+    else
+    {
+        Closure* cl = gco2cl(o);
+        LUAU_ASSERT(cl->isC && cl->c.debugname);
+
+        snapstring(s, cl->c.debugname, strlen(cl->c.debugname));
+    }
+}
+
+static int snapgco(void* context, lua_Page* page, GCObject* gco)
+{
+    SnapshotState* s = (SnapshotState*)context;
+
+    int named = gco->gch.tt == LUA_TPROTO || (gco->gch.tt == LUA_TFUNCTION && gco2cl(gco)->isC && gco2cl(gco)->c.debugname);
+
+    snapbyte(s, SnapshotObject);
+    snapdelta(s, (uintptr_t)gco, s->lastid);
+    snapbyte(s, cast_byte(gco->gch.tt | (named ? 128 : 0)));
+    snapbyte(s, gco->gch.memcat);
+    snapvarint(s, snapobjsize(gco));
+
+    s->lastid = (uintptr_t)gco;
+    s->id = (uintptr_t)gco;
+
+    // edges are written after the count, so we need to walk the object twice; this avoids buffering edges of large tables
+    s->counting = 1;
+    snapvarint(s, snapobjedges(s, gco));
+    s->counting = 0;
+    snapobjedges(s, gco);
+
+    if (named)
+        snapobjname(s, gco);
+
+    return 0;
+}
+
+static void snaproot(SnapshotState* s, const char* name, GCObject* o)
+{
+    snapbyte(s, SnapshotRoot);
+    snapvarint(s, (uintptr_t)o);
+    snapstring(s, name, strlen(name));
+}
+
+static void snapheap(lua_State* L, void* ud)
+{
+    SnapshotState* s = (SnapshotState*)ud;
+    global_State* g = L->global;
+
+    snapbytes(s, "LHS1", 4);
+
+    // main thread is not allocated in a GCO page
+    snapgco(s, NULL, obj2gco(g->mainthread));
+
+    luaM_visitgco(L, s, snapgco);
+
+    snaproot(s, "mainthread", obj2gco(g->mainthread));
+    snaproot(s, "registry", gcvalue(&g->registry));
+
+    for (int i = 0; i < LUA_MEMORY_CATEGORIES; i++)
+    {
+        size_t bytes = g->memcatbytes[i];
+
+        if (bytes)
+        {
+            const char* name = s->categoryName ? s->categoryName(L, (uint8_t)i) : NULL;
+
+            snapbyte(s, SnapshotCategory);
+            snapvarint(s, i);
+            snapvarint(s, bytes);
+            snapstring(s, name ? name : "", name ? strlen(name) : 0);
+        }
+    }
+
+    snapbyte(s, SnapshotEnd);
+    snapflush(s);
+}
+
+void luaC_dumpsnapshot(lua_State* L, lua_SnapshotWriter writer, void* ud, const char* (*categoryName)(lua_State* L, uint8_t memcat))
+{
+    global_State* g = L->global;
+
+    luaC_bgsweepwait(L);
+
+    // the buffer is fairly large, so we don't keep it on the stack; it's not attributed to any memory category to keep the stats intact
+    SnapshotState* s = (SnapshotState*)(*g->frealloc)(g->ud, NULL, 0, sizeof(SnapshotState));
+    if (!s)
+        luaD_throw(L, LUA_ERRMEM);
+
+    s->L = L;
+    s->writer = writer;
+    s->ud = ud;
+    s->categoryName = categoryName;
+    s->lastid = 0;
+    s->id = 0;
+    s->counting = 0;
+    s->edges = 0;
+    s->pos = 0;
+
+    // the writer is allowed to raise an error, which is propagated after the buffer is freed
+    int status = luaD_rawrunprotected(L, snapheap, s);
+
+    (*g->frealloc)(g->ud, s, sizeof(SnapshotState), 0);
+
+    if (status != 0)
+        luaD_throw(L, status);
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -0,0 +1,546 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+#include "lgc.h"
+
+#include "lfunc.h"
+#include "lmem.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "ltable.h"
+#include "ludata.h"
+
+#if LUA_BACKGROUND_SWEEP
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+#endif
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsign-conversion"
+#pragma clang diagnostic ignored "-Wcast-align"
+#endif
+
+/*
+ * Background sweeping moves part of the work of sweeping GCO pages to a helper thread.
+ *
+ * During GCSsweep, at the end of each sweep step the mutator hands a batch of pages that follow the sweep position to the helper
+ * (a "job"). Only pages without free blocks are handed off: they aren't in the size class free lists, so the mutator can't allocate
+ * new objects in them, and GCO blocks are only freed by the sweeper, so nothing else changes the page until the job is picked up.
+ * Pages with free blocks stay available for allocation and are swept inline.
+ *
+ * While the mutator runs application code, the helper visits every object in these pages and frees the dead objects that can be
+ * released without running any per-object logic: closures, closed upvalues, tables without a shape and userdata without a
+ * destructor. The blocks are linked into the free list of the page; storage of tables is freed by the mutator, which receives
+ * the list of these blocks with the result, since the block allocator isn't thread-safe. Objects that need finalization or that
+ * are referenced from other VM structures (strings in the string table, threads, prototypes) are left to the regular sweeper.
+ *
+ * When the sweep reaches a page that belongs to the job, the mutator picks up the result: it frees the table storage, updates the
+ * heap size and returns the page to the allocator. A page where every object was freed is released without visiting it; other pages
+ * are swept inline, which makes live objects white and frees the dead objects that the helper left behind.
+ *
+ * Until the job is picked up, the helper reads the headers of all objects in its pages, and writes to dead objects that it frees.
+ * The mutator never accesses dead objects, with the exception of dead strings that can be resurrected by the string table, which is
+ * why the helper doesn't look at strings beyond their type. Write barriers would change the color of live objects, so while a job
+ * is in flight, barriers leave black objects black (see `sweepjob` in luaC_barrierf and friends); during the sweep this is only an
+ * optimization, and such objects are made white when the sweep gets to them.
+ */
+
+#define GC_SWEEPJOBPAGES 16
+#define GC_SWEEPJOBSCAN 64
+#define GC_SWEEPJOBFREES 1024
+
+#if LUA_BACKGROUND_SWEEP
+
+typedef struct SweepPageResult
+{
+    size_t bytes;   // total size of objects freed by the helper
+    uint8_t memcat; // memory category of all objects freed by the helper
+    int firstfree;  // range of storage blocks in `frees' that belong to freed tables
+    int freecount;
+} SweepPageResult;
+
+typedef struct SweepStorage
+{
+    void* block;
+    size_t size;
+    uint8_t memcat;
+} SweepStorage;
+
+struct lua_SweepWorker
+{
+#ifdef _WIN32
+    HANDLE thread;
+    SRWLOCK lock;
+    CONDITION_VARIABLE cv;
+#else
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+#endif
+
+    int quit;
+    int busy; // job was posted and the helper didn't finish it yet; protected by lock
+    int done; // number of pages in the job that the helper finished; protected by lock
+
+    // job data is written by the mutator before the job is posted and read by the helper; results are written by the helper
+    int count;
+    int consumed; // only accessed by the mutator
+    int deadmask;
+    uint8_t dtors[LUA_UTAG_LIMIT]; // userdata tags that had a destructor when the job was posted
+    lua_Page* pages[GC_SWEEPJOBPAGES];
+    SweepPageResult results[GC_SWEEPJOBPAGES];
+
+    int freecount;
+    SweepStorage frees[GC_SWEEPJOBFREES];
+};
+
+static void workerlock(lua_SweepWorker* w)
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&w->lock);
+#else
+    pthread_mutex_lock(&w->lock);
+#endif
+}
+
+static void workerunlock(lua_SweepWorker* w)
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&w->lock);
+#else
+    pthread_mutex_unlock(&w->lock);
+#endif
+}
+
+static void workerwait(lua_SweepWorker* w)
+{
+#ifdef _WIN32
+    SleepConditionVariableSRW(&w->cv, &w->lock, INFINITE, 0);
+#else
+    pthread_cond_wait(&w->cv, &w->lock);
+#endif
+}
+
+static void workerwake(lua_SweepWorker* w)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(&w->cv);
+#else
+    pthread_cond_broadcast(&w->cv);
+#endif
+}
+
+static void addstorage(lua_SweepWorker* w, void* block, size_t size, uint8_t memcat)
+{
+    SweepStorage* f = &w->frees[w->freecount++];
+    f->block = block;
+    f->size = size;
+    f->memcat = memcat;
+}
+
+// returns the size of a dead object if the helper can free it, or 0 if it has to be freed by the mutator
+static size_t freeablesize(lua_SweepWorker* w, GCObject* o)
+{
+    switch (o->gch.tt)
+    {
+    case LUA_TFUNCTION:
+    {
+        Closure* cl = gco2cl(o);
+        return cl->isC ? sizeCclosure(cl->nupvalues) : sizeLclosure(cl->nupvalues);
+    }
+    case LUA_TUPVAL:
+    {
+        // dead upvalues are closed during the atomic phase
+        return sizeof(UpVal);
+    }
+    case LUA_TUSERDATA:
+    {
+        Udata* u = gco2u(o);
+        if (u->tag == UTAG_IDTOR || (u->tag < LUA_UTAG_LIMIT && w->dtors[u->tag]))
+            return 0;
+
+        return sizeudata(u->len);
+    }
+    case LUA_TTABLE:
+    {
+        Table* h = gco2h(o);
+
+        // shapes are shared between tables, so tables with a shape are freed by the mutator; so are tables that namecall caches refer to,
+        // since freeing them starts a new epoch (see luaH_watch)
+        if (isshaped(h) || testbit(h->marked, WATCHEDBIT))
+            return 0;
+
+        int storage = (h->node != &luaH_dummynode) + (h->array != NULL);
+        if (w->freecount + storage > GC_SWEEPJOBFREES)
+            return 0;
+
+        if (h->node != &luaH_dummynode)
+            addstorage(w, h->node, sizenodebytes(h->lsizenode), h->memcat);
+
+        if (ispacked(h))
+            addstorage(w, h->numbers, sizenumbers(h->numbers->capacity), h->memcat);
+        else if (h->array)
+            addstorage(w, h->array, h->sizearray * sizeof(TValue), h->memcat);
+
+        return sizeof(Table);
+    }
+    default:
+        return 0;
+    }
+}
+
+static void sweeppage(lua_SweepWorker* w, lua_Page* page, SweepPageResult* result)
+{
+    char* start;
+    char* end;
+    int busyBlocks;
+    int blockSize;
+    luaM_getpagewalkinfo(page, &start, &end, &busyBlocks, &blockSize);
+
+    result->bytes = 0;
+    result->memcat = 0;
+    result->firstfree = w->freecount;
+
+    int found = 0;
+
+    for (char* pos = start; pos != end; pos += blockSize)
+    {
+        GCObject* gco = (GCObject*)pos;
+
+        // skip memory blocks that are already freed
+        if (gco->gch.tt == LUA_TNIL)
+            continue;
+
+        // dead strings can be resurrected by the mutator, so their color can't be read here
+        if (gco->gch.tt == LUA_TSTRING)
+            continue;
+
+        // is the object alive? this matches the check in sweepgcopage
+        if ((gco->gch.marked ^ WHITEBITS) & w->deadmask)
+            continue;
+
+        // accounting is done per page so all objects that are freed here must share the memory category
+        if (found && gco->gch.memcat != result->memcat)
+            continue;
+
+        size_t size = freeablesize(w, gco);
+        if (size == 0)
+            continue;
+
+        result->memcat = gco->gch.memcat;
+        result->bytes += size;
+        found = 1;
+
+        luaM_releasegcoblock(page, gco);
+
+        if (--busyBlocks == 0)
+            break;
+    }
+
+    result->freecount = w->freecount - result->firstfree;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI workermain(LPVOID arg)
+#else
+static void* workermain(void* arg)
+#endif
+{
+    lua_SweepWorker* w = (lua_SweepWorker*)arg;
+
+    workerlock(w);
+
+    for (;;)
+    {
+        while (!w->busy && !w->quit)
+            workerwait(w);
+
+        if (w->quit)
+            break;
+
+        workerunlock(w);
+
+        for (int i = 0; i < w->count; ++i)
+        {
+            sweeppage(w, w->pages[i], &w->results[i]);
+
+            // the mutator can pick up each page as soon as it's done
+            workerlock(w);
+            w->done = i + 1;
+            workerwake(w);
+            workerunlock(w);
+        }
+
+        workerlock(w);
+
+        w->busy = 0;
+        workerwake(w);
+    }
+
+    workerunlock(w);
+
+    return 0;
+}
+
+static void waitjob(lua_SweepWorker* w)
+{
+    workerlock(w);
+
+    while (w->busy)
+        workerwait(w);
+
+    workerunlock(w);
+}
+
+static void waitpage(lua_SweepWorker* w, int index)
+{
+    workerlock(w);
+
+    while (w->done <= index)
+        workerwait(w);
+
+    workerunlock(w);
+}
+
+// apply the result of a page and return it to the allocator; returns 1 if the page was released
+static int finishpage(lua_State* L, lua_SweepWorker* w, int index)
+{
+    global_State* g = L->global;
+    SweepPageResult* result = &w->results[index];
+
+    for (int i = 0; i < result->freecount; ++i)
+    {
+        SweepStorage* f = &w->frees[result->firstfree + i];
+        luaM_free_(L, f->block, f->size, f->memcat);
+    }
+
+    g->gcstats.sweepbgbytes += result->bytes;
+
+    if (!luaM_returngcopage(L, w->pages[index], result->bytes, result->memcat))
+        return 0;
+
+    g->gcstats.sweepbgpages++;
+    return 1;
+}
+
+// finish the current job early, returning unvisited pages to the allocator; they are swept inline
+static void canceljob(lua_State* L, lua_SweepWorker* w)
+{
+    global_State* g = L->global;
+
+    if (w->consumed == w->count)
+        return;
+
+    waitjob(w);
+
+    for (int i = w->consumed; i < w->count; ++i)
+    {
+        lua_Page* page = w->pages[i];
+        lua_Page* next = luaM_getnextgcopage(page);
+
+        if (finishpage(L, w, i) && g->sweepgcopage == page)
+            g->sweepgcopage = next;
+    }
+
+    w->count = 0;
+    w->consumed = 0;
+    g->sweepjob = 0;
+}
+
+int luaC_setbgsweep(lua_State* L, int enabled)
+{
+    global_State* g = L->global;
+    lua_SweepWorker* w = g->sweepworker;
+
+    if ((w != NULL) == (enabled != 0))
+        return w != NULL;
+
+    if (w)
+    {
+        canceljob(L, w);
+
+        workerlock(w);
+        w->quit = 1;
+        workerwake(w);
+        workerunlock(w);
+
+#ifdef _WIN32
+        WaitForSingleObject(w->thread, INFINITE);
+        CloseHandle(w->thread);
+#else
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->cv);
+        pthread_mutex_destroy(&w->lock);
+#endif
+
+        g->sweepworker = NULL;
+        luaM_freearray(L, w, 1, lua_SweepWorker, 0);
+        return 1;
+    }
+
+    w = luaM_newarray(L, 1, lua_SweepWorker, 0);
+    w->quit = 0;
+    w->busy = 0;
+    w->done = 0;
+    w->count = 0;
+    w->consumed = 0;
+    w->deadmask = 0;
+    w->freecount = 0;
+
+#ifdef _WIN32
+    InitializeSRWLock(&w->lock);
+    InitializeConditionVariable(&w->cv);
+
+    w->thread = CreateThread(NULL, 0, workermain, w, 0, NULL);
+
+    if (!w->thread)
+    {
+        luaM_freearray(L, w, 1, lua_SweepWorker, 0);
+        return 0;
+    }
+#else
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cv, NULL);
+
+    if (pthread_create(&w->thread, NULL, workermain, w) != 0)
+    {
+        pthread_cond_destroy(&w->cv);
+        pthread_mutex_destroy(&w->lock);
+        luaM_freearray(L, w, 1, lua_SweepWorker, 0);
+        return 0;
+    }
+#endif
+
+    g->sweepworker = w;
+    return 0;
+}
+
+void luaC_bgsweeppost(lua_State* L, lua_Page* first)
+{
+    global_State* g = L->global;
+    lua_SweepWorker* w = g->sweepworker;
+
+    // only one job can be in flight at a time
+    if (!w || w->consumed != w->count)
+        return;
+
+    // in generational mode, barriers must record changes to old objects during the sweep
+    if (g->gcsticky)
+        return;
+
+    // the helper may still be leaving the previous job after its last page was picked up
+    waitjob(w);
+
+    int count = 0;
+    int scanned = 0;
+
+    for (lua_Page* page = first; page && count < GC_SWEEPJOBPAGES && scanned < GC_SWEEPJOBSCAN; page = luaM_getnextgcopage(page))
+    {
+        // pages with free blocks are left to the allocator
+        if (luaM_isfullgcopage(page))
+            w->pages[count++] = page;
+
+        scanned++;
+    }
+
+    if (count == 0)
+        return;
+
+    w->count = count;
+    w->consumed = 0;
+    w->deadmask = otherwhite(g);
+    w->freecount = 0;
+
+    for (int i = 0; i < LUA_UTAG_LIMIT; ++i)
+        w->dtors[i] = g->udatagc[i] != NULL;
+
+    g->sweepjob = 1;
+
+    workerlock(w);
+    w->busy = 1;
+    w->done = 0;
+    workerwake(w);
+    workerunlock(w);
+}
+
+int luaC_bgsweeppage(lua_State* L, lua_Page* page)
+{
+    global_State* g = L->global;
+    lua_SweepWorker* w = g->sweepworker;
+
+    if (!w || w->consumed == w->count || w->pages[w->consumed] != page)
+        return 0;
+
+    // the helper is usually done by the time sweep gets here, otherwise we have to wait for it since it owns the page
+    waitpage(w, w->consumed);
+
+    int released = finishpage(L, w, w->consumed++);
+
+    if (w->consumed == w->count)
+        g->sweepjob = 0;
+
+    return released;
+}
+
+void luaC_bgsweepcancel(lua_State* L)
+{
+    global_State* g = L->global;
+
+    if (g->sweepworker)
+        canceljob(L, g->sweepworker);
+}
+
+void luaC_bgsweepwait(lua_State* L)
+{
+    global_State* g = L->global;
+
+    // results stay in the job so that the heap size and page lists don't change
+    if (g->sweepworker)
+        waitjob(g->sweepworker);
+}
+
+#else
+
+int luaC_setbgsweep(lua_State* L, int enabled)
+{
+    (void)sizeof(L);
+    (void)sizeof(enabled);
+    return 0;
+}
+
+void luaC_bgsweeppost(lua_State* L, lua_Page* first)
+{
+    (void)sizeof(L);
+    (void)sizeof(first);
+}
+
+int luaC_bgsweeppage(lua_State* L, lua_Page* page)
+{
+    (void)sizeof(L);
+    (void)sizeof(page);
+    return 0;
+}
+
+void luaC_bgsweepcancel(lua_State* L)
+{
+    (void)sizeof(L);
+}
+
+void luaC_bgsweepwait(lua_State* L)
+{
+    (void)sizeof(L);
+}
+
+#endif
+
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
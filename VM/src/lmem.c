@@ -64,12 +64,20 @@
  * there is no global list for non-GCO pages since we never need to traverse them directly.
  *
  * In both cases, we pick the page by computing the size class from the block size which rounds the block
- * size up to reduce the chance that we'll allocate pages that have very few allocated blocks. The size
- * class strategy is determined by SizeClassConfig constructor.
+ * size up to reduce the chance that we'll allocate pages that have very few allocated blocks. The default
+ * size class strategy is determined by lua_setupmemsizeclassconfig; it can be replaced per state with
+ * lua_newstatewithsizeclasses, using a table derived from allocation histograms (see lua_setallochistogram and tools/sizeclasses.py).
  *
- * Note that when the last block in a page is freed, we immediately free the page with frealloc - the
- * memory manager doesn't currently attempt to keep unused memory around. This can result in excessive
- * allocation traffic and can be mitigated by adding a page cache in the future.
+ * When the last block in a page is freed, the page is returned to a small per-state page cache instead of
+ * being freed with frealloc right away (global_State::pagecache). Only pages of the standard page size are
+ * cached, so a cached page can be reused for any size class of either GCO or non-GCO allocations. The cache
+ * is bounded by a page count (see LUA_GCSETPAGECACHE) and is trimmed at the end of every GC cycle: pages that
+ * stayed in the cache during the entire cycle are released with frealloc. This avoids excessive allocation
+ * traffic when short-lived objects make pages flip between empty and used every cycle.
+ *
+ * Pages of the standard page size can also be allocated from an arena of large OS memory chunks instead of
+ * frealloc (see LUA_GCPAGEARENA and lmemarena.c); such pages are released back to the arena, which decommits the ones
+ * that stay free for an entire GC cycle.
  *
  * For both GCO and non-GCO pages, the per-page block allocation combines bump pointer style allocation
  * (lua_Page::freeNext) and per-page free list (lua_Page::freeList). We use the bump allocator to allocate
@@ -124,27 +132,41 @@ static_assert(offsetof(Udata, data) == ABISWITCH(16, 16, 12), "size mismatch for
 static_assert(sizeof(Table) == ABISWITCH(48, 32, 32), "size mismatch for table header");
 
 #define kSizeClasses ((size_t)LUA_SIZECLASSES)
-#define kMaxSmallSize ((size_t)512)
+#define kMaxSmallSize ((size_t)LUAI_MAXSMALLSIZE)
+#define kAllocHistogramSize (kMaxSmallSize + 2)
  // slightly under 16KB since that results in less fragmentation due to heap metadata
  #define kPageSize ((size_t)(16 * 1024 - 24))
 
 static const size_t kBlockHeader = sizeof(double) > sizeof(void*) ? sizeof(double) : sizeof(void*); // suitable for aligning double & void* on all platforms
 static const size_t kGCOLinkOffset = (sizeof(GCheader) + sizeof(void*) - 1) & ~(sizeof(void*) - 1); // GCO pages contain freelist links after the GC header
 
-static struct SizeClassConfig
+static SizeClassConfig kSizeClassConfig;
+
+static void buildsizeclassconfig(SizeClassConfig* config, const int* sizes, int count)
 {
-    int sizeOfClass[kSizeClasses];
-    int8_t classForSize[kMaxSmallSize + 1];
-    int classCount;
-} kSizeClassConfig;
+    memset(config->sizeOfClass, 0, sizeof(config->sizeOfClass));
+    memset(config->classForSize, -1, sizeof(config->classForSize));
+    config->classCount = count;
+
+    for (int klass = 0; klass < count; ++klass)
+        config->sizeOfClass[klass] = sizes[klass];
+
+    // fill the lookup table for all classes
+    for (int klass = 0; klass < count; ++klass)
+        config->classForSize[sizes[klass]] = (int8_t)(klass);
+
+    // fill the gaps in lookup table
+    for (int size = kMaxSmallSize - 1; size >= 0; --size)
+        if (config->classForSize[size] < 0)
+            config->classForSize[size] = config->classForSize[size + 1];
+}
 
 extern void lua_setupmemsizeclassconfig(void);
 
 void lua_setupmemsizeclassconfig(void)
 {
-    memset(kSizeClassConfig.sizeOfClass, 0, sizeof(kSizeClassConfig.sizeOfClass));
-    memset(kSizeClassConfig.classForSize, -1, sizeof(kSizeClassConfig.classForSize));
-    kSizeClassConfig.classCount = 0;
+    int sizes[kSizeClasses];
+    int count = 0;
 
     // we use a progressive size class scheme:
     // - all size classes are aligned by 8b to satisfy pointer alignment requirements
@@ -153,28 +175,102 @@ void lua_setupmemsizeclassconfig(void)
     // - after the second cutoff we allocate size classes in multiples of 32
     // this balances internal fragmentation vs external fragmentation
     for (int size = 8; size < 64; size += 8)
-        kSizeClassConfig.sizeOfClass[kSizeClassConfig.classCount++] = size;
+        sizes[count++] = size;
 
     for (int size = 64; size < 256; size += 16)
-        kSizeClassConfig.sizeOfClass[kSizeClassConfig.classCount++] = size;
+        sizes[count++] = size;
 
     for (int size = 256; size <= 512; size += 32)
-        kSizeClassConfig.sizeOfClass[kSizeClassConfig.classCount++] = size;
+        sizes[count++] = size;
 
-    LUAU_ASSERT((size_t)(kSizeClassConfig.classCount) <= kSizeClasses);
+    LUAU_ASSERT((size_t)(count) <= kSizeClasses);
+    LUAU_ASSERT(luaM_validsizeclasses(sizes, count));
 
-    // fill the lookup table for all classes
-    for (int klass = 0; klass < kSizeClassConfig.classCount; ++klass)
-        kSizeClassConfig.classForSize[kSizeClassConfig.sizeOfClass[klass]] = (int8_t)(klass);
+    buildsizeclassconfig(&kSizeClassConfig, sizes, count);
+}
 
-    // fill the gaps in lookup table
-    for (int size = kMaxSmallSize - 1; size >= 0; --size)
-        if (kSizeClassConfig.classForSize[size] < 0)
-            kSizeClassConfig.classForSize[size] = kSizeClassConfig.classForSize[size + 1];
+int luaM_validsizeclasses(const int* sizes, int count)
+{
+    if (count <= 0 || (size_t)(count) > kSizeClasses)
+        return 0;
+
+    for (int klass = 0; klass < count; ++klass)
+    {
+        // all classes must keep blocks aligned by 8b and be sorted so that the lookup table can be built
+        if (sizes[klass] <= 0 || sizes[klass] % 8 != 0 || (klass > 0 && sizes[klass] <= sizes[klass - 1]))
+            return 0;
+    }
+
+    // the largest class has to cover all small blocks
+    return (size_t)(sizes[count - 1]) == kMaxSmallSize;
+}
+
+void luaM_setsizeclasses(lua_State* L, const int* sizes, int count)
+{
+    global_State* g = L->global;
+
+    // size classes can't change after pages have been allocated
+    LUAU_ASSERT(g->allgcopages == NULL && g->pagecache == NULL);
+
+    if (sizes)
+    {
+        LUAU_ASSERT(luaM_validsizeclasses(sizes, count));
+        buildsizeclassconfig(&g->sizeclasses, sizes, count);
+    }
+    else
+    {
+        g->sizeclasses = kSizeClassConfig;
+    }
+}
+
+void luaM_setallochistogram(lua_State* L, int enabled)
+{
+    global_State* g = L->global;
+
+    if ((g->allochistogram != NULL) == (enabled != 0))
+        return;
+
+    // the histogram is allocated outside of the heap so that it doesn't show up in memory categories or in the histogram itself
+    if (enabled)
+    {
+        size_t* histogram = (size_t*)(*g->frealloc)(g->ud, NULL, 0, kAllocHistogramSize * sizeof(size_t));
+        if (!histogram)
+            luaD_throw(L, LUA_ERRMEM);
+
+        memset(histogram, 0, kAllocHistogramSize * sizeof(size_t));
+        g->allochistogram = histogram;
+    }
+    else
+    {
+        (*g->frealloc)(g->ud, g->allochistogram, kAllocHistogramSize * sizeof(size_t), 0);
+        g->allochistogram = NULL;
+    }
+}
+
+int luaM_getallochistogram(lua_State* L, size_t* counts, int count)
+{
+    global_State* g = L->global;
+
+    if (!g->allochistogram || count <= 0)
+        return 0;
+
+    size_t small = (size_t)(count - 1) < kAllocHistogramSize - 1 ? (size_t)(count - 1) : kAllocHistogramSize - 1;
+
+    for (size_t size = 0; size < small; ++size)
+        counts[size] = g->allochistogram[size];
+
+    // sizes that don't get their own entry are accumulated in the last one
+    size_t rest = 0;
+
+    for (size_t size = small; size < kAllocHistogramSize; ++size)
+        rest += g->allochistogram[size];
+
+    counts[small] = rest;
+    return (int)(small + 1);
 }
 
 // size class for a block of size sz; returns -1 for size=0 because empty allocations take no space
-#define sizeclass(sz) ((size_t)((sz)-1) < kMaxSmallSize ? kSizeClassConfig.classForSize[sz] : -1)
+#define sizeclass(g, sz) ((size_t)((sz)-1) < kMaxSmallSize ? (g)->sizeclasses.classForSize[sz] : -1)
 
 // metadata for a block is stored in the first pointer of the block
 #define metadata(block) (*(void**)(block))
@@ -217,7 +313,33 @@ static lua_Page* newpage(lua_State* L, lua_Page** gcopageset, int pageSize, int
 
     LUAU_ASSERT(pageSize - (int)(offsetof(lua_Page, data)) >= blockSize * blockCount);
 
-    lua_Page* page = (lua_Page*)(*g->frealloc)(g->ud, NULL, 0, pageSize);
+    lua_Page* page = NULL;
+
+    // fast path: reuse a page from the page cache
+    if ((size_t)pageSize == kPageSize)
+    {
+        if (g->pagecache)
+        {
+            page = g->pagecache;
+            g->pagecache = page->next;
+            g->pagecachesize--;
+            g->pagecachehits++;
+
+            if (g->pagecachesize < g->pagecachelowwater)
+                g->pagecachelowwater = g->pagecachesize;
+        }
+        else
+        {
+            g->pagecachemisses++;
+        }
+    }
+
+    if (!page && (size_t)pageSize == kPageSize)
+        page = (lua_Page*)luaM_newarenapage(L, pageSize);
+
+    if (!page)
+        page = (lua_Page*)(*g->frealloc)(g->ud, NULL, 0, pageSize);
+
     if (!page)
         luaD_throw(L, LUA_ERRMEM);
 
@@ -253,7 +375,9 @@ static lua_Page* newpage(lua_State* L, lua_Page** gcopageset, int pageSize, int
 
 static lua_Page* newclasspage(lua_State* L, lua_Page** freepageset, lua_Page** gcopageset, uint8_t sizeClass, int storeMetadata)
 {
-    size_t blockSize = kSizeClassConfig.sizeOfClass[sizeClass] + (storeMetadata ? kBlockHeader : 0);
+    global_State* g = L->global;
+
+    size_t blockSize = g->sizeclasses.sizeOfClass[sizeClass] + (storeMetadata ? kBlockHeader : 0);
     size_t blockCount = (kPageSize - offsetof(lua_Page, data)) / blockSize;
 
     lua_Page* page = newpage(L, gcopageset, kPageSize, (int)blockSize, (int)blockCount);
@@ -265,6 +389,17 @@ static lua_Page* newclasspage(lua_State* L, lua_Page** freepageset, lua_Page** g
     return page;
 }
 
+static void releasepage(lua_State* L, lua_Page* page, size_t pageSize)
+{
+    global_State* g = L->global;
+
+    // pages that were carved out of the arena go back to it
+    if (g->pagearena && luaM_freearenapage(L, page))
+        return;
+
+    (*g->frealloc)(g->ud, page, pageSize, 0);
+}
+
 static void freepage(lua_State* L, lua_Page** gcopageset, lua_Page* page)
 {
     global_State* g = L->global;
@@ -281,8 +416,63 @@ static void freepage(lua_State* L, lua_Page** gcopageset, lua_Page* page)
             *gcopageset = page->gcolistnext;
     }
 
+    // keep the page around for reuse if there's space left in the page cache
+    if ((size_t)page->pageSize == kPageSize && g->pagecachesize < g->pagecachelimit)
+    {
+        page->prev = NULL;
+        page->next = g->pagecache;
+        g->pagecache = page;
+        g->pagecachesize++;
+
+        ASAN_POISON_MEMORY_REGION(page->data, page->pageSize - offsetof(lua_Page, data));
+        return;
+    }
+
     // so long
-    (*g->frealloc)(g->ud, page, page->pageSize, 0);
+    releasepage(L, page, page->pageSize);
+}
+
+static void releasecachedpages(lua_State* L, int count)
+{
+    global_State* g = L->global;
+
+    while (count-- > 0 && g->pagecache)
+    {
+        lua_Page* page = g->pagecache;
+        g->pagecache = page->next;
+        g->pagecachesize--;
+
+        releasepage(L, page, kPageSize);
+    }
+}
+
+void luaM_trimpagecache(lua_State* L)
+{
+    global_State* g = L->global;
+
+    // pages that were not taken out of the cache since the last trim are not needed by the steady state workload
+    int unused = g->pagecachelowwater;
+
+    // the limit might have been lowered since the cache was filled
+    if (g->pagecachesize - unused > g->pagecachelimit)
+        unused = g->pagecachesize - g->pagecachelimit;
+
+    releasecachedpages(L, unused);
+
+    g->pagecachelowwater = g->pagecachesize;
+
+    luaM_trimpagearena(L, 0);
+}
+
+void luaM_freepagecache(lua_State* L)
+{
+    global_State* g = L->global;
+
+    releasecachedpages(L, g->pagecachesize);
+
+    g->pagecachelowwater = 0;
+
+    luaM_trimpagearena(L, 1);
 }
 
 static void freeclasspage(lua_State* L, lua_Page** freepageset, lua_Page** gcopageset, lua_Page* page, uint8_t sizeClass)
@@ -310,7 +500,7 @@ static void* newblock(lua_State* L, int sizeClass)
 
     LUAU_ASSERT(!page->prev);
     LUAU_ASSERT(page->freeList || page->freeNext >= 0);
-    LUAU_ASSERT((size_t)(page->blockSize) == kSizeClassConfig.sizeOfClass[sizeClass] + kBlockHeader);
+    LUAU_ASSERT((size_t)(page->blockSize) == g->sizeclasses.sizeOfClass[sizeClass] + kBlockHeader);
 
     void* block;
 
@@ -358,7 +548,7 @@ static void* newgcoblock(lua_State* L, int sizeClass)
 
     LUAU_ASSERT(!page->prev);
     LUAU_ASSERT(page->freeList || page->freeNext >= 0);
-    LUAU_ASSERT(page->blockSize == kSizeClassConfig.sizeOfClass[sizeClass]);
+    LUAU_ASSERT(page->blockSize == g->sizeclasses.sizeOfClass[sizeClass]);
 
     void* block;
 
@@ -402,7 +592,7 @@ static void freeblock(lua_State* L, int sizeClass, void* block)
 
     lua_Page* page = (lua_Page*)metadata(block);
     LUAU_ASSERT(page && page->busyBlocks > 0);
-    LUAU_ASSERT((size_t)(page->blockSize) == kSizeClassConfig.sizeOfClass[sizeClass] + kBlockHeader);
+    LUAU_ASSERT((size_t)(page->blockSize) == g->sizeclasses.sizeOfClass[sizeClass] + kBlockHeader);
     LUAU_ASSERT(block >= (void*)page->data && block < (void*)((char*)page + page->pageSize));
 
     // if the page wasn't in the page free list, it should be now since it got a block!
@@ -432,12 +622,12 @@ static void freeblock(lua_State* L, int sizeClass, void* block)
 
 static void freegcoblock(lua_State* L, int sizeClass, void* block, lua_Page* page)
 {
+    global_State* g = L->global;
+
     LUAU_ASSERT(page && page->busyBlocks > 0);
-    LUAU_ASSERT(page->blockSize == kSizeClassConfig.sizeOfClass[sizeClass]);
+    LUAU_ASSERT(page->blockSize == g->sizeclasses.sizeOfClass[sizeClass]);
     LUAU_ASSERT(block >= (void*)page->data && block < (void*)((char*)page + page->pageSize));
 
-    global_State* g = L->global;
-
     // if the page wasn't in the page free list, it should be now since it got a block!
     if (!page->freeList && page->freeNext < 0)
     {
@@ -463,11 +653,47 @@ static void freegcoblock(lua_State* L, int sizeClass, void* block, lua_Page* pag
         freeclasspage(L, g->freegcopages, &g->allgcopages, page, (uint8_t)sizeClass);
 }
 
+// slow path for allocations that go over the soft or the hard limit of the memory category
+static LUAU_NOINLINE void checkmemcatlimit(lua_State* L, size_t bytes, uint8_t memcat)
+{
+    global_State* g = L->global;
+
+    // in both cases, run the next collector step as soon as possible, unless collection is stopped
+    if (g->GCthreshold != SIZE_MAX && g->GCthreshold > g->totalbytes)
+        g->GCthreshold = g->totalbytes;
+
+    if (bytes > g->memcathardlimit[memcat])
+        luaD_throw(L, LUA_ERRMEM);
+
+    // soft limit was crossed; until the category gets back under it, only the hard limit needs to be checked
+    LUAU_ASSERT(bytes > g->memcatsoftlimit[memcat]);
+    g->memcatthreshold[memcat] = g->memcathardlimit[memcat];
+
+    if (g->cb.memcatlimit)
+        g->cb.memcatlimit(L, memcat, bytes);
+}
+
+#define checkmemcat(L, g, bytes, memcat) \
+    { \
+        if (LUAU_UNLIKELY((bytes) > (g)->memcatthreshold[memcat])) \
+            checkmemcatlimit(L, bytes, memcat); \
+    }
+
+// count the requested size in the allocation histogram, see lua_setallochistogram; the last bucket counts all large allocations
+#define recordallocation(g, size) \
+    { \
+        if (LUAU_UNLIKELY((g)->allochistogram != NULL)) \
+            (g)->allochistogram[(size) <= kMaxSmallSize ? (size) : kMaxSmallSize + 1]++; \
+    }
+
 void* luaM_new_(lua_State* L, size_t nsize, uint8_t memcat)
 {
     global_State* g = L->global;
 
-    int nclass = sizeclass(nsize);
+    checkmemcat(L, g, g->memcatbytes[memcat] + nsize, memcat);
+    recordallocation(g, nsize);
+
+    int nclass = sizeclass(g, nsize);
 
     void* block = nclass >= 0 ? newblock(L, nclass) : (*g->frealloc)(g->ud, NULL, 0, nsize);
     if (block == NULL && nsize > 0)
@@ -486,7 +712,10 @@ GCObject* luaM_newgco_(lua_State* L, size_t nsize, uint8_t memcat)
 
     global_State* g = L->global;
 
-    int nclass = sizeclass(nsize);
+    checkmemcat(L, g, g->memcatbytes[memcat] + nsize, memcat);
+    recordallocation(g, nsize);
+
+    int nclass = sizeclass(g, nsize);
 
     void* block = NULL;
 
@@ -519,7 +748,7 @@ void luaM_free_(lua_State* L, void* block, size_t osize, uint8_t memcat)
     global_State* g = L->global;
     LUAU_ASSERT((osize == 0) == (block == NULL));
 
-    int oclass = sizeclass(osize);
+    int oclass = sizeclass(g, osize);
 
     if (oclass >= 0)
         freeblock(L, oclass, block);
@@ -535,7 +764,7 @@ void luaM_freegco_(lua_State* L, GCObject* block, size_t osize, uint8_t memcat,
     global_State* g = L->global;
     LUAU_ASSERT((osize == 0) == (block == NULL));
 
-    int oclass = sizeclass(osize);
+    int oclass = sizeclass(g, osize);
 
     if (oclass >= 0)
     {
@@ -561,8 +790,14 @@ void* luaM_realloc_(lua_State* L, void* block, size_t osize, size_t nsize, uint8
     global_State* g = L->global;
     LUAU_ASSERT((osize == 0) == (block == NULL));
 
-    int nclass = sizeclass(nsize);
-    int oclass = sizeclass(osize);
+    if (nsize > osize)
+        checkmemcat(L, g, g->memcatbytes[memcat] - osize + nsize, memcat);
+
+    if (nsize > 0)
+        recordallocation(g, nsize);
+
+    int nclass = sizeclass(g, nsize);
+    int oclass = sizeclass(g, osize);
     void* result;
 
     // if either block needs to be allocated using a block allocator, we can't use realloc directly
@@ -593,6 +828,83 @@ void* luaM_realloc_(lua_State* L, void* block, size_t osize, size_t nsize, uint8
     return result;
 }
 
+void luaM_setmemcatlimit(lua_State* L, uint8_t memcat, size_t softlimit, size_t hardlimit)
+{
+    global_State* g = L->global;
+
+    g->memcatsoftlimit[memcat] = softlimit ? softlimit : SIZE_MAX;
+    g->memcathardlimit[memcat] = hardlimit ? hardlimit : SIZE_MAX;
+
+    // soft limit only fires when it's crossed; if the category is already above it, only the hard limit is checked
+    if (g->memcatbytes[memcat] <= g->memcatsoftlimit[memcat] && g->memcatsoftlimit[memcat] < g->memcathardlimit[memcat])
+        g->memcatthreshold[memcat] = g->memcatsoftlimit[memcat];
+    else
+        g->memcatthreshold[memcat] = g->memcathardlimit[memcat];
+}
+
+void luaM_rearmmemcatlimits(lua_State* L)
+{
+    global_State* g = L->global;
+
+    for (int i = 0; i < LUA_MEMORY_CATEGORIES; i++)
+    {
+        // soft limit is armed again once the category is back under it
+        if (g->memcatthreshold[i] > g->memcatsoftlimit[i] && g->memcatbytes[i] <= g->memcatsoftlimit[i])
+            g->memcatthreshold[i] = g->memcatsoftlimit[i];
+    }
+}
+
+int luaM_isfullgcopage(lua_Page* page)
+{
+    return !page->freeList && page->freeNext < 0;
+}
+
+void luaM_releasegcoblock(lua_Page* page, GCObject* block)
+{
+    // the page is owned by the caller and isn't in the free list; it's returned to the allocator later with luaM_returngcopage
+    LUAU_ASSERT(!page->prev && !page->next);
+    LUAU_ASSERT(page->busyBlocks > 0);
+    LUAU_ASSERT((char*)block >= page->data && (char*)block < (char*)page + page->pageSize);
+
+    block->gch.tt = LUA_TNIL;
+
+    freegcolink(block) = page->freeList;
+    page->freeList = block;
+
+    ASAN_POISON_MEMORY_REGION((char*)block + sizeof(GCheader), page->blockSize - sizeof(GCheader));
+
+    page->busyBlocks--;
+}
+
+int luaM_returngcopage(lua_State* L, lua_Page* page, size_t osize, uint8_t memcat)
+{
+    global_State* g = L->global;
+    LUAU_ASSERT(!page->prev && !page->next);
+
+    g->totalbytes -= osize;
+    g->memcatbytes[memcat] -= osize;
+
+    if (page->busyBlocks == 0)
+    {
+        freepage(L, &g->allgcopages, page);
+        return 1;
+    }
+
+    // blocks that were released while the page was owned by the caller can be allocated again
+    if (page->freeList)
+    {
+        int sizeClass = sizeclass(g, page->blockSize);
+        LUAU_ASSERT(sizeClass >= 0 && page->blockSize == g->sizeclasses.sizeOfClass[sizeClass]);
+
+        page->next = g->freegcopages[sizeClass];
+        if (page->next)
+            page->next->prev = page;
+        g->freegcopages[sizeClass] = page;
+    }
+
+    return 0;
+}
+
 void luaM_getpagewalkinfo(lua_Page* page, char** start, char** end, int* busyBlocks, int* blockSize)
 {
     int blockCount = (page->pageSize - offsetof(lua_Page, data)) / page->blockSize;
@@ -654,6 +966,103 @@ void luaM_visitgco(lua_State* L, void* context, int (*visitor)(void* context, lu
     }
 }
 
+lua_Page* luaM_getblockpage(lua_State* L, void* block, size_t size)
+{
+    global_State* g = L->global;
+
+    if (sizeclass(g, size) < 0)
+        return NULL;
+
+    lua_Page* page = (lua_Page*)metadata((char*)block - kBlockHeader);
+    LUAU_ASSERT(page && page->busyBlocks > 0);
+    LUAU_ASSERT((char*)block > page->data && (char*)block < (char*)page + page->pageSize);
+    return page;
+}
+
+size_t luaM_getpagesize(lua_Page* page)
+{
+    return page->pageSize;
+}
+
+void luaM_copypage(lua_Page* page, int gco, char* dest, void* context, void (*visitptr)(void* context, void** slot))
+{
+    char* start;
+    char* end;
+    int busyBlocks;
+    int blockSize;
+    luaM_getpagewalkinfo(page, &start, &end, &busyBlocks, &blockSize);
+
+    memcpy(dest, page, offsetof(lua_Page, data));
+
+    visitptr(context, (void**)&page->prev);
+    visitptr(context, (void**)&page->next);
+    visitptr(context, (void**)&page->gcolistprev);
+    visitptr(context, (void**)&page->gcolistnext);
+    visitptr(context, &page->freeList);
+
+    // blocks that were never allocated are skipped, and free blocks only keep the parts that the allocator uses (the rest is poisoned)
+    for (char* pos = start; pos != end; pos += blockSize)
+    {
+        char* copy = dest + (pos - (char*)page);
+
+        if (gco)
+        {
+            if (((GCObject*)pos)->gch.tt != LUA_TNIL)
+            {
+                memcpy(copy, pos, blockSize);
+                continue;
+            }
+
+            memcpy(copy, pos, sizeof(GCheader));
+
+            ASAN_UNPOISON_MEMORY_REGION(&freegcolink(pos), sizeof(void*));
+            memcpy(copy + kGCOLinkOffset, &freegcolink(pos), sizeof(void*));
+            visitptr(context, &freegcolink(pos));
+            ASAN_POISON_MEMORY_REGION(&freegcolink(pos), sizeof(void*));
+        }
+        else
+        {
+            ASAN_UNPOISON_MEMORY_REGION(pos, sizeof(void*));
+
+            if (metadata(pos) == page)
+            {
+                memcpy(copy, pos, blockSize);
+                visitptr(context, &metadata(pos));
+            }
+            else
+            {
+                memcpy(copy, pos, sizeof(void*));
+                visitptr(context, &metadata(pos));
+                ASAN_POISON_MEMORY_REGION(pos, sizeof(void*));
+            }
+        }
+    }
+}
+
+void luaM_poisonpage(lua_Page* page, int gco)
+{
+#if __has_feature(address_sanitizer) || defined(LUAU_ENABLE_ASAN)
+    char* start;
+    char* end;
+    int busyBlocks;
+    int blockSize;
+    luaM_getpagewalkinfo(page, &start, &end, &busyBlocks, &blockSize);
+
+    ASAN_POISON_MEMORY_REGION(page->data, start - page->data);
+
+    for (char* pos = start; pos != end; pos += blockSize)
+    {
+        if (gco && ((GCObject*)pos)->gch.tt == LUA_TNIL)
+            ASAN_POISON_MEMORY_REGION(pos + sizeof(GCheader), blockSize - sizeof(GCheader));
+        else if (!gco && metadata(pos) != page)
+            ASAN_POISON_MEMORY_REGION(pos, blockSize);
+    }
+#else
+    (void)sizeof(page);
+    (void)sizeof(gco);
+#endif
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -5,6 +5,7 @@
 #include "lua.h"
 
 typedef struct lua_Page lua_Page;
+typedef struct lua_PageArena lua_PageArena;
 union GCObject;
 
 #define luaM_newgco(L, t, size, memcat) cast_to(t*, luaM_newgco_(L, size, memcat))
@@ -25,8 +26,38 @@ LUAI_FUNC void* luaM_realloc_(lua_State* L, void* block, size_t osize, size_t ns
 
 LUAI_FUNC l_noret luaM_toobig(lua_State* L);
 
+LUAI_FUNC void luaM_setmemcatlimit(lua_State* L, uint8_t memcat, size_t softlimit, size_t hardlimit);
+LUAI_FUNC void luaM_rearmmemcatlimits(lua_State* L);
+
+LUAI_FUNC int luaM_validsizeclasses(const int* sizes, int count);
+LUAI_FUNC void luaM_setsizeclasses(lua_State* L, const int* sizes, int count);
+
+LUAI_FUNC void luaM_setallochistogram(lua_State* L, int enabled);
+LUAI_FUNC int luaM_getallochistogram(lua_State* L, size_t* counts, int count);
+
+LUAI_FUNC void luaM_trimpagecache(lua_State* L);
+LUAI_FUNC void luaM_freepagecache(lua_State* L);
+
+LUAI_FUNC int luaM_setpagearena(lua_State* L, int enabled);
+LUAI_FUNC void* luaM_newarenapage(lua_State* L, size_t size);
+LUAI_FUNC int luaM_freearenapage(lua_State* L, void* page);
+LUAI_FUNC void luaM_trimpagearena(lua_State* L, int full);
+LUAI_FUNC void luaM_freepagearena(lua_State* L);
+LUAI_FUNC void luaM_getpagearenastats(lua_State* L, size_t* resident, size_t* slack);
+
 LUAI_FUNC void luaM_getpagewalkinfo(lua_Page* page, char** start, char** end, int* busyBlocks, int* blockSize);
 LUAI_FUNC lua_Page* luaM_getnextgcopage(lua_Page* page);
 
+// used by lua_snapshotstate to find and copy the pages that the heap consists of
+LUAI_FUNC lua_Page* luaM_getblockpage(lua_State* L, void* block, size_t size);
+LUAI_FUNC size_t luaM_getpagesize(lua_Page* page);
+LUAI_FUNC void luaM_copypage(lua_Page* page, int gco, char* dest, void* context, void (*visitptr)(void* context, void** slot));
+LUAI_FUNC void luaM_poisonpage(lua_Page* page, int gco);
+
+// used by the background sweep; pages without free blocks are handed off to the helper thread, which releases dead blocks in them
+LUAI_FUNC int luaM_isfullgcopage(lua_Page* page);
+LUAI_FUNC void luaM_releasegcoblock(lua_Page* page, union GCObject* block);
+LUAI_FUNC int luaM_returngcopage(lua_State* L, lua_Page* page, size_t osize, uint8_t memcat);
+
 LUAI_FUNC void luaM_visitpage(lua_Page* page, void* context, int (*visitor)(void* context, lua_Page* page, union GCObject* gco));
 LUAI_FUNC void luaM_visitgco(lua_State* L, void* context, int (*visitor)(void* context, lua_Page* page, union GCObject* gco));
@@ -0,0 +1,448 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+#include "lmem.h"
+
+#include "lstate.h"
+
+#if LUA_PAGE_ARENA
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsign-conversion"
+#pragma clang diagnostic ignored "-Wcast-align"
+#endif
+
+/*
+ * Page arena is an optional backend for standard size pages (see LUA_GCPAGEARENA).
+ *
+ * Instead of allocating every page with frealloc, the arena reserves large chunks of address space directly from the OS and
+ * carves pages out of them contiguously. Chunks are aligned to the huge page size and are marked as eligible for transparent
+ * huge pages where the OS supports it, so that a large heap is backed by a small number of TLB entries; this matters for GC
+ * traversal and sweeping that walk all pages of the heap.
+ *
+ * Pages are carved out of each chunk using a bump pointer; freed pages are returned to the free list of the chunk they belong
+ * to and are reused before any new memory is touched. Allocation prefers older chunks, which keeps the live heap compact and
+ * lets newer chunks become empty; chunks without live pages are returned to the OS at the end of a GC cycle.
+ *
+ * Memory of the chunk is only committed when a page is carved out of it, so the resident size of the arena is the total size of
+ * carved pages. Free pages stay resident (and are reported as slack) so that they can be reused cheaply, but just like with the
+ * page cache, pages that stayed free during an entire GC cycle are decommitted at the end of it; their address space remains
+ * reserved and they are committed again when reused. The free list of a chunk is kept outside of the pages, since decommitted
+ * pages lose their contents.
+ *
+ * On Windows, chunks are reserved and pages are committed individually. Large pages on Windows require a privilege and can't be
+ * committed on demand, so chunks aren't aligned to the huge page size there.
+ *
+ * Chunk size starts small and doubles with every new chunk up to a limit, so that the number of chunks stays small and finding
+ * the chunk that a page belongs to is cheap.
+ */
+
+#define ARENA_SLOTSIZE 16384                  // stride between pages in a chunk; needs to fit the standard page size
+#define ARENA_ALIGNMENT (2 * 1024 * 1024)     // huge page size on x64 and most arm64 configurations
+#define ARENA_MINCHUNK (4 * 1024 * 1024)      // size of the first chunk
+#define ARENA_MAXCHUNK (256 * 1024 * 1024)    // chunk size stops doubling after this
+
+#if LUA_PAGE_ARENA
+
+typedef struct ArenaChunk
+{
+    struct ArenaChunk* next;
+
+    char* start;
+    char* top; // pages below top were carved out at least once
+    char* end;
+
+    uint16_t* free;  // slot indices of free pages below top; pages in the first `decommitted' entries are not resident
+    int freecount;   // number of entries in free
+    int decommitted; // number of entries in free that were decommitted
+    int used;        // number of pages that were carved out and not freed
+} ArenaChunk;
+
+struct lua_PageArena
+{
+    ArenaChunk* chunks; // oldest chunk first
+    size_t chunksize;   // size of the next chunk
+    int enabled;        // new pages are only allocated from the arena when it's enabled
+
+    size_t resident;      // total size of committed pages in all chunks
+    size_t slack;         // total size of free pages that are still resident
+    size_t slacklowwater; // smallest slack since the last trim, i.e. the size of free pages that weren't needed during the cycle
+};
+
+// slot indices are stored as 16-bit integers
+static_assert(ARENA_MAXCHUNK / ARENA_SLOTSIZE <= 65536, "slot index doesn't fit in 16 bits");
+
+static char* reservechunk(size_t size)
+{
+#ifdef _WIN32
+    // pages are committed as they are carved out, see commitpage
+    return (char*)VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_READWRITE);
+#else
+    // reserve extra space so that the chunk can be aligned to the huge page size
+    size_t total = size + ARENA_ALIGNMENT;
+
+    char* base = (char*)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == (char*)MAP_FAILED)
+        return NULL;
+
+    char* start = (char*)(((uintptr_t)base + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1));
+
+    if (start != base)
+        munmap(base, start - base);
+
+    if (start + size != base + total)
+        munmap(start + size, (base + total) - (start + size));
+
+#ifdef MADV_HUGEPAGE
+    madvise(start, size, MADV_HUGEPAGE);
+#endif
+
+    return start;
+#endif
+}
+
+static int commitpage(char* page)
+{
+#ifdef _WIN32
+    return VirtualAlloc(page, ARENA_SLOTSIZE, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+    // anonymous memory is committed when it's touched
+    (void)sizeof(page);
+    return 1;
+#endif
+}
+
+static void decommitpage(char* page)
+{
+#ifdef _WIN32
+    VirtualFree(page, ARENA_SLOTSIZE, MEM_DECOMMIT);
+#elif defined(MADV_DONTNEED)
+    madvise(page, ARENA_SLOTSIZE, MADV_DONTNEED);
+#else
+    (void)sizeof(page);
+#endif
+}
+
+static void releasechunk(char* start, size_t size)
+{
+#ifdef _WIN32
+    (void)sizeof(size);
+    VirtualFree(start, 0, MEM_RELEASE);
+#else
+    munmap(start, size);
+#endif
+}
+
+static ArenaChunk* newchunk(lua_State* L, lua_PageArena* arena)
+{
+    global_State* g = L->global;
+
+    size_t slots = arena->chunksize / ARENA_SLOTSIZE;
+
+    ArenaChunk* chunk = (ArenaChunk*)(*g->frealloc)(g->ud, NULL, 0, sizeof(ArenaChunk));
+    if (!chunk)
+        return NULL;
+
+    uint16_t* free = (uint16_t*)(*g->frealloc)(g->ud, NULL, 0, slots * sizeof(uint16_t));
+    char* start = free ? reservechunk(arena->chunksize) : NULL;
+
+    if (!start)
+    {
+        if (free)
+            (*g->frealloc)(g->ud, free, slots * sizeof(uint16_t), 0);
+        (*g->frealloc)(g->ud, chunk, sizeof(ArenaChunk), 0);
+        return NULL;
+    }
+
+    chunk->next = NULL;
+    chunk->start = start;
+    chunk->top = start;
+    chunk->end = start + arena->chunksize;
+    chunk->free = free;
+    chunk->freecount = 0;
+    chunk->decommitted = 0;
+    chunk->used = 0;
+
+    // append the chunk to keep the oldest chunks first
+    ArenaChunk** last = &arena->chunks;
+    while (*last)
+        last = &(*last)->next;
+    *last = chunk;
+
+    if (arena->chunksize < ARENA_MAXCHUNK)
+        arena->chunksize *= 2;
+
+    return chunk;
+}
+
+static void freechunk(lua_State* L, ArenaChunk* chunk)
+{
+    global_State* g = L->global;
+
+    size_t size = chunk->end - chunk->start;
+
+    releasechunk(chunk->start, size);
+
+    (*g->frealloc)(g->ud, chunk->free, size / ARENA_SLOTSIZE * sizeof(uint16_t), 0);
+    (*g->frealloc)(g->ud, chunk, sizeof(ArenaChunk), 0);
+}
+
+int luaM_setpagearena(lua_State* L, int enabled)
+{
+    global_State* g = L->global;
+    lua_PageArena* arena = g->pagearena;
+
+    int previous = arena && arena->enabled;
+
+    // the arena is kept around when disabled because it still owns the pages that were allocated from it
+    if (arena)
+    {
+        arena->enabled = enabled != 0;
+        return previous;
+    }
+
+    if (!enabled)
+        return previous;
+
+    arena = (lua_PageArena*)(*g->frealloc)(g->ud, NULL, 0, sizeof(lua_PageArena));
+    if (!arena)
+        return previous;
+
+    arena->chunks = NULL;
+    arena->chunksize = ARENA_MINCHUNK;
+    arena->enabled = 1;
+    arena->resident = 0;
+    arena->slack = 0;
+    arena->slacklowwater = 0;
+
+    g->pagearena = arena;
+    return previous;
+}
+
+void* luaM_newarenapage(lua_State* L, size_t size)
+{
+    global_State* g = L->global;
+    lua_PageArena* arena = g->pagearena;
+
+    LUAU_ASSERT(size <= ARENA_SLOTSIZE);
+    (void)sizeof(size);
+
+    if (!arena || !arena->enabled)
+        return NULL;
+
+    ArenaChunk* chunk = arena->chunks;
+
+    while (chunk && chunk->freecount == 0 && chunk->top == chunk->end)
+        chunk = chunk->next;
+
+    if (!chunk)
+        chunk = newchunk(L, arena);
+
+    // the caller falls back to frealloc when the OS is out of address space
+    if (!chunk)
+        return NULL;
+
+    char* page;
+
+    if (chunk->freecount)
+    {
+        // resident pages are on top of the free list
+        page = chunk->start + (size_t)chunk->free[chunk->freecount - 1] * ARENA_SLOTSIZE;
+
+        if (chunk->freecount > chunk->decommitted)
+        {
+            arena->slack -= ARENA_SLOTSIZE;
+
+            if (arena->slack < arena->slacklowwater)
+                arena->slacklowwater = arena->slack;
+        }
+        else
+        {
+            if (!commitpage(page))
+                return NULL;
+
+            chunk->decommitted--;
+            arena->resident += ARENA_SLOTSIZE;
+        }
+
+        chunk->freecount--;
+    }
+    else
+    {
+        page = chunk->top;
+
+        if (!commitpage(page))
+            return NULL;
+
+        chunk->top += ARENA_SLOTSIZE;
+        arena->resident += ARENA_SLOTSIZE;
+    }
+
+    chunk->used++;
+
+    return page;
+}
+
+int luaM_freearenapage(lua_State* L, void* page)
+{
+    global_State* g = L->global;
+    lua_PageArena* arena = g->pagearena;
+
+    if (!arena)
+        return 0;
+
+    for (ArenaChunk* chunk = arena->chunks; chunk; chunk = chunk->next)
+    {
+        if ((char*)page >= chunk->start && (char*)page < chunk->top)
+        {
+            LUAU_ASSERT(((char*)page - chunk->start) % ARENA_SLOTSIZE == 0);
+            LUAU_ASSERT(chunk->used > 0);
+
+            chunk->free[chunk->freecount++] = (uint16_t)(((char*)page - chunk->start) / ARENA_SLOTSIZE);
+            chunk->used--;
+
+            arena->slack += ARENA_SLOTSIZE;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void luaM_trimpagearena(lua_State* L, int full)
+{
+    global_State* g = L->global;
+    lua_PageArena* arena = g->pagearena;
+
+    if (!arena || !arena->chunks)
+        return;
+
+    // the oldest chunk is kept even when it's empty to avoid remapping memory every cycle for small heaps
+    ArenaChunk** link = &arena->chunks->next;
+
+    while (*link)
+    {
+        ArenaChunk* chunk = *link;
+
+        if (chunk->used == 0)
+        {
+            size_t free = (size_t)(chunk->freecount - chunk->decommitted) * ARENA_SLOTSIZE;
+
+            arena->resident -= free;
+            arena->slack -= free;
+
+            *link = chunk->next;
+            freechunk(L, chunk);
+        }
+        else
+        {
+            link = &chunk->next;
+        }
+    }
+
+    // decommit free pages that weren't needed during the entire cycle, starting from the ones that were freed the longest time ago
+    size_t unused = full ? arena->slack : (arena->slacklowwater < arena->slack ? arena->slacklowwater : arena->slack);
+
+    for (ArenaChunk* chunk = arena->chunks; chunk && unused; chunk = chunk->next)
+    {
+        while (chunk->decommitted < chunk->freecount && unused)
+        {
+            decommitpage(chunk->start + (size_t)chunk->free[chunk->decommitted] * ARENA_SLOTSIZE);
+            chunk->decommitted++;
+
+            arena->resident -= ARENA_SLOTSIZE;
+            arena->slack -= ARENA_SLOTSIZE;
+            unused -= ARENA_SLOTSIZE;
+        }
+    }
+
+    arena->slacklowwater = arena->slack;
+}
+
+void luaM_freepagearena(lua_State* L)
+{
+    global_State* g = L->global;
+    lua_PageArena* arena = g->pagearena;
+
+    if (!arena)
+        return;
+
+    while (arena->chunks)
+    {
+        ArenaChunk* chunk = arena->chunks;
+        LUAU_ASSERT(chunk->used == 0);
+
+        arena->chunks = chunk->next;
+        freechunk(L, chunk);
+    }
+
+    g->pagearena = NULL;
+    (*g->frealloc)(g->ud, arena, sizeof(lua_PageArena), 0);
+}
+
+void luaM_getpagearenastats(lua_State* L, size_t* resident, size_t* slack)
+{
+    global_State* g = L->global;
+    lua_PageArena* arena = g->pagearena;
+
+    *resident = arena ? arena->resident : 0;
+    *slack = arena ? arena->slack : 0;
+}
+
+#else
+
+int luaM_setpagearena(lua_State* L, int enabled)
+{
+    (void)sizeof(L);
+    (void)sizeof(enabled);
+    return 0;
+}
+
+void* luaM_newarenapage(lua_State* L, size_t size)
+{
+    (void)sizeof(L);
+    (void)sizeof(size);
+    return NULL;
+}
+
+int luaM_freearenapage(lua_State* L, void* page)
+{
+    (void)sizeof(L);
+    (void)sizeof(page);
+    return 0;
+}
+
+void luaM_trimpagearena(lua_State* L, int full)
+{
+    (void)sizeof(L);
+    (void)sizeof(full);
+}
+
+void luaM_freepagearena(lua_State* L)
+{
+    (void)sizeof(L);
+}
+
+void luaM_getpagearenastats(lua_State* L, size_t* resident, size_t* slack)
+{
+    (void)sizeof(L);
+    *resident = 0;
+    *slack = 0;
+}
+
+#endif
+
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
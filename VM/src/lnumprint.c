@@ -372,6 +372,115 @@ char* luai_num2str(char* buf, double n)
     }
 }
 
+// 10^k for k = 0..17
+static const uint64_t kPow10Int[18] = {
+    1ull,
+    10ull,
+    100ull,
+    1000ull,
+    10000ull,
+    100000ull,
+    1000000ull,
+    10000000ull,
+    100000000ull,
+    1000000000ull,
+    10000000000ull,
+    100000000000ull,
+    1000000000000ull,
+    10000000000000ull,
+    100000000000000ull,
+    1000000000000000ull,
+    10000000000000000ull,
+    100000000000000000ull,
+};
+
+char* luai_num2fixed(char* buf, double n, int precision)
+{
+    // IEEE-754
+    union
+    {
+        double v;
+        uint64_t bits;
+    } v = {n};
+    int sign = (int)(v.bits >> 63);
+    int exponent = (int)(v.bits >> 52) & 2047;
+    uint64_t fraction = v.bits & ((1ull << 52) - 1);
+
+    // specials are printed differently by different C runtimes
+    if (exponent == 0x7ff || precision < 0 || precision > LUAI_MAXNUM2FIXEDPREC)
+        return NULL;
+
+    // n rounded to `precision' fractional digits, scaled by 10^precision
+    uint64_t r = 0;
+
+    if (exponent != 0 || fraction != 0)
+    {
+        Decimal d = schubfach(exponent, fraction);
+
+        while (d.s % 10 == 0)
+        {
+            d.s /= 10;
+            d.k++;
+        }
+
+        int fd = -d.k; // number of fractional digits
+
+        if (fd > precision + 1)
+        {
+            // Schubfach picks the decimal with the fewest digits in the rounding interval of n, so no decimal with precision + 1
+            // fractional digits is in that interval; since both n and d are, they round to the same value and d can't be a tie
+            int drop = fd - precision;
+
+            // d < 10^17, so it rounds to zero when at least 18 digits are dropped
+            if (drop < 18)
+            {
+                uint64_t p = kPow10Int[drop];
+                r = d.s / p + ((d.s % p) * 2 >= p);
+            }
+        }
+        else if (fd <= precision)
+        {
+            // padding d with zeros gives the exact digits of n only when the rounding interval of n is narrower than the last digit
+            double bound = (double)(1ull << 51) / (double)kPow10Int[precision];
+            if (n >= bound || n <= -bound)
+                return NULL;
+
+            r = d.s * kPow10Int[precision - fd];
+        }
+        else
+        {
+            // the digit after the last printed one is 5; n may be a tie or may be on either side of it
+            return NULL;
+        }
+    }
+
+    *buf = '-';
+    buf += sign;
+
+    char decbuf[40];
+    char* decend = decbuf + 40;
+    char* dec = printunsignedrev(decend, r);
+
+    // at least one integer digit is printed, followed by exactly `precision' fractional digits
+    while (decend - dec < precision + 1)
+        *--dec = '0';
+
+    int declen = (int)(decend - dec);
+    int dot = declen - precision;
+
+    memcpy(buf, dec, dot);
+    buf += dot;
+
+    if (precision > 0)
+    {
+        *buf++ = '.';
+        memcpy(buf, dec + dot, precision);
+        buf += precision;
+    }
+
+    return buf;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -65,6 +65,12 @@ LUAU_FASTMATH_END
 
 LUAI_FUNC char* luai_num2str(char* buf, double n);
 
+// largest precision accepted by luai_num2fixed
+#define LUAI_MAXNUM2FIXEDPREC 17
+
+// prints n like "%.*f" does if the shortest representation of n determines the result exactly; otherwise returns NULL
+LUAI_FUNC char* luai_num2fixed(char* buf, double n, int precision);
+
 #define luai_str2num(s, p) strtod((s), (p))
 
 #ifdef __clang__
@@ -221,10 +221,13 @@ typedef TValue* StkId; // index to stack elements
 typedef struct TString
 {
     CommonHeader;
-    // 1 byte padding
+
+    uint8_t slice; // string data is stored in another string, see TStringSlice
 
     int16_t atom;
-    // 2 byte padding
+
+    uint8_t ascii; // STRASCII_*, cached by the utf8 library
+    // 1 byte padding
 
     struct TString* next; // next string in the hash table bucket
 
@@ -234,7 +237,24 @@ typedef struct TString
     char data[1]; // string data is allocated right after the header
 } TString;
 
-#define getstr(ts) (ts)->data
+// slices are stored in place of the data of strings that reference a suffix of another string, so the data is still zero-terminated
+typedef struct TStringSlice
+{
+    char* data;      // points into the data of parent; comes first so that getstr can read it from any string, see sizestring
+    TString* parent; // never a slice itself
+} TStringSlice;
+
+// ASCII state of string contents, computed lazily since most strings never need it
+#define STRASCII_UNKNOWN 0
+#define STRASCII_YES 1
+#define STRASCII_NO 2
+
+#define gslice(ts) cast_to(TStringSlice*, (ts)->data)
+
+// strings are accessed everywhere, so the data pointer of slices is selected without a branch; the data area of every string can hold
+// a pointer (see sizestring), so it's read from regular strings as well and masked out
+#define getstr(ts) \
+    cast_to(char*, (uintptr_t)(ts)->data ^ (((uintptr_t)(ts)->data ^ (uintptr_t)gslice(ts)->data) & (0 - (uintptr_t)(ts)->slice)))
 #define svalue(o) getstr(tsvalue(o))
 
 typedef struct Udata
@@ -275,6 +295,10 @@ typedef struct Proto
     TString* debugname;
     uint8_t* debuginsn; // a copy of code[] array with just opcodes
 
+    struct LazyChunk* chunk; // bytecode that the parts of the function marked in `lazy' are decoded from, see luau_loadlazy
+
+    struct NamecallSite* namecache; // method lookup cache for each NAMECALL instruction; allocated on first cache miss
+
 #if LUA_CUSTOM_EXECUTION
     void* execdata;
 #endif
@@ -291,15 +315,24 @@ typedef struct Proto
     int linegaplog2;
     int linedefined;
     int bytecodeid;
+    int sizenamecache; // number of NAMECALL instructions that have a cache site, see luau_loadcode
+
+    uint32_t lazycode;  // offset of code and constants in chunk
+    uint32_t lazydebug; // offset of line info and debug info in chunk
 
 
     uint8_t nups; // number of upvalues
     uint8_t numparams;
     uint8_t is_vararg;
     uint8_t maxstacksize;
+    uint8_t lazy;   // PROTO_LAZY* parts that haven't been decoded yet
+    uint8_t shared; // code and line info are owned by the lua_Program the function was loaded from, see luau_loadprogram
 } Proto;
 // clang-format on
 
+#define PROTO_LAZYCODE 1  // code and constants; decoded before the first call
+#define PROTO_LAZYDEBUG 2 // line info, local and upvalue names; decoded on first use by the debug APIs
+
 typedef struct LocVar
 {
     TString* varname;
@@ -383,7 +416,7 @@ typedef struct TKey
     Value value;
     int extra[LUA_EXTRA_SIZE];
     unsigned tt : 4;
-    int next : 28; // for chaining
+    int next : 28; // for chaining; in hash parts with control bytes, 1 if the node is occupied
 } TKey;
 
 typedef struct LuaNode
@@ -414,6 +447,60 @@ typedef struct LuaNode
         checkliveness(L->global, i_o); \
     }
 
+/*
+** Shapes describe the keys of tables created from the same constructor template. Tables with a shape store values of string keys
+** in a dense array of fields, and share the mapping from keys to field indices. Adding a key transitions the table to a child shape;
+** children of the same shape are shared by all tables that add the same key.
+**
+** Each shape only adds one key to its parent. Shapes along a chain of transitions share the array of all keys of the chain and the
+** index that maps keys to field indices (see TableShapeKeys); a shape uses the first `nfields' keys of the array.
+*/
+typedef struct TableShapeKeys
+{
+    struct TableShape* last; // shape that added the last key; only this shape can append keys, NULL once a shape of the chain is freed
+
+    int refs;           // number of shapes that use the keys
+    int size;           // number of allocated keys
+    uint8_t lsizeindex; // log2 of size of `index' array
+    uint8_t memcat;
+
+    TString* keys[1]; // keys are allocated right after the header, followed by `index' with field indices + 1 (0 for unused)
+} TableShapeKeys;
+
+#define shapeindex(k) (cast_to(uint8_t*, (k)->keys + (k)->size))
+
+typedef struct TableShape
+{
+    struct TableShape* parent;  // shape without the last key; NULL for the empty shape
+    struct TableShape* child;   // first shape that adds a key to this one
+    struct TableShape* sibling; // next shape that adds a key to `parent'
+
+    TString* key;         // key added by this shape; NULL for the empty shape
+    TableShapeKeys* keys; // keys of the chain this shape belongs to; NULL for the empty shape
+
+    int refs;    // number of tables and child shapes that reference this shape
+    int nfields; // number of keys
+
+    uint8_t memcat;
+} TableShape;
+
+typedef struct TableFields
+{
+    TableShape* shape;
+    int size;      // number of allocated values, at least shape->nfields
+    int newshapes; // number of shapes that were created by transitions of this table
+
+    TValue values[1]; // values are allocated right after the header
+} TableFields;
+
+typedef struct TableNumbers
+{
+    int size;     // number of elements; all of them are numbers
+    int capacity; // number of allocated elements
+
+    double values[1]; // values are allocated right after the header
+} TableNumbers;
+
 // clang-format off
 typedef struct Table
 {
@@ -429,13 +516,18 @@ typedef struct Table
     int sizearray; // size of `array' array
     union
     {
-        int lastfree;  // any free position is before this position
+        int lastfree;  // any free position is before this position; with control bytes, number of free positions left
         int aboundary; // negated 'boundary' of `array' array; iff aboundary < 0
     };
 
 
     struct Table* metatable;
-    TValue* array;  // array part
+    union
+    {
+        TValue* array;          // array part
+        TableNumbers* numbers;  // packed array part; iff sizearray == 0 and numbers != NULL, and the table doesn't have a shape
+        uintptr_t shaped;       // address of fields + 1 if the table has a shape, see isshaped; sizearray is 0 and hash part is empty
+    };
     LuaNode* node;
     GCObject* gclist;
 } Table;
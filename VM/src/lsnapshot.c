@@ -0,0 +1,923 @@
+// This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+// This code is based on Lua 5.x implementation licensed under MIT License; see lua_LICENSE.txt for details
+#include "lua.h"
+
+#include "lstate.h"
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lmem.h"
+#include "lstring.h"
+#include "ltable.h"
+#include "lvm.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wsign-conversion"
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+
+/*
+ * State snapshot (lua_snapshotstate) is a copy of the entire heap of an idle state that new states can be stamped from
+ * (lua_newstatefromsnapshot), which skips the work of opening libraries and running initialization code in every new state.
+ *
+ * The heap of a state consists of:
+ * - the main thread and the global state (LG)
+ * - GCO pages, linked in global_State::allgcopages
+ * - pages with small non-GCO blocks; these are found through the blocks that the objects own (see luaM_getblockpage)
+ * - large non-GCO blocks that are allocated with frealloc directly
+ *
+ * Each of these memory blocks becomes a segment of the snapshot image, and pages are copied with their page headers and free lists
+ * intact, so the new state continues to allocate from the same page structure. Every pointer in the heap that points into one of the
+ * segments is recorded as a relocation (segment and offset of the pointer, and the segment it points into); until the state is stamped,
+ * the pointer stores the offset in the target segment. Stamping a new state allocates each segment with the allocator of the new
+ * state, copies the image and patches the relocations. Pointers that don't point into the heap (static data like the dummy node, C
+ * functions, code owned by a lua_Program and memory owned by the host) are copied as is.
+ *
+ * Since the pointers are found by traversing the objects, userdata payloads can't be relocated and are copied as is. Execution state
+ * that lives outside of the heap can't be captured either, so the state must be idle and can't have native code.
+ */
+
+enum SnapshotSegmentKind
+{
+    SEGMENT_BLOCK,   // block allocated with frealloc
+    SEGMENT_PAGE,    // page with non-GCO blocks
+    SEGMENT_GCOPAGE, // page with GCO blocks
+};
+
+typedef struct SnapshotSegment
+{
+    char* source; // address in the captured state, only valid while the snapshot is built
+    size_t size;
+    size_t offset; // offset in the image
+
+    uint8_t kind;
+} SnapshotSegment;
+
+typedef struct SnapshotReloc
+{
+    uint32_t segment; // segment and offset of the pointer
+    uint32_t offset;
+    uint32_t target; // segment that the pointer points into
+} SnapshotReloc;
+
+struct lua_StateSnapshot
+{
+    lua_Alloc frealloc;
+    void* ud;
+
+    char* image;
+    size_t imagesize;
+
+    SnapshotSegment* segments;
+    size_t segmentCount;
+    size_t mainsegment; // segment with the main thread and the global state
+
+    SnapshotReloc* relocs;
+    size_t relocCount;
+
+    // programs that lazily decoded functions refer to, one entry for each chunk; each stamped state retains them
+    lua_Program** programs;
+    size_t programCount;
+};
+
+typedef struct SnapshotBuilder
+{
+    lua_State* L;
+    global_State* g;
+    lua_StateSnapshot* snapshot;
+
+    size_t segmentCapacity;
+    size_t relocCapacity;
+
+    // chunks are shared between functions, so they are collected separately to visit each one once
+    LazyChunk** chunks;
+    size_t chunkCount;
+    size_t chunkCapacity;
+
+    int failed;
+} SnapshotBuilder;
+
+#define SNAPSHOT_ALIGN 16
+
+static int reserve(SnapshotBuilder* B, void** data, size_t* capacity, size_t count, size_t size)
+{
+    if (count < *capacity)
+        return 1;
+
+    size_t newcapacity = *capacity ? *capacity * 2 : 256;
+    void* result = (*B->g->frealloc)(B->g->ud, *data, *capacity * size, newcapacity * size);
+
+    if (!result)
+    {
+        B->failed = 1;
+        return 0;
+    }
+
+    *data = result;
+    *capacity = newcapacity;
+    return 1;
+}
+
+static void shrink(SnapshotBuilder* B, void** data, size_t capacity, size_t count, size_t size)
+{
+    // reallocation to a smaller size can't fail
+    if (capacity != count)
+        *data = (*B->g->frealloc)(B->g->ud, *data, capacity * size, count * size);
+}
+
+static void addsegment(SnapshotBuilder* B, void* source, size_t size, uint8_t kind)
+{
+    lua_StateSnapshot* S = B->snapshot;
+
+    if (!reserve(B, (void**)&S->segments, &B->segmentCapacity, S->segmentCount, sizeof(SnapshotSegment)))
+        return;
+
+    SnapshotSegment* seg = &S->segments[S->segmentCount++];
+    seg->source = (char*)source;
+    seg->size = size;
+    seg->offset = 0;
+    seg->kind = kind;
+}
+
+static void addblock(SnapshotBuilder* B, void* block, size_t size)
+{
+    // empty arrays are not allocated
+    if (size == 0)
+        return;
+
+    // small blocks add their page once per block, which is used to check that all blocks in the page are known
+    lua_Page* page = luaM_getblockpage(B->L, block, size);
+
+    if (page)
+        addsegment(B, page, luaM_getpagesize(page), SEGMENT_PAGE);
+    else
+        addsegment(B, block, size, SEGMENT_BLOCK);
+}
+
+static void addthreadblocks(SnapshotBuilder* B, lua_State* th)
+{
+    addblock(B, th->stack, th->stacksize * sizeof(TValue));
+    addblock(B, th->base_ci, th->size_ci * sizeof(CallInfo));
+}
+
+static int discovergco(void* context, lua_Page* page, GCObject* gco)
+{
+    SnapshotBuilder* B = (SnapshotBuilder*)context;
+
+    switch (gco->gch.tt)
+    {
+    case LUA_TTABLE:
+    {
+        Table* h = gco2h(gco);
+
+        if (h->sizearray)
+            addblock(B, h->array, h->sizearray * sizeof(TValue));
+        else if (ispacked(h))
+            addblock(B, h->numbers, sizenumbers(h->numbers->capacity));
+
+        if (h->node != &luaH_dummynode)
+            addblock(B, h->node, sizenodebytes(h->lsizenode));
+
+        if (isshaped(h))
+            addblock(B, gfields(h), sizefields(gfields(h)->size));
+        break;
+    }
+    case LUA_TTHREAD:
+        addthreadblocks(B, gco2th(gco));
+        break;
+    case LUA_TPROTO:
+    {
+        Proto* p = gco2p(gco);
+
+#if LUA_CUSTOM_EXECUTION
+        if (p->execdata)
+            B->failed = 1;
+#endif
+
+        addblock(B, p->k, p->sizek * sizeof(TValue));
+        addblock(B, p->p, p->sizep * sizeof(Proto*));
+        addblock(B, p->locvars, p->sizelocvars * sizeof(LocVar));
+        addblock(B, p->upvalues, p->sizeupvalues * sizeof(TString*));
+
+        if (!p->shared)
+        {
+            addblock(B, p->code, p->sizecode * sizeof(Instruction));
+            if (p->lineinfo)
+                addblock(B, p->lineinfo, p->sizelineinfo);
+        }
+
+        if (p->debuginsn)
+            addblock(B, p->debuginsn, p->sizecode);
+
+        if (p->namecache)
+            addblock(B, p->namecache, p->sizenamecache * sizeof(NamecallSite));
+
+        if (p->chunk && reserve(B, (void**)&B->chunks, &B->chunkCapacity, B->chunkCount, sizeof(LazyChunk*)))
+            B->chunks[B->chunkCount++] = p->chunk;
+        break;
+    }
+    }
+
+    return 0;
+}
+
+// shapes of a chain share the keys, which are owned by the first shape of the chain
+static int isfirstinchain(TableShape* s)
+{
+    return s->keys && s->parent->keys != s->keys;
+}
+
+static TableShape* nextshape(TableShape* s)
+{
+    if (s->child)
+        return s->child;
+
+    while (s && !s->sibling)
+        s = s->parent;
+
+    return s ? s->sibling : NULL;
+}
+
+static int comparesegments(const void* lhs, const void* rhs)
+{
+    uintptr_t l = (uintptr_t)((const SnapshotSegment*)lhs)->source;
+    uintptr_t r = (uintptr_t)((const SnapshotSegment*)rhs)->source;
+
+    return l < r ? -1 : l > r;
+}
+
+static int comparechunks(const void* lhs, const void* rhs)
+{
+    uintptr_t l = (uintptr_t)(*(LazyChunk* const*)lhs);
+    uintptr_t r = (uintptr_t)(*(LazyChunk* const*)rhs);
+
+    return l < r ? -1 : l > r;
+}
+
+static SnapshotSegment* findsegment(lua_StateSnapshot* S, const void* ptr)
+{
+    uintptr_t p = (uintptr_t)ptr;
+
+    // find the first segment that starts after the pointer
+    size_t l = 0;
+    size_t r = S->segmentCount;
+
+    while (l < r)
+    {
+        size_t m = l + (r - l) / 2;
+
+        if ((uintptr_t)S->segments[m].source <= p)
+            l = m + 1;
+        else
+            r = m;
+    }
+
+    if (l == 0)
+        return NULL;
+
+    SnapshotSegment* seg = &S->segments[l - 1];
+    return p - (uintptr_t)seg->source < seg->size ? seg : NULL;
+}
+
+static void layoutsegments(SnapshotBuilder* B)
+{
+    lua_StateSnapshot* S = B->snapshot;
+
+    qsort(S->segments, S->segmentCount, sizeof(SnapshotSegment), comparesegments);
+
+    size_t count = 0;
+    size_t offset = 0;
+
+    for (size_t i = 0; i < S->segmentCount;)
+    {
+        SnapshotSegment seg = S->segments[i];
+
+        size_t j = i + 1;
+        while (j < S->segmentCount && S->segments[j].source == seg.source)
+            j++;
+
+        if (seg.kind == SEGMENT_PAGE)
+        {
+            char* start;
+            char* end;
+            int busyBlocks;
+            int blockSize;
+            luaM_getpagewalkinfo((lua_Page*)seg.source, &start, &end, &busyBlocks, &blockSize);
+
+            // pointers to a block that isn't owned by a known object can't be relocated
+            LUAU_ASSERT(j - i == (size_t)busyBlocks);
+            if (j - i != (size_t)busyBlocks)
+                B->failed = 1;
+        }
+        else
+        {
+            LUAU_ASSERT(j == i + 1);
+        }
+
+        LUAU_ASSERT(count == 0 || S->segments[count - 1].source + S->segments[count - 1].size <= seg.source);
+
+        if (seg.size > UINT32_MAX)
+            B->failed = 1;
+
+        offset = (offset + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1);
+        seg.offset = offset;
+        offset += seg.size;
+
+        S->segments[count++] = seg;
+        i = j;
+    }
+
+    S->segmentCount = count;
+    S->imagesize = offset;
+
+    // pages with free blocks are reachable through the free lists even if none of their blocks are known
+    for (int i = 0; i < LUA_SIZECLASSES; i++)
+    {
+        if (B->g->freepages[i] && !findsegment(S, B->g->freepages[i]))
+            B->failed = 1;
+    }
+}
+
+static void relocateto(SnapshotBuilder* B, void** slot, const void* anchor)
+{
+    lua_StateSnapshot* S = B->snapshot;
+
+    // pointers to static data, C functions, code owned by programs and memory owned by the host stay as is
+    SnapshotSegment* target = findsegment(S, anchor);
+    if (!target)
+        return;
+
+    SnapshotSegment* seg = findsegment(S, slot);
+    LUAU_ASSERT(seg);
+
+    if (!seg || !reserve(B, (void**)&S->relocs, &B->relocCapacity, S->relocCount, sizeof(SnapshotReloc)))
+    {
+        B->failed = 1;
+        return;
+    }
+
+    SnapshotReloc* r = &S->relocs[S->relocCount++];
+    r->segment = (uint32_t)(seg - S->segments);
+    r->offset = (uint32_t)((char*)slot - seg->source);
+    r->target = (uint32_t)(target - S->segments);
+
+    uintptr_t value = (uintptr_t)((char*)*slot - target->source);
+    memcpy(S->image + seg->offset + r->offset, &value, sizeof(value));
+}
+
+static void relocate(void* context, void** slot)
+{
+    relocateto((SnapshotBuilder*)context, slot, *slot);
+}
+
+#define relocptr(B, field) relocate(B, (void**)&(field))
+
+static void relocatevalue(SnapshotBuilder* B, TValue* v)
+{
+    if (iscollectable(v))
+        relocptr(B, v->value.gc);
+}
+
+static void relocatetable(SnapshotBuilder* B, Table* h)
+{
+    relocptr(B, h->metatable);
+    relocptr(B, h->node);
+    relocptr(B, h->gclist);
+
+    // same slot as `numbers' and fields of tables with a shape, which keep the tag in the relocated pointer
+    if (isshaped(h))
+        relocateto(B, (void**)&h->array, gfields(h));
+    else
+        relocptr(B, h->array);
+
+    for (int i = 0; i < h->sizearray; ++i)
+        relocatevalue(B, &h->array[i]);
+
+    if (h->node != &luaH_dummynode)
+    {
+        for (int i = 0; i < (int)sizenode(h); ++i)
+        {
+            LuaNode* n = gnode(h, i);
+
+            relocatevalue(B, &n->val);
+
+            // dead keys keep the pointer for traversal
+            if (n->key.tt >= LUA_TSTRING)
+                relocptr(B, n->key.value.gc);
+        }
+    }
+
+    if (isshaped(h))
+    {
+        TableFields* f = gfields(h);
+
+        relocptr(B, f->shape);
+
+        for (int i = 0; i < f->size; ++i)
+            relocatevalue(B, &f->values[i]);
+    }
+}
+
+static void relocateclosure(SnapshotBuilder* B, Closure* cl)
+{
+    relocptr(B, cl->gclist);
+    relocptr(B, cl->env);
+
+    if (cl->isC)
+    {
+        for (int i = 0; i < cl->nupvalues; ++i)
+            relocatevalue(B, &cl->c.upvals[i]);
+    }
+    else
+    {
+        relocptr(B, cl->l.p);
+
+        for (int i = 0; i < cl->nupvalues; ++i)
+            relocatevalue(B, &cl->l.uprefs[i]);
+    }
+}
+
+static void relocatethread(SnapshotBuilder* B, lua_State* th)
+{
+    // values above the top are dead, but they are relocated anyway since the stack isn't cleared when it shrinks
+    for (int i = 0; i < th->stacksize; ++i)
+        relocatevalue(B, &th->stack[i]);
+
+    for (CallInfo* ci = th->base_ci; ci <= th->ci; ++ci)
+    {
+        relocptr(B, ci->base);
+        relocptr(B, ci->func);
+        relocptr(B, ci->top);
+        relocptr(B, ci->savedpc);
+    }
+
+    relocptr(B, th->top);
+    relocptr(B, th->base);
+    relocptr(B, th->global);
+    relocptr(B, th->ci);
+    relocptr(B, th->stack_last);
+    relocptr(B, th->stack);
+    relocptr(B, th->end_ci);
+    relocptr(B, th->base_ci);
+    relocptr(B, th->gt);
+    relocptr(B, th->openupval);
+    relocptr(B, th->gclist);
+    relocptr(B, th->namecall);
+}
+
+static void relocateproto(SnapshotBuilder* B, Proto* p)
+{
+    for (int i = 0; i < p->sizek; ++i)
+        relocatevalue(B, &p->k[i]);
+
+    for (int i = 0; i < p->sizep; ++i)
+        relocptr(B, p->p[i]);
+
+    for (int i = 0; i < p->sizelocvars; ++i)
+        relocptr(B, p->locvars[i].varname);
+
+    for (int i = 0; i < p->sizeupvalues; ++i)
+        relocptr(B, p->upvalues[i]);
+
+    // stale entries point into tables that may be gone; they are relocated like the rest since their epochs never match again
+    for (int i = 0; p->namecache && i < p->sizenamecache; ++i)
+    {
+        for (int j = 0; j < LUA_NAMECALL_CACHESIZE; ++j)
+        {
+            NamecallEntry* e = &p->namecache[i].entries[j];
+
+            for (int d = 0; d < e->depth; ++d)
+            {
+                relocptr(B, e->levels[d].mt);
+                relocptr(B, e->levels[d].h);
+                relocptr(B, e->levels[d].index);
+                relocptr(B, e->levels[d].slot);
+            }
+        }
+    }
+
+    relocptr(B, p->k);
+    relocptr(B, p->code);
+    relocptr(B, p->p);
+    relocptr(B, p->lineinfo);
+    relocptr(B, p->abslineinfo);
+    relocptr(B, p->locvars);
+    relocptr(B, p->upvalues);
+    relocptr(B, p->source);
+    relocptr(B, p->debugname);
+    relocptr(B, p->debuginsn);
+    relocptr(B, p->chunk);
+    relocptr(B, p->namecache);
+    relocptr(B, p->gclist);
+}
+
+static void relocateupval(SnapshotBuilder* B, UpVal* uv)
+{
+    if (upisopen(uv))
+    {
+        relocptr(B, uv->u.open.prev);
+        relocptr(B, uv->u.open.next);
+        relocptr(B, uv->u.open.threadnext);
+    }
+    else
+    {
+        relocatevalue(B, &uv->u.value);
+    }
+
+    relocptr(B, uv->v);
+}
+
+static int relocategco(void* context, lua_Page* page, GCObject* gco)
+{
+    SnapshotBuilder* B = (SnapshotBuilder*)context;
+
+    switch (gco->gch.tt)
+    {
+    case LUA_TSTRING:
+    {
+        TString* ts = gco2ts(gco);
+
+        relocptr(B, ts->next);
+
+        if (ts->slice)
+        {
+            relocptr(B, gslice(ts)->parent);
+            relocptr(B, gslice(ts)->data);
+        }
+        break;
+    }
+    case LUA_TTABLE:
+        relocatetable(B, gco2h(gco));
+        break;
+    case LUA_TFUNCTION:
+        relocateclosure(B, gco2cl(gco));
+        break;
+    case LUA_TUSERDATA:
+        relocptr(B, gco2u(gco)->metatable);
+        break;
+    case LUA_TTHREAD:
+        relocatethread(B, gco2th(gco));
+        break;
+    case LUA_TPROTO:
+        relocateproto(B, gco2p(gco));
+        break;
+    case LUA_TUPVAL:
+        relocateupval(B, gco2uv(gco));
+        break;
+    default:
+        LUAU_ASSERT(!"Unknown object type");
+    }
+
+    return 0;
+}
+
+static void relocatechunk(SnapshotBuilder* B, LazyChunk* chunk)
+{
+    for (unsigned int i = 0; i < chunk->protoCount; ++i)
+        relocptr(B, chunk->protos[i]);
+
+    relocptr(B, chunk->data);
+    relocptr(B, chunk->protos);
+    relocptr(B, chunk->env);
+    relocptr(B, chunk->gt);
+
+    // string offsets of chunks that don't come from a program are stored after the function table, which may be at the end of the chunk
+    relocateto(B, (void**)&chunk->strings, chunk->program ? (const void*)chunk->strings : (const void*)chunk);
+}
+
+static void relocateglobal(SnapshotBuilder* B, global_State* g)
+{
+    LUAU_ASSERT(!g->strt.oldhash);
+
+    for (int i = 0; i < g->strt.size; ++i)
+        relocptr(B, g->strt.hash[i]);
+
+    relocptr(B, g->strt.hash);
+
+    relocptr(B, g->gray);
+    relocptr(B, g->grayagain);
+    relocptr(B, g->weak);
+    relocptr(B, g->weakcursor);
+
+    for (int i = 0; i < LUA_SIZECLASSES; i++)
+    {
+        relocptr(B, g->freepages[i]);
+        relocptr(B, g->freegcopages[i]);
+    }
+
+    relocptr(B, g->allgcopages);
+    relocptr(B, g->sweepgcopage);
+
+    relocptr(B, g->mainthread);
+    relocptr(B, g->uvhead.u.open.prev);
+    relocptr(B, g->uvhead.u.open.next);
+
+    for (int i = 0; i < LUA_T_COUNT; i++)
+    {
+        relocptr(B, g->mt[i]);
+        relocptr(B, g->ttname[i]);
+    }
+
+    for (int i = 0; i < TM_N; i++)
+        relocptr(B, g->tmname[i]);
+
+    relocptr(B, g->shaperoot);
+
+    relocatevalue(B, &g->pseudotemp);
+    relocatevalue(B, &g->registry);
+}
+
+static void freebuilder(SnapshotBuilder* B)
+{
+    lua_StateSnapshot* S = B->snapshot;
+    global_State* g = B->g;
+
+    (*g->frealloc)(g->ud, B->chunks, B->chunkCapacity * sizeof(LazyChunk*), 0);
+
+    if (B->failed)
+    {
+        if (S->image)
+            (*g->frealloc)(g->ud, S->image, S->imagesize, 0);
+        (*g->frealloc)(g->ud, S->segments, B->segmentCapacity * sizeof(SnapshotSegment), 0);
+        (*g->frealloc)(g->ud, S->relocs, B->relocCapacity * sizeof(SnapshotReloc), 0);
+        (*g->frealloc)(g->ud, S, sizeof(lua_StateSnapshot), 0);
+    }
+}
+
+static lua_StateSnapshot* buildsnapshot(lua_State* L)
+{
+    global_State* g = L->global;
+
+    lua_StateSnapshot* S = (lua_StateSnapshot*)(*g->frealloc)(g->ud, NULL, 0, sizeof(lua_StateSnapshot));
+    if (!S)
+        return NULL;
+
+    memset(S, 0, sizeof(lua_StateSnapshot));
+    S->frealloc = g->frealloc;
+    S->ud = g->ud;
+
+    SnapshotBuilder B = {L, g, S, 0, 0, NULL, 0, 0, 0};
+
+    // find all memory blocks of the heap
+    addsegment(&B, g->mainthread, sizeof(LG), SEGMENT_BLOCK);
+
+    for (lua_Page* page = g->allgcopages; page; page = luaM_getnextgcopage(page))
+        addsegment(&B, page, luaM_getpagesize(page), SEGMENT_GCOPAGE);
+
+    addthreadblocks(&B, g->mainthread);
+    luaM_visitgco(L, &B, discovergco);
+
+    addblock(&B, g->strt.hash, g->strt.size * sizeof(TString*));
+
+    for (TableShape* s = g->shaperoot; s; s = nextshape(s))
+    {
+        addblock(&B, s, sizeof(TableShape));
+
+        if (isfirstinchain(s))
+            addblock(&B, s->keys, sizeshapekeys(s->keys->size, s->keys->lsizeindex));
+    }
+
+    // chunks is NULL when nothing was loaded lazily
+    if (B.chunkCount > 1)
+        qsort(B.chunks, B.chunkCount, sizeof(LazyChunk*), comparechunks);
+
+    size_t chunkCount = 0;
+    size_t programCount = 0;
+
+    for (size_t i = 0; i < B.chunkCount; ++i)
+    {
+        if (chunkCount > 0 && B.chunks[chunkCount - 1] == B.chunks[i])
+            continue;
+
+        LazyChunk* chunk = B.chunks[i];
+        B.chunks[chunkCount++] = chunk;
+
+        addblock(&B, chunk, chunk->memsize);
+
+        if (chunk->program)
+            programCount++;
+    }
+
+    B.chunkCount = chunkCount;
+
+    if (!B.failed)
+        layoutsegments(&B);
+
+    if (!B.failed)
+    {
+        S->image = (char*)(*g->frealloc)(g->ud, NULL, 0, S->imagesize);
+
+        if (S->image)
+            memset(S->image, 0, S->imagesize);
+        else
+            B.failed = 1;
+    }
+
+    // copy the segments; pages record the relocations of page headers and free lists while they are copied
+    for (size_t i = 0; i < S->segmentCount && !B.failed; ++i)
+    {
+        SnapshotSegment* seg = &S->segments[i];
+
+        if (seg->kind == SEGMENT_BLOCK)
+            memcpy(S->image + seg->offset, seg->source, seg->size);
+        else
+            luaM_copypage((lua_Page*)seg->source, seg->kind == SEGMENT_GCOPAGE, S->image + seg->offset, &B, relocate);
+    }
+
+    // relocate the pointers stored in the objects
+    if (!B.failed)
+    {
+        S->mainsegment = (size_t)(findsegment(S, g->mainthread) - S->segments);
+
+        relocatethread(&B, g->mainthread);
+        relocateglobal(&B, g);
+
+        luaM_visitgco(L, &B, relocategco);
+
+        for (TableShape* s = g->shaperoot; s; s = nextshape(s))
+        {
+            relocptr(&B, s->parent);
+            relocptr(&B, s->child);
+            relocptr(&B, s->sibling);
+            relocptr(&B, s->key);
+
+            if (isfirstinchain(s))
+            {
+                relocptr(&B, s->keys->last);
+
+                // keys of freed shapes are cleared, so all keys are either live or NULL
+                for (int i = 0; i < s->keys->size; ++i)
+                    relocptr(&B, s->keys->keys[i]);
+            }
+
+            relocptr(&B, s->keys);
+        }
+
+        for (size_t i = 0; i < B.chunkCount; ++i)
+            relocatechunk(&B, B.chunks[i]);
+    }
+
+    if (!B.failed && programCount)
+    {
+        S->programs = (lua_Program**)(*g->frealloc)(g->ud, NULL, 0, programCount * sizeof(lua_Program*));
+
+        if (!S->programs)
+            B.failed = 1;
+    }
+
+    if (B.failed)
+    {
+        freebuilder(&B);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < B.chunkCount; ++i)
+    {
+        lua_Program* program = B.chunks[i]->program;
+
+        if (program)
+        {
+            luau_retainprogram(program);
+            S->programs[S->programCount++] = program;
+        }
+    }
+
+    for (size_t i = 0; i < S->segmentCount; ++i)
+        S->segments[i].source = NULL;
+
+    shrink(&B, (void**)&S->segments, B.segmentCapacity, S->segmentCount, sizeof(SnapshotSegment));
+    shrink(&B, (void**)&S->relocs, B.relocCapacity, S->relocCount, sizeof(SnapshotReloc));
+
+    freebuilder(&B);
+    return S;
+}
+
+static void restorebgsweep(lua_State* L, void* ud)
+{
+    (void)sizeof(ud);
+    luaC_setbgsweep(L, 1);
+}
+
+lua_StateSnapshot* lua_snapshotstate(lua_State* L)
+{
+    global_State* g = L->global;
+
+    // call frames refer to the C stack and error handlers of the running state
+    if (L->nCcalls || g->mainthread->nCcalls || g->errorjmp)
+        return NULL;
+
+#if LUA_CUSTOM_EXECUTION
+    // native code is owned by the execution callbacks
+    if (g->ecb.context || g->ecb.close)
+        return NULL;
+#endif
+
+    // background sweep and incremental string table resize (which can be started by the collection) own blocks that the objects don't
+    int bgsweep = luaC_setbgsweep(L, 0);
+    luaC_fullgc(L);
+    luaS_rehash(L, INT_MAX);
+
+    // cached pages are not part of the heap
+    luaM_freepagecache(L);
+
+    lua_StateSnapshot* S = buildsnapshot(L);
+
+    // if the worker can't be created, sweep continues on the mutator thread
+    if (bgsweep)
+        luaD_rawrunprotected(L, restorebgsweep, NULL);
+
+    return S;
+}
+
+lua_State* lua_newstatefromsnapshot(const lua_StateSnapshot* snapshot, lua_Alloc f, void* ud)
+{
+    const lua_StateSnapshot* S = snapshot;
+
+    char** blocks = (char**)(*f)(ud, NULL, 0, S->segmentCount * sizeof(char*));
+    if (!blocks)
+        return NULL;
+
+    for (size_t i = 0; i < S->segmentCount; ++i)
+    {
+        const SnapshotSegment* seg = &S->segments[i];
+
+        blocks[i] = (char*)(*f)(ud, NULL, 0, seg->size);
+
+        if (!blocks[i])
+        {
+            while (i-- > 0)
+                (*f)(ud, blocks[i], S->segments[i].size, 0);
+
+            (*f)(ud, blocks, S->segmentCount * sizeof(char*), 0);
+            return NULL;
+        }
+
+        memcpy(blocks[i], S->image + seg->offset, seg->size);
+    }
+
+    for (size_t i = 0; i < S->relocCount; ++i)
+    {
+        const SnapshotReloc* r = &S->relocs[i];
+        char* slot = blocks[r->segment] + r->offset;
+
+        uintptr_t offset;
+        memcpy(&offset, slot, sizeof(offset));
+
+        char* value = blocks[r->target] + offset;
+        memcpy(slot, &value, sizeof(value));
+    }
+
+    // free blocks are not poisoned in fresh memory
+    for (size_t i = 0; i < S->segmentCount; ++i)
+    {
+        if (S->segments[i].kind != SEGMENT_BLOCK)
+            luaM_poisonpage((lua_Page*)blocks[i], S->segments[i].kind == SEGMENT_GCOPAGE);
+    }
+
+    lua_State* L = (lua_State*)blocks[S->mainsegment];
+    global_State* g = L->global;
+
+    (*f)(ud, blocks, S->segmentCount * sizeof(char*), 0);
+
+    LUAU_ASSERT(g->mainthread == L);
+    LUAU_ASSERT(!g->errorjmp && !g->sweepworker && !g->pagecache);
+
+    g->frealloc = f;
+    g->ud = ud;
+
+    // pages of the new state are allocated with frealloc; background sweep, page arena and allocation histogram can be enabled again
+    g->pagearena = NULL;
+    g->allochistogram = NULL;
+    g->pagecachehits = 0;
+    g->pagecachemisses = 0;
+
+    // states that are stamped from the same snapshot get different random sequences, just like states that are initialized separately
+    g->rngstate ^= (uintptr_t)L;
+
+    for (size_t i = 0; i < S->programCount; ++i)
+        luau_retainprogram(S->programs[i]);
+
+    return L;
+}
+
+void lua_freestatesnapshot(lua_StateSnapshot* snapshot)
+{
+    lua_StateSnapshot* S = snapshot;
+
+    for (size_t i = 0; i < S->programCount; ++i)
+        luau_releaseprogram(S->programs[i]);
+
+    (*S->frealloc)(S->ud, S->programs, S->programCount * sizeof(lua_Program*), 0);
+    (*S->frealloc)(S->ud, S->relocs, S->relocCount * sizeof(SnapshotReloc), 0);
+    (*S->frealloc)(S->ud, S->segments, S->segmentCount * sizeof(SnapshotSegment), 0);
+    (*S->frealloc)(S->ud, S->image, S->imagesize, 0);
+    (*S->frealloc)(S->ud, S, sizeof(lua_StateSnapshot), 0);
+}
+
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
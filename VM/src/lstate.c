@@ -18,15 +18,6 @@
 #pragma clang diagnostic ignored "-Wextra-semi-stmt"
 #endif
 
-/*
-** Main thread combines a thread state and the global state
-*/
-typedef struct LG
-{
-    lua_State l;
-    global_State g;
-} LG;
-
 static void stack_init(lua_State* L1, lua_State* L)
 {
     // initialize CallInfo array
@@ -95,10 +86,17 @@ static void close_state(lua_State* L)
 {
     global_State* g = L->global;
     luaF_close(L, L->stack); // close all upvalues for this thread
+    luaC_setbgsweep(L, 0);   // stop sweep helper thread
     luaC_freeall(L);         // collect all objects
+    luaH_freeshapes(L);
     LUAU_ASSERT(g->strt.nuse == 0);
+    luaS_rehash(L, INT_MAX); // finish string table resize if there's one in progress
     luaM_freearray(L, L->global->strt.hash, L->global->strt.size, TString*, 0);
     freestack(L, L);
+    luaM_freepagecache(L);
+    LUAU_ASSERT(g->pagecache == NULL);
+    luaM_freepagearena(L);
+    luaM_setallochistogram(L, 0);
     for (int i = 0; i < LUA_SIZECLASSES; i++)
     {
         LUAU_ASSERT(g->freepages[i] == NULL);
@@ -174,7 +172,7 @@ int lua_isthreadreset(lua_State* L)
     return L->ci == L->base_ci && L->base == L->top && L->status == LUA_OK;
 }
 
-lua_State* lua_newstate(lua_Alloc f, void* ud)
+static lua_State* newstate(lua_Alloc f, void* ud, const int* sizes, int count)
 {
     if (!lua_has_setup)
     {
@@ -182,6 +180,8 @@ lua_State* lua_newstate(lua_Alloc f, void* ud)
         lua_setupmemsizeclassconfig();
         lua_setupclock();
     }
+    if (sizes && !luaM_validsizeclasses(sizes, count))
+        return NULL;
     int i;
     lua_State* L;
     global_State* g;
@@ -210,16 +210,34 @@ lua_State* lua_newstate(lua_Alloc f, void* ud)
     g->strt.size = 0;
     g->strt.nuse = 0;
     g->strt.hash = NULL;
+    g->strt.oldhash = NULL;
+    g->strt.oldsize = 0;
+    g->strt.rehashpos = 0;
     setnilvalue(&g->pseudotemp);
     setnilvalue(registry(L));
     g->gcstate = GCSpause;
     g->gray = NULL;
     g->grayagain = NULL;
     g->weak = NULL;
+    g->weakcursor = NULL;
+    g->weakpasses = 0;
+    g->weakrecord = 0;
+    g->weakkeycount = 0;
+    g->weakbudget = 0;
+    g->weaknode = NULL;
+    g->weakindex = 0;
+    g->weaklastfree = 0;
     g->totalbytes = sizeof(LG);
     g->gcgoal = LUAI_GCGOAL;
     g->gcstepmul = LUAI_GCSTEPMUL;
     g->gcstepsize = LUAI_GCSTEPSIZE << 10;
+    g->gcgen = 0;
+    g->gcgenmark = 0;
+    g->gcminor = 0;
+    g->gcsticky = 0;
+    g->gcgenminormul = LUAI_GCGENMINORMUL;
+    g->gcgenmajormul = LUAI_GCGENMAJORMUL;
+    g->gcgenmajorbase = 0;
     for (i = 0; i < LUA_SIZECLASSES; i++)
     {
         g->freepages[i] = NULL;
@@ -227,12 +245,29 @@ lua_State* lua_newstate(lua_Alloc f, void* ud)
     }
     g->allgcopages = NULL;
     g->sweepgcopage = NULL;
+    g->sweepworker = NULL;
+    g->sweepjob = 0;
+    g->pagecache = NULL;
+    g->pagecachesize = 0;
+    g->pagecachelimit = LUAI_GCPAGECACHE;
+    g->pagecachelowwater = 0;
+    g->pagecachehits = 0;
+    g->pagecachemisses = 0;
+    g->pagearena = NULL;
+    g->allochistogram = NULL;
+    g->shaperoot = NULL;
+    g->namecallepoch = 1;
     for (i = 0; i < LUA_T_COUNT; i++)
         g->mt[i] = NULL;
     for (i = 0; i < LUA_UTAG_LIMIT; i++)
         g->udatagc[i] = NULL;
     for (i = 0; i < LUA_MEMORY_CATEGORIES; i++)
+    {
         g->memcatbytes[i] = 0;
+        g->memcatthreshold[i] = SIZE_MAX;
+        g->memcatsoftlimit[i] = SIZE_MAX;
+        g->memcathardlimit[i] = SIZE_MAX;
+    }
 
     g->memcatbytes[0] = sizeof(LG);
 
@@ -246,6 +281,8 @@ lua_State* lua_newstate(lua_Alloc f, void* ud)
     g->gcmetrics = GCMetrics();
 #endif
 
+    luaM_setsizeclasses(L, sizes, count);
+
     if (luaD_rawrunprotected(L, f_luaopen, NULL) != 0)
     {
         // memory allocation error: free partial state
@@ -255,6 +292,16 @@ lua_State* lua_newstate(lua_Alloc f, void* ud)
     return L;
 }
 
+lua_State* lua_newstate(lua_Alloc f, void* ud)
+{
+    return newstate(f, ud, NULL, 0);
+}
+
+lua_State* lua_newstatewithsizeclasses(lua_Alloc f, void* ud, const int* sizes, int count)
+{
+    return newstate(f, ud, sizes, count);
+}
+
 void lua_close(lua_State* L)
 {
     L = L->global->mainthread; // only the main thread can be closed
@@ -22,9 +22,24 @@ typedef struct stringtable
     TString** hash;
     uint32_t nuse; // number of elements
     int size;
+
+    TString** oldhash; // bucket array that is being migrated to `hash' during incremental resize, NULL if there is none
+    int oldsize;
+    int rehashpos; // next bucket in `oldhash' to migrate
 } stringtable;
 // clang-format on
 
+// largest block size that is allocated from size class pages; larger blocks are allocated with frealloc directly
+#define LUAI_MAXSMALLSIZE 512
+
+// size classes used by the page allocator, see lmem.c
+typedef struct SizeClassConfig
+{
+    int sizeOfClass[LUA_SIZECLASSES];
+    int8_t classForSize[LUAI_MAXSMALLSIZE + 1];
+    int classCount;
+} SizeClassConfig;
+
 /*
 ** informations about a call
 **
@@ -89,6 +104,10 @@ typedef struct GCStats
     double starttimestamp;
     double atomicstarttimestamp;
     double endtimestamp;
+
+    double sweeptime;    // total time spent sweeping on the mutator thread
+    size_t sweepbgpages; // number of pages released using results of the background sweep
+    size_t sweepbgbytes; // total size of objects freed by the background sweep
 } GCStats;
 
 #ifdef LUAI_GCMETRICS
@@ -118,6 +137,9 @@ struct GCCycleMetrics
     double atomictimegray;
     double atomictimeclear;
 
+    double clearweaktime; // removing dead keys from tables with weak keys after atomic
+    size_t clearweakwork;
+
     double sweeptime;
     double sweepassisttime;
     double sweepmaxexplicittime;
@@ -172,25 +194,63 @@ typedef struct global_State
     uint8_t currentwhite;
     uint8_t gcstate; // state of garbage collector
 
+    uint8_t gcgen;     // generational mode was requested via lua_gc
+    uint8_t gcgenmark; // current mark phase runs in generational mode (sampled from `gcgen' at cycle start)
+    uint8_t gcminor;   // current mark phase is a minor collection that doesn't traverse old objects
+    uint8_t gcsticky;  // objects that survived the last mark keep their color through the sweep (they become old)
+
 
     GCObject* gray;      // list of gray objects
     GCObject* grayagain; // list of objects to be traversed atomically
     GCObject* weak;     // list of weak tables (to be cleared)
 
+    GCObject* weakcursor; // next table to visit in the current marking pass over `weak' ephemerons
+    uint8_t weakpasses;   // number of marking passes over `weak' ephemerons started in this cycle
+    uint8_t weakrecord;   // objects marked since the start of the last pass are recorded in `weakkeys' (2 while they can't be looked up)
+    int weakkeycount;     // number of recorded objects; exceeds LUA_EPHEMERON_MARKS if some of them were lost
+    size_t weakbudget;    // lookups of recorded objects left before tables with weak keys have to be traversed instead
+    GCObject* weakkeys[LUA_EPHEMERON_MARKS];
+
+    LuaNode* weaknode;    // node array of the table at the front of `weak' while its dead keys are cleared after atomic
+    int weakindex;        // nodes from this index up are cleared
+    int weaklastfree;     // `lastfree' of the table at the last clearing step; newkey moves entries to free positions below it
+
 
     size_t GCthreshold;                       // when totalbytes > GCthreshold, run GC step
     size_t totalbytes;                        // number of bytes currently allocated
     int gcgoal;                               // see LUAI_GCGOAL
     int gcstepmul;                            // see LUAI_GCSTEPMUL
     int gcstepsize;                          // see LUAI_GCSTEPSIZE
+    int gcgenminormul;                        // see LUAI_GCGENMINORMUL
+    int gcgenmajormul;                        // see LUAI_GCGENMAJORMUL
+    size_t gcgenmajorbase;                    // heap size after the last major collection
+
+    SizeClassConfig sizeclasses; // see lua_newstatewithsizeclasses
 
     struct lua_Page* freepages[LUA_SIZECLASSES]; // free page linked list for each size class for non-collectable objects
     struct lua_Page* freegcopages[LUA_SIZECLASSES]; // free page linked list for each size class for collectable objects
     struct lua_Page* allgcopages; // page linked list with all pages for all classes
     struct lua_Page* sweepgcopage; // position of the sweep in `allgcopages'
+    struct lua_SweepWorker* sweepworker; // helper thread for background sweep, see LUA_GCBACKGROUNDSWEEP
+    uint8_t sweepjob;                    // some pages after the sweep position are owned by the helper thread, see lgcsweep.c
+
+    struct lua_Page* pagecache; // empty pages kept around for reuse, linked with lua_Page::next
+    int pagecachesize;          // number of pages in `pagecache'
+    int pagecachelimit;         // maximum number of pages in `pagecache', see LUA_GCSETPAGECACHE
+    int pagecachelowwater;      // smallest `pagecachesize' since the last trim
+    uint64_t pagecachehits;     // number of page allocations served from `pagecache'
+    uint64_t pagecachemisses;   // number of page allocations that had to call `frealloc'
+
+    struct lua_PageArena* pagearena; // OS memory arena for standard size pages, see LUA_GCPAGEARENA
+
+    size_t* allochistogram; // number of allocations of each requested size, see lua_setallochistogram
 
     size_t memcatbytes[LUA_MEMORY_CATEGORIES]; // total amount of memory used by each memory category
 
+    size_t memcatthreshold[LUA_MEMORY_CATEGORIES]; // allocations that go over this size take the slow path to check memory limits
+    size_t memcatsoftlimit[LUA_MEMORY_CATEGORIES]; // see lua_setmemcatlimit; SIZE_MAX if not set
+    size_t memcathardlimit[LUA_MEMORY_CATEGORIES]; // see lua_setmemcatlimit; SIZE_MAX if not set
+
 
     struct lua_State* mainthread;
     UpVal uvhead;                                    // head of double-linked list of all open upvalues
@@ -198,6 +258,9 @@ typedef struct global_State
     TString* ttname[LUA_T_COUNT];       // names for basic types
     TString* tmname[TM_N];             // array with tag-method names
 
+    struct TableShape* shaperoot; // shape without keys that all table shapes are derived from; created on first use
+    uint32_t namecallepoch;       // namecall cache entries from older epochs are stale, see luaH_watch
+
     TValue pseudotemp; // storage for temporary values used in pseudo2addr
 
     TValue registry; // registry table, used by lua_ref and LUA_REGISTRYINDEX
@@ -271,6 +334,15 @@ struct lua_State
 };
 // clang-format on
 
+/*
+** Main thread combines a thread state and the global state
+*/
+typedef struct LG
+{
+    lua_State l;
+    global_State g;
+} LG;
+
 /*
 ** Union of all collectible objects
 */
@@ -47,30 +47,156 @@ unsigned int luaS_hash(const char* str, size_t len)
     return h;
 }
 
-void luaS_resize(lua_State* L, int newsize)
+/*
+ * String table can be resized incrementally to avoid long pauses when the table has millions of strings. When incremental resize
+ * starts, current bucket array becomes `oldhash' and a new bucket array is allocated; new strings are always added to the new
+ * array and every string allocation or GC step migrates a few chains from the old array. Lookups check both arrays until all chains
+ * are migrated; migrated buckets in the old array are left empty.
+ * String allocations migrate enough chains for the migration to finish before the new array gets crowded, so that the table can
+ * always grow again when it needs to.
+ */
+
+static void rehashbucket(stringtable* tb, TString* p)
+{
+    while (p)
+    {                            // for each node in the list
+        TString* next = p->next; // save next
+        unsigned int h = p->hash;
+        int h1 = lmod(h, tb->size); // new position
+        LUAU_ASSERT(cast_int(h % tb->size) == lmod(h, tb->size));
+        p->next = tb->hash[h1]; // chain it
+        tb->hash[h1] = p;
+        p = next;
+    }
+}
+
+void luaS_rehash(lua_State* L, int budget)
 {
+    stringtable* tb = &L->global->strt;
+
+    while (tb->oldhash && budget-- > 0)
+    {
+        TString* p = tb->oldhash[tb->rehashpos];
+        tb->oldhash[tb->rehashpos] = NULL;
+
+        rehashbucket(tb, p);
+
+        if (++tb->rehashpos == tb->oldsize)
+        {
+            luaM_freearray(L, tb->oldhash, tb->oldsize, TString*, 0);
+            tb->oldhash = NULL;
+            tb->oldsize = 0;
+            tb->rehashpos = 0;
+        }
+    }
+}
+
+static int rehashbudget(const stringtable* tb)
+{
+    int remaining = tb->oldsize - tb->rehashpos;
+    // string allocations that are left until the new array is crowded
+    int headroom = tb->nuse < cast_to(uint32_t, tb->size) ? tb->size - cast_int(tb->nuse) : 1;
+
+    int budget = (remaining + headroom - 1) / headroom;
+    return budget > LUA_STRTABREHASHSTEP ? budget : LUA_STRTABREHASHSTEP;
+}
+
+void luaS_startresize(lua_State* L, int newsize)
+{
+    stringtable* tb = &L->global->strt;
+
+    // only one resize can be in progress at a time; string allocations usually finish the migration before a new resize is needed
+    luaS_rehash(L, INT_MAX);
+
     TString** newhash = luaM_newarray(L, newsize, TString*, 0);
+    for (int i = 0; i < newsize; i++)
+        newhash[i] = NULL;
+
+    tb->oldhash = tb->hash;
+    tb->oldsize = tb->size;
+    tb->rehashpos = 0;
+
+    tb->hash = newhash;
+    tb->size = newsize;
+}
+
+void luaS_resize(lua_State* L, int newsize)
+{
     stringtable* tb = &L->global->strt;
+
+    // finish incremental resize if there's one in progress
+    luaS_rehash(L, INT_MAX);
+
+    TString** oldhash = tb->hash;
+    int oldsize = tb->size;
+
+    TString** newhash = luaM_newarray(L, newsize, TString*, 0);
     for (int i = 0; i < newsize; i++)
         newhash[i] = NULL;
+
+    tb->hash = newhash;
+    tb->size = newsize;
+
     // rehash
-    for (int i = 0; i < tb->size; i++)
+    for (int i = 0; i < oldsize; i++)
+        rehashbucket(tb, oldhash[i]);
+
+    luaM_freearray(L, oldhash, oldsize, TString*, 0);
+}
+
+static TString* findstr(global_State* g, const char* str, size_t l, unsigned int h)
+{
+    stringtable* tb = &g->strt;
+
+    for (TString* el = tb->hash[lmod(h, tb->size)]; el != NULL; el = el->next)
     {
-        TString* p = tb->hash[i];
-        while (p)
-        {                            // for each node in the list
-            TString* next = p->next; // save next
-            unsigned int h = p->hash;
-            int h1 = lmod(h, newsize); // new position
-            LUAU_ASSERT(cast_int(h % newsize) == lmod(h, newsize));
-            p->next = newhash[h1]; // chain it
-            newhash[h1] = p;
-            p = next;
+        // dead slices can't be resurrected since their parent may already be freed; they are unlinked when they are swept
+        if (el->slice && isdead(g, obj2gco(el)))
+            continue;
+
+        if (el->len == l && (memcmp(str, getstr(el), l) == 0))
+        {
+            // string may be dead
+            if (isdead(g, obj2gco(el)))
+                changewhite(obj2gco(el));
+            return el;
         }
     }
-    luaM_freearray(L, tb->hash, tb->size, TString*, 0);
-    tb->size = newsize;
-    tb->hash = newhash;
+
+    // chains that weren't migrated yet
+    if (tb->oldhash)
+    {
+        for (TString* el = tb->oldhash[lmod(h, tb->oldsize)]; el != NULL; el = el->next)
+        {
+            if (el->slice && isdead(g, obj2gco(el)))
+                continue;
+
+            if (el->len == l && (memcmp(str, getstr(el), l) == 0))
+            {
+                // string may be dead
+                if (isdead(g, obj2gco(el)))
+                    changewhite(obj2gco(el));
+                return el;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void insertstr(lua_State* L, TString* ts)
+{
+    stringtable* tb = &L->global->strt;
+    int bucket = lmod(ts->hash, tb->size);
+    ts->next = tb->hash[bucket]; // chain new entry
+    tb->hash[bucket] = ts;
+
+    tb->nuse++;
+    if (tb->oldhash)
+        luaS_rehash(L, rehashbudget(tb));
+
+    if (!tb->oldhash && tb->nuse > cast_to(uint32_t, tb->size) && tb->size <= INT_MAX / 2)
+        luaS_startresize(L, tb->size * 2); // too crowded
 }
 
 static TString* newlstr(lua_State* L, const char* str, size_t l, unsigned int h)
@@ -80,21 +206,16 @@ static TString* newlstr(lua_State* L, const char* str, size_t l, unsigned int h)
 
     TString* ts = luaM_newgco(L, TString, sizestring(l), L->activememcat);
     luaC_init(L, ts, LUA_TSTRING);
+    ts->slice = 0;
     ts->atom = ATOM_UNDEF;
+    ts->ascii = STRASCII_UNKNOWN;
     ts->hash = h;
     ts->len = (unsigned)(l);
 
     memcpy(ts->data, str, l);
     ts->data[l] = '\0'; // ending 0
 
-    stringtable* tb = &L->global->strt;
-    h = lmod(h, tb->size);
-    ts->next = tb->hash[h]; // chain new entry
-    tb->hash[h] = ts;
-
-    tb->nuse++;
-    if (tb->nuse > cast_to(uint32_t, tb->size) && tb->size <= INT_MAX / 2)
-        luaS_resize(L, tb->size * 2); // too crowded
+    insertstr(L, ts);
 
     return ts;
 }
@@ -106,7 +227,9 @@ TString* luaS_bufstart(lua_State* L, size_t size)
 
     TString* ts = luaM_newgco(L, TString, sizestring(size), L->activememcat);
     luaC_init(L, ts, LUA_TSTRING);
+    ts->slice = 0;
     ts->atom = ATOM_UNDEF;
+    ts->ascii = STRASCII_UNKNOWN;
     ts->hash = 0; // computed in luaS_buffinish
     ts->len = (unsigned)(size);
 
@@ -118,33 +241,20 @@ TString* luaS_bufstart(lua_State* L, size_t size)
 TString* luaS_buffinish(lua_State* L, TString* ts)
 {
     unsigned int h = luaS_hash(ts->data, ts->len);
-    stringtable* tb = &L->global->strt;
-    int bucket = lmod(h, tb->size);
 
     // search if we already have this string in the hash table
-    for (TString* el = tb->hash[bucket]; el != NULL; el = el->next)
-    {
-        if (el->len == ts->len && memcmp(el->data, ts->data, ts->len) == 0)
-        {
-            // string may be dead
-            if (isdead(L->global, obj2gco(el)))
-                changewhite(obj2gco(el));
-
-            return el;
-        }
-    }
+    TString* el = findstr(L->global, ts->data, ts->len, h);
+    if (el)
+        return el;
 
     LUAU_ASSERT(ts->next == NULL);
 
     ts->hash = h;
     ts->data[ts->len] = '\0'; // ending 0
     ts->atom = ATOM_UNDEF;
-    ts->next = tb->hash[bucket]; // chain new entry
-    tb->hash[bucket] = ts;
+    ts->ascii = STRASCII_UNKNOWN;
 
-    tb->nuse++;
-    if (tb->nuse > cast_to(uint32_t, tb->size) && tb->size <= INT_MAX / 2)
-        luaS_resize(L, tb->size * 2); // too crowded
+    insertstr(L, ts);
 
     return ts;
 }
@@ -152,25 +262,57 @@ TString* luaS_buffinish(lua_State* L, TString* ts)
 TString* luaS_newlstr(lua_State* L, const char* str, size_t l)
 {
     unsigned int h = luaS_hash(str, l);
-    unsigned int hmod = lmod(h, L->global->strt.size);
-    for (TString* el = L->global->strt.hash[hmod]; el != NULL; el = el->next)
+
+    TString* el = findstr(L->global, str, l, h);
+    if (el)
+        return el;
+
+    return newlstr(L, str, l, h); // not found
+}
+
+TString* luaS_newsuffix(lua_State* L, TString* ts, size_t offset)
+{
+    LUAU_ASSERT(offset <= ts->len);
+
+    // slices always reference the string that owns the data
+    if (ts->slice)
     {
-        if (el->len == l && (memcmp(str, getstr(el), l) == 0))
-        {
-            // string may be dead
-            if (isdead(L->global, obj2gco(el)))
-                changewhite(obj2gco(el));
-            return el;
-        }
+        TStringSlice* ss = gslice(ts);
+        offset += ss->data - getstr(ss->parent);
+        ts = ss->parent;
     }
-    return newlstr(L, str, l, h); // not found
+
+    const char* str = getstr(ts) + offset;
+    size_t l = ts->len - offset;
+
+    // a slice keeps the entire parent alive, so short suffixes and suffixes of much longer strings are copied
+    if (l < LUA_STRING_SLICEMIN || l < ts->len / LUA_STRING_SLICERATIO)
+        return luaS_newlstr(L, str, l);
+
+    unsigned int h = luaS_hash(str, l);
+
+    TString* el = findstr(L->global, str, l, h);
+    if (el)
+        return el;
+
+    TString* ss = luaM_newgco(L, TString, sizeslice(), L->activememcat);
+    luaC_init(L, ss, LUA_TSTRING);
+    ss->slice = 1;
+    ss->atom = ATOM_UNDEF;
+    ss->ascii = ts->ascii == STRASCII_YES ? STRASCII_YES : STRASCII_UNKNOWN; // suffix of an ASCII string is ASCII
+    ss->hash = h;
+    ss->len = (unsigned)(l);
+
+    gslice(ss)->parent = ts;
+    gslice(ss)->data = cast_to(char*, str);
+
+    insertstr(L, ss);
+
+    return ss;
 }
 
-static int unlinkstr(lua_State* L, TString* ts)
+static int unlinkchain(TString** p, TString* ts)
 {
-    global_State* g = L->global;
-    unsigned int hmod = lmod(ts->hash, g->strt.size);
-    TString** p = &g->strt.hash[hmod];
     TString* curr;
     while ((curr = *p))
     {
@@ -188,6 +330,16 @@ static int unlinkstr(lua_State* L, TString* ts)
     return 0;
 }
 
+static int unlinkstr(lua_State* L, TString* ts)
+{
+    stringtable* tb = &L->global->strt;
+
+    if (unlinkchain(&tb->hash[lmod(ts->hash, tb->size)], ts))
+        return 1;
+
+    return tb->oldhash && unlinkchain(&tb->oldhash[lmod(ts->hash, tb->oldsize)], ts);
+}
+
 void luaS_free(lua_State* L, TString* ts, lua_Page* page)
 {
     if (unlinkstr(L, ts))
@@ -195,7 +347,7 @@ void luaS_free(lua_State* L, TString* ts, lua_Page* page)
     else
         LUAU_ASSERT(ts->next == NULL); // orphaned string buffer
 
-    luaM_freegco(L, ts, sizestring(ts->len), ts->memcat, page);
+    luaM_freegco(L, ts, sizetstring(ts), ts->memcat, page);
 }
 
 #ifdef __clang__
@@ -11,7 +11,12 @@
 // string atoms are not defined by default; the storage is 16-bit integer
 #define ATOM_UNDEF -32768
 
-#define sizestring(len) (offsetof(TString, data) + len + 1)
+// the data area always has room for the data pointer of a slice, see getstr; this doesn't change the size class of short strings
+#define sizestring(len) (offsetof(TString, data) + ((len) + 1 < sizeof(char*) ? sizeof(char*) : (len) + 1))
+#define sizeslice() (offsetof(TString, data) + sizeof(TStringSlice))
+
+// allocated size of a string object
+#define sizetstring(ts) ((ts)->slice ? sizeslice() : sizestring((ts)->len))
 
 #define luaS_new(L, s) (luaS_newlstr(L, s, strlen(s)))
 #define luaS_newliteral(L, s) (luaS_newlstr(L, "" s, (sizeof(s) / sizeof(char)) - 1))
@@ -21,8 +26,11 @@
 LUAI_FUNC unsigned int luaS_hash(const char* str, size_t len);
 
 LUAI_FUNC void luaS_resize(lua_State* L, int newsize);
+LUAI_FUNC void luaS_startresize(lua_State* L, int newsize);
+LUAI_FUNC void luaS_rehash(lua_State* L, int budget);
 
 LUAI_FUNC TString* luaS_newlstr(lua_State* L, const char* str, size_t l);
+LUAI_FUNC TString* luaS_newsuffix(lua_State* L, TString* ts, size_t offset);
 LUAI_FUNC void luaS_free(lua_State* L, TString* ts, struct lua_Page* page);
 
 LUAI_FUNC TString* luaS_bufstart(lua_State* L, size_t size);
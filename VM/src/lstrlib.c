@@ -9,11 +9,25 @@
 #include "lualib.h"
 
 #include "lstring.h"
+#include "lgc.h"
+#include "lnumutils.h"
 
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
 #include <stdio.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUA_STRSSE2 1
+#else
+#define LUA_STRSSE2 0
+#endif
+
+#if LUA_STRSSE2 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wsign-conversion"
@@ -43,7 +57,7 @@ static int posrelat(int pos, size_t len)
 static int str_sub(lua_State* L)
 {
     size_t l;
-    const char* s = luaL_checklstring(L, 1, &l);
+    luaL_checklstring(L, 1, &l);
     int start = posrelat(luaL_checkinteger(L, 2), l);
     int end = posrelat(luaL_optinteger(L, 3, -1), l);
     if (start < 1)
@@ -51,7 +65,7 @@ static int str_sub(lua_State* L)
     if (end > (int)l)
         end = (int)l;
     if (start <= end)
-        lua_pushlstring(L, s + start - 1, end - start + 1);
+        lua_pushsubstring(L, 1, start - 1, end - start + 1);
     else
         lua_pushliteral(L, "");
     return 1;
@@ -190,11 +204,13 @@ static int str_char(lua_State* L)
 typedef struct MatchState
 {
     int matchdepth;       // control for recursive depth (to avoid C stack overflow)
+    int src_idx;          // stack index of source string, captures that end at its end may reference it instead of copying
     const char* src_init; // init of source string
     const char* src_end;  // end ('\0') of source string
     const char* p_end;    // end ('\0') of pattern
     lua_State* L;
-    int level; // total number of captures (finished or unfinished)
+    const uint8_t* sets; // character sets of a compiled pattern
+    int level;           // total number of captures (finished or unfinished)
     struct
     {
         const char* init;
@@ -576,28 +592,693 @@ init: // using goto's to optimize tail recursion
     return s;
 }
 
+/*
+** Compiled patterns
+** Patterns are compiled into a list of items once and cached per pattern string. Character classes and sets become bitmaps, so matching
+** doesn't parse the pattern again. The compiled matcher follows the structure of `match' exactly, including the recursion depth and
+** the order in which captures are made; patterns that would raise an error when matched are not compiled and use `match' instead, so
+** the errors are still raised lazily.
+*/
+#define PATTERN_MAXITEMS 128
+#define PATTERN_MAXSETS 16
+#define PATTERN_SETSIZE 32
+
+enum PatternOp
+{
+    PI_END,
+    PI_CHAR,     // c: character
+    PI_ANY,      // `.'
+    PI_SET,      // c: set index
+    PI_CAPSTART, // `('
+    PI_CAPPOS,   // `()'
+    PI_CAPEND,   // `)'
+    PI_EOS,      // `$' at the end of the pattern
+    PI_BALANCE,  // c, d: `%bcd'
+    PI_FRONTIER, // c: set index
+    PI_BACKREF,  // c: capture character `1'..`9'
+};
+
+typedef struct PatternItem
+{
+    uint8_t op;
+    uint8_t rep; // `*', `+', `-', `?' or 0 for a single class
+    uint8_t c;
+    uint8_t d;
+} PatternItem;
+
+typedef struct Pattern
+{
+    int valid;     // 0 if the pattern has to be matched by `match'
+    int anchor;    // pattern starts with `^'
+    int firstchar; // character that all matches start with, or -1
+    int nitems;
+    int nsets;
+    PatternItem items[1];
+    // sets follow the items
+} Pattern;
+
+#define patternsets(pat) ((const uint8_t*)((pat)->items + (pat)->nitems))
+#define sizepattern(nitems, nsets) (offsetof(Pattern, items) + (nitems) * sizeof(PatternItem) + (nsets) * PATTERN_SETSIZE)
+#define insetc(sets, i, c) ((sets)[(i) * PATTERN_SETSIZE + ((c) >> 3)] & (1 << ((c) & 7)))
+
+typedef struct PatternCompiler
+{
+    PatternItem items[PATTERN_MAXITEMS];
+    uint8_t sets[PATTERN_MAXSETS][PATTERN_SETSIZE];
+    int nitems;
+    int nsets;
+} PatternCompiler;
+
+static PatternItem* addpatternitem(PatternCompiler* pc, int op)
+{
+    if (pc->nitems == PATTERN_MAXITEMS)
+        return NULL;
+    PatternItem* pi = &pc->items[pc->nitems++];
+    pi->op = (uint8_t)op;
+    pi->rep = 0;
+    pi->c = 0;
+    pi->d = 0;
+    return pi;
+}
+
+// adds a set of the characters matched by `p'..`ep' (a class or a bracket class); returns its index or -1 if there are too many
+static int addpatternset(PatternCompiler* pc, const char* p, const char* ep)
+{
+    if (pc->nsets == PATTERN_MAXSETS)
+        return -1;
+    uint8_t* set = pc->sets[pc->nsets];
+    memset(set, 0, PATTERN_SETSIZE);
+    for (int c = 0; c < 256; ++c)
+    {
+        int in = (*p == '[') ? matchbracketclass(c, p, ep - 1) : match_class(c, uchar(*(p + 1)));
+        if (in)
+            set[c >> 3] |= (uint8_t)(1 << (c & 7));
+    }
+    return pc->nsets++;
+}
+
+// finds the end of a single class like `classend', but returns NULL instead of raising an error
+static const char* compileclassend(const char* p, const char* p_end)
+{
+    switch (*p++)
+    {
+    case L_ESC:
+        return p == p_end ? NULL : p + 1;
+    case '[':
+        if (*p == '^')
+            p++;
+        do
+        {
+            if (p == p_end)
+                return NULL;
+            if (*(p++) == L_ESC && p < p_end)
+                p++;
+        } while (*p != ']');
+        return p + 1;
+    default:
+        return p;
+    }
+}
+
+// returns 0 if the pattern can't be compiled or would raise an error when matched
+static int compilepattern(PatternCompiler* pc, const char* p, const char* p_end)
+{
+    int level = 0;
+    int unfinished[LUA_MAXCAPTURES];
+    PatternItem* pi;
+
+    while (p != p_end)
+    {
+        switch (*p)
+        {
+        case '(':
+        {
+            if (level >= LUA_MAXCAPTURES || !(pi = addpatternitem(pc, PI_CAPSTART)))
+                return 0;
+            if (*(p + 1) == ')')
+            {
+                pi->op = PI_CAPPOS;
+                unfinished[level++] = 0;
+                p += 2;
+            }
+            else
+            {
+                unfinished[level++] = 1;
+                p += 1;
+            }
+            continue;
+        }
+        case ')':
+        {
+            int l = level - 1;
+            while (l >= 0 && !unfinished[l])
+                l--;
+            if (l < 0 || !addpatternitem(pc, PI_CAPEND))
+                return 0;
+            unfinished[l] = 0;
+            p += 1;
+            continue;
+        }
+        case '$':
+        {
+            if (p + 1 != p_end)
+                break;
+            if (!addpatternitem(pc, PI_EOS))
+                return 0;
+            p += 1;
+            continue;
+        }
+        case L_ESC:
+        {
+            char e = *(p + 1);
+            if (e == 'b')
+            {
+                if (p + 2 >= p_end - 1 || !(pi = addpatternitem(pc, PI_BALANCE)))
+                    return 0;
+                pi->c = uchar(*(p + 2));
+                pi->d = uchar(*(p + 3));
+                p += 4;
+                continue;
+            }
+            else if (e == 'f')
+            {
+                p += 2;
+                const char* ep = *p == '[' ? compileclassend(p, p_end) : NULL;
+                int set = ep ? addpatternset(pc, p, ep) : -1;
+                if (set < 0 || !(pi = addpatternitem(pc, PI_FRONTIER)))
+                    return 0;
+                pi->c = (uint8_t)set;
+                p = ep;
+                continue;
+            }
+            else if (e >= '0' && e <= '9')
+            {
+                int l = e - '1';
+                if (l < 0 || l >= level || unfinished[l] || !(pi = addpatternitem(pc, PI_BACKREF)))
+                    return 0;
+                pi->c = uchar(e);
+                p += 2;
+                continue;
+            }
+            break;
+        }
+        }
+
+        // pattern class plus optional suffix
+        const char* ep = compileclassend(p, p_end);
+        if (!ep || !(pi = addpatternitem(pc, PI_CHAR)))
+            return 0;
+
+        if (*p == '.')
+        {
+            pi->op = PI_ANY;
+        }
+        else if (*p == L_ESC || *p == '[')
+        {
+            int set = addpatternset(pc, p, ep);
+            if (set < 0)
+                return 0;
+            pi->op = PI_SET;
+            pi->c = (uint8_t)set;
+        }
+        else
+        {
+            pi->c = uchar(*p);
+        }
+
+        if (*ep == '*' || *ep == '+' || *ep == '-' || *ep == '?')
+        {
+            pi->rep = uchar(*ep);
+            ep++;
+        }
+        p = ep;
+    }
+
+    return addpatternitem(pc, PI_END) != NULL;
+}
+
+static int csinglematch(MatchState* ms, const char* s, const PatternItem* pi)
+{
+    if (s >= ms->src_end)
+        return 0;
+
+    int c = uchar(*s);
+    switch (pi->op)
+    {
+    case PI_CHAR:
+        return pi->c == c;
+    case PI_ANY:
+        return 1;
+    default:
+        return insetc(ms->sets, pi->c, c) != 0;
+    }
+}
+
+static const char* cmatch(MatchState* ms, const char* s, const PatternItem* pi);
+
+static const char* cmax_expand(MatchState* ms, const char* s, const PatternItem* pi)
+{
+    ptrdiff_t i = 0; // counts maximum expand for item
+    while (csinglematch(ms, s + i, pi))
+        i++;
+    // keeps trying to match with the maximum repetitions
+    while (i >= 0)
+    {
+        const char* res = cmatch(ms, (s + i), pi + 1);
+        if (res)
+            return res;
+        i--; // else didn't match; reduce 1 repetition to try again
+    }
+    return NULL;
+}
+
+static const char* cmin_expand(MatchState* ms, const char* s, const PatternItem* pi)
+{
+    for (;;)
+    {
+        const char* res = cmatch(ms, s, pi + 1);
+        if (res != NULL)
+            return res;
+        else if (csinglematch(ms, s, pi))
+            s++; // try with one more repetition
+        else
+            return NULL;
+    }
+}
+
+static const char* cstart_capture(MatchState* ms, const char* s, const PatternItem* pi, int what)
+{
+    const char* res;
+    int level = ms->level;
+    LUAU_ASSERT(level < LUA_MAXCAPTURES);
+    ms->capture[level].init = s;
+    ms->capture[level].len = what;
+    ms->level = level + 1;
+    if ((res = cmatch(ms, s, pi)) == NULL) // match failed?
+        ms->level--;                       // undo capture
+    return res;
+}
+
+static const char* cend_capture(MatchState* ms, const char* s, const PatternItem* pi)
+{
+    int l = capture_to_close(ms);
+    const char* res;
+    ms->capture[l].len = s - ms->capture[l].init; // close capture
+    if ((res = cmatch(ms, s, pi)) == NULL)        // match failed?
+        ms->capture[l].len = CAP_UNFINISHED;      // undo capture
+    return res;
+}
+
+static const char* cmatch(MatchState* ms, const char* s, const PatternItem* pi)
+{
+    if (ms->matchdepth-- == 0)
+        luaL_error(ms->L, "pattern too complex");
+init: // using goto's to optimize tail recursion
+    switch (pi->op)
+    {
+    case PI_END:
+        break;
+    case PI_CAPSTART:
+        s = cstart_capture(ms, s, pi + 1, CAP_UNFINISHED);
+        break;
+    case PI_CAPPOS:
+        s = cstart_capture(ms, s, pi + 1, CAP_POSITION);
+        break;
+    case PI_CAPEND:
+        s = cend_capture(ms, s, pi + 1);
+        break;
+    case PI_EOS:
+        s = (s == ms->src_end) ? s : NULL; // check end of string
+        break;
+    case PI_BALANCE:
+    {
+        if (uchar(*s) != pi->c)
+        {
+            s = NULL;
+            break;
+        }
+        int cont = 1;
+        const char* e = s;
+        s = NULL; // string ends out of balance
+        while (++e < ms->src_end)
+        {
+            if (uchar(*e) == pi->d)
+            {
+                if (--cont == 0)
+                {
+                    s = e + 1;
+                    break;
+                }
+            }
+            else if (uchar(*e) == pi->c)
+                cont++;
+        }
+        if (s != NULL)
+        {
+            pi++;
+            goto init;
+        }
+        break;
+    }
+    case PI_FRONTIER:
+    {
+        int previous = (s == ms->src_init) ? '\0' : uchar(*(s - 1));
+        if (!insetc(ms->sets, pi->c, previous) && insetc(ms->sets, pi->c, uchar(*s)))
+        {
+            pi++;
+            goto init;
+        }
+        s = NULL; // match failed
+        break;
+    }
+    case PI_BACKREF:
+    {
+        s = match_capture(ms, s, pi->c);
+        if (s != NULL)
+        {
+            pi++;
+            goto init;
+        }
+        break;
+    }
+    default:
+    {
+        // does not match at least once?
+        if (!csinglematch(ms, s, pi))
+        {
+            if (pi->rep == '*' || pi->rep == '?' || pi->rep == '-')
+            { // accept empty?
+                pi++;
+                goto init;
+            }
+            else          // '+' or no suffix
+                s = NULL; // fail
+        }
+        else
+        { // matched once
+            switch (pi->rep)
+            { // handle optional suffix
+            case '?':
+            { // optional
+                const char* res;
+                if ((res = cmatch(ms, s + 1, pi + 1)) != NULL)
+                    s = res;
+                else
+                {
+                    pi++;
+                    goto init;
+                }
+                break;
+            }
+            case '+': // 1 or more repetitions
+                s++;  // 1 match already done
+                      // go through
+            case '*': // 0 or more repetitions
+                s = cmax_expand(ms, s, pi);
+                break;
+            case '-': // 0 or more repetitions (minimum)
+                s = cmin_expand(ms, s, pi);
+                break;
+            default: // no suffix
+                s++;
+                pi++;
+                goto init;
+            }
+        }
+        break;
+    }
+    }
+    ms->matchdepth++;
+    return s;
+}
+
+/*
+** returns the compiled form of the pattern at `idx', which is cached in the table of upvalue 1; the compiled pattern is left on the
+** stack to keep it alive, since the cache doesn't keep its values alive
+*/
+static const Pattern* getpattern(lua_State* L, int idx, const char* p, size_t lp)
+{
+    lua_pushvalue(L, idx);
+    lua_rawget(L, lua_upvalueindex(1));
+
+    const Pattern* cached = (const Pattern*)lua_touserdata(L, -1);
+    if (cached)
+        return cached;
+
+    lua_pop(L, 1);
+
+    PatternCompiler pc;
+    pc.nitems = 0;
+    pc.nsets = 0;
+
+    int anchor = (*p == '^');
+    int valid = compilepattern(&pc, p + anchor, p + lp);
+    if (!valid)
+        pc.nitems = pc.nsets = 0;
+
+    Pattern* pat = (Pattern*)lua_newuserdata(L, sizepattern(pc.nitems, pc.nsets));
+    pat->valid = valid;
+    pat->anchor = anchor;
+    pat->firstchar = -1;
+    pat->nitems = pc.nitems;
+    pat->nsets = pc.nsets;
+    memcpy(pat->items, pc.items, pc.nitems * sizeof(PatternItem));
+    memcpy((uint8_t*)patternsets(pat), pc.sets, pc.nsets * PATTERN_SETSIZE);
+
+    // captures don't consume characters, so the first single class determines the first character of all matches
+    const PatternItem* pi = pat->items;
+    while (pi < pat->items + pat->nitems && (pi->op == PI_CAPSTART || pi->op == PI_CAPPOS))
+        pi++;
+    if (pi < pat->items + pat->nitems && pi->op == PI_CHAR && (pi->rep == 0 || pi->rep == '+'))
+        pat->firstchar = pi->c;
+
+    lua_pushvalue(L, idx);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, lua_upvalueindex(1));
+
+    return pat;
+}
+
+// returns the first position at or after `s' where a match of a compiled pattern can start
+static const char* nextcandidate(MatchState* ms, const Pattern* pat, const char* s)
+{
+    if (pat->firstchar < 0)
+        return s;
+    if (s >= ms->src_end)
+        return NULL;
+    return (const char*)memchr(s, pat->firstchar, ms->src_end - s);
+}
+
+// substring search with the Two-Way algorithm (Crochemore-Perrin); this runs in linear time for any input and is used once the
+// candidate filter in lmemfind stops paying off, which only happens for adversarial haystacks and needles
+static const char* twowayfind(const char* s1, size_t l1, const char* s2, size_t l2)
+{
+    const unsigned char* h = (const unsigned char*)s1;
+    const unsigned char* hend = h + l1;
+    const unsigned char* n = (const unsigned char*)s2;
+    size_t shift[256];
+    uint8_t present[256];
+    size_t i, ip, jp, k, p, p0, ms, mem, mem0;
+
+    memset(present, 0, sizeof(present));
+    for (i = 0; i < l2; i++)
+    {
+        present[n[i]] = 1;
+        shift[n[i]] = i + 1;
+    }
+
+    // maximal suffix with respect to the byte order and its period
+    ip = (size_t)-1;
+    jp = 0;
+    k = p = 1;
+    while (jp + k < l2)
+    {
+        if (n[ip + k] == n[jp + k])
+        {
+            if (k == p)
+            {
+                jp += p;
+                k = 1;
+            }
+            else
+                k++;
+        }
+        else if (n[ip + k] > n[jp + k])
+        {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        }
+        else
+        {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    ms = ip;
+    p0 = p;
+
+    // same with the opposite order; the critical factorization is the longer of the two
+    ip = (size_t)-1;
+    jp = 0;
+    k = p = 1;
+    while (jp + k < l2)
+    {
+        if (n[ip + k] == n[jp + k])
+        {
+            if (k == p)
+            {
+                jp += p;
+                k = 1;
+            }
+            else
+                k++;
+        }
+        else if (n[ip + k] < n[jp + k])
+        {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        }
+        else
+        {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    if (ip + 1 > ms + 1)
+        ms = ip;
+    else
+        p = p0;
+
+    // periodic needles remember how much of the left half already matched after a shift by the period
+    if (memcmp(n, n + p, ms + 1) != 0)
+    {
+        mem0 = 0;
+        p = (ms > l2 - ms - 1 ? ms : l2 - ms - 1) + 1;
+    }
+    else
+        mem0 = l2 - p;
+    mem = 0;
+
+    while ((size_t)(hend - h) >= l2)
+    {
+        // the last byte of the window decides how far the needle can be shifted without a full comparison
+        unsigned char last = h[l2 - 1];
+        if (!present[last])
+        {
+            h += l2;
+            mem = 0;
+            continue;
+        }
+        k = l2 - shift[last];
+        if (k)
+        {
+            h += k < mem ? mem : k;
+            mem = 0;
+            continue;
+        }
+
+        // right half
+        for (k = ms + 1 > mem ? ms + 1 : mem; k < l2 && n[k] == h[k]; k++)
+            ;
+        if (k < l2)
+        {
+            h += k - ms;
+            mem = 0;
+            continue;
+        }
+
+        // left half
+        for (k = ms + 1; k > mem && n[k - 1] == h[k - 1]; k--)
+            ;
+        if (k <= mem)
+            return (const char*)h;
+        h += p;
+        mem = mem0;
+    }
+
+    return NULL;
+}
+
+#if LUA_STRSSE2
+static LUAU_FORCEINLINE int memfindfirst(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long rl;
+    _BitScanForward(&rl, mask);
+    return (int)rl;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// candidates that pass the first and last byte filter but fail the full comparison are tolerated until the comparisons cost this many
+// times the length of the scanned input, after which the search switches to twowayfind
+#define MEMFIND_MAXWORK 8
+// the comparison cost of the first few kilobytes isn't counted, so that short haystacks never pay for the Two-Way setup
+#define MEMFIND_MINWORK 4096
+
+// finds the first occurrence of `s2' in `s1'; candidates are positions where both the first and the last byte of `s2' match, which
+// rejects nearly all false positives of the memchr approach on text with frequent first bytes
 static const char* lmemfind(const char* s1, size_t l1, const char* s2, size_t l2)
 {
     if (l2 == 0)
         return s1; // empty strings are everywhere
     else if (l2 > l1)
         return NULL; // avoids a negative `l1'
+    else if (l2 == 1)
+        return (const char*)memchr(s1, *s2, l1);
     else
     {
-        const char* init; // to search for a `*s2' inside `s1'
-        l2--;             // 1st char will be checked by `memchr'
-        l1 = l1 - l2;     // `s2' cannot be found after that
-        while (l1 > 0 && (init = (const char*)memchr(s1, *s2, l1)) != NULL)
+        const char* last = s1 + (l1 - l2); // `s2' cannot be found after that
+        const char* init = s1;
+        char first = s2[0];
+        char final = s2[l2 - 1];
+        size_t work = 0;
+
+#if LUA_STRSSE2
+        __m128i vfirst = _mm_set1_epi8(first);
+        __m128i vfinal = _mm_set1_epi8(final);
+
+        // each iteration checks 16 candidates; the loads of the last bytes must stay inside `s1'
+        while (last - init >= 15)
         {
-            init++; // 1st char is already checked
-            if (memcmp(init, s2 + 1, l2) == 0)
-                return init - 1;
-            else
-            { // correct `l1' and `s1' to try again
-                l1 -= init - s1;
-                s1 = init;
+            __m128i bfirst = _mm_loadu_si128((const __m128i*)init);
+            __m128i bfinal = _mm_loadu_si128((const __m128i*)(init + l2 - 1));
+            unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bfirst, vfirst), _mm_cmpeq_epi8(bfinal, vfinal)));
+
+            while (mask)
+            {
+                const char* cand = init + memfindfirst(mask);
+
+                if (memcmp(cand + 1, s2 + 1, l2 - 2) == 0)
+                    return cand;
+
+                work += l2;
+                if (work > MEMFIND_MINWORK && work / MEMFIND_MAXWORK > (size_t)(cand - s1))
+                    return twowayfind(cand + 1, l1 - (cand + 1 - s1), s2, l2);
+
+                mask &= mask - 1;
             }
+
+            init += 16;
+        }
+#endif
+
+        while (init <= last && (init = (const char*)memchr(init, first, last - init + 1)) != NULL)
+        {
+            if (init[l2 - 1] == final && memcmp(init + 1, s2 + 1, l2 - 2) == 0)
+                return init;
+
+            work += l2;
+            if (work > MEMFIND_MINWORK && work / MEMFIND_MAXWORK > (size_t)(init - s1))
+                return twowayfind(init + 1, l1 - (init + 1 - s1), s2, l2);
+
+            init++;
         }
+
         return NULL; // not found
     }
 }
@@ -607,7 +1288,7 @@ static void push_onecapture(MatchState* ms, int i, const char* s, const char* e)
     if (i >= ms->level)
     {
         if (i == 0)                           // ms->level == 0, too
-            lua_pushlstring(ms->L, s, e - s); // add whole match
+            lua_pushsubstring(ms->L, ms->src_idx, s - ms->src_init, e - s); // add whole match
         else
             luaL_error(ms->L, "invalid capture index");
     }
@@ -619,7 +1300,7 @@ static void push_onecapture(MatchState* ms, int i, const char* s, const char* e)
         if (l == CAP_POSITION)
             lua_pushinteger(ms->L, (int)(ms->capture[i].init - ms->src_init) + 1);
         else
-            lua_pushlstring(ms->L, ms->capture[i].init, l);
+            lua_pushsubstring(ms->L, ms->src_idx, ms->capture[i].init - ms->src_init, l);
     }
 }
 
@@ -646,9 +1327,11 @@ static int nospecials(const char* p, size_t l)
     return 1; // no special chars found
 }
 
-static void prepstate(MatchState* ms, lua_State* L, const char* s, size_t ls, const char* p, size_t lp)
+static void prepstate(MatchState* ms, lua_State* L, int idx, const char* s, size_t ls, const char* p, size_t lp)
 {
     ms->L = L;
+    ms->src_idx = idx;
+    ms->sets = NULL;
     ms->matchdepth = LUAI_MAXCCALLS;
     ms->src_init = s;
     ms->src_end = s + ls;
@@ -690,18 +1373,24 @@ static int str_find_aux(lua_State* L, int find)
     {
         MatchState ms;
         const char* s1 = s + init - 1;
+        const Pattern* pat = getpattern(L, 2, p, lp);
         int anchor = (*p == '^');
         if (anchor)
         {
             p++;
             lp--; // skip anchor character
         }
-        prepstate(&ms, L, s, ls, p, lp);
+        prepstate(&ms, L, 1, s, ls, p, lp);
+        if (pat->valid)
+            ms.sets = patternsets(pat);
         do
         {
             const char* res;
+            // skip positions where a match can't start
+            if (pat->valid && !anchor && (s1 = nextcandidate(&ms, pat, s1)) == NULL)
+                break;
             reprepstate(&ms);
-            if ((res = match(&ms, s1, p)) != NULL)
+            if ((res = pat->valid ? cmatch(&ms, s1, pat->items) : match(&ms, s1, p)) != NULL)
             {
                 if (find)
                 {
@@ -735,12 +1424,19 @@ static int gmatch_aux(lua_State* L)
     const char* s = lua_tolstring(L, lua_upvalueindex(1), &ls);
     const char* p = lua_tolstring(L, lua_upvalueindex(2), &lp);
     const char* src;
-    prepstate(&ms, L, s, ls, p, lp);
+    prepstate(&ms, L, lua_upvalueindex(1), s, ls, p, lp);
+    // gmatch doesn't treat `^' as an anchor, so compiled patterns that start with one can't be used
+    const Pattern* pat = (const Pattern*)lua_touserdata(L, lua_upvalueindex(4));
+    int compiled = pat->valid && !pat->anchor;
+    if (compiled)
+        ms.sets = patternsets(pat);
     for (src = s + (size_t)lua_tointeger(L, lua_upvalueindex(3)); src <= ms.src_end; src++)
     {
         const char* e;
+        if (compiled && (src = nextcandidate(&ms, pat, src)) == NULL)
+            break;
         reprepstate(&ms);
-        if ((e = match(&ms, src, p)) != NULL)
+        if ((e = compiled ? cmatch(&ms, src, pat->items) : match(&ms, src, p)) != NULL)
         {
             int newstart = (int)(e - s);
             if (e == src)
@@ -756,10 +1452,12 @@ static int gmatch_aux(lua_State* L)
 static int gmatch(lua_State* L)
 {
     luaL_checkstring(L, 1);
-    luaL_checkstring(L, 2);
+    size_t lp;
+    const char* p = luaL_checklstring(L, 2, &lp);
     lua_settop(L, 2);
     lua_pushinteger(L, 0);
-    lua_pushcclosure(L, gmatch_aux, NULL, 3);
+    getpattern(L, 2, p, lp);
+    lua_pushcclosure(L, gmatch_aux, NULL, 4);
     return 1;
 }
 
@@ -822,7 +1520,7 @@ static void add_value(MatchState* ms, luaL_Buffer* b, const char* s, const char*
     if (!lua_toboolean(L, -1))
     { // nil or false?
         lua_pop(L, 1);
-        lua_pushlstring(L, s, e - s); // keep original text
+        lua_pushsubstring(L, ms->src_idx, s - ms->src_init, e - s); // keep original text
     }
     else if (!lua_isstring(L, -1))
         luaL_error(L, "invalid replacement value (a %s)", luaL_typename(L, -1));
@@ -841,128 +1539,503 @@ static int str_gsub(lua_State* L)
     MatchState ms;
     luaL_Buffer b;
     luaL_argexpected(L, tr == LUA_TNUMBER || tr == LUA_TSTRING || tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3, "string/function/table");
+    const Pattern* pat = getpattern(L, 2, p, lp);
     luaL_buffinit(L, &b);
     if (anchor)
     {
         p++;
         lp--; // skip anchor character
     }
-    prepstate(&ms, L, src, srcl, p, lp);
+    prepstate(&ms, L, 1, src, srcl, p, lp);
+    if (pat->valid)
+        ms.sets = patternsets(pat);
     while (n < max_s)
     {
         const char* e;
         reprepstate(&ms);
-        e = match(&ms, src, p);
+        e = pat->valid ? cmatch(&ms, src, pat->items) : match(&ms, src, p);
         if (e)
         {
             n++;
             add_value(&ms, &b, src, e, tr);
         }
-        if (e && e > src) // non empty match?
-            src = e;      // skip it
-        else if (src < ms.src_end)
-            luaL_addchar(&b, *src++);
-        else
-            break;
-        if (anchor)
-            break;
+        if (e && e > src) // non empty match?
+            src = e;      // skip it
+        else if (!e && pat->valid && pat->firstchar >= 0 && src < ms.src_end)
+        {
+            // copy the characters up to the next position where a match can start
+            const char* next = nextcandidate(&ms, pat, src + 1);
+            if (!next)
+                next = ms.src_end;
+            luaL_addlstring(&b, src, next - src, -1);
+            src = next;
+        }
+        else if (src < ms.src_end)
+            luaL_addchar(&b, *src++);
+        else
+            break;
+        if (anchor)
+            break;
+    }
+    luaL_addlstring(&b, src, ms.src_end - src, -1);
+    luaL_pushresult(&b);
+    lua_pushinteger(L, n); // number of substitutions
+    return 2;
+}
+
+// }======================================================
+
+// valid flags in a format specification
+#define FLAGS "-+ #0"
+// maximum size of each formatted item (> len(format('%99.99f', -1e308)))
+#define MAX_ITEM 512
+// maximum size of each format specification (such as '%-099.99d')
+#define MAX_FORMAT 32
+
+static void addquoted(lua_State* L, luaL_Buffer* b, int arg)
+{
+    size_t l;
+    const char* s = luaL_checklstring(L, arg, &l);
+
+    luaL_reservebuffer(b, l + 2, -1);
+
+    luaL_addchar(b, '"');
+    while (l--)
+    {
+        switch (*s)
+        {
+        case '"':
+        case '\\':
+        case '\n':
+        {
+            luaL_addchar(b, '\\');
+            luaL_addchar(b, *s);
+            break;
+        }
+        case '\r':
+        {
+            luaL_addlstring(b, "\\r", 2, -1);
+            break;
+        }
+        case '\0':
+        {
+            luaL_addlstring(b, "\\000", 4, -1);
+            break;
+        }
+        default:
+        {
+            luaL_addchar(b, *s);
+            break;
+        }
+        }
+        s++;
+    }
+    luaL_addchar(b, '"');
+}
+
+// skips the flags, width and precision of a format item; returns NULL and sets `error' if they are invalid
+static const char* skipformat(const char* strfrmt, const char** error)
+{
+    const char* p = strfrmt;
+    while (*p != '\0' && strchr(FLAGS, *p) != NULL)
+        p++; // skip flags
+    if ((size_t)(p - strfrmt) >= sizeof(FLAGS))
+    {
+        *error = "invalid format (repeated flags)";
+        return NULL;
+    }
+    if (isdigit(uchar(*p)))
+        p++; // skip width
+    if (isdigit(uchar(*p)))
+        p++; // (2 digits at most)
+    if (*p == '.')
+    {
+        p++;
+        if (isdigit(uchar(*p)))
+            p++; // skip precision
+        if (isdigit(uchar(*p)))
+            p++; // (2 digits at most)
+    }
+    if (isdigit(uchar(*p)))
+    {
+        *error = "invalid format (width or precision too long)";
+        return NULL;
+    }
+    return p;
+}
+
+static const char* scanformat(lua_State* L, const char* strfrmt, char* form, size_t* size)
+{
+    const char* error = NULL;
+    const char* p = skipformat(strfrmt, &error);
+    if (!p)
+        luaL_error(L, "%s", error);
+    *(form++) = '%';
+    *size = p - strfrmt + 1;
+    strncpy(form, strfrmt, *size);
+    form += *size;
+    *form = '\0';
+    return p;
+}
+
+static void addInt64Format(char form[MAX_FORMAT], char formatIndicator, size_t formatItemSize)
+{
+    LUAU_ASSERT((formatItemSize + 3) <= MAX_FORMAT);
+    LUAU_ASSERT(form[0] == '%');
+    LUAU_ASSERT(form[formatItemSize] != 0);
+    LUAU_ASSERT(form[formatItemSize + 1] == 0);
+    form[formatItemSize + 0] = 'l';
+    form[formatItemSize + 1] = 'l';
+    form[formatItemSize + 2] = formatIndicator;
+    form[formatItemSize + 3] = 0;
+}
+
+// formats argument `arg' according to the format item `form' (which includes the conversion character) and adds it to the buffer
+static void addformatitem(lua_State* L, luaL_Buffer* b, int arg, char formatIndicator, char form[MAX_FORMAT], size_t formatItemSize)
+{
+    char buff[MAX_ITEM]; // to store the formatted item
+    switch (formatIndicator)
+    {
+    case 'c':
+    {
+        snprintf(buff, sizeof(buff), form, (int)luaL_checknumber(L, arg));
+        break;
+    }
+    case 'd':
+    case 'i':
+    {
+        addInt64Format(form, formatIndicator, formatItemSize);
+        snprintf(buff, sizeof(buff), form, (long long)luaL_checknumber(L, arg));
+        break;
+    }
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+    {
+        double argValue = luaL_checknumber(L, arg);
+        addInt64Format(form, formatIndicator, formatItemSize);
+        unsigned long long v = (argValue < 0) ? (unsigned long long)(long long)argValue : (unsigned long long)argValue;
+        snprintf(buff, sizeof(buff), form, v);
+        break;
+    }
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'g':
+    case 'G':
+    {
+        snprintf(buff, sizeof(buff), form, (double)luaL_checknumber(L, arg));
+        break;
+    }
+    case 'q':
+    {
+        addquoted(L, b, arg);
+        return; // skip the 'luaL_addlstring' at the end
+    }
+    case 's':
+    {
+        size_t l;
+        const char* s = luaL_checklstring(L, arg, &l);
+        if (!strchr(form, '.') && l >= 100)
+        {
+            /* no precision and string is too long to be formatted;
+               keep original string */
+            lua_pushvalue(L, arg);
+            luaL_addvalue(b);
+            return; // skip the `luaL_addlstring' at the end
+        }
+        else
+        {
+            snprintf(buff, sizeof(buff), form, s);
+            break;
+        }
+    }
+    case '*':
+    {
+        if (formatItemSize != 1)
+            luaL_error(L, "'%%*' does not take a form");
+
+        size_t length;
+        const char* string = luaL_tolstring(L, arg, &length);
+
+        luaL_addlstring(b, string, length, -2);
+        lua_pop(L, 1);
+
+        return; // skip the `luaL_addlstring' at the end
+    }
+    default:
+    { // also treat cases `pnLlh'
+        luaL_error(L, "invalid option '%%%c' to 'format'", formatIndicator);
+    }
+    }
+    luaL_addlstring(b, buff, strlen(buff), -1);
+}
+
+/*
+** {======================================================
+** Compiled formats
+** =======================================================
+*/
+
+// format strings are split into items once and cached in a table with weak values that is stored as the upvalue of string.format;
+// formats that would raise an error regardless of the arguments aren't compiled, so that they report errors exactly as before
+
+enum FormatKind
+{
+    FI_LITERAL, // no conversion, only the literal text before the item is added
+    FI_GENERIC, // formatted by addformatitem
+    FI_INT,     // %d and %i
+    FI_HEX,     // %x and %X
+    FI_STRING,  // %s
+    FI_FIXED,   // %.Nf
+};
+
+typedef struct FormatItem
+{
+    unsigned int literal; // literal text before the item, as an offset into the format string
+    unsigned int literallen;
+    uint8_t kind;
+    char indicator;
+    uint8_t precision;
+    uint8_t formsize;
+    char form[MAX_FORMAT]; // the format item, starting with '%' and ending with the conversion character
+} FormatItem;
+
+typedef struct Format
+{
+    int valid;
+    int nitems;
+    size_t size; // expected size of the result, used to size the buffer
+    FormatItem items[1];
+} Format;
+
+#define sizeformat(nitems) (offsetof(Format, items) + (nitems) * sizeof(FormatItem))
+
+// expected size of a formatted item; the buffer grows as needed if the estimate is too small
+#define FORMAT_ITEMSIZE 16
+
+// splits the format string into items; returns the number of items or -1 if the format is invalid
+// when `fmt' is NULL the items are only counted
+static int compileformat(const char* strfrmt, size_t sfl, Format* fmt)
+{
+    const char* strfrmt_begin = strfrmt;
+    const char* strfrmt_end = strfrmt + sfl;
+    const char* literal = strfrmt;
+    int nitems = 0;
+
+    while (strfrmt < strfrmt_end)
+    {
+        if (*strfrmt != L_ESC)
+        {
+            strfrmt++;
+            continue;
+        }
+
+        FormatItem* fi = fmt ? &fmt->items[nitems] : NULL;
+
+        if (strfrmt + 1 < strfrmt_end && strfrmt[1] == L_ESC)
+        {
+            // %% adds the first % as a part of the literal text
+            if (fi)
+            {
+                fi->literal = (unsigned)(literal - strfrmt_begin);
+                fi->literallen = (unsigned)(strfrmt + 1 - literal);
+                fi->kind = FI_LITERAL;
+            }
+
+            nitems++;
+            strfrmt += 2;
+            literal = strfrmt;
+            continue;
+        }
+
+        const char* error = NULL;
+        const char* spec = strfrmt + 1;
+        const char* p = skipformat(spec, &error);
+        if (!p || p >= strfrmt_end)
+            return -1;
+
+        char indicator = *p;
+        size_t formsize = p - spec + 1;
+
+        if (indicator == '\0' || !strchr("cdiouxXeEfgGqs*", indicator) || (indicator == '*' && formsize != 1))
+            return -1;
+
+        if (fi)
+        {
+            fi->literal = (unsigned)(literal - strfrmt_begin);
+            fi->literallen = (unsigned)(strfrmt - literal);
+            fi->indicator = indicator;
+            fi->formsize = (uint8_t)formsize;
+            fi->form[0] = '%';
+            memcpy(fi->form + 1, spec, formsize);
+            fi->form[formsize + 1] = '\0';
+
+            // precision of %.Nf, or -1 if the item has other flags
+            int precision = -1;
+            if (indicator == 'f' && spec[0] == '.')
+            {
+                if (formsize == 2)
+                    precision = 0;
+                else if (formsize == 3)
+                    precision = spec[1] - '0';
+                else if (formsize == 4)
+                    precision = (spec[1] - '0') * 10 + (spec[2] - '0');
+            }
+
+            if ((indicator == 'd' || indicator == 'i') && formsize == 1)
+                fi->kind = FI_INT;
+            else if ((indicator == 'x' || indicator == 'X') && formsize == 1)
+                fi->kind = FI_HEX;
+            else if (indicator == 's' && formsize == 1)
+                fi->kind = FI_STRING;
+            else if (precision >= 0 && precision <= LUAI_MAXNUM2FIXEDPREC)
+                fi->kind = FI_FIXED;
+            else
+                fi->kind = FI_GENERIC;
+
+            fi->precision = (uint8_t)(precision < 0 ? 0 : precision);
+        }
+
+        nitems++;
+        strfrmt = p + 1;
+        literal = strfrmt;
     }
-    luaL_addlstring(&b, src, ms.src_end - src, -1);
-    luaL_pushresult(&b);
-    lua_pushinteger(L, n); // number of substitutions
-    return 2;
+
+    // the remaining literal text is added by a final item without a conversion
+    if (fmt)
+    {
+        FormatItem* fi = &fmt->items[nitems];
+        fi->literal = (unsigned)(literal - strfrmt_begin);
+        fi->literallen = (unsigned)(strfrmt_end - literal);
+        fi->kind = FI_LITERAL;
+    }
+
+    return nitems + 1;
 }
 
-// }======================================================
+// returns the compiled format for the format string at stack index 1, leaving it on the stack
+static const Format* getformat(lua_State* L, const char* strfrmt, size_t sfl)
+{
+    lua_pushvalue(L, 1);
+    lua_rawget(L, lua_upvalueindex(1));
 
-// valid flags in a format specification
-#define FLAGS "-+ #0"
-// maximum size of each formatted item (> len(format('%99.99f', -1e308)))
-#define MAX_ITEM 512
-// maximum size of each format specification (such as '%-099.99d')
-#define MAX_FORMAT 32
+    const Format* cached = (const Format*)lua_touserdata(L, -1);
+    if (cached)
+        return cached;
 
-static void addquoted(lua_State* L, luaL_Buffer* b, int arg)
+    lua_pop(L, 1);
+
+    // the offsets of the items are 32-bit
+    int nitems = sfl <= UINT_MAX ? compileformat(strfrmt, sfl, NULL) : -1;
+
+    Format* fmt = (Format*)lua_newuserdata(L, sizeformat(nitems < 0 ? 0 : nitems));
+    fmt->valid = nitems >= 0;
+    fmt->nitems = nitems < 0 ? 0 : nitems;
+    fmt->size = sfl;
+
+    if (fmt->valid)
+    {
+        compileformat(strfrmt, sfl, fmt);
+
+        for (int i = 0; i < nitems; i++)
+            fmt->size += fmt->items[i].kind == FI_LITERAL ? 0 : FORMAT_ITEMSIZE;
+    }
+
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, lua_upvalueindex(1));
+
+    return fmt;
+}
+
+// prints an integer in reverse, ending at `end'; returns the start of the printed digits
+static char* formatunsigned(char* end, unsigned long long v, const char* digits, unsigned base)
 {
-    size_t l;
-    const char* s = luaL_checklstring(L, arg, &l);
+    do
+    {
+        *--end = digits[v % base];
+        v /= base;
+    } while (v);
 
-    luaL_reservebuffer(b, l + 2, -1);
+    return end;
+}
 
-    luaL_addchar(b, '"');
-    while (l--)
+static void addformat(lua_State* L, luaL_Buffer* b, const Format* fmt, const char* strfrmt, int top)
+{
+    int arg = 1;
+
+    for (int i = 0; i < fmt->nitems; i++)
     {
-        switch (*s)
+        const FormatItem* fi = &fmt->items[i];
+
+        luaL_addlstring(b, strfrmt + fi->literal, fi->literallen, -1);
+
+        if (fi->kind == FI_LITERAL)
+            continue;
+
+        if (++arg > top)
+            luaL_error(L, "missing argument #%d", arg);
+
+        char buff[MAX_ITEM];
+
+        switch (fi->kind)
         {
-        case '"':
-        case '\\':
-        case '\n':
+        case FI_INT:
         {
-            luaL_addchar(b, '\\');
-            luaL_addchar(b, *s);
+            long long v = (long long)luaL_checknumber(L, arg);
+            char* end = buff + sizeof(buff);
+            char* s = formatunsigned(end, v < 0 ? 0ull - (unsigned long long)v : (unsigned long long)v, "0123456789", 10);
+            if (v < 0)
+                *--s = '-';
+            luaL_addlstring(b, s, end - s, -1);
             break;
         }
-        case '\r':
+        case FI_HEX:
         {
-            luaL_addlstring(b, "\\r", 2, -1);
+            double argValue = luaL_checknumber(L, arg);
+            unsigned long long v = (argValue < 0) ? (unsigned long long)(long long)argValue : (unsigned long long)argValue;
+            char* end = buff + sizeof(buff);
+            char* s = formatunsigned(end, v, fi->indicator == 'x' ? "0123456789abcdef" : "0123456789ABCDEF", 16);
+            luaL_addlstring(b, s, end - s, -1);
             break;
         }
-        case '\0':
+        case FI_STRING:
         {
-            luaL_addlstring(b, "\\000", 4, -1);
+            size_t l;
+            const char* s = luaL_checklstring(L, arg, &l);
+            // short strings are formatted with snprintf, which stops at the first embedded zero
+            if (l >= 100)
+            {
+                lua_pushvalue(L, arg);
+                luaL_addvalue(b);
+            }
+            else
+                luaL_addlstring(b, s, strlen(s), -1);
+            break;
+        }
+        case FI_FIXED:
+        {
+            double v = luaL_checknumber(L, arg);
+            char* end = luai_num2fixed(buff, v, fi->precision);
+            if (!end)
+                end = buff + snprintf(buff, sizeof(buff), fi->form, v);
+            luaL_addlstring(b, buff, end - buff, -1);
             break;
         }
         default:
         {
-            luaL_addchar(b, *s);
+            char form[MAX_FORMAT];
+            memcpy(form, fi->form, fi->formsize + 2);
+            addformatitem(L, b, arg, fi->indicator, form, fi->formsize);
             break;
         }
         }
-        s++;
-    }
-    luaL_addchar(b, '"');
-}
-
-static const char* scanformat(lua_State* L, const char* strfrmt, char* form, size_t* size)
-{
-    const char* p = strfrmt;
-    while (*p != '\0' && strchr(FLAGS, *p) != NULL)
-        p++; // skip flags
-    if ((size_t)(p - strfrmt) >= sizeof(FLAGS))
-        luaL_error(L, "invalid format (repeated flags)");
-    if (isdigit(uchar(*p)))
-        p++; // skip width
-    if (isdigit(uchar(*p)))
-        p++; // (2 digits at most)
-    if (*p == '.')
-    {
-        p++;
-        if (isdigit(uchar(*p)))
-            p++; // skip precision
-        if (isdigit(uchar(*p)))
-            p++; // (2 digits at most)
     }
-    if (isdigit(uchar(*p)))
-        luaL_error(L, "invalid format (width or precision too long)");
-    *(form++) = '%';
-    *size = p - strfrmt + 1;
-    strncpy(form, strfrmt, *size);
-    form += *size;
-    *form = '\0';
-    return p;
 }
 
-static void addInt64Format(char form[MAX_FORMAT], char formatIndicator, size_t formatItemSize)
-{
-    LUAU_ASSERT((formatItemSize + 3) <= MAX_FORMAT);
-    LUAU_ASSERT(form[0] == '%');
-    LUAU_ASSERT(form[formatItemSize] != 0);
-    LUAU_ASSERT(form[formatItemSize + 1] == 0);
-    form[formatItemSize + 0] = 'l';
-    form[formatItemSize + 1] = 'l';
-    form[formatItemSize + 2] = formatIndicator;
-    form[formatItemSize + 3] = 0;
-}
+// }======================================================
 
 static int str_format(lua_State* L)
 {
@@ -971,6 +2044,19 @@ static int str_format(lua_State* L)
     size_t sfl;
     const char* strfrmt = luaL_checklstring(L, arg, &sfl);
     const char* strfrmt_end = strfrmt + sfl;
+
+    const Format* fmt = getformat(L, strfrmt, sfl);
+    if (fmt->valid)
+    {
+        luaL_Buffer b;
+        luaL_buffinitsize(L, &b, fmt->size);
+        addformat(L, &b, fmt, strfrmt, top);
+        luaL_pushresult(&b);
+        return 1;
+    }
+
+    lua_pop(L, 1);
+
     luaL_Buffer b;
     luaL_buffinit(L, &b);
     while (strfrmt < strfrmt_end)
@@ -982,88 +2068,12 @@ static int str_format(lua_State* L)
         else
         {                          // format item
             char form[MAX_FORMAT]; // to store the format (`%...')
-            char buff[MAX_ITEM];   // to store the formatted item
             if (++arg > top)
                 luaL_error(L, "missing argument #%d", arg);
             size_t formatItemSize = 0;
             strfrmt = scanformat(L, strfrmt, form, &formatItemSize);
             char formatIndicator = *strfrmt++;
-            switch (formatIndicator)
-            {
-            case 'c':
-            {
-                snprintf(buff, sizeof(buff), form, (int)luaL_checknumber(L, arg));
-                break;
-            }
-            case 'd':
-            case 'i':
-            {
-                addInt64Format(form, formatIndicator, formatItemSize);
-                snprintf(buff, sizeof(buff), form, (long long)luaL_checknumber(L, arg));
-                break;
-            }
-            case 'o':
-            case 'u':
-            case 'x':
-            case 'X':
-            {
-                double argValue = luaL_checknumber(L, arg);
-                addInt64Format(form, formatIndicator, formatItemSize);
-                unsigned long long v = (argValue < 0) ? (unsigned long long)(long long)argValue : (unsigned long long)argValue;
-                snprintf(buff, sizeof(buff), form, v);
-                break;
-            }
-            case 'e':
-            case 'E':
-            case 'f':
-            case 'g':
-            case 'G':
-            {
-                snprintf(buff, sizeof(buff), form, (double)luaL_checknumber(L, arg));
-                break;
-            }
-            case 'q':
-            {
-                addquoted(L, &b, arg);
-                continue; // skip the 'luaL_addlstring' at the end
-            }
-            case 's':
-            {
-                size_t l;
-                const char* s = luaL_checklstring(L, arg, &l);
-                if (!strchr(form, '.') && l >= 100)
-                {
-                    /* no precision and string is too long to be formatted;
-                       keep original string */
-                    lua_pushvalue(L, arg);
-                    luaL_addvalue(&b);
-                    continue; // skip the `luaL_addlstring' at the end
-                }
-                else
-                {
-                    snprintf(buff, sizeof(buff), form, s);
-                    break;
-                }
-            }
-            case '*':
-            {
-                if (formatItemSize != 1)
-                    luaL_error(L, "'%%*' does not take a form");
-
-                size_t length;
-                const char* string = luaL_tolstring(L, arg, &length);
-
-                luaL_addlstring(&b, string, length, -2);
-                lua_pop(L, 1);
-
-                continue; // skip the `luaL_addlstring' at the end
-            }
-            default:
-            { // also treat cases `pnLlh'
-                luaL_error(L, "invalid option '%%%c' to 'format'", *(strfrmt - 1));
-            }
-            }
-            luaL_addlstring(&b, buff, strlen(buff), -1);
+            addformatitem(L, &b, arg, formatIndicator, form, formatItemSize);
         }
     }
     luaL_pushresult(&b);
@@ -1085,33 +2095,33 @@ static int str_split(lua_State* L)
     lua_createtable(L, 0, 0);
 
     if (needleLen == 0)
-        begin++;
+    {
+        // every position is a split, so the result is a table of single characters
+        for (const char* iter = begin + 1; iter <= end; iter++)
+        {
+            lua_pushinteger(L, ++numMatches);
+            lua_pushsubstring(L, 1, spanStart - haystack, iter - spanStart);
+            lua_settable(L, -3);
 
-    // Don't iterate the last needleLen - 1 bytes of the string - they are
-    // impossible to be splits and would let us memcmp past the end of the
-    // buffer.
-    for (const char* iter = begin; iter <= end - needleLen; iter++)
+            spanStart = iter;
+        }
+    }
+    else
     {
-        // Use of memcmp here instead of strncmp is so that we allow embedded
-        // nulls to be used in either of the haystack or the needle strings.
-        // Most Lua string APIs allow embedded nulls, and this should be no
-        // exception.
-        if (memcmp(iter, needle, needleLen) == 0)
+        // lmemfind compares with memcmp, so embedded nulls are allowed in either of the haystack or the needle strings, like in other
+        // Lua string APIs
+        const char* iter;
+        while ((iter = lmemfind(spanStart, end - spanStart, needle, needleLen)) != NULL)
         {
             lua_pushinteger(L, ++numMatches);
-            lua_pushlstring(L, spanStart, iter - spanStart);
+            lua_pushsubstring(L, 1, spanStart - haystack, iter - spanStart);
             lua_settable(L, -3);
 
             spanStart = iter + needleLen;
-            if (needleLen > 0)
-                iter += needleLen - 1;
         }
-    }
 
-    if (needleLen > 0)
-    {
         lua_pushinteger(L, ++numMatches);
-        lua_pushlstring(L, spanStart, end - spanStart);
+        lua_pushsubstring(L, 1, spanStart - haystack, end - spanStart);
         lua_settable(L, -3);
     }
 
@@ -1636,16 +2646,182 @@ static int str_unpack(lua_State* L)
 
 // }======================================================
 
+/*
+** {======================================================
+** STRING BUILDER
+** =======================================================
+*/
+
+// builders append to a buffer string that is only interned when the result is requested, so building a string out of many pieces
+// doesn't copy and hash every intermediate result like repeated concatenation does
+#define BUILDER_MINSIZE 64
+
+typedef struct StringBuilder
+{
+    TString* storage; // buffer string from luaS_bufstart; kept alive by a weak table that maps builders to their buffers
+    size_t len;
+} StringBuilder;
+
+// builder methods have the builder metatable and the table of buffers as upvalues
+static StringBuilder* checkbuilder(lua_State* L)
+{
+    StringBuilder* b = (StringBuilder*)lua_touserdata(L, 1);
+    if (!b || !lua_getmetatable(L, 1))
+        luaL_typeerror(L, 1, "StringBuilder");
+    if (!lua_rawequal(L, -1, lua_upvalueindex(1)))
+        luaL_typeerror(L, 1, "StringBuilder");
+    lua_pop(L, 1);
+    return b;
+}
+
+static char* builder_reserve(lua_State* L, StringBuilder* b, int idx, size_t size)
+{
+    size_t capacity = b->storage ? b->storage->len : 0;
+    if (capacity - b->len >= size)
+        return b->storage->data + b->len;
+
+    if (size > MAXSSIZE - b->len)
+        luaL_error(L, "string length overflow");
+
+    size_t nextsize = capacity < BUILDER_MINSIZE ? BUILDER_MINSIZE : capacity * 2;
+    if (nextsize < b->len + size)
+        nextsize = b->len + size;
+    if (nextsize > MAXSSIZE)
+        nextsize = MAXSSIZE;
+
+    TString* ts = luaS_bufstart(L, nextsize);
+    if (b->len)
+        memcpy(ts->data, b->storage->data, b->len);
+
+    // replace the buffer of the builder; the old one becomes garbage
+    lua_pushvalue(L, idx);
+    lua_pushnil(L);
+    setsvalue(L, L->top - 1, ts);
+    lua_rawset(L, lua_upvalueindex(2));
+    b->storage = ts;
+
+    luaC_checkGC(L);
+
+    return ts->data + b->len;
+}
+
+static int builder_new(lua_State* L)
+{
+    int size = luaL_optinteger(L, 1, 0);
+    luaL_argcheck(L, size >= 0, 1, "size out of range");
+
+    StringBuilder* b = (StringBuilder*)lua_newuserdata(L, sizeof(StringBuilder));
+    b->storage = NULL;
+    b->len = 0;
+
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_setmetatable(L, -2);
+
+    if (size > 0)
+        builder_reserve(L, b, lua_gettop(L), size);
+
+    return 1;
+}
+
+static int builder_append(lua_State* L)
+{
+    StringBuilder* b = checkbuilder(L);
+    int n = lua_gettop(L);
+
+    for (int i = 2; i <= n; ++i)
+    {
+        size_t l;
+        const char* s = luaL_checklstring(L, i, &l);
+
+        if (l > 0)
+        {
+            char* p = builder_reserve(L, b, 1, l);
+            memcpy(p, s, l);
+            b->len += l;
+        }
+    }
+
+    lua_settop(L, 1);
+    return 1;
+}
+
+static int builder_tostring(lua_State* L)
+{
+    StringBuilder* b = checkbuilder(L);
+
+    if (b->len == 0)
+        lua_pushliteral(L, "");
+    else
+        lua_pushlstring(L, b->storage->data, b->len);
+    return 1;
+}
+
+static int builder_len(lua_State* L)
+{
+    StringBuilder* b = checkbuilder(L);
+    lua_pushinteger(L, (int)b->len);
+    return 1;
+}
+
+static int builder_clear(lua_State* L)
+{
+    StringBuilder* b = checkbuilder(L);
+    b->len = 0; // buffer is kept to be reused
+    lua_settop(L, 1);
+    return 1;
+}
+
+static const luaL_Reg builderlib[] = {
+    {"append", builder_append},
+    {"tostring", builder_tostring},
+    {"len", builder_len},
+    {"clear", builder_clear},
+    {NULL, NULL},
+};
+
+static void createbuilder(lua_State* L)
+{
+    lua_createtable(L, 0, 4); // metatable for string builders
+    lua_createtable(L, 0, 0); // buffers of string builders
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "k");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2); // buffers are only kept alive by their builders
+
+    lua_createtable(L, 0, 4); // methods
+    for (const luaL_Reg* l = builderlib; l->name; l++)
+    {
+        lua_pushvalue(L, -3);
+        lua_pushvalue(L, -3);
+        lua_pushcclosure(L, l->func, l->name, 2);
+        lua_setfield(L, -2, l->name);
+    }
+    lua_setfield(L, -3, "__index");
+
+    lua_pushvalue(L, -2);
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, builder_tostring, "__tostring", 2);
+    lua_setfield(L, -3, "__tostring");
+
+    lua_pushvalue(L, -2);
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, builder_len, "__len", 2);
+    lua_setfield(L, -3, "__len");
+
+    lua_pushliteral(L, "StringBuilder");
+    lua_setfield(L, -3, "__type");
+
+    lua_pushcclosure(L, builder_new, "builder", 2); // takes the metatable and the buffers as upvalues
+    lua_setfield(L, -2, "builder");
+}
+
+// }======================================================
+
 static const luaL_Reg strlib[] = {
     {"byte", str_byte},
     {"char", str_char},
-    {"find", str_find},
-    {"format", str_format},
-    {"gmatch", gmatch},
-    {"gsub", str_gsub},
     {"len", str_len},
     {"lower", str_lower},
-    {"match", str_match},
     {"rep", str_rep},
     {"reverse", str_reverse},
     {"sub", str_sub},
@@ -1657,6 +2833,40 @@ static const luaL_Reg strlib[] = {
     {NULL, NULL},
 };
 
+// pattern matching functions share a cache of compiled patterns with weak values, which is cleared by the garbage collector
+static const luaL_Reg patternlib[] = {
+    {"find", str_find},
+    {"gmatch", gmatch},
+    {"gsub", str_gsub},
+    {"match", str_match},
+    {NULL, NULL},
+};
+
+// string.format has a separate cache of compiled formats
+static const luaL_Reg formatlib[] = {
+    {"format", str_format},
+    {NULL, NULL},
+};
+
+// registers functions that share a table of compiled objects keyed by strings as their first upvalue
+static void createcachedlib(lua_State* L, const luaL_Reg* lib)
+{
+    lua_createtable(L, 0, 0); // compiled objects
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+
+    for (const luaL_Reg* l = lib; l->name; l++)
+    {
+        lua_pushvalue(L, -1);
+        lua_pushcclosure(L, l->func, l->name, 1);
+        lua_setfield(L, -3, l->name);
+    }
+
+    lua_pop(L, 1);
+}
+
 static void createmetatable(lua_State* L)
 {
     lua_createtable(L, 0, 1); // create metatable for strings
@@ -1675,7 +2885,10 @@ static void createmetatable(lua_State* L)
 int luaopen_string(lua_State* L)
 {
     luaL_register(L, LUA_STRLIBNAME, strlib);
+    createcachedlib(L, patternlib);
+    createcachedlib(L, formatlib);
     createmetatable(L);
+    createbuilder(L);
 
     return 1;
 }
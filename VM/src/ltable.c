@@ -13,6 +13,26 @@
  * position that its hash gives to it), then the colliding element is in its own main position.
  * Hence even when the load factor reaches 100%, performance remains good.
  *
+ * When built with LUA_TABLE_CONTROLBYTES, hash parts with more than 2^LUAH_CTRLMINLSIZE nodes use open addressing instead; smaller
+ * ones, which most objects have, keep chains that are cheaper to fill and need no extra memory. Each node has a control byte that is
+ * either free or stores 7 bits of the key hash; lookups compare control bytes of LUAH_CTRLGROUP consecutive nodes at once, starting at
+ * the main position, and only compare keys of nodes with matching control bytes. Probing stops at the first group with a free node, so
+ * misses rarely touch the nodes at all. Nodes are never freed until the table is resized (keys with nil values stay in place, like they
+ * do in chains), so a key is always placed at its main position if that node is free; VM fast paths rely on this, see gnext. Node
+ * indices are used as slots and traversal order exactly as in the chained layout.
+ *
+ * Tables created from constructor templates start with a shape instead of a hash part (see TableShape). A shape maps string keys to
+ * indices of a dense array of values that is owned by the table, and is shared by all tables with the same keys added in the same order,
+ * so each such table only pays for its values. Adding a string key moves the table to a child shape; any other new key, too many keys,
+ * or too many keys in an order that no other table used, move all fields into a regular hash part. Field indices are used as slots and
+ * traversal order in place of node indices. Tables with a shape have no array part, so their fields are stored in its place.
+ *
+ * Tables that get a number at index 1 before having an array part, or that are filled with numbers by constructors, store the array
+ * part as raw doubles instead (see TableNumbers). Such a "packed" array part has no holes and keeps sizearray at 0, so all code that
+ * accesses TValue arrays directly sees an empty array part and goes through the slower paths that understand packed tables. Storing a
+ * value that isn't a number, or a hole, converts the packed array part back to a regular one. While the table is packed, the hash part
+ * has no integer keys up to the capacity of the packed array part plus one, which keeps the boundary at the end of the packed elements.
+ *
  * Table keys can be arbitrary values unless they contain NaN. Keys are hashed and compared using raw equality,
  * so even if the key is a userdata with an overridden __eq, it's not used during hash lookups.
  *
@@ -33,6 +53,17 @@
 
 #include <string.h>
 
+#if LUA_TABLE_CONTROLBYTES && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define LUAH_CTRLSSE2 1
+#else
+#define LUAH_CTRLSSE2 0
+#endif
+
+#if LUA_TABLE_CONTROLBYTES && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wsign-conversion"
@@ -71,9 +102,8 @@ const LuaNode luaH_dummynode = {
 #define hashpow2(t, n) (gnode(t, lmod((n), sizenode(t))))
 
 #define hashstr(t, str) hashpow2(t, (str)->hash)
-#define hashboolean(t, p) hashpow2(t, p)
 
-static LuaNode* hashpointer(const Table* t, const void* p)
+static unsigned int hashpointer(const void* p)
 {
     // we discard the high 32-bit portion of the pointer on 64-bit platforms as it doesn't carry much entropy anyway
     unsigned int h = (unsigned)((uintptr_t)p);
@@ -85,10 +115,10 @@ static LuaNode* hashpointer(const Table* t, const void* p)
     h *= 0xc2b2ae35u;
     h ^= h >> 16;
 
-    return hashpow2(t, h);
+    return h;
 }
 
-static LuaNode* hashnum(const Table* t, double n)
+static unsigned int hashnum(double n)
 {
     static_assert(sizeof(double) == sizeof(unsigned int) * 2, "expected a 8-byte double");
     unsigned int i[2];
@@ -111,10 +141,10 @@ static LuaNode* hashnum(const Table* t, double n)
     h2 *= m;
 
     // ... truncated to 32-bit output (normally hash is equal to (uint64_t(h1) << 32) | h2, but we only really need the lower 32-bit half)
-    return hashpow2(t, h2);
+    return h2;
 }
 
-static LuaNode* hashvec(const Table* t, const float* v)
+static unsigned int hashvec(const float* v)
 {
     unsigned int i[LUA_VECTOR_SIZE];
     memcpy(i, v, sizeof(i));
@@ -138,32 +168,287 @@ static LuaNode* hashvec(const Table* t, const float* v)
     h ^= i[3] * 39916801;
 #endif
 
-    return hashpow2(t, h);
+    return h;
 }
 
-/*
-** returns the `main' position of an element in a table (that is, the index
-** of its hash value)
-*/
-static LuaNode* mainposition(const Table* t, const TValue* key)
+static unsigned int hashkey(const TValue* key)
 {
     switch (ttype(key))
     {
     case LUA_TNUMBER:
-        return hashnum(t, nvalue(key));
+        return hashnum(nvalue(key));
     case LUA_TVECTOR:
-        return hashvec(t, vvalue(key));
+        return hashvec(vvalue(key));
     case LUA_TSTRING:
-        return hashstr(t, tsvalue(key));
+        return tsvalue(key)->hash;
     case LUA_TBOOLEAN:
-        return hashboolean(t, bvalue(key));
+        return bvalue(key);
     case LUA_TLIGHTUSERDATA:
-        return hashpointer(t, pvalue(key));
+        return hashpointer(pvalue(key));
     default:
-        return hashpointer(t, gcvalue(key));
+        return hashpointer(gcvalue(key));
+    }
+}
+
+/*
+** returns the `main' position of an element in a table (that is, the index
+** of its hash value)
+*/
+#define mainposition(t, key) hashpow2(t, hashkey(key))
+
+#if LUA_TABLE_CONTROLBYTES
+#define ctrlhash(h) cast_byte((h) >> 25)
+
+// some nodes are kept free to keep probe sequences short; hash parts with control bytes have at least two groups
+#define ctrlcapacity(size) ((size) - (size) / 8)
+#define ctrlgroups(t) (sizenode(t) / LUAH_CTRLGROUP)
+
+// returns a mask with bit i set if control byte i of the group is equal to c
+static LUAU_FORCEINLINE unsigned int ctrlmatch(const uint8_t* ctrl, uint8_t c)
+{
+#if LUAH_CTRLSSE2
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)c)));
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < LUAH_CTRLGROUP; ++i)
+        mask |= (unsigned int)(ctrl[i] == c) << i;
+    return mask;
+#endif
+}
+
+// returns a mask with bit i set if node i of the group is free
+static LUAU_FORCEINLINE unsigned int ctrlmatchempty(const uint8_t* ctrl)
+{
+#if LUAH_CTRLSSE2
+    // only free nodes have the high bit set
+    return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#else
+    return ctrlmatch(ctrl, LUAH_CTRLEMPTY);
+#endif
+}
+
+static LUAU_FORCEINLINE int ctrlfirst(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long rl;
+    _BitScanForward(&rl, mask);
+    return (int)rl;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static void setctrl(Table* t, int i, uint8_t c)
+{
+    uint8_t* ctrl = gctrl(t);
+    int size = sizenode(t);
+
+    ctrl[i] = c;
+
+    // update the copy of the first group
+    if (i < LUAH_CTRLGROUP)
+        ctrl[size + i] = c;
+}
+#endif
+
+/*
+** {=============================================================
+** Shapes
+** ==============================================================
+*/
+
+// tables that keep adding keys that no other table added switch to a hash part once they created this many shapes, see newfield
+#define MAXNEWSHAPES 8
+
+/*
+** returns the field index of `key' in shape `s', or -1 if the shape doesn't have the key
+*/
+static int shapeslot(const TableShape* s, const TString* key)
+{
+    const TableShapeKeys* k = s->keys;
+    if (!k)
+        return -1;
+
+    const uint8_t* index = shapeindex(k);
+    int mask = (1 << k->lsizeindex) - 1;
+
+    // index is at most half full, so there's always an unused entry that terminates the probe sequence
+    for (int i = key->hash & mask;; i = (i + 1) & mask)
+    {
+        int slot = index[i] - 1;
+        if (slot < 0)
+            return -1;
+        // keys are unique within the chain; keys after the first `nfields' ones belong to descendants of the shape
+        if (k->keys[slot] == key)
+            return slot < s->nfields ? slot : -1;
     }
 }
 
+static void addshapekey(TableShapeKeys* k, int slot, TString* key)
+{
+    uint8_t* index = shapeindex(k);
+    int mask = (1 << k->lsizeindex) - 1;
+
+    int i = key->hash & mask;
+    while (index[i])
+        i = (i + 1) & mask;
+    index[i] = cast_byte(slot + 1);
+
+    k->keys[slot] = key;
+}
+
+/*
+** allocates keys for a chain of shapes that starts with the keys of `s'
+*/
+static TableShapeKeys* newshapekeys(lua_State* L, const TableShape* s, int size, uint8_t memcat)
+{
+    int lsizeindex = ceillog2(size * 2);
+
+    TableShapeKeys* k = cast_to(TableShapeKeys*, luaM_new_(L, sizeshapekeys(size, lsizeindex), memcat));
+    k->last = NULL;
+    k->refs = 0;
+    k->size = size;
+    k->lsizeindex = cast_byte(lsizeindex);
+    k->memcat = memcat;
+
+    memset(k->keys, 0, size * sizeof(TString*));
+    memset(shapeindex(k), 0, twoto(lsizeindex));
+
+    for (int slot = 0; slot < s->nfields; ++slot)
+        addshapekey(k, slot, gshapekey(s, slot));
+
+    return k;
+}
+
+static void freeshapekeys(lua_State* L, TableShapeKeys* k)
+{
+    luaM_free_(L, k, sizeshapekeys(k->size, k->lsizeindex), k->memcat);
+}
+
+static TableShape* newshape(lua_State* L, TableShape* parent, TString* key, uint8_t memcat)
+{
+    TableShape* s = cast_to(TableShape*, luaM_new_(L, sizeof(TableShape), memcat));
+    s->parent = parent;
+    s->child = NULL;
+    s->sibling = NULL;
+    s->key = key;
+    s->keys = NULL;
+    s->refs = 0;
+    s->nfields = parent ? parent->nfields + 1 : 0;
+    s->memcat = memcat;
+
+    if (parent)
+    {
+        TableShapeKeys* k = parent->keys;
+
+        // the shape continues the chain of its parent when the parent has the last key, otherwise it starts a new chain
+        if (!k || k->last != parent || parent->nfields == k->size)
+        {
+            int size = s->nfields < 2 ? 4 : s->nfields * 2;
+            if (size > LUA_TABLE_SHAPEFIELDS)
+                size = LUA_TABLE_SHAPEFIELDS;
+
+            TableShapeKeys* nk = newshapekeys(L, parent, size, memcat);
+
+            // when a chain runs out of space, all shapes of the chain move to the new keys; they are ancestors of the last shape
+            if (k && k->last == parent)
+            {
+                for (TableShape* p = parent; p && p->keys == k; p = p->parent)
+                    p->keys = nk;
+
+                nk->refs = k->refs;
+                freeshapekeys(L, k);
+            }
+
+            k = nk;
+        }
+
+        addshapekey(k, parent->nfields, key);
+        k->last = s;
+        k->refs++;
+        s->keys = k;
+
+        s->sibling = parent->child;
+        parent->child = s;
+        parent->refs++;
+    }
+
+    return s;
+}
+
+/*
+** drops a reference to `s', freeing it and then its parents when they are no longer referenced
+*/
+static void releaseshape(lua_State* L, TableShape* s)
+{
+    while (s && --s->refs == 0)
+    {
+        TableShape* parent = s->parent;
+        LUAU_ASSERT(s->child == NULL);
+
+        if (parent)
+        {
+            TableShape** link = &parent->child;
+            while (*link != s)
+                link = &(*link)->sibling;
+            *link = s->sibling;
+        }
+
+        TableShapeKeys* k = s->keys;
+
+        // shapes after this one in the chain are its descendants, which were freed before; the key stays in the index, but it
+        // doesn't match any lookups anymore, and since its slot can't be reused, nobody can add keys to the chain either
+        if (k)
+        {
+            k->keys[s->nfields - 1] = NULL;
+            k->last = NULL;
+
+            if (--k->refs == 0)
+                freeshapekeys(L, k);
+        }
+
+        luaM_free_(L, s, sizeof(TableShape), s->memcat);
+        s = parent;
+    }
+}
+
+/*
+** returns the shape with the keys of `s' followed by `key' if a table already made this transition, NULL otherwise
+*/
+static TableShape* shapechild(TableShape* s, TString* key)
+{
+    for (TableShape* c = s->child; c; c = c->sibling)
+        if (c->key == key)
+            return c;
+
+    return NULL;
+}
+
+static TableFields* newfields(lua_State* L, Table* t, TableShape* s, int size)
+{
+    TableFields* f = cast_to(TableFields*, luaM_new_(L, sizefields(size), t->memcat));
+    f->shape = s;
+    f->size = size;
+    f->newshapes = 0;
+    for (int i = 0; i < size; ++i)
+        setnilvalue(&f->values[i]);
+    return f;
+}
+
+static void freefields(lua_State* L, Table* t)
+{
+    TableFields* f = gfields(t);
+    TableShape* s = f->shape;
+    t->shaped = 0;
+    luaM_free_(L, f, sizefields(f->size), t->memcat);
+    releaseshape(L, s);
+}
+
+/*
+** }=============================================================
+*/
+
 /*
 ** returns the index for `key' if `key' is an appropriate key to live in
 ** the array part of the table, -1 otherwise.
@@ -186,24 +471,67 @@ static int findindex(lua_State* L, Table* t, StkId key)
     int i;
     if (ttisnil(key))
         return -1; // first iteration
+    int asize = sizearrayindex(t);
     i = ttisnumber(key) ? arrayindex(nvalue(key)) : -1;
-    if (0 < i && i <= t->sizearray) // is `key' inside array part?
-        return i - 1;               // yes; that's the index (corrected to C)
+    if (0 < i && i <= asize) // is `key' inside array part?
+        return i - 1;        // yes; that's the index (corrected to C)
     else
     {
-        LuaNode* n = mainposition(t, key);
-        for (;;)
-        { // check whether `key' is somewhere in the chain
-            // key may be dead already, but it is ok to use it in `next'
-            if (luaO_rawequalKey(gkey(n), key) || (ttype(gkey(n)) == LUA_TDEADKEY && iscollectable(key) && gcvalue(gkey(n)) == gcvalue(key)))
+        if (isshaped(t))
+        {
+            int slot = ttisstring(key) ? shapeslot(gfields(t)->shape, tsvalue(key)) : -1;
+            // fields are numbered after array elements
+            if (slot >= 0)
+                return slot + asize;
+        }
+#if LUA_TABLE_CONTROLBYTES
+        else if (hasctrl(t))
+        {
+            unsigned int h = hashkey(key);
+            const uint8_t* ctrl = gctrl(t);
+            int mask = sizenode(t) - 1;
+            int pos = lmod(h, sizenode(t));
+            LuaNode* dead = NULL;
+            for (int g = ctrlgroups(t); g > 0; --g, pos = (pos + LUAH_CTRLGROUP) & mask)
             {
-                i = cast_int(n - gnode(t, 0)); // key index in hash table
-                // hash elements are numbered after array ones
-                return i + t->sizearray;
+                for (unsigned int m = ctrlmatch(ctrl + pos, ctrlhash(h)); m; m &= m - 1)
+                {
+                    LuaNode* n = gnode(t, (pos + ctrlfirst(m)) & mask);
+                    if (luaO_rawequalKey(gkey(n), key))
+                    {
+                        i = cast_int(n - gnode(t, 0)); // key index in hash table
+                        // hash elements are numbered after array ones
+                        return i + asize;
+                    }
+                    // key may be dead already, but it is ok to use it in `next'; a live copy of the key that was inserted again later
+                    // can be further in the probe sequence, and it has to take precedence to avoid visiting it twice
+                    if (!dead && ttype(gkey(n)) == LUA_TDEADKEY && iscollectable(key) && gcvalue(gkey(n)) == gcvalue(key))
+                        dead = n;
+                }
+                if (ctrlmatchempty(ctrl + pos))
+                    break;
+            }
+            if (dead)
+                return cast_int(dead - gnode(t, 0)) + asize;
+        }
+#endif
+        else
+        {
+            LuaNode* n = mainposition(t, key);
+            for (;;)
+            { // check whether `key' is somewhere in the chain
+                // key may be dead already, but it is ok to use it in `next'
+                if (luaO_rawequalKey(gkey(n), key) ||
+                    (ttype(gkey(n)) == LUA_TDEADKEY && iscollectable(key) && gcvalue(gkey(n)) == gcvalue(key)))
+                {
+                    i = cast_int(n - gnode(t, 0)); // key index in hash table
+                    // hash elements are numbered after array ones
+                    return i + asize;
+                }
+                if (gnext(n) == 0)
+                    break;
+                n += gnext(n);
             }
-            if (gnext(n) == 0)
-                break;
-            n += gnext(n);
         }
         luaG_runerror(L, "invalid key to 'next'"); // key not found
     }
@@ -211,7 +539,22 @@ static int findindex(lua_State* L, Table* t, StkId key)
 
 int luaH_next(lua_State* L, Table* t, StkId key)
 {
+    luaC_checkweak(L, t);
+
     int i = findindex(L, t, key); // find original element
+    int asize = sizearrayindex(t);
+    if (ispacked(t))
+    { // packed array part has no holes
+        if (i + 1 < t->numbers->size)
+        {
+            i++;
+            setnvalue(key, cast_num(i + 1));
+            setnvalue(key + 1, gpacked(t, i));
+            return 1;
+        }
+        if (i < asize)
+            i = asize - 1; // skip unused capacity
+    }
     for (i++; i < t->sizearray; i++)
     { // try first array part
         if (!ttisnil(&t->array[i]))
@@ -221,7 +564,21 @@ int luaH_next(lua_State* L, Table* t, StkId key)
             return 1;
         }
     }
-    for (i -= t->sizearray; i < sizenode(t); i++)
+    if (isshaped(t))
+    {
+        TableShape* shape = gfields(t)->shape;
+        for (i -= asize; i < shape->nfields; i++)
+        { // then fields
+            if (!ttisnil(gfield(t, i)))
+            {
+                setsvalue(L, key, gshapekey(shape, i));
+                setobj2s(L, key + 1, gfield(t, i));
+                return 1;
+            }
+        }
+        return 0; // no more elements
+    }
+    for (i -= asize; i < sizenode(t); i++)
     { // then hash part
         if (!ttisnil(gval(gnode(t, i))))
         { // a non-nil value?
@@ -332,6 +689,34 @@ static int numusehash(const Table* t, int* nums, int* pnasize)
     return totaluse;
 }
 
+/*
+** namecall caches hold pointers to values of the tables they look methods up in; these tables are marked as watched, and adding or moving
+** keys of a watched table (or freeing it) starts a new epoch, which makes all cache entries that were recorded before it stale. the
+** values are read through the pointers, so stores to existing keys don't need a new epoch
+*/
+static void unwatch(lua_State* L, Table* t)
+{
+    if (LUAU_UNLIKELY(testbit(t->marked, WATCHEDBIT)))
+    {
+        global_State* g = L->global;
+
+        resetbit(t->marked, WATCHEDBIT);
+
+        // once all epochs are used, caches stop accepting entries until the end of the next collection (see restartnamecallepoch)
+        if (g->namecallepoch != UINT32_MAX)
+            g->namecallepoch++;
+    }
+}
+
+int luaH_watch(lua_State* L, Table* t)
+{
+    if (L->global->namecallepoch == UINT32_MAX)
+        return 0;
+
+    l_setbit(t->marked, WATCHEDBIT);
+    return 1;
+}
+
 static void setarrayvector(lua_State* L, Table* t, int size)
 {
     if (size > MAXSIZE)
@@ -355,10 +740,14 @@ static void setnodevector(lua_State* L, Table* t, int size)
     {
         int i;
         lsize = ceillog2(size);
+#if LUA_TABLE_CONTROLBYTES
+        if (lsize > LUAH_CTRLMINLSIZE && ctrlcapacity(twoto(lsize)) < (unsigned)size)
+            lsize++;
+#endif
         if (lsize > MAXBITS)
             luaG_runerror(L, "table overflow");
         size = twoto(lsize);
-        t->node = luaM_newarray(L, size, LuaNode, t->memcat);
+        t->node = cast_to(LuaNode*, luaM_new_(L, sizenodebytes(lsize), t->memcat));
         for (i = 0; i < size; i++)
         {
             LuaNode* n = gnode(t, i);
@@ -369,7 +758,16 @@ static void setnodevector(lua_State* L, Table* t, int size)
     }
     t->lsizenode = cast_byte(lsize);
     t->nodemask8 = cast_byte((1 << lsize) - 1);
+#if LUA_TABLE_CONTROLBYTES
+    if (hasctrl(t))
+    {
+        memset(gctrl(t), LUAH_CTRLEMPTY, size + LUAH_CTRLGROUP);
+        size = ctrlcapacity(size);
+    }
+#endif
     t->lastfree = size; // all positions are free
+
+    unwatch(L, t);
 }
 
 static TValue* newkey(lua_State* L, Table* t, const TValue* key);
@@ -388,10 +786,95 @@ static TValue* arrayornewkey(lua_State* L, Table* t, const TValue* key)
     return newkey(L, t, key);
 }
 
+/*
+** moves fields of a table with a shape into a new hash part
+*/
+static void deshape(lua_State* L, Table* t)
+{
+    TableFields* f = gfields(t);
+    TableShape* shape = f->shape;
+
+    int nfields = 0;
+    for (int i = 0; i < shape->nfields; ++i)
+        nfields += !ttisnil(&f->values[i]);
+
+    LUAU_ASSERT(t->node == dummynode);
+    setnodevector(L, t, nfields);
+
+    // from now on, the table only uses the hash part; fields are still alive until they are copied
+    t->shaped = 0;
+
+    for (int i = 0; i < shape->nfields; ++i)
+    {
+        if (!ttisnil(&f->values[i]))
+        {
+            TValue k;
+            setsvalue(L, &k, gshapekey(shape, i));
+            setobjt2t(L, newkey(L, t, &k), &f->values[i]);
+        }
+    }
+
+    setfields(t, f);
+    freefields(L, t);
+}
+
+/*
+** adds `key' to a table with a shape; returns NULL if the table needs to switch to a hash part instead
+*/
+static TValue* newfield(lua_State* L, Table* t, const TValue* key)
+{
+    TableFields* f = gfields(t);
+    int slot = f->shape->nfields;
+
+    if (slot == LUA_TABLE_SHAPEFIELDS)
+        return NULL;
+
+    TableShape* shape = shapechild(f->shape, tsvalue(key));
+
+    // tables that keep adding keys in an order no other table used are likely used as dictionaries, which are better off with a hash
+    // part; this also keeps them from growing long chains of shapes that nothing else shares
+    if (!shape && f->newshapes == MAXNEWSHAPES)
+        return NULL;
+
+    if (slot == f->size)
+    {
+        int size = f->size < 2 ? 4 : f->size * 2;
+        if (size > LUA_TABLE_SHAPEFIELDS)
+            size = LUA_TABLE_SHAPEFIELDS;
+
+        TableFields* nf = newfields(L, t, f->shape, size);
+        memcpy(nf->values, f->values, f->size * sizeof(TValue));
+        nf->newshapes = f->newshapes;
+        luaM_free_(L, f, sizefields(f->size), t->memcat);
+        setfields(t, nf);
+        f = nf;
+    }
+
+    if (!shape)
+    {
+        shape = newshape(L, f->shape, tsvalue(key), t->memcat);
+        f->newshapes++;
+    }
+
+    LUAU_ASSERT(shape->nfields == slot + 1);
+
+    // the new shape references the old one, so it's safe to release it first
+    shape->refs++;
+    releaseshape(L, f->shape);
+    f->shape = shape;
+
+    luaC_barriert(L, t, key);
+    LUAU_ASSERT(ttisnil(&f->values[slot]));
+    return &f->values[slot];
+}
+
 static void resize(lua_State* L, Table* t, int nasize, int nhsize)
 {
     if (nasize > MAXSIZE || nhsize > MAXSIZE)
         luaG_runerror(L, "table overflow");
+    // entries are moved to the new hash part, where the collector wouldn't find the ones with dead keys
+    luaC_checkweak(L, t);
+    LUAU_ASSERT(!ispacked(t) || nasize == 0);
     int oldasize = t->sizearray;
     int oldhsize = t->lsizenode;
     LuaNode* nold = t->node; // save old hash ...
@@ -436,7 +919,7 @@ static void resize(lua_State* L, Table* t, int nasize, int nhsize)
     LUAU_ASSERT(anew == t->array);
 
     if (nold != dummynode)
-        luaM_freearray(L, nold, twoto(oldhsize), LuaNode, t->memcat); // free old array
+        luaM_free_(L, nold, sizenodebytes(oldhsize), t->memcat); // free old array
 }
 
 static int adjustasize(Table* t, int size, const TValue* ek)
@@ -451,6 +934,11 @@ static int adjustasize(Table* t, int size, const TValue* ek)
 
 void luaH_resizearray(lua_State* L, Table* t, int nasize)
 {
+    if (isshaped(t))
+        deshape(L, t);
+    if (ispacked(t))
+        luaH_unpack(L, t);
+
     int nsize = (t->node == dummynode) ? 0 : sizenode(t);
     int asize = adjustasize(t, nasize, NULL);
     resize(L, t, asize, nsize);
@@ -458,6 +946,9 @@ void luaH_resizearray(lua_State* L, Table* t, int nasize)
 
 void luaH_resizehash(lua_State* L, Table* t, int nhsize)
 {
+    if (isshaped(t))
+        deshape(L, t);
+
     resize(L, t, t->sizearray, nhsize);
 }
 
@@ -466,6 +957,13 @@ static void rehash(lua_State* L, Table* t, const TValue* ek)
     int nums[MAXBITS + 1]; // nums[i] = number of keys between 2^(i-1) and 2^i
     for (int i = 0; i <= MAXBITS; i++)
         nums[i] = 0;                          // reset counts
+    if (ispacked(t))
+    {
+        // packed elements stay in place, and integer keys in the hash part are too far from them to be moved to the array part
+        int nasize = 0;
+        resize(L, t, 0, numusehash(t, nums, &nasize) + 1);
+        return;
+    }
     int nasize = numusearray(t, nums);        // count keys in array part
     int totaluse = nasize;                    // all those keys are integer keys
     totaluse += numusehash(t, nums, &nasize); // count keys in hash part
@@ -486,6 +984,205 @@ static void rehash(lua_State* L, Table* t, const TValue* ek)
 ** }=============================================================
 */
 
+/*
+** {=============================================================
+** Packed array part
+** ==============================================================
+*/
+
+// capacity of packed array parts created for the first element
+#define MINPACKED 4
+
+static TableNumbers* newnumbers(lua_State* L, Table* t, int capacity)
+{
+    TableNumbers* p = cast_to(TableNumbers*, luaM_new_(L, sizenumbers(capacity), t->memcat));
+    p->size = 0;
+    p->capacity = capacity;
+    return p;
+}
+
+static void freenumbers(lua_State* L, Table* t)
+{
+    luaM_free_(L, t->numbers, sizenumbers(t->numbers->capacity), t->memcat);
+    t->numbers = NULL;
+}
+
+/*
+** checks that the hash part has no integer keys in 1..n, so that a packed array part can reserve them; keys of removed entries count
+** too, since their nodes would be reused if the keys are stored again after the table is unpacked
+*/
+static int noarrayints(const Table* t, int n)
+{
+    if (t->node == dummynode)
+        return 1;
+
+    for (int i = 0; i < sizenode(t); ++i)
+    {
+        const LuaNode* node = gnode(t, i);
+        if (ttisnumber(gkey(node)) && nvalue(gkey(node)) >= 1 && nvalue(gkey(node)) <= n)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+** converts a packed array part to a regular one that can store any value; keys up to the capacity stay in the array part, so
+** traversal indices don't change
+*/
+void luaH_unpack(lua_State* L, Table* t)
+{
+    TableNumbers* p = t->numbers;
+    LUAU_ASSERT(ispacked(t));
+
+    TValue* array = luaM_newarray(L, p->capacity, TValue, t->memcat);
+    for (int i = 0; i < p->size; ++i)
+        setnvalue(&array[i], p->values[i]);
+    for (int i = p->size; i < p->capacity; ++i)
+        setnilvalue(&array[i]);
+
+    t->array = array;
+    t->sizearray = p->capacity;
+    maybesetaboundary(t, p->size);
+
+    luaM_free_(L, p, sizenumbers(p->capacity), t->memcat);
+}
+
+/*
+** converts an array part that is completely filled with numbers to a packed one; used for tables that are filled by constructors
+*/
+void luaH_pack(lua_State* L, Table* t)
+{
+#if LUA_TABLE_PACKNUMBERS
+    int n = t->sizearray;
+    if (n == 0)
+        return;
+
+    for (int i = 0; i < n; ++i)
+        if (!ttisnumber(&t->array[i]))
+            return;
+
+    if (!noarrayints(t, n + 1))
+        return;
+
+    TableNumbers* p = newnumbers(L, t, n);
+    for (int i = 0; i < n; ++i)
+        p->values[i] = nvalue(&t->array[i]);
+    p->size = n;
+
+    luaM_freearray(L, t->array, n, TValue, t->memcat);
+
+    t->numbers = p;
+    t->sizearray = 0;
+    if (t->aboundary < 0)
+        t->aboundary = 0;
+#endif
+}
+
+/*
+** reads element `key' of the packed array part; returns 0 if the table isn't packed or the element isn't in the packed array part
+*/
+int luaH_getpacked(Table* t, const TValue* key, TValue* res)
+{
+    if (!ispacked(t) || !ttisnumber(key))
+        return 0;
+
+    int k = arrayindex(nvalue(key));
+    if (cast_to(unsigned int, k - 1) >= cast_to(unsigned int, t->numbers->size))
+        return 0;
+
+    setnvalue(res, gpacked(t, k - 1));
+    return 1;
+}
+
+/*
+** stores `val' at `key' if it can be stored in the packed array part: numbers replace existing elements or are appended, and nil
+** removes the last element. Tables without an array part start packing when they get a number at index 1.
+** Returns 0 if the value wasn't stored; if the key is in the range reserved for the packed array part, the table is unpacked so that
+** the caller can store the value in a regular array part.
+*/
+int luaH_setpacked(lua_State* L, Table* t, const TValue* key, const TValue* val)
+{
+    if (!ttisnumber(key))
+        return 0;
+
+    int k = arrayindex(nvalue(key));
+
+    if (!ispacked(t))
+    {
+#if LUA_TABLE_PACKNUMBERS
+        if (k == 1 && ttisnumber(val) && t->array == NULL && noarrayints(t, MINPACKED + 1))
+        {
+            t->numbers = newnumbers(L, t, MINPACKED);
+            t->numbers->size = 1;
+            gpacked(t, 0) = nvalue(val);
+            if (t->aboundary < 0)
+                t->aboundary = 0;
+            return 1;
+        }
+#endif
+        return 0;
+    }
+
+    TableNumbers* p = t->numbers;
+    unsigned int i = cast_to(unsigned int, k - 1);
+
+    if (i < cast_to(unsigned int, p->size))
+    {
+        if (ttisnumber(val))
+        {
+            p->values[i] = nvalue(val);
+            return 1;
+        }
+        else if (ttisnil(val) && i == cast_to(unsigned int, p->size - 1))
+        {
+            p->size--;
+            return 1;
+        }
+    }
+    else if (i == cast_to(unsigned int, p->size) && ttisnumber(val))
+    {
+        if (p->size == p->capacity)
+        {
+            // the hash part can't have the keys that are reserved by the larger capacity
+            int capacity = p->capacity * 2;
+            if (capacity > MAXSIZE || !noarrayints(t, capacity + 1))
+            {
+                luaH_unpack(L, t);
+                return 0;
+            }
+
+            p = cast_to(TableNumbers*, luaM_realloc_(L, p, sizenumbers(p->capacity), sizenumbers(capacity), t->memcat));
+            p->capacity = capacity;
+            t->numbers = p;
+        }
+
+        p->values[p->size++] = nvalue(val);
+        return 1;
+    }
+    else if (i <= cast_to(unsigned int, p->capacity) && ttisnil(val))
+    {
+        // keys after the packed elements are never present in the hash part
+        return 1;
+    }
+
+    if (i <= cast_to(unsigned int, p->capacity))
+        luaH_unpack(L, t);
+    return 0;
+}
+
+/*
+** unpacks the table if `key' is in the range reserved for the packed array part; used before values are stored through a pointer
+*/
+static void unpackkey(lua_State* L, Table* t, int key)
+{
+    if (ispacked(t) && cast_to(unsigned int, key - 1) <= cast_to(unsigned int, t->numbers->capacity))
+        luaH_unpack(L, t);
+}
+
+/*
+** }=============================================================
+*/
+
 Table* luaH_new(lua_State* L, int narray, int nhash)
 {
     Table* t = luaM_newgco(L, Table, sizeof(Table), L->activememcat);
@@ -507,15 +1204,76 @@ Table* luaH_new(lua_State* L, int narray, int nhash)
     return t;
 }
 
+Table* luaH_newshaped(lua_State* L, int nfields)
+{
+    global_State* g = L->global;
+
+    // the empty shape is referenced by the global state until it's closed; other shapes are charged to tables that create them
+    if (!g->shaperoot)
+    {
+        g->shaperoot = newshape(L, NULL, NULL, 0);
+        g->shaperoot->refs = 1;
+    }
+
+    Table* t = luaH_new(L, 0, 0);
+    setfields(t, newfields(L, t, g->shaperoot, nfields < LUA_TABLE_SHAPEFIELDS ? nfields : LUA_TABLE_SHAPEFIELDS));
+    g->shaperoot->refs++;
+    return t;
+}
+
 void luaH_free(lua_State* L, Table* t, lua_Page* page)
 {
+    unwatch(L, t);
+
+    if (isshaped(t))
+        freefields(L, t);
     if (t->node != dummynode)
-        luaM_freearray(L, t->node, sizenode(t), LuaNode, t->memcat);
-    if (t->array)
+        luaM_free_(L, t->node, sizenodebytes(t->lsizenode), t->memcat);
+    if (ispacked(t))
+        freenumbers(L, t);
+    else if (t->array)
         luaM_freearray(L, t->array, t->sizearray, TValue, t->memcat);
     luaM_freegco(L, t, sizeof(Table), t->memcat, page);
 }
 
+#if LUA_TABLE_CONTROLBYTES
+/*
+** returns the node for a new key with hash `h'; that's the main position if it's free or its key
+** has a nil value, and the first free node in the probe sequence otherwise
+*/
+static LuaNode* getctrlpos(Table* t, unsigned int h)
+{
+    uint8_t* ctrl = gctrl(t);
+    int mask = sizenode(t) - 1;
+    int pos = lmod(h, sizenode(t));
+
+    // reusing the main position doesn't change probe sequences since the node stays occupied
+    LuaNode* mp = gnode(t, pos);
+    if (ctrl[pos] != LUAH_CTRLEMPTY && ttisnil(gval(mp)))
+    {
+        setctrl(t, pos, ctrlhash(h));
+        return mp;
+    }
+
+    if (t->lastfree <= 0)
+        return NULL; // table is at capacity
+
+    for (int g = ctrlgroups(t); g > 0; --g, pos = (pos + LUAH_CTRLGROUP) & mask)
+    {
+        unsigned int m = ctrlmatchempty(ctrl + pos);
+        if (m)
+        {
+            int i = (pos + ctrlfirst(m)) & mask;
+            t->lastfree--;
+            setctrl(t, i, ctrlhash(h));
+            gnext(gnode(t, i)) = 1;
+            return gnode(t, i);
+        }
+    }
+    return NULL; // could not find a free place
+}
+#endif
+
 static LuaNode* getfreepos(Table* t)
 {
     while (t->lastfree > 0)
@@ -538,6 +1296,17 @@ static LuaNode* getfreepos(Table* t)
 */
 static TValue* newkey(lua_State* L, Table* t, const TValue* key)
 {
+    unwatch(L, t);
+
+    if (isshaped(t))
+    {
+        TValue* v = ttisstring(key) ? newfield(L, t, key) : NULL;
+        if (v)
+            return v;
+
+        deshape(L, t);
+    }
+
     // enforce boundary invariant
     if (ttisnumber(key) && nvalue(key) == t->sizearray + 1)
     {
@@ -547,6 +1316,24 @@ static TValue* newkey(lua_State* L, Table* t, const TValue* key)
         return arrayornewkey(L, t, key);
     }
 
+#if LUA_TABLE_CONTROLBYTES
+    if (hasctrl(t))
+    {
+        LuaNode* n = getctrlpos(t, hashkey(key));
+        if (n == NULL)
+        {
+            rehash(L, t, key); // grow table
+
+            // after rehash, numeric keys might be located in the new array part, but won't be found in the node part
+            return arrayornewkey(L, t, key);
+        }
+        setnodekey(L, n, key);
+        luaC_barriert(L, t, key);
+        LUAU_ASSERT(ttisnil(gval(n)));
+        return gval(n);
+    }
+#endif
+
     LuaNode* mp = mainposition(t, key);
     if (!ttisnil(gval(mp)) || mp == dummynode)
     {
@@ -559,8 +1346,11 @@ static TValue* newkey(lua_State* L, Table* t, const TValue* key)
             return arrayornewkey(L, t, key);
         }
         LUAU_ASSERT(n != dummynode);
+        // the colliding key is only hashed; it can refer to a dead object if the table has weak keys and wasn't cleared yet
         TValue mk;
-        getnodekey(L, &mk, mp);
+        mk.value = mp->key.value;
+        memcpy(mk.extra, mp->key.extra, sizeof(mk.extra));
+        mk.tt = mp->key.tt;
         LuaNode* othern = mainposition(t, &mk);
         if (othern != mp)
         { // is colliding node out of its main position?
@@ -598,13 +1388,37 @@ static TValue* newkey(lua_State* L, Table* t, const TValue* key)
 */
 const TValue* luaH_getnum(Table* t, int key)
 {
+    // packed elements don't have a TValue to point to, they are read with luaH_getpacked
+    LUAU_ASSERT(!ispacked(t) || cast_to(unsigned int, key - 1) >= cast_to(unsigned int, t->numbers->size));
+
     // (1 <= key && key <= t->sizearray)
     if (cast_to(unsigned int, key - 1) < cast_to(unsigned int, t->sizearray))
         return &t->array[key - 1];
     else if (t->node != dummynode)
     {
         double nk = cast_num(key);
-        LuaNode* n = hashnum(t, nk);
+#if LUA_TABLE_CONTROLBYTES
+        if (hasctrl(t))
+        {
+            unsigned int h = hashnum(nk);
+            const uint8_t* ctrl = gctrl(t);
+            int mask = sizenode(t) - 1;
+            int pos = lmod(h, sizenode(t));
+            for (int g = ctrlgroups(t); g > 0; --g, pos = (pos + LUAH_CTRLGROUP) & mask)
+            {
+                for (unsigned int m = ctrlmatch(ctrl + pos, ctrlhash(h)); m; m &= m - 1)
+                {
+                    LuaNode* n = gnode(t, (pos + ctrlfirst(m)) & mask);
+                    if (ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), nk))
+                        return gval(n); // that's it
+                }
+                if (ctrlmatchempty(ctrl + pos))
+                    break;
+            }
+            return luaO_nilobject;
+        }
+#endif
+        LuaNode* n = hashpow2(t, hashnum(nk));
         for (;;)
         { // check whether `key' is somewhere in the chain
             if (ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), nk))
@@ -624,6 +1438,33 @@ const TValue* luaH_getnum(Table* t, int key)
 */
 const TValue* luaH_getstr(Table* t, TString* key)
 {
+    if (isshaped(t))
+    {
+        int slot = shapeslot(gfields(t)->shape, key);
+        return slot >= 0 ? gfield(t, slot) : luaO_nilobject;
+    }
+
+#if LUA_TABLE_CONTROLBYTES
+    if (hasctrl(t))
+    {
+        const uint8_t* ctrl = gctrl(t);
+        int mask = sizenode(t) - 1;
+        int pos = lmod(key->hash, sizenode(t));
+        for (int g = ctrlgroups(t); g > 0; --g, pos = (pos + LUAH_CTRLGROUP) & mask)
+        {
+            for (unsigned int m = ctrlmatch(ctrl + pos, ctrlhash(key->hash)); m; m &= m - 1)
+            {
+                LuaNode* n = gnode(t, (pos + ctrlfirst(m)) & mask);
+                if (ttisstring(gkey(n)) && tsvalue(gkey(n)) == key)
+                    return gval(n); // that's it
+            }
+            if (ctrlmatchempty(ctrl + pos))
+                break;
+        }
+        return luaO_nilobject;
+    }
+#endif
+
     LuaNode* n = hashstr(t, key);
     for (;;)
     { // check whether `key' is somewhere in the chain
@@ -658,6 +1499,27 @@ const TValue* luaH_get(Table* t, const TValue* key)
     }
     default:
     {
+#if LUA_TABLE_CONTROLBYTES
+        if (hasctrl(t))
+        {
+            unsigned int h = hashkey(key);
+            const uint8_t* ctrl = gctrl(t);
+            int mask = sizenode(t) - 1;
+            int pos = lmod(h, sizenode(t));
+            for (int g = ctrlgroups(t); g > 0; --g, pos = (pos + LUAH_CTRLGROUP) & mask)
+            {
+                for (unsigned int m = ctrlmatch(ctrl + pos, ctrlhash(h)); m; m &= m - 1)
+                {
+                    LuaNode* n = gnode(t, (pos + ctrlfirst(m)) & mask);
+                    if (luaO_rawequalKey(gkey(n), key))
+                        return gval(n); // that's it
+                }
+                if (ctrlmatchempty(ctrl + pos))
+                    break;
+            }
+            return luaO_nilobject;
+        }
+#endif
         LuaNode* n = mainposition(t, key);
         for (;;)
         { // check whether `key' is somewhere in the chain
@@ -674,6 +1536,9 @@ const TValue* luaH_get(Table* t, const TValue* key)
 
 TValue* luaH_set(lua_State* L, Table* t, const TValue* key)
 {
+    if (ispacked(t) && ttisnumber(key))
+        unpackkey(L, t, arrayindex(nvalue(key)));
+
     const TValue* p = luaH_get(t, key);
     invalidateTMcache(t);
     if (p != luaO_nilobject)
@@ -690,11 +1555,19 @@ TValue* luaH_newkey(lua_State* L, Table* t, const TValue* key)
         luaG_runerror(L, "table index is NaN");
     else if (ttisvector(key) && luai_vecisnan(vvalue(key)))
         luaG_runerror(L, "table index contains NaN");
+    if (ispacked(t) && ttisnumber(key))
+    {
+        // the key may be in the range reserved for the packed array part, which becomes a regular array part
+        unpackkey(L, t, arrayindex(nvalue(key)));
+        return arrayornewkey(L, t, key);
+    }
     return newkey(L, t, key);
 }
 
 TValue* luaH_setnum(lua_State* L, Table* t, int key)
 {
+    unpackkey(L, t, key);
+
     // (1 <= key && key <= t->sizearray)
     if (cast_to(unsigned int, key - 1) < cast_to(unsigned int, t->sizearray))
         return &t->array[key - 1];
@@ -749,6 +1622,10 @@ static int updateaboundary(Table* t, int boundary)
 */
 int luaH_getn(Table* t)
 {
+    // the hash part doesn't have the key after the last packed element
+    if (ispacked(t))
+        return t->numbers->size;
+
     int boundary = getaboundary(t);
 
     if (boundary > 0)
@@ -791,6 +1668,9 @@ int luaH_getn(Table* t)
 
 Table* luaH_clone(lua_State* L, Table* tt)
 {
+    // entries with dead keys would be copied to a table that the collector doesn't clear
+    luaC_checkweak(L, tt);
+
     Table* t = luaM_newgco(L, Table, sizeof(Table), L->activememcat);
     luaC_init(L, t, LUA_TTABLE);
     t->metatable = tt->metatable;
@@ -812,17 +1692,32 @@ Table* luaH_clone(lua_State* L, Table* tt)
 
         memcpy(t->array, tt->array, t->sizearray * sizeof(TValue));
     }
+    else if (ispacked(tt))
+    {
+        t->numbers = newnumbers(L, t, tt->numbers->capacity);
+        t->numbers->size = tt->numbers->size;
+
+        memcpy(t->numbers->values, tt->numbers->values, tt->numbers->size * sizeof(double));
+    }
 
     if (tt->node != dummynode)
     {
-        int size = 1 << tt->lsizenode;
-        t->node = luaM_newarray(L, size, LuaNode, t->memcat);
+        t->node = cast_to(LuaNode*, luaM_new_(L, sizenodebytes(tt->lsizenode), t->memcat));
         t->lsizenode = tt->lsizenode;
         t->nodemask8 = tt->nodemask8;
-        memcpy(t->node, tt->node, size * sizeof(LuaNode));
+        memcpy(t->node, tt->node, sizenodebytes(tt->lsizenode));
         t->lastfree = tt->lastfree;
     }
 
+    if (isshaped(tt))
+    {
+        TableFields* f = newfields(L, t, gfields(tt)->shape, gfields(tt)->size);
+        f->shape->refs++;
+        setfields(t, f);
+
+        memcpy(f->values, gfields(tt)->values, f->shape->nfields * sizeof(TValue));
+    }
+
     return t;
 }
 
@@ -834,6 +1729,9 @@ void luaH_clear(Table* tt)
         setnilvalue(&tt->array[i]);
     }
 
+    if (ispacked(tt))
+        tt->numbers->size = 0;
+
     maybesetaboundary(tt, 0);
 
     // clear hash part
@@ -848,12 +1746,39 @@ void luaH_clear(Table* tt)
             setnilvalue(gval(n));
             gnext(n) = 0;
         }
+#if LUA_TABLE_CONTROLBYTES
+        if (hasctrl(tt))
+        {
+            memset(gctrl(tt), LUAH_CTRLEMPTY, size + LUAH_CTRLGROUP);
+            tt->lastfree = ctrlcapacity(size);
+        }
+#endif
+    }
+
+    // clear fields; keys stay in the shape, like they stay in hash nodes
+    if (isshaped(tt))
+    {
+        for (int i = 0; i < gfields(tt)->shape->nfields; ++i)
+            setnilvalue(gfield(tt, i));
     }
 
     // back to empty -> no tag methods present
     tt->tmcache = cast_byte(~0);
 }
 
+void luaH_freeshapes(lua_State* L)
+{
+    global_State* g = L->global;
+
+    // all tables are freed at this point, so only the reference from the global state is left
+    if (g->shaperoot)
+    {
+        LUAU_ASSERT(g->shaperoot->refs == 1);
+        releaseshape(L, g->shaperoot);
+        g->shaperoot = NULL;
+    }
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
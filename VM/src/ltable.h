@@ -10,7 +10,50 @@
 #define gnext(n) ((n)->key.next)
 
 _Static_assert(offsetof(LuaNode, val) == 0, "Unexpected Node memory layout, pointer cast below is incorrect");
-#define gval2slot(t, v) ((int)(cast_to(LuaNode*, (const TValue*)(v)) - t->node))
+#define gval2slot(t, v) \
+    (isshaped(t) ? (int)((const TValue*)(v) - gfields(t)->values) : (int)(cast_to(LuaNode*, (const TValue*)(v)) - t->node))
+
+// fields of tables with a shape share the slot of the array part, tagged with the low bit since such tables have no array part
+#define isshaped(t) ((t)->shaped & 1)
+#define gfields(t) cast_to(TableFields*, (t)->shaped - 1)
+#define setfields(t, f) ((t)->shaped = (uintptr_t)(f) + 1)
+
+// key of field `slot' in shape `s'; slot has to be less than s->nfields
+#define gshapekey(s, slot) ((s)->keys->keys[slot])
+
+// key of field `slot' of a table with a shape, or NULL if there is no such field; used to check predicted slots
+#define gfieldkey(t, slot) ((unsigned)(slot) < (unsigned)gfields(t)->shape->nfields ? gshapekey(gfields(t)->shape, slot) : NULL)
+#define gfield(t, slot) (&gfields(t)->values[slot])
+
+#define sizeshapekeys(size, lsizeindex) (offsetof(TableShapeKeys, keys) + (size) * sizeof(TString*) + twoto(lsizeindex))
+#define sizefields(size) (offsetof(TableFields, values) + (size) * sizeof(TValue))
+
+// packed array parts keep sizearray at 0, so code that only understands TValue arrays sees an empty array part and takes a slower path
+#define ispacked(t) ((t)->sizearray == 0 && (t)->numbers != NULL && !isshaped(t))
+#define gpacked(t, i) ((t)->numbers->values[i])
+
+#define sizenumbers(capacity) (offsetof(TableNumbers, values) + (capacity) * sizeof(double))
+
+// number of traversal indices used by the array part; packed elements are numbered up to the capacity so that the numbering doesn't
+// change when the table is unpacked during traversal
+#define sizearrayindex(t) (ispacked(t) ? (t)->numbers->capacity : (t)->sizearray)
+
+#if LUA_TABLE_CONTROLBYTES
+// number of control bytes that are scanned at once when probing the hash part
+#define LUAH_CTRLGROUP 16
+// control byte of a free node; occupied nodes store 7 bits of the key hash
+#define LUAH_CTRLEMPTY 0x80
+// hash parts with up to 2^LUAH_CTRLMINLSIZE nodes keep collision chains, which are smaller and faster to fill with a few fields
+#define LUAH_CTRLMINLSIZE 4
+
+#define hasctrl(t) ((t)->lsizenode > LUAH_CTRLMINLSIZE)
+// control bytes are stored after the nodes, followed by copies of the first group so that any group can be loaded without wrapping
+#define gctrl(t) (cast_to(uint8_t*, (t)->node + sizenode(t)))
+#define sizenodebytes(lsize) (twoto(lsize) * sizeof(LuaNode) + ((lsize) > LUAH_CTRLMINLSIZE ? twoto(lsize) + LUAH_CTRLGROUP : 0))
+#else
+#define hasctrl(t) 0
+#define sizenodebytes(lsize) (twoto(lsize) * sizeof(LuaNode))
+#endif
 
 // reset cache of absent metamethods, cache is updated in luaT_gettm
 #define invalidateTMcache(t) t->tmcache = 0
@@ -25,6 +68,7 @@ LUAI_FUNC const TValue* luaH_get(Table* t, const TValue* key);
 LUAI_FUNC TValue* luaH_set(lua_State* L, Table* t, const TValue* key);
 LUAI_FUNC TValue* luaH_newkey(lua_State* L, Table* t, const TValue* key);
 LUAI_FUNC Table* luaH_new(lua_State* L, int narray, int lnhash);
+LUAI_FUNC Table* luaH_newshaped(lua_State* L, int nfields);
 LUAI_FUNC void luaH_resizearray(lua_State* L, Table* t, int nasize);
 LUAI_FUNC void luaH_resizehash(lua_State* L, Table* t, int nhsize);
 LUAI_FUNC void luaH_free(lua_State* L, Table* t, struct lua_Page* page);
@@ -32,6 +76,12 @@ LUAI_FUNC int luaH_next(lua_State* L, Table* t, StkId key);
 LUAI_FUNC int luaH_getn(Table* t);
 LUAI_FUNC Table* luaH_clone(lua_State* L, Table* tt);
 LUAI_FUNC void luaH_clear(Table* tt);
+LUAI_FUNC void luaH_freeshapes(lua_State* L);
+LUAI_FUNC int luaH_getpacked(Table* t, const TValue* key, TValue* res);
+LUAI_FUNC int luaH_setpacked(lua_State* L, Table* t, const TValue* key, const TValue* val);
+LUAI_FUNC void luaH_pack(lua_State* L, Table* t);
+LUAI_FUNC void luaH_unpack(lua_State* L, Table* t);
+LUAI_FUNC int luaH_watch(lua_State* L, Table* t);
 
 #define luaH_setslot(L, t, slot, key) (invalidateTMcache(t), (slot == luaO_nilobject ? luaH_newkey(L, t, key) : cast_to(TValue*, slot)))
 
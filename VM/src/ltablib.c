@@ -8,7 +8,9 @@
 #include "lstring.h"
 #include "lgc.h"
 #include "ldebug.h"
+#include "ldo.h"
 #include "lvm.h"
+#include "lnumutils.h"
 
 #ifdef __clang__
 #pragma clang diagnostic push
@@ -213,7 +215,8 @@ static int tmove(lua_State* L)
         if (dst->readonly) // also checked in moveelements, but this blocks resizes of r/o tables
             luaG_readonlyerror(L);
 
-        if (t > 0 && (t - 1) <= dst->sizearray && (t - 1 + n) > dst->sizearray)
+        // packed destination tables grow as elements are appended to them
+        if (t > 0 && (t - 1) <= dst->sizearray && (t - 1 + n) > dst->sizearray && !ispacked(dst))
         { // grow the destination table array
             luaH_resizearray(L, dst, t - 1 + n);
         }
@@ -293,6 +296,12 @@ static int tunpack(lua_State* L)
             setobj2s(L, L->top + i, &t->array[i]);
         L->top += n;
     }
+    else if (i == 1 && ispacked(t) && (int)(n) <= t->numbers->size)
+    {
+        for (i = 0; i < (int)(n); i++)
+            setnvalue(L->top + i, gpacked(t, i));
+        L->top += n;
+    }
     else
     {
         // push arg[i..e - 1] (to avoid overflows)
@@ -310,119 +319,320 @@ static int tunpack(lua_State* L)
 **  Addison-Wesley, 1993.)
 */
 
-static void set2(lua_State* L, int i, int j)
+typedef int (*SortPredicate)(lua_State* L, const TValue* l, const TValue* r);
+
+static int sort_func(lua_State* L, const TValue* l, const TValue* r)
+{
+    LUAU_ASSERT(L->top == L->base + 2); // table, function
+
+    setobj2s(L, L->top, &L->base[1]);
+    setobj2s(L, L->top + 1, l);
+    setobj2s(L, L->top + 2, r);
+    L->top += 3; // safe because of LUA_MINSTACK guarantee
+    luaD_call(L, L->top - 3, 1);
+    L->top -= 1; // maintain stack depth
+
+    return !l_isfalse(L->top);
+}
+
+// predicates for arrays that only have numbers or only have strings; these can't call into Lua and modify the table
+static int sort_lessnum(lua_State* L, const TValue* l, const TValue* r)
 {
-    lua_rawseti(L, 1, i);
-    lua_rawseti(L, 1, j);
+    return luai_numlt(nvalue(l), nvalue(r));
 }
 
-static int sort_comp(lua_State* L, int a, int b)
+static int sort_lessstr(lua_State* L, const TValue* l, const TValue* r)
 {
-    if (!lua_isnil(L, 2))
-    { // function?
-        int res;
-        lua_pushvalue(L, 2);
-        lua_pushvalue(L, a - 1); // -1 to compensate function
-        lua_pushvalue(L, b - 2); // -2 to compensate function and `a'
-        lua_call(L, 2, 1);
-        res = lua_toboolean(L, -1);
-        lua_pop(L, 1);
-        return res;
+    return luaV_strcmp(tsvalue(l), tsvalue(r)) < 0;
+}
+
+static void sort_swap(lua_State* L, Table* t, int i, int j)
+{
+    TValue* arr = t->array;
+    LUAU_ASSERT((unsigned)(i) < (unsigned)(t->sizearray) && (unsigned)(j) < (unsigned)(t->sizearray)); // contract maintained in sort_less
+
+    // no barrier required because both elements are in the array before and after the swap
+    TValue temp;
+    setobj2s(L, &temp, &arr[i]);
+    setobj2t(L, &arr[i], &arr[j]);
+    setobj2t(L, &arr[j], &temp);
+}
+
+static int sort_less(lua_State* L, Table* t, int i, int j, SortPredicate pred)
+{
+    TValue* arr = t->array;
+    int n = t->sizearray;
+    LUAU_ASSERT((unsigned)(i) < (unsigned)(n) && (unsigned)(j) < (unsigned)(n));
+
+    int res = pred(L, &arr[i], &arr[j]);
+
+    // predicate call may resize the table, which is invalid
+    if (t->sizearray != n || t->array != arr)
+        luaL_error(L, "table modified during sorting");
+
+    return res;
+}
+
+static void sort_siftheap(lua_State* L, Table* t, int l, int u, SortPredicate pred, int root)
+{
+    LUAU_ASSERT(l <= u);
+    int count = u - l + 1;
+
+    // process all elements with two children
+    while (root * 2 + 2 < count)
+    {
+        int left = root * 2 + 1, right = root * 2 + 2;
+        int next = root;
+        next = sort_less(L, t, l + next, l + left, pred) ? left : next;
+        next = sort_less(L, t, l + next, l + right, pred) ? right : next;
+
+        if (next == root)
+            break;
+
+        sort_swap(L, t, l + root, l + next);
+        root = next;
+    }
+
+    // process last element if it has just one child
+    int lastleft = root * 2 + 1;
+    if (lastleft == count - 1 && sort_less(L, t, l + root, l + lastleft, pred))
+        sort_swap(L, t, l + root, l + lastleft);
+}
+
+static void sort_heap(lua_State* L, Table* t, int l, int u, SortPredicate pred)
+{
+    LUAU_ASSERT(l <= u);
+    int count = u - l + 1;
+
+    for (int i = count / 2 - 1; i >= 0; --i)
+        sort_siftheap(L, t, l, u, pred, i);
+
+    for (int i = count - 1; i > 0; --i)
+    {
+        sort_swap(L, t, l, l + i);
+        sort_siftheap(L, t, l, l + i - 1, pred, 0);
     }
-    else // a < b?
-        return lua_lessthan(L, a, b);
 }
 
-static void auxsort(lua_State* L, int l, int u)
+static void sort_rec(lua_State* L, Table* t, int l, int u, int limit, SortPredicate pred)
 {
+    // sort range [l..u] (inclusive, 0-based)
     while (l < u)
-    { // for tail recursion
-        int i, j;
-        // sort elements a[l], a[(l+u)/2] and a[u]
-        lua_rawgeti(L, 1, l);
-        lua_rawgeti(L, 1, u);
-        if (sort_comp(L, -1, -2)) // a[u] < a[l]?
-            set2(L, l, u);        // swap a[l] - a[u]
-        else
-            lua_pop(L, 2);
-        if (u - l == 1)
-            break; // only 2 elements
-        i = (l + u) / 2;
-        lua_rawgeti(L, 1, i);
-        lua_rawgeti(L, 1, l);
-        if (sort_comp(L, -2, -1)) // a[i]<a[l]?
-            set2(L, i, l);
-        else
+    {
+        // if the limit has been reached, quick sort is going over the permitted nlogn complexity, so we fall back to heap sort
+        if (limit == 0)
         {
-            lua_pop(L, 1); // remove a[l]
-            lua_rawgeti(L, 1, u);
-            if (sort_comp(L, -1, -2)) // a[u]<a[i]?
-                set2(L, i, u);
-            else
-                lua_pop(L, 2);
+            sort_heap(L, t, l, u, pred);
+            return;
         }
+
+        // sort elements a[l], a[(l+u)/2] and a[u]
+        // note: this simultaneously acts as a small sort and a median selector
+        if (sort_less(L, t, u, l, pred)) // a[u] < a[l]?
+            sort_swap(L, t, u, l);       // swap a[l] - a[u]
+        if (u - l == 1)
+            break;                       // only 2 elements
+        int m = l + ((u - l) >> 1);      // midpoint
+        if (sort_less(L, t, m, l, pred)) // a[m]<a[l]?
+            sort_swap(L, t, m, l);
+        else if (sort_less(L, t, u, m, pred)) // a[u]<a[m]?
+            sort_swap(L, t, m, u);
         if (u - l == 2)
-            break;            // only 3 elements
-        lua_rawgeti(L, 1, i); // Pivot
-        lua_pushvalue(L, -1);
-        lua_rawgeti(L, 1, u - 1);
-        set2(L, i, u - 1);
+            break; // only 3 elements
+
+        // here l, m, u are ordered; m will become the new pivot
+        int p = u - 1;
+        sort_swap(L, t, m, u - 1); // pivot is now (and always) at u-1
+
         // a[l] <= P == a[u-1] <= a[u], only need to sort from l+1 to u-2
-        i = l;
-        j = u - 1;
+        int i = l;
+        int j = u - 1;
         for (;;)
         { // invariant: a[l..i] <= P <= a[j..u]
             // repeat ++i until a[i] >= P
-            while (lua_rawgeti(L, 1, ++i), sort_comp(L, -1, -2))
+            while (sort_less(L, t, ++i, p, pred))
             {
                 if (i >= u)
                     luaL_error(L, "invalid order function for sorting");
-                lua_pop(L, 1); // remove a[i]
             }
             // repeat --j until a[j] <= P
-            while (lua_rawgeti(L, 1, --j), sort_comp(L, -3, -1))
+            while (sort_less(L, t, p, --j, pred))
             {
                 if (j <= l)
                     luaL_error(L, "invalid order function for sorting");
-                lua_pop(L, 1); // remove a[j]
             }
             if (j < i)
-            {
-                lua_pop(L, 3); // pop pivot, a[i], a[j]
                 break;
-            }
-            set2(L, i, j);
+            sort_swap(L, t, i, j);
         }
-        lua_rawgeti(L, 1, u - 1);
-        lua_rawgeti(L, 1, i);
-        set2(L, u - 1, i); // swap pivot (a[u-1]) with a[i]
+
+        // swap pivot a[p] with a[i], which is the new midpoint
+        sort_swap(L, t, p, i);
+
+        // adjust limit to allow 1.5 log2N recursive steps
+        limit = (limit >> 1) + (limit >> 2);
+
         // a[l..i-1] <= a[i] == P <= a[i+1..u]
-        // adjust so that smaller half is in [j..i] and larger one in [l..u]
+        // sort smaller half recursively; the larger half is sorted in the next loop iteration
         if (i - l < u - i)
         {
-            j = l;
-            i = i - 1;
-            l = i + 2;
+            sort_rec(L, t, l, i - 1, limit, pred);
+            l = i + 1;
         }
         else
         {
-            j = i + 1;
-            i = u;
-            u = j - 2;
+            sort_rec(L, t, i + 1, u, limit, pred);
+            u = i - 1;
         }
-        auxsort(L, j, i); // call recursively the smaller one
-    }                     // repeat the routine for the larger one
+    }
+}
+
+/*
+** packed array parts are sorted as raw doubles; since they don't have NaNs, `<' is a strict weak order and short ranges can use insertion
+** sort without changing the result
+*/
+#define SORT_INSERTION 16
+
+static void sort_siftnumbers(double* a, int count, int root)
+{
+    double v = a[root];
+
+    while (root * 2 + 1 < count)
+    {
+        int child = root * 2 + 1;
+        if (child + 1 < count && a[child] < a[child + 1])
+            child++;
+        if (!(v < a[child]))
+            break;
+        a[root] = a[child];
+        root = child;
+    }
+
+    a[root] = v;
+}
+
+static void sort_numbers(double* a, int l, int u, int limit)
+{
+    while (u - l >= SORT_INSERTION)
+    {
+        if (limit == 0)
+        {
+            int count = u - l + 1;
+            for (int i = count / 2 - 1; i >= 0; --i)
+                sort_siftnumbers(a + l, count, i);
+            for (int i = count - 1; i > 0; --i)
+            {
+                double v = a[l];
+                a[l] = a[l + i];
+                a[l + i] = v;
+                sort_siftnumbers(a + l, i, 0);
+            }
+            return;
+        }
+
+        // median of three, which also guards both partition scans
+        int m = l + ((u - l) >> 1);
+        double v;
+        if (a[u] < a[l])
+            v = a[u], a[u] = a[l], a[l] = v;
+        if (a[m] < a[l])
+            v = a[m], a[m] = a[l], a[l] = v;
+        else if (a[u] < a[m])
+            v = a[m], a[m] = a[u], a[u] = v;
+
+        double pivot = a[m];
+        int i = l;
+        int j = u;
+        for (;;)
+        {
+            while (a[++i] < pivot)
+                ;
+            while (pivot < a[--j])
+                ;
+            if (j <= i)
+                break;
+            v = a[i], a[i] = a[j], a[j] = v;
+        }
+
+        limit = (limit >> 1) + (limit >> 2);
+
+        // a[l..j] <= P <= a[j+1..u]
+        if (j - l < u - j)
+        {
+            sort_numbers(a, l, j, limit);
+            l = j + 1;
+        }
+        else
+        {
+            sort_numbers(a, j + 1, u, limit);
+            u = j;
+        }
+    }
+
+    for (int i = l + 1; i <= u; ++i)
+    {
+        double v = a[i];
+        int j = i - 1;
+        for (; j >= l && v < a[j]; --j)
+            a[j + 1] = a[j];
+        a[j + 1] = v;
+    }
 }
 
 static int sort(lua_State* L)
 {
     luaL_checktype(L, 1, LUA_TTABLE);
-    int n = lua_objlen(L, 1);
-    luaL_checkstack(L, 40, ""); // assume array is smaller than 2^40
+    Table* t = hvalue(L->base);
+    int n = luaH_getn(t);
+    if (t->readonly)
+        luaG_readonlyerror(L);
+
+    SortPredicate pred = luaV_lessthan;
     if (!lua_isnoneornil(L, 2)) // is there a 2nd argument?
+    {
         luaL_checktype(L, 2, LUA_TFUNCTION);
+        pred = sort_func;
+    }
     lua_settop(L, 2); // make sure there is two arguments
-    auxsort(L, 1, n);
+
+    if (n < 2)
+        return 0;
+
+    // fast-path: default order of a packed array part; it has exactly n elements since they don't have holes
+    if (ispacked(t) && pred == luaV_lessthan)
+    {
+        double* a = t->numbers->values;
+        int nan = 0;
+        for (int i = 0; i < n; ++i)
+            nan |= luai_numisnan(a[i]);
+
+        if (!nan)
+        {
+            sort_numbers(a, 0, n - 1, n);
+            return 0;
+        }
+    }
+
+    // elements are sorted in place, so they must all be in the array part
+    if (n > t->sizearray)
+        luaH_resizearray(L, t, n);
+
+    // fast-path: default order of homogeneous arrays doesn't need metamethods
+    if (pred == luaV_lessthan)
+    {
+        TValue* arr = t->array;
+        int tt = ttype(&arr[0]);
+        int i = 1;
+        while (i < n && ttype(&arr[i]) == tt)
+            i++;
+
+        if (i == n && tt == LUA_TNUMBER)
+            pred = sort_lessnum;
+        else if (i == n && tt == LUA_TSTRING)
+            pred = sort_lessstr;
+    }
+
+    sort_rec(L, t, 0, n - 1, n, pred);
     return 0;
 }
 
@@ -446,6 +656,9 @@ static int tcreate(lua_State* L)
             TValue* e = &t->array[i];
             setobj2t(L, e, v);
         }
+
+        if (ttisnumber(v))
+            luaH_pack(L, t);
     }
     else
     {
@@ -468,7 +681,14 @@ static int tfind(lua_State* L)
 
     for (int i = init;; ++i)
     {
-        const TValue* e = luaH_getnum(t, i);
+        TValue packed;
+        const TValue* e = &packed;
+        if (ispacked(t) && (unsigned)(i - 1) < (unsigned)(t->numbers->size))
+        {
+            setnvalue(&packed, gpacked(t, i - 1));
+        }
+        else
+            e = luaH_getnum(t, i);
         if (ttisnil(e))
             break;
 
@@ -3,6 +3,21 @@
 #include "lualib.h"
 
 #include "lcommon.h"
+#include "lapi.h"
+#include "lstring.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUA_UTF8SSE2 1
+#else
+#define LUA_UTF8SSE2 0
+#endif
+
+#if LUA_UTF8SSE2 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #ifdef __clang__
 #pragma clang diagnostic push
@@ -57,6 +72,63 @@ static const char* utf8_decode(const char* o, int* val)
     return (const char*)s + 1; // +1 to include first byte
 }
 
+#if LUA_UTF8SSE2
+static LUAU_FORCEINLINE size_t asciifirst(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long rl;
+    _BitScanForward(&rl, mask);
+    return rl;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/*
+** Return the length of the longest prefix of s[0..len) that only has ASCII characters.
+*/
+static LUAU_NOINLINE size_t asciiprefix(const char* s, size_t len)
+{
+    size_t i = 0;
+
+#if LUA_UTF8SSE2
+    // most text is ASCII, so we check 32 bytes at a time and only find the exact position once the block has a high bit set
+    for (; i + 32 <= len; i += 32)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + i + 16));
+
+        if (_mm_movemask_epi8(_mm_or_si128(a, b)))
+        {
+            unsigned int mask = _mm_movemask_epi8(a) | (_mm_movemask_epi8(b) << 16);
+            return i + asciifirst(mask);
+        }
+    }
+
+    if (i + 16 <= len)
+    {
+        unsigned int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i)));
+        if (mask)
+            return i + asciifirst(mask);
+        i += 16;
+    }
+#endif
+
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        if (w & 0x8080808080808080ull)
+            break;
+    }
+
+    while (i < len && (unsigned char)s[i] < 0x80)
+        i++;
+
+    return i;
+}
+
 /*
 ** utf8len(s [, i [, j]]) --> number of characters that start in the
 ** range [i,j], or nil + current position if 's' is not well formed in
@@ -71,11 +143,29 @@ static int utflen(lua_State* L)
     int posj = u_posrelat(luaL_optinteger(L, 3, -1), len);
     luaL_argcheck(L, 1 <= posi && --posi <= (int)len, 2, "initial position out of string");
     luaL_argcheck(L, --posj < (int)len, 3, "final position out of string");
+    // strings that are known to be ASCII have one character per byte
+    TString* ts = tsvalue(luaA_toobject(L, 1));
+    if (ts->ascii == STRASCII_YES)
+    {
+        lua_pushinteger(L, posi <= posj ? posj - posi + 1 : 0);
+        return 1;
+    }
+    int whole = (posi == 0 && posj == (int)len - 1);
     while (posi <= posj)
     {
+        // ASCII runs are counted in bulk, only the other characters need to be decoded
+        if ((unsigned char)s[posi] < 0x80)
+        {
+            size_t run = asciiprefix(s + posi, posj - posi + 1);
+            n += (int)run;
+            posi += (int)run;
+            continue;
+        }
         const char* s1 = utf8_decode(s + posi, NULL);
         if (s1 == NULL)
         {                                 // conversion error?
+            if (whole)
+                ts->ascii = STRASCII_NO;
             lua_pushnil(L);               // return nil ...
             lua_pushinteger(L, posi + 1); // ... and current position
             return 2;
@@ -83,6 +173,9 @@ static int utflen(lua_State* L)
         posi = (int)(s1 - s);
         n++;
     }
+    // every character is a single byte iff the string is ASCII
+    if (whole)
+        ts->ascii = n == (int)len ? STRASCII_YES : STRASCII_NO;
     lua_pushinteger(L, n);
     return 1;
 }
@@ -247,6 +340,8 @@ static int iter_aux(lua_State* L)
     int n = lua_tointeger(L, 2) - 1;
     if (n < 0) // first iteration?
         n = 0; // start from here
+    else if (tsvalue(luaA_toobject(L, 1))->ascii == STRASCII_YES)
+        n++; // every byte is a character
     else if (n < (int)len)
     {
         n++; // skip current byte
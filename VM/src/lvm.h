@@ -3,8 +3,120 @@
 #pragma once
 
 #include "lobject.h"
+#include "lstate.h"
 #include "ltm.h"
 
+// limit for table tag-method chains (to avoid loops)
+#define MAXTAGLOOP 100
+
+/*
+ * In lazy mode (luau_loadlazy), only function headers and the function hierarchy are decoded during load. The bytecode is retained in
+ * a LazyChunk that is shared by all functions of the module; code and constants of each function are decoded from it right before
+ * the function is called for the first time, and line/debug info is decoded when the debug APIs or error messages need it.
+ * Each function keeps a reference to the chunk until it's fully decoded.
+ */
+typedef struct LazyChunk
+{
+    const char* data;
+    size_t size;
+
+    size_t memsize;
+    uint8_t memcat;
+
+    int refs; // number of functions that still have lazy parts, or all functions that are alive when loaded from a program
+
+    // program that owns the bytecode and code of all functions when loaded with luau_loadprogram
+    lua_Program* program;
+
+    // environment of closures in constants and globals that imports are resolved against; just like in luau_load, these are the ones
+    // that the chunk was loaded with, regardless of the caller. functions that refer to the chunk keep them alive (see traverseproto)
+    Table* env;
+    Table* gt;
+
+    // all functions by id; closure constants only refer to child functions, which are alive as long as the function that is decoded
+    Proto** protos;
+    unsigned int protoCount;
+
+    // offset of each entry in the string table
+    uint32_t* strings;
+    unsigned int stringCount;
+} LazyChunk;
+
+/*
+ * Each NAMECALL instruction has a site in the namecache of its function (the C operand is the site index, assigned when the function is
+ * loaded) with up to LUA_NAMECALL_CACHESIZE entries, one for each receiver metatable that the method was found through recently. An
+ * entry records the chain of __index tables that was walked to find the method, up to NAMECALL_MAXDEPTH tables long: for each level,
+ * both tables and pointers to the __index field of the metatable and to the key in the __index table. The tables are watched (see
+ * luaH_watch): adding or moving their keys, or freeing them, starts a new epoch. While the epoch of the entry is current, the pointers
+ * are valid and the values are read through them, so the lookup sees writes to existing keys without hashing the key. Entries don't
+ * keep the tables alive; the epoch is checked before any pointer is used.
+ */
+#define NAMECALL_MAXDEPTH 4
+
+typedef struct NamecallLevel
+{
+    const Table* mt; // metatable
+    const Table* h;  // __index table
+
+    const TValue* index; // __index field of the metatable
+    const TValue* slot;  // key in the __index table; NULL if the table doesn't have the key
+} NamecallLevel;
+
+typedef struct NamecallEntry
+{
+    NamecallLevel levels[NAMECALL_MAXDEPTH];
+    uint32_t epoch; // namecallepoch when the entry was recorded; 0 for empty entries
+    int depth;      // number of levels; the method is in the last one
+} NamecallEntry;
+
+typedef struct NamecallSite
+{
+    NamecallEntry entries[LUA_NAMECALL_CACHESIZE];
+    int next; // entry to replace next
+} NamecallSite;
+
+// finds the method in the namecall cache entries that were recorded for metatable `mt'; the receiver itself must not have the key
+// note: used by both the interpreter and the native code fallback of NAMECALL
+static LUAU_FORCEINLINE const TValue* luaV_namecallcached(global_State* g, const Proto* p, int site, const Table* mt)
+{
+    if (!mt || !p->namecache || site >= p->sizenamecache)
+        return NULL;
+
+    const NamecallSite* s = &p->namecache[site];
+
+    for (int i = 0; i < LUA_NAMECALL_CACHESIZE; ++i)
+    {
+        const NamecallEntry* e = &s->entries[i];
+
+        // entries from older epochs may point into tables that changed or were freed
+        if (e->epoch != g->namecallepoch)
+            continue;
+
+        const Table* t = mt;
+
+        for (int d = 0; t == e->levels[d].mt; ++d)
+        {
+            const NamecallLevel* l = &e->levels[d];
+
+            // keys of both tables didn't move, so `index' still points to the __index field and `slot' to the key; the field could have
+            // been assigned a different table though
+            if (!ttistable(l->index) || hvalue(l->index) != l->h)
+                break;
+
+            if (d + 1 == e->depth)
+                return ttisnil(l->slot) ? NULL : l->slot;
+
+            // the key could have been assigned to an existing node of an intermediate table
+            if (l->slot && !ttisnil(l->slot))
+                break;
+
+            t = l->h->metatable;
+        }
+    }
+
+    return NULL;
+}
+
 #define tostring(L, o) ((ttype(o) == LUA_TSTRING) || (luaV_tostring(L, o)))
 
 #define tonumber(o, n) (ttype(o) == LUA_TNUMBER || (((o) = luaV_tonumber(o, n)) != NULL))
@@ -27,8 +139,16 @@ LUAI_FUNC void luaV_getimport(lua_State* L, Table* env, TValue* k, uint32_t id,
 LUAI_FUNC void luaV_prepareFORN(lua_State* L, StkId plimit, StkId pstep, StkId pinit);
 LUAI_FUNC void luaV_callTM(lua_State* L, int nparams, int res);
 LUAI_FUNC void luaV_tryfuncTM(lua_State* L, StkId func);
+LUAI_FUNC void luaV_cachenamecall(lua_State* L, Proto* p, int site, const TValue* obj, TString* key);
 
 LUAI_FUNC void luau_execute(lua_State* L);
 LUAI_FUNC int luau_precall(lua_State* L, struct lua_TValue* func, int nresults);
 LUAI_FUNC void luau_poscall(lua_State* L, StkId first);
 LUAI_FUNC void luau_callhook(lua_State* L, lua_Hook hook, void* userdata);
+
+LUAI_FUNC void luau_loadcode(lua_State* L, Proto* p);
+LUAI_FUNC void luau_loaddebug(lua_State* L, Proto* p);
+LUAI_FUNC void luau_loadall(lua_State* L, Proto* p);
+LUAI_FUNC void luau_releasechunk(lua_State* L, Proto* p);
+LUAI_FUNC void luau_unfusecode(lua_State* L, Proto* p);
+LUAI_FUNC uint8_t luau_unfuseop(uint8_t op);
@@ -75,8 +75,12 @@
 #define VM_KV(i) (LUAU_ASSERT((unsigned)(i) < (unsigned)(cl->l.p->sizek)), &k[i])
 #define VM_UV(i) (LUAU_ASSERT((unsigned)(i) < (unsigned)(cl->nupvalues)), &cl->l.uprefs[i])
 
-#define VM_PATCH_C(pc, slot) *((Instruction*)(pc)) = (((uint8_t)(slot) << 24) | (0x00ffffffu & *(pc)))
-#define VM_PATCH_E(pc, slot) *((Instruction*)(pc)) = (((uint32_t)(slot) << 8) | (0x000000ffu & *(pc)))
+// code of functions loaded from a lua_Program is shared with other states and is never patched; frames that were running when the
+// function got a private copy of the code (see luaF_unshareproto) keep executing the shared code until they return
+#define VM_CANPATCH(pc) (!cl->l.p->shared && (pc) >= cl->l.p->code && (pc) < cl->l.p->code + cl->l.p->sizecode)
+
+#define VM_PATCH_C(pc, slot) (VM_CANPATCH(pc) ? (void)(*((Instruction*)(pc)) = (((uint8_t)(slot) << 24) | (0x00ffffffu & *(pc)))) : (void)0)
+#define VM_PATCH_E(pc, slot) (VM_CANPATCH(pc) ? (void)(*((Instruction*)(pc)) = (((uint32_t)(slot) << 8) | (0x000000ffu & *(pc)))) : (void)0)
 
 #define VM_INTERRUPT() \
     { \
@@ -115,7 +119,9 @@
         VM_DISPATCH_OP(LOP_LOADKX), VM_DISPATCH_OP(LOP_JUMPX), VM_DISPATCH_OP(LOP_FASTCALL), VM_DISPATCH_OP(LOP_COVERAGE), \
         VM_DISPATCH_OP(LOP_CAPTURE), VM_DISPATCH_OP(LOP_DEP_JUMPIFEQK), VM_DISPATCH_OP(LOP_DEP_JUMPIFNOTEQK), VM_DISPATCH_OP(LOP_FASTCALL1), \
         VM_DISPATCH_OP(LOP_FASTCALL2), VM_DISPATCH_OP(LOP_FASTCALL2K), VM_DISPATCH_OP(LOP_FORGPREP), VM_DISPATCH_OP(LOP_JUMPXEQKNIL), \
-        VM_DISPATCH_OP(LOP_JUMPXEQKB), VM_DISPATCH_OP(LOP_JUMPXEQKN), VM_DISPATCH_OP(LOP_JUMPXEQKS),
+        VM_DISPATCH_OP(LOP_JUMPXEQKB), VM_DISPATCH_OP(LOP_JUMPXEQKN), VM_DISPATCH_OP(LOP_JUMPXEQKS), VM_DISPATCH_OP(LOP_FUSED_MOVE_MOVE), \
+        VM_DISPATCH_OP(LOP_FUSED_MOVE_GETTABLEKS), VM_DISPATCH_OP(LOP_FUSED_LOADK_ADD), VM_DISPATCH_OP(LOP_FUSED_GETTABLEKS_GETTABLEKS), \
+        VM_DISPATCH_OP(LOP_FUSED_GETTABLEKS_MOVE), VM_DISPATCH_OP(LOP_FUSED_GETTABLEKS_ADD), VM_DISPATCH_OP(LOP_FUSED_GETTABLEKS_CALL),
 
 #if defined(__GNUC__) || defined(__clang__)
 #define VM_USE_CGOTO 1
@@ -130,19 +136,57 @@
  * VM_NEXT() fetch a byte and dispatch or jump to the beginning of the switch statement
  * VM_CONTINUE() Use an opcode override to dispatch with computed goto or
  * switch statement to skip a LOP_BREAK instruction.
+ * VM_NEXT_FUSED(op) Execute the second instruction of a fused pair, which is
+ * known to be op; with computed goto this is a direct jump to its handler.
  */
 #if VM_USE_CGOTO
 #define VM_CASE(op) CASE_##op:
 #define VM_NEXT() goto*(L->singlestep ? &&dispatch : kDispatchTable[LUAU_INSN_OP(*pc)])
 #define VM_CONTINUE(op) goto* kDispatchTable[(uint8_t)(op)]
+#define VM_NEXT_FUSED(op) goto CASE_##op
 #else
 #define VM_CASE(op) case op:
 #define VM_NEXT() goto dispatch
 #define VM_CONTINUE(op) \
     dispatchOp = (uint8_t)(op); \
     goto dispatchContinue
+#define VM_NEXT_FUSED(op) VM_CONTINUE(op)
 #endif
 
+// Fast paths of GETTABLEKS for fused pairs: when the value isn't in the expected slot or shape field, the first instruction goes through
+// the regular handler and the second one is dispatched as usual.
+#define VM_FUSED_GETTABLEKS() \
+    { \
+        Instruction insn = pc[0]; \
+        StkId ra = VM_REG(LUAU_INSN_A(insn)); \
+        StkId rb = VM_REG(LUAU_INSN_B(insn)); \
+        TValue* kv = VM_KV(pc[1]); \
+        LUAU_ASSERT(ttisstring(kv)); \
+\
+        if (!ttistable(rb)) \
+        { \
+            VM_CONTINUE(LOP_GETTABLEKS); \
+        } \
+\
+        Table* h = hvalue(rb); \
+        LuaNode* n = &h->node[LUAU_INSN_C(insn) & h->nodemask8]; \
+\
+        if (LUAU_LIKELY(ttisstring(gkey(n)) && tsvalue(gkey(n)) == tsvalue(kv) && !ttisnil(gval(n)))) \
+        { \
+            setobj2s(L, ra, gval(n)); \
+        } \
+        else if (isshaped(h) && gfieldkey(h, LUAU_INSN_C(insn)) == tsvalue(kv) && !ttisnil(gfield(h, LUAU_INSN_C(insn)))) \
+        { \
+            setobj2s(L, ra, gfield(h, LUAU_INSN_C(insn))); \
+        } \
+        else \
+        { \
+            VM_CONTINUE(LOP_GETTABLEKS); \
+        } \
+\
+        pc += 2; \
+    }
+
 LUAU_NOINLINE void luau_callhook(lua_State* L, lua_Hook hook, void* userdata)
 {
     ptrdiff_t base = savestack(L, L->base);
@@ -168,6 +212,9 @@ LUAU_NOINLINE void luau_callhook(lua_State* L, lua_Hook hook, void* userdata)
 
     Closure* cl = clvalue(L->ci->func);
 
+    if (!cl->isC && (cl->l.p->lazy & PROTO_LAZYDEBUG))
+        luau_loaddebug(L, cl->l.p);
+
     lua_Debug ar;
     ar.currentline = cl->isC ? -1 : luaG_getline(cl->l.p, pcRel(L->ci->savedpc, cl->l.p));
     ar.userdata = userdata;
@@ -257,13 +304,14 @@ reentry:
                     goto exit;
             }
 
+            // fused instructions are stepped through one by one
 #if VM_USE_CGOTO
-            VM_CONTINUE(LUAU_INSN_OP(*pc));
+            VM_CONTINUE(luau_unfuseop(LUAU_INSN_OP(*pc)));
 #endif
         }
 
 #if !VM_USE_CGOTO
-        size_t dispatchOp = LUAU_INSN_OP(*pc);
+        size_t dispatchOp = L->singlestep ? luau_unfuseop(LUAU_INSN_OP(*pc)) : LUAU_INSN_OP(*pc);
 
     dispatchContinue:
         switch (dispatchOp)
@@ -471,6 +519,12 @@ reentry:
                         setobj2s(L, ra, gval(n));
                         VM_NEXT();
                     }
+                    // fast-path: table has a shape and value is in expected field
+                    else if (isshaped(h) && gfieldkey(h, LUAU_INSN_C(insn)) == tsvalue(kv) && !ttisnil(gfield(h, LUAU_INSN_C(insn))))
+                    {
+                        setobj2s(L, ra, gfield(h, LUAU_INSN_C(insn)));
+                        VM_NEXT();
+                    }
                     else if (!h->metatable)
                     {
                         // fast-path: value is not in expected slot, but the table lookup doesn't involve metatable
@@ -589,6 +643,14 @@ reentry:
                         luaC_barriert(L, h, ra);
                         VM_NEXT();
                     }
+                    // fast-path: table has a shape and value is in expected field
+                    else if (isshaped(h) && gfieldkey(h, LUAU_INSN_C(insn)) == tsvalue(kv) && !ttisnil(gfield(h, LUAU_INSN_C(insn))) &&
+                             !h->readonly)
+                    {
+                        setobj2t(L, gfield(h, LUAU_INSN_C(insn)), ra);
+                        luaC_barriert(L, h, ra);
+                        VM_NEXT();
+                    }
                     else if (fastnotm(h->metatable, TM_NEWINDEX) && !h->readonly)
                     {
                         VM_PROTECT_PC(); // set may fail
@@ -662,6 +724,12 @@ reentry:
                         setobj2s(L, ra, &h->array[(unsigned)(index - 1)]);
                         VM_NEXT();
                     }
+                    // packed elements are never nil, so __index doesn't need to be checked
+                    else if (ispacked(h) && (unsigned)(index - 1) < (unsigned)(h->numbers->size) && (double)(index) == indexd)
+                    {
+                        setnvalue(ra, gpacked(h, (unsigned)(index - 1)));
+                        VM_NEXT();
+                    }
 
                     // fall through to slow path
                 }
@@ -693,6 +761,13 @@ reentry:
                         luaC_barriert(L, h, ra);
                         VM_NEXT();
                     }
+                    // packed elements are never nil, so __newindex doesn't need to be checked; other values are stored by the slow path
+                    else if (ispacked(h) && ttisnumber(ra) && (unsigned)(index - 1) < (unsigned)(h->numbers->size) && !h->readonly &&
+                             (double)(index) == indexd)
+                    {
+                        gpacked(h, (unsigned)(index - 1)) = nvalue(ra);
+                        VM_NEXT();
+                    }
 
                     // fall through to slow path
                 }
@@ -719,6 +794,12 @@ reentry:
                         setobj2s(L, ra, &h->array[c]);
                         VM_NEXT();
                     }
+                    // packed elements are never nil, so __index doesn't need to be checked
+                    else if (ispacked(h) && (unsigned)(c) < (unsigned)(h->numbers->size))
+                    {
+                        setnvalue(ra, gpacked(h, c));
+                        VM_NEXT();
+                    }
 
                     // fall through to slow path
                 }
@@ -748,6 +829,12 @@ reentry:
                         luaC_barriert(L, h, ra);
                         VM_NEXT();
                     }
+                    // packed elements are never nil, so __newindex doesn't need to be checked; other values are stored by the slow path
+                    else if (ispacked(h) && ttisnumber(ra) && (unsigned)(c) < (unsigned)(h->numbers->size) && !h->readonly)
+                    {
+                        gpacked(h, c) = nvalue(ra);
+                        VM_NEXT();
+                    }
 
                     // fall through to slow path
                 }
@@ -818,8 +905,7 @@ reentry:
                     // for predictive lookups
                     LuaNode* n = &h->node[tsvalue(kv)->hash & (sizenode(h) - 1)];
 
-                    const TValue* mt = 0;
-                    const LuaNode* mtn = 0;
+                    const TValue* method = 0;
 
                     // fast-path: key is in the table in expected slot
                     if (ttisstring(gkey(n)) && tsvalue(gkey(n)) == tsvalue(kv) && !ttisnil(gval(n)))
@@ -828,33 +914,32 @@ reentry:
                         setobj2s(L, ra + 1, rb);
                         setobj2s(L, ra, gval(n));
                     }
-                    // fast-path: key is absent from the base, table has an __index table, and it has the result in the expected slot
-                    else if (gnext(n) == 0 && (mt = fasttm(L, hvalue(rb)->metatable, TM_INDEX)) && ttistable(mt) &&
-                             (mtn = &hvalue(mt)->node[LUAU_INSN_C(insn) & hvalue(mt)->nodemask8]) && ttisstring(gkey(mtn)) &&
-                             tsvalue(gkey(mtn)) == tsvalue(kv) && !ttisnil(gval(mtn)))
+                    // fast-path: key is absent from the base, and the cache of this instruction has the method for the metatable
+                    // note: tables with a shape have no hash part, so their fields need a lookup, as do keys that collide with other keys
+                    else if (((!isshaped(h) && gnext(n) == 0) || ttisnil(luaH_getstr(h, tsvalue(kv)))) &&
+                             (method = luaV_namecallcached(L->global, cl->l.p, LUAU_INSN_C(insn), h->metatable)))
                     {
                         // note: order of copies allows rb to alias ra+1 or ra
                         setobj2s(L, ra + 1, rb);
-                        setobj2s(L, ra, gval(mtn));
+                        setobj2s(L, ra, method);
                     }
                     else
                     {
                         // slow-path: handles full table lookup
                         setobj2s(L, ra + 1, rb);
-                        L->cachedslot = LUAU_INSN_C(insn);
                         VM_PROTECT(luaV_gettable(L, rb, kv, ra));
-                        // save cachedslot to accelerate future lookups; patches currently executing instruction since pc-2 rolls back two pc++
-                        VM_PATCH_C(pc - 2, L->cachedslot);
                         // recompute ra since stack might have been reallocated
                         ra = VM_REG(LUAU_INSN_A(insn));
                         if (ttisnil(ra))
                             luaG_methoderror(L, ra + 1, tsvalue(kv));
+                        // record the __index chain in the cache of this instruction to accelerate future lookups
+                        VM_PROTECT(luaV_cachenamecall(L, cl->l.p, LUAU_INSN_C(insn), ra + 1, tsvalue(kv)));
                     }
                 }
                 else
                 {
                     Table* mt = ttisuserdata(rb) ? uvalue(rb)->metatable : L->global->mt[ttype(rb)];
-                    const TValue* tmi = 0;
+                    const TValue* method = 0;
 
                     // fast-path: metatable with __namecall
                     const TValue* fn;
@@ -866,42 +951,24 @@ reentry:
 
                         L->namecall = tsvalue(kv);
                     }
-                    else if ((tmi = fasttm(L, mt, TM_INDEX)) && ttistable(tmi))
+                    // fast-path: the cache of this instruction has the method for the metatable
+                    else if ((method = luaV_namecallcached(L->global, cl->l.p, LUAU_INSN_C(insn), mt)))
                     {
-                        Table* h = hvalue(tmi);
-                        int slot = LUAU_INSN_C(insn) & h->nodemask8;
-                        LuaNode* n = &h->node[slot];
-
-                        // fast-path: metatable with __index that has method in expected slot
-                        if (LUAU_LIKELY(ttisstring(gkey(n)) && tsvalue(gkey(n)) == tsvalue(kv) && !ttisnil(gval(n))))
-                        {
-                            // note: order of copies allows rb to alias ra+1 or ra
-                            setobj2s(L, ra + 1, rb);
-                            setobj2s(L, ra, gval(n));
-                        }
-                        else
-                        {
-                            // slow-path: handles slot mismatch
-                            setobj2s(L, ra + 1, rb);
-                            L->cachedslot = slot;
-                            VM_PROTECT(luaV_gettable(L, rb, kv, ra));
-                            // save cachedslot to accelerate future lookups; patches currently executing instruction since pc-2 rolls back two pc++
-                            VM_PATCH_C(pc - 2, L->cachedslot);
-                            // recompute ra since stack might have been reallocated
-                            ra = VM_REG(LUAU_INSN_A(insn));
-                            if (ttisnil(ra))
-                                luaG_methoderror(L, ra + 1, tsvalue(kv));
-                        }
+                        // note: order of copies allows rb to alias ra+1 or ra
+                        setobj2s(L, ra + 1, rb);
+                        setobj2s(L, ra, method);
                     }
                     else
                     {
-                        // slow-path: handles non-table __index
+                        // slow-path: handles __index tables that aren't cached yet and non-table __index
                         setobj2s(L, ra + 1, rb);
                         VM_PROTECT(luaV_gettable(L, rb, kv, ra));
                         // recompute ra since stack might have been reallocated
                         ra = VM_REG(LUAU_INSN_A(insn));
                         if (ttisnil(ra))
                             luaG_methoderror(L, ra + 1, tsvalue(kv));
+                        // record the __index chain in the cache of this instruction to accelerate future lookups
+                        VM_PROTECT(luaV_cachenamecall(L, cl->l.p, LUAU_INSN_C(insn), ra + 1, tsvalue(kv)));
                     }
                 }
 
@@ -931,6 +998,10 @@ reentry:
                 Closure* ccl = clvalue(ra);
                 L->ci->savedpc = pc;
 
+                // functions loaded with luau_loadlazy are decoded on first call
+                if (!ccl->isC && LUAU_UNLIKELY(ccl->l.p->lazy & PROTO_LAZYCODE))
+                    luau_loadcode(L, ccl->l.p);
+
                 CallInfo* ci = incr_ci(L);
                 ci->func = ra;
                 ci->base = ra + 1;
@@ -2122,6 +2193,15 @@ reentry:
                     setobj2t(L, &array[index + i - 1], rb + i);
 
                 luaC_barrierfast(L, h);
+
+                // constructors that fill the entire array part with numbers produce packed tables
+                if (index == 1 && c > 0 && last == h->sizearray && ttisnumber(rb))
+                {
+                    VM_PROTECT_PC(); // luaH_pack may fail due to OOM
+
+                    luaH_pack(L, h);
+                }
+
                 VM_NEXT();
             }
 
@@ -2258,6 +2338,33 @@ reentry:
                         for (int i = 2; i < (int)(aux); ++i)
                             setnilvalue(ra + 3 + i);
 
+                    // packed array portion has no holes; the rest of the table is numbered after its capacity
+                    if (LUAU_UNLIKELY(ispacked(h)))
+                    {
+                        if ((unsigned)(index) < (unsigned)(h->numbers->size))
+                        {
+                            setpvalue(ra + 2, (void*)((uintptr_t)(index + 1)));
+                            setnvalue(ra + 3, (double)(index + 1));
+                            setnvalue(ra + 4, gpacked(h, index));
+
+                            pc += LUAU_INSN_D(insn);
+                            LUAU_ASSERT((unsigned)(pc - cl->l.p->code) < (unsigned)(cl->l.p->sizecode));
+                            VM_NEXT();
+                        }
+
+                        // ipairs-style traversal ends after the packed elements, since the hash portion can't have the next key
+                        if ((int)(aux) < 0)
+                        {
+                            pc++;
+                            VM_NEXT();
+                        }
+
+                        sizearray = h->numbers->capacity;
+
+                        if ((unsigned)(index) < (unsigned)(sizearray))
+                            index = sizearray;
+                    }
+
                     // terminate ipairs-style traversal early when encountering nil
                     if ((int)(aux) < 0 && ((unsigned)(index) >= (unsigned)(sizearray) || ttisnil(&h->array[index])))
                     {
@@ -2284,6 +2391,33 @@ reentry:
                         index++;
                     }
 
+                    // tables with a shape have fields instead of the hash portion
+                    if (isshaped(h))
+                    {
+                        TableShape* shape = gfields(h)->shape;
+
+                        while ((unsigned)(index - sizearray) < (unsigned)(shape->nfields))
+                        {
+                            TValue* e = gfield(h, index - sizearray);
+
+                            if (!ttisnil(e))
+                            {
+                                setpvalue(ra + 2, (void*)((uintptr_t)(index + 1)));
+                                setsvalue(L, ra + 3, gshapekey(shape, index - sizearray));
+                                setobj2s(L, ra + 4, e);
+
+                                pc += LUAU_INSN_D(insn);
+                                LUAU_ASSERT((unsigned)(pc - cl->l.p->code) < (unsigned)(cl->l.p->sizecode));
+                                VM_NEXT();
+                            }
+
+                            index++;
+                        }
+                    }
+
+                    // keys of tables with weak keys can only be observed after the collector removed the dead ones
+                    luaC_checkweak(L, h);
+
                     int sizenode = 1 << h->lsizenode;
 
                     // then we advance index through the hash portion
@@ -2845,6 +2979,66 @@ reentry:
                 VM_NEXT();
             }
 
+            VM_CASE(LOP_FUSED_MOVE_MOVE)
+            {
+                Instruction insn = *pc++;
+                StkId ra = VM_REG(LUAU_INSN_A(insn));
+                StkId rb = VM_REG(LUAU_INSN_B(insn));
+
+                setobj2s(L, ra, rb);
+
+                Instruction next = *pc++;
+                StkId na = VM_REG(LUAU_INSN_A(next));
+                StkId nb = VM_REG(LUAU_INSN_B(next));
+
+                setobj2s(L, na, nb);
+                VM_NEXT();
+            }
+
+            VM_CASE(LOP_FUSED_MOVE_GETTABLEKS)
+            {
+                Instruction insn = *pc++;
+                StkId ra = VM_REG(LUAU_INSN_A(insn));
+                StkId rb = VM_REG(LUAU_INSN_B(insn));
+
+                setobj2s(L, ra, rb);
+                VM_NEXT_FUSED(LOP_GETTABLEKS);
+            }
+
+            VM_CASE(LOP_FUSED_LOADK_ADD)
+            {
+                Instruction insn = *pc++;
+                StkId ra = VM_REG(LUAU_INSN_A(insn));
+                TValue* kv = VM_KV(LUAU_INSN_D(insn));
+
+                setobj2s(L, ra, kv);
+                VM_NEXT_FUSED(LOP_ADD);
+            }
+
+            VM_CASE(LOP_FUSED_GETTABLEKS_GETTABLEKS)
+            {
+                VM_FUSED_GETTABLEKS();
+                VM_NEXT_FUSED(LOP_GETTABLEKS);
+            }
+
+            VM_CASE(LOP_FUSED_GETTABLEKS_MOVE)
+            {
+                VM_FUSED_GETTABLEKS();
+                VM_NEXT_FUSED(LOP_MOVE);
+            }
+
+            VM_CASE(LOP_FUSED_GETTABLEKS_ADD)
+            {
+                VM_FUSED_GETTABLEKS();
+                VM_NEXT_FUSED(LOP_ADD);
+            }
+
+            VM_CASE(LOP_FUSED_GETTABLEKS_CALL)
+            {
+                VM_FUSED_GETTABLEKS();
+                VM_NEXT_FUSED(LOP_CALL);
+            }
+
 #if !VM_USE_CGOTO
         default:
             LUAU_ASSERT(!"Unknown opcode");
@@ -2866,6 +3060,9 @@ int luau_precall(lua_State* L, StkId func, int nresults)
 
     Closure* ccl = clvalue(func);
 
+    if (!ccl->isC && LUAU_UNLIKELY(ccl->l.p->lazy & PROTO_LAZYCODE))
+        luau_loadcode(L, ccl->l.p);
+
     CallInfo* ci = incr_ci(L);
     ci->func = func;
     ci->base = func + 1;
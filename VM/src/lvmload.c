@@ -13,6 +13,10 @@
 
 #include <string.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #ifdef __clang__
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wsign-conversion"
@@ -103,11 +107,99 @@ static unsigned int readVarInt(const char* data, size_t size, size_t* offset)
     return result;
 }
 
-static TString* readString(TString** strings, const char* data, size_t size, size_t* offset)
+/*
+ * Programs (luau_newprogram) decode the bytecode once into an image that isn't tied to any state: the code, line info and function
+ * hierarchy of every function. The image is immutable and reference counted, and any number of states can load it concurrently
+ * (luau_loadprogram). Loading a program into a state creates the functions with code and line info that point into the image and
+ * a LazyChunk that refers to the program's copy of the bytecode; constants, imports and debug info are decoded lazily per state,
+ * same as with luau_loadlazy. Since the code is borrowed, the chunk holds a reference to the program until all functions are freed.
+ */
+typedef struct ProgramProto
+{
+    uint8_t maxstacksize;
+    uint8_t numparams;
+    uint8_t nups;
+    uint8_t is_vararg;
+    uint8_t coverage; // code has COVERAGE instructions, which count hits in place, so every state needs a private copy
+
+    int sizecode;
+    int sizep;
+    int linedefined;
+    int linegaplog2;
+    int sizelineinfo;
+    int sizenamecache;
+
+    Instruction* code;
+    uint32_t* p; // ids of child functions
+    uint8_t* lineinfo;
+    int* abslineinfo; // allocated after lineinfo
+
+    unsigned int debugname; // string id
+    uint32_t constants;     // offset of constants in data
+    uint32_t debuginfo;     // offset of local and upvalue names in data; 0 if the function doesn't have any
+} ProgramProto;
+
+struct lua_Program
+{
+    lua_Alloc frealloc;
+    void* ud;
+
+    long refs; // updated atomically
+
+    char* chunkname;
+    size_t chunknamesize;
+    char* data;
+    size_t size;
+
+    uint32_t* strings; // offset of each entry in the string table
+    unsigned int stringCount;
+
+    ProgramProto* protos; // NULL if the bytecode is invalid; the error is reported by luau_loadprogram
+    unsigned int protoCount;
+    unsigned int mainid;
+};
+
+#ifdef _MSC_VER
+#define programincref(P) _InterlockedIncrement(&(P)->refs)
+#define programdecref(P) _InterlockedDecrement(&(P)->refs)
+#else
+#define programincref(P) __atomic_add_fetch(&(P)->refs, 1, __ATOMIC_RELAXED)
+#define programdecref(P) __atomic_sub_fetch(&(P)->refs, 1, __ATOMIC_ACQ_REL)
+#endif
+
+typedef struct LoadState
+{
+    lua_State* L;
+    const char* data;
+    size_t size;
+
+    TString** strings; // interned string table; NULL in lazy mode where strings are interned on demand
+    Proto** protos;    // all functions by id
+    LazyChunk* chunk;
+
+    Table* env;
+} LoadState;
+
+static TString* getString(LoadState* S, unsigned int id)
+{
+    if (id == 0)
+        return NULL;
+
+    if (S->strings)
+        return S->strings[id - 1];
+
+    LUAU_ASSERT(id <= S->chunk->stringCount);
+    size_t soffset = S->chunk->strings[id - 1];
+    unsigned int length = readVarInt(S->data, S->size, &soffset);
+
+    return luaS_newlstr(S->L, S->data + soffset, length);
+}
+
+static TString* readString(LoadState* S, size_t* offset)
 {
-    unsigned int id = readVarInt(data, size, offset);
+    unsigned int id = readVarInt(S->data, S->size, offset);
 
-    return id == 0 ? 0 : strings[id - 1];
+    return getString(S, id);
 }
 
 typedef struct ResolveImport
@@ -150,18 +242,695 @@ static void resolveImportSafe(lua_State* L, Table* env, TValue* k, uint32_t id)
     }
 }
 
-int luau_load(lua_State* L, const char* chunkname, const char* data, size_t size, int env)
+static const TValue* getImportField(lua_State* L, Table* t, TString* key)
+{
+    for (int loop = 0; loop < MAXTAGLOOP; loop++)
+    {
+        const TValue* res = luaH_getstr(t, key);
+        if (!ttisnil(res))
+            return res;
+
+        const TValue* tm = fasttm(L, t->metatable, TM_INDEX);
+        if (tm == NULL || !ttistable(tm))
+            return res;
+
+        t = hvalue(tm);
+    }
+
+    return luaO_nilobject;
+}
+
+// lazy functions are decoded in the middle of execution, so unlike resolveImportSafe this can't run any Lua code; imports that need
+// metamethods other than __index tables are left as nil and are resolved by GETIMPORT at runtime
+static void resolveImportRaw(lua_State* L, Table* env, TValue* k, uint32_t id, TValue* res)
+{
+    int count = id >> 30;
+    int ids[3] = {(int)(id >> 20) & 1023, (int)(id >> 10) & 1023, (int)(id)&1023};
+
+    setnilvalue(res);
+
+    if (!env->safeenv)
+        return;
+
+    const TValue* value = NULL;
+    Table* t = env;
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (i > 0)
+        {
+            if (!ttistable(value))
+                return;
+
+            t = hvalue(value);
+        }
+
+        value = getImportField(L, t, tsvalue(&k[ids[i]]));
+
+        if (ttisnil(value))
+            return;
+    }
+
+    setobj(L, res, value);
+}
+
+static int getOpLength(uint8_t op)
+{
+    switch (op)
+    {
+    case LOP_GETGLOBAL:
+    case LOP_SETGLOBAL:
+    case LOP_GETIMPORT:
+    case LOP_GETTABLEKS:
+    case LOP_SETTABLEKS:
+    case LOP_NAMECALL:
+    case LOP_JUMPIFEQ:
+    case LOP_JUMPIFLE:
+    case LOP_JUMPIFLT:
+    case LOP_JUMPIFNOTEQ:
+    case LOP_JUMPIFNOTLE:
+    case LOP_JUMPIFNOTLT:
+    case LOP_NEWTABLE:
+    case LOP_SETLIST:
+    case LOP_FORGLOOP:
+    case LOP_LOADKX:
+    case LOP_FASTCALL2:
+    case LOP_FASTCALL2K:
+    case LOP_JUMPXEQKNIL:
+    case LOP_JUMPXEQKB:
+    case LOP_JUMPXEQKN:
+    case LOP_JUMPXEQKS:
+    case LOP_DEP_JUMPIFEQK:
+    case LOP_DEP_JUMPIFNOTEQK:
+        return 2;
+
+    default:
+        return 1;
+    }
+}
+
+static uint8_t getFusedOp(uint8_t op, uint8_t next)
+{
+    switch (op)
+    {
+    case LOP_MOVE:
+        switch (next)
+        {
+        case LOP_MOVE:
+            return LOP_FUSED_MOVE_MOVE;
+        case LOP_GETTABLEKS:
+            return LOP_FUSED_MOVE_GETTABLEKS;
+        default:
+            return op;
+        }
+
+    case LOP_LOADK:
+        switch (next)
+        {
+        case LOP_ADD:
+            return LOP_FUSED_LOADK_ADD;
+        default:
+            return op;
+        }
+
+    case LOP_GETTABLEKS:
+        switch (next)
+        {
+        case LOP_GETTABLEKS:
+            return LOP_FUSED_GETTABLEKS_GETTABLEKS;
+        case LOP_MOVE:
+            return LOP_FUSED_GETTABLEKS_MOVE;
+        case LOP_ADD:
+            return LOP_FUSED_GETTABLEKS_ADD;
+        case LOP_CALL:
+            return LOP_FUSED_GETTABLEKS_CALL;
+        default:
+            return op;
+        }
+
+    default:
+        return op;
+    }
+}
+
+uint8_t luau_unfuseop(uint8_t op)
+{
+    switch (op)
+    {
+    case LOP_FUSED_MOVE_MOVE:
+    case LOP_FUSED_MOVE_GETTABLEKS:
+        return LOP_MOVE;
+
+    case LOP_FUSED_LOADK_ADD:
+        return LOP_LOADK;
+
+    case LOP_FUSED_GETTABLEKS_GETTABLEKS:
+    case LOP_FUSED_GETTABLEKS_MOVE:
+    case LOP_FUSED_GETTABLEKS_ADD:
+    case LOP_FUSED_GETTABLEKS_CALL:
+        return LOP_GETTABLEKS;
+
+    default:
+        return op;
+    }
+}
+
+static int numberNamecalls(Instruction* code, int sizecode)
+{
+    // the compiler leaves a slot hint in the C operand of NAMECALL; the VM replaces it with the index of the cache site, and the
+    // instructions that don't fit into the operand get an index past the last site
+    int sites = 0;
+
+    for (int i = 0; i < sizecode;)
+    {
+        uint8_t op = LUAU_INSN_OP(code[i]);
+
+        // code with opcodes that this VM doesn't know will fail elsewhere; without instruction boundaries, no instruction gets a site
+        if (op >= LOP__COUNT)
+            return 0;
+
+        if (op == LOP_NAMECALL)
+        {
+            code[i] = (code[i] & 0x00ffffff) | ((uint32_t)sites << 24);
+
+            if (sites < 255)
+                sites++;
+        }
+
+        i += getOpLength(op);
+    }
+
+    return sites;
+}
+
+static int hasCoverage(const Instruction* code, int sizecode)
+{
+    for (int i = 0; i < sizecode;)
+    {
+        uint8_t op = LUAU_INSN_OP(code[i]);
+
+        if (op == LOP_COVERAGE)
+            return 1;
+
+        i += getOpLength(op);
+    }
+
+    return 0;
+}
+
+static void fuseCode(Instruction* code, int sizecode)
+{
+#if LUA_FUSED_OPCODES
+    // the second instruction keeps its opcode, so it can itself start another pair; it's only entered from the fused handler when the
+    // first instruction falls through to it, and every instruction that getFusedOp accepts as the first one does
+    for (int i = 0; i < sizecode;)
+    {
+        uint8_t op = LUAU_INSN_OP(code[i]);
+
+        // code with opcodes that this VM doesn't know will fail elsewhere; don't try to find instruction boundaries in it
+        if (op >= LOP__COUNT)
+            return;
+
+        int next = i + getOpLength(op);
+
+        if (next < sizecode)
+        {
+            uint8_t fused = getFusedOp(op, LUAU_INSN_OP(code[next]));
+
+            // patch just the opcode byte, leave arguments alone
+            code[i] = (code[i] & ~0xff) | fused;
+        }
+
+        i = next;
+    }
+#endif
+}
+
+void luau_unfusecode(lua_State* L, Proto* p)
+{
+    // AUX words could look like fused opcodes, so the code is walked by instruction
+    for (int i = 0; i < p->sizecode;)
+    {
+        uint8_t op = LUAU_INSN_OP(p->code[i]);
+        uint8_t base = luau_unfuseop(op);
+
+        if (op != base)
+        {
+            // code of functions loaded from a lua_Program is shared with other states
+            if (p->shared)
+                luaF_unshareproto(L, p);
+
+            p->code[i] = (p->code[i] & ~0xff) | base;
+        }
+
+        i += getOpLength(base);
+    }
+}
+
+static void loadCode(LoadState* S, Proto* p, size_t* offset)
+{
+    lua_State* L = S->L;
+
+    int sizecode = readVarInt(S->data, S->size, offset);
+    Instruction* code = luaM_newarray(L, sizecode, Instruction, p->memcat);
+    for (int j = 0; j < sizecode; ++j)
+        code[j] = read_uint32_t(S->data, S->size, offset);
+
+    p->sizenamecache = numberNamecalls(code, sizecode);
+    fuseCode(code, sizecode);
+
+    p->code = code;
+    p->sizecode = sizecode;
+}
+
+static void loadConstants(LoadState* S, Proto* p, size_t* offset)
+{
+    lua_State* L = S->L;
+    const char* data = S->data;
+    size_t size = S->size;
+
+    int sizek = readVarInt(data, size, offset);
+    TValue* k = luaM_newarray(L, sizek, TValue, p->memcat);
+
+    // k is pre-filled with nil so that the function can be traversed by GC if decoding fails midway; additionally, resolveImportSafe
+    // can trigger GC checks under HARDMEMTESTS
+    for (int j = 0; j < sizek; ++j)
+        setnilvalue(&k[j]);
+
+    p->k = k;
+    p->sizek = sizek;
+
+    for (int j = 0; j < p->sizek; ++j)
+    {
+        switch (read_uint8_t(data, size, offset))
+        {
+        case LBC_CONSTANT_NIL:
+            setnilvalue(&p->k[j]);
+            break;
+
+        case LBC_CONSTANT_BOOLEAN:
+        {
+            uint8_t v = read_uint8_t(data, size, offset);
+            setbvalue(&p->k[j], v);
+            break;
+        }
+
+        case LBC_CONSTANT_NUMBER:
+        {
+            double v = read_double(data, size, offset);
+            setnvalue(&p->k[j], v);
+            break;
+        }
+
+        case LBC_CONSTANT_STRING:
+        {
+            TString* v = readString(S, offset);
+            setsvalue(L, &p->k[j], v);
+            break;
+        }
+
+        case LBC_CONSTANT_IMPORT:
+        {
+            uint32_t iid = read_uint32_t(data, size, offset);
+            if (S->chunk)
+            {
+                resolveImportRaw(L, S->chunk->gt, p->k, iid, &p->k[j]);
+            }
+            else
+            {
+                resolveImportSafe(L, S->env, p->k, iid);
+                setobj(L, &p->k[j], L->top - 1);
+                L->top--;
+            }
+            break;
+        }
+
+        case LBC_CONSTANT_TABLE:
+        {
+            int keys = readVarInt(data, size, offset);
+#if LUA_TABLE_SHAPEFIELDS
+            // templates only have string keys; tables cloned from templates with the same keys share the shape
+            Table* h = luaH_newshaped(L, keys);
+#else
+            Table* h = luaH_new(L, 0, keys);
+#endif
+            for (int ikey = 0; ikey < keys; ++ikey)
+            {
+                int key = readVarInt(data, size, offset);
+                TValue* val = luaH_set(L, h, &p->k[key]);
+                setnvalue(val, 0.0);
+            }
+            sethvalue(L, &p->k[j], h);
+            break;
+        }
+
+        case LBC_CONSTANT_CLOSURE:
+        {
+            uint32_t fid = readVarInt(data, size, offset);
+            Proto* pv = S->protos[fid];
+            Closure* cl = luaF_newLclosure(L, pv->nups, S->env, pv);
+            cl->preload = (cl->nupvalues > 0);
+            setclvalue(L, &p->k[j], cl);
+            break;
+        }
+
+        default:
+            LUAU_ASSERT(0 && "Unexpected constant kind");
+        }
+
+        // lazily decoded functions may already be marked; each constant is barriered as it's stored so that the array never holds
+        // unmarked objects, even if decoding fails midway due to an allocation error
+        luaC_barrier(L, p, &p->k[j]);
+    }
+}
+
+static void skipConstants(const char* data, size_t size, size_t* offset)
+{
+    int sizek = readVarInt(data, size, offset);
+
+    for (int j = 0; j < sizek; ++j)
+    {
+        switch (read_uint8_t(data, size, offset))
+        {
+        case LBC_CONSTANT_NIL:
+            break;
+
+        case LBC_CONSTANT_BOOLEAN:
+            *offset += sizeof(uint8_t);
+            break;
+
+        case LBC_CONSTANT_NUMBER:
+            *offset += sizeof(double);
+            break;
+
+        case LBC_CONSTANT_STRING:
+        case LBC_CONSTANT_CLOSURE:
+            readVarInt(data, size, offset);
+            break;
+
+        case LBC_CONSTANT_IMPORT:
+            *offset += sizeof(uint32_t);
+            break;
+
+        case LBC_CONSTANT_TABLE:
+        {
+            int keys = readVarInt(data, size, offset);
+            for (int ikey = 0; ikey < keys; ++ikey)
+                readVarInt(data, size, offset);
+            break;
+        }
+
+        default:
+            LUAU_ASSERT(0 && "Unexpected constant kind");
+        }
+    }
+}
+
+// line info is a single block with per-instruction offsets followed by absolute line numbers; returns the size of the block
+static int getLineInfoSize(int sizecode, int linegaplog2, int* absoffset)
+{
+    int intervals = ((sizecode - 1) >> linegaplog2) + 1;
+    *absoffset = (sizecode + 3) & ~3;
+
+    return *absoffset + intervals * sizeof(int);
+}
+
+static void readLineInfo(const char* data, size_t size, int sizecode, int linegaplog2, uint8_t* info, int* absinfo, size_t* offset)
+{
+    int intervals = ((sizecode - 1) >> linegaplog2) + 1;
+
+    uint8_t lastoffset = 0;
+    for (int j = 0; j < sizecode; ++j)
+    {
+        lastoffset += read_uint8_t(data, size, offset);
+        info[j] = lastoffset;
+    }
+
+    int lastline = 0;
+    for (int j = 0; j < intervals; ++j)
+    {
+        lastline += read_int32_t(data, size, offset);
+        absinfo[j] = lastline;
+    }
+}
+
+static void loadLineInfo(LoadState* S, Proto* p, int sizecode, size_t* offset)
 {
+    lua_State* L = S->L;
+    const char* data = S->data;
+    size_t size = S->size;
+
+    uint8_t lineinfo = read_uint8_t(data, size, offset);
+
+    if (lineinfo)
+    {
+        int linegaplog2 = read_uint8_t(data, size, offset);
+
+        int absoffset = 0;
+        int sizelineinfo = getLineInfoSize(sizecode, linegaplog2, &absoffset);
+        uint8_t* info = luaM_newarray(L, sizelineinfo, uint8_t, p->memcat);
+        int* absinfo = (int*)(info + absoffset);
+
+        readLineInfo(data, size, sizecode, linegaplog2, info, absinfo, offset);
+
+        p->linegaplog2 = linegaplog2;
+        p->lineinfo = info;
+        p->abslineinfo = absinfo;
+        p->sizelineinfo = sizelineinfo;
+    }
+}
+
+static void loadDebugInfo(LoadState* S, Proto* p, size_t* offset)
+{
+    lua_State* L = S->L;
+    const char* data = S->data;
+    size_t size = S->size;
+
+    uint8_t debuginfo = read_uint8_t(data, size, offset);
+
+    if (debuginfo)
+    {
+        int sizelocvars = readVarInt(data, size, offset);
+        LocVar* locvars = luaM_newarray(L, sizelocvars, LocVar, p->memcat);
+
+        for (int j = 0; j < sizelocvars; ++j)
+        {
+            locvars[j].varname = readString(S, offset);
+            locvars[j].startpc = readVarInt(data, size, offset);
+            locvars[j].endpc = readVarInt(data, size, offset);
+            locvars[j].reg = read_uint8_t(data, size, offset);
+        }
+
+        p->locvars = locvars;
+        p->sizelocvars = sizelocvars;
+
+        int sizeupvalues = readVarInt(data, size, offset);
+        TString** upvalues = luaM_newarray(L, sizeupvalues, TString*, p->memcat);
+
+        for (int j = 0; j < sizeupvalues; ++j)
+        {
+            upvalues[j] = readString(S, offset);
+        }
+
+        p->upvalues = upvalues;
+        p->sizeupvalues = sizeupvalues;
+    }
+}
+
+static void loadDebug(LoadState* S, Proto* p, int sizecode, size_t* offset)
+{
+    loadLineInfo(S, p, sizecode, offset);
+    loadDebugInfo(S, p, offset);
+}
+
+// returns 1 if the function has local or upvalue names
+static int skipDebugInfo(const char* data, size_t size, size_t* offset)
+{
+    uint8_t debuginfo = read_uint8_t(data, size, offset);
+
+    if (debuginfo)
+    {
+        int sizelocvars = readVarInt(data, size, offset);
+
+        for (int j = 0; j < sizelocvars; ++j)
+        {
+            readVarInt(data, size, offset);
+            readVarInt(data, size, offset);
+            readVarInt(data, size, offset);
+            *offset += sizeof(uint8_t);
+        }
+
+        int sizeupvalues = readVarInt(data, size, offset);
+
+        for (int j = 0; j < sizeupvalues; ++j)
+            readVarInt(data, size, offset);
+    }
+
+    return debuginfo;
+}
+
+// returns 1 if the function has any line or debug info
+static int skipDebug(const char* data, size_t size, int sizecode, size_t* offset)
+{
+    uint8_t lineinfo = read_uint8_t(data, size, offset);
+
+    if (lineinfo)
+    {
+        int linegaplog2 = read_uint8_t(data, size, offset);
+        int intervals = ((sizecode - 1) >> linegaplog2) + 1;
+
+        *offset += sizecode + intervals * sizeof(int32_t);
+    }
+
+    int debuginfo = skipDebugInfo(data, size, offset);
+
+    return lineinfo || debuginfo;
+}
+
+static void initLazyState(LoadState* S, lua_State* L, Proto* p)
+{
+    LazyChunk* chunk = p->chunk;
+
+    S->L = L;
+    S->data = chunk->data;
+    S->size = chunk->size;
+    S->strings = NULL;
+    S->protos = chunk->protos;
+    S->chunk = chunk;
+    S->env = chunk->env;
+}
+
+void luau_releasechunk(lua_State* L, Proto* p)
+{
+    LazyChunk* chunk = p->chunk;
+    LUAU_ASSERT(chunk && chunk->refs > 0);
+
+    p->chunk = NULL;
+
+    if (--chunk->refs == 0)
+    {
+        lua_Program* program = chunk->program;
+
+        luaM_free_(L, chunk, chunk->memsize, chunk->memcat);
+
+        if (program)
+            luau_releaseprogram(program);
+    }
+}
+
+void luau_loadcode(lua_State* L, Proto* p)
+{
+    LUAU_ASSERT(p->lazy & PROTO_LAZYCODE);
+
+    LoadState S;
+    initLazyState(&S, L, p);
+
+    // a previous attempt could have failed midway due to an allocation error
+    luaM_freearray(L, p->k, p->sizek, TValue, p->memcat);
+    p->k = NULL;
+    p->sizek = 0;
+
+    lua_Program* program = S.chunk->program;
     size_t offset = 0;
 
-    uint8_t version = read_uint8_t(data, size, &offset);
+    if (program)
+    {
+        // code is borrowed from the program, unless the function already has a private copy of it (see luaF_unshareproto)
+        offset = program->protos[p->bytecodeid].constants;
+    }
+    else
+    {
+        luaM_freearray(L, p->code, p->sizecode, Instruction, p->memcat);
+        p->code = NULL;
+        p->sizecode = 0;
+
+        offset = p->lazycode;
+        loadCode(&S, p, &offset);
+    }
+
+    loadConstants(&S, p, &offset);
+
+    p->lazy &= ~PROTO_LAZYCODE;
+
+    if (p->lazy == 0 && !program)
+        luau_releasechunk(L, p);
+}
+
+void luau_loaddebug(lua_State* L, Proto* p)
+{
+    LUAU_ASSERT(p->lazy & PROTO_LAZYDEBUG);
+
+    LoadState S;
+    initLazyState(&S, L, p);
+
+    luaM_freearray(L, p->locvars, p->sizelocvars, LocVar, p->memcat);
+    p->locvars = NULL;
+    p->sizelocvars = 0;
+    luaM_freearray(L, p->upvalues, p->sizeupvalues, TString*, p->memcat);
+    p->upvalues = NULL;
+    p->sizeupvalues = 0;
+
+    lua_Program* program = S.chunk->program;
+
+    if (program)
+    {
+        // line info is borrowed from the program
+        size_t offset = program->protos[p->bytecodeid].debuginfo;
+        loadDebugInfo(&S, p, &offset);
+    }
+    else
+    {
+        if (p->lineinfo)
+            luaM_freearray(L, p->lineinfo, p->sizelineinfo, uint8_t, p->memcat);
+        p->lineinfo = NULL;
+        p->abslineinfo = NULL;
+        p->sizelineinfo = 0;
+
+        // line info layout depends on the code size, which is known even if the code is still lazy
+        size_t codeoffset = p->lazycode;
+        int sizecode = readVarInt(S.data, S.size, &codeoffset);
+
+        size_t offset = p->lazydebug;
+        loadDebug(&S, p, sizecode, &offset);
+    }
+
+    for (int j = 0; j < p->sizelocvars; ++j)
+        if (p->locvars[j].varname)
+            luaC_objbarrier(L, p, p->locvars[j].varname);
+
+    for (int j = 0; j < p->sizeupvalues; ++j)
+        if (p->upvalues[j])
+            luaC_objbarrier(L, p, p->upvalues[j]);
+
+    p->lazy &= ~PROTO_LAZYDEBUG;
+
+    if (p->lazy == 0 && !program)
+        luau_releasechunk(L, p);
+}
+
+void luau_loadall(lua_State* L, Proto* p)
+{
+    if (p->lazy & PROTO_LAZYCODE)
+        luau_loadcode(L, p);
+
+    if (p->lazy & PROTO_LAZYDEBUG)
+        luau_loaddebug(L, p);
+
+    for (int i = 0; i < p->sizep; ++i)
+        luau_loadall(L, p->p[i]);
+}
+
+// returns 1 and pushes the error message if the bytecode can't be loaded
+static int loadVersion(lua_State* L, const char* chunkname, const char* data, size_t size, size_t* offset)
+{
+    uint8_t version = read_uint8_t(data, size, offset);
 
     // 0 means the rest of the bytecode is the error message
     if (version == 0)
     {
         char chunkbuf[LUA_IDSIZE];
         const char* chunkid = luaO_chunkid(chunkbuf, sizeof(chunkbuf), chunkname, strlen(chunkname));
-        lua_pushfstring(L, "%s%.*s", chunkid, (int)(size - offset), data + offset);
+        lua_pushfstring(L, "%s%.*s", chunkid, (int)(size - *offset), data + *offset);
         return 1;
     }
 
@@ -173,6 +942,16 @@ int luau_load(lua_State* L, const char* chunkname, const char* data, size_t size
         return 1;
     }
 
+    return 0;
+}
+
+static int load(lua_State* L, const char* chunkname, const char* data, size_t size, int env, int lazy, int copy)
+{
+    size_t offset = 0;
+
+    if (loadVersion(L, chunkname, data, size, &offset))
+        return 1;
+
     // pause GC for the duration of deserialization - some objects we're creating aren't rooted
     // TODO: if an allocation error happens mid-load, we do not unpause GC!
     size_t GCthreshold = L->global->GCthreshold;
@@ -183,21 +962,73 @@ int luau_load(lua_State* L, const char* chunkname, const char* data, size_t size
 
     TString* source = luaS_new(L, chunkname);
 
+    LoadState S = {L, data, size, NULL, NULL, NULL, envt};
+
     // string table
     unsigned int stringCount = readVarInt(data, size, &offset);
-    TString** strings = luaM_newarray(L, stringCount, TString*, 0);
+    Proto** protos = NULL;
 
-    for (unsigned int i = 0; i < stringCount; ++i)
+    if (lazy)
     {
-        unsigned int length = readVarInt(data, size, &offset);
+        size_t stringOffset = offset;
 
-        strings[i] = luaS_newlstr(L, data + offset, length);
-        offset += length;
+        for (unsigned int i = 0; i < stringCount; ++i)
+        {
+            unsigned int length = readVarInt(data, size, &offset);
+            offset += length;
+        }
+
+        unsigned int protoCount = readVarInt(data, size, &offset);
+
+        // lazy functions only keep offsets into the chunk, so the bytecode is copied unless the caller keeps it alive
+        size_t memsize = sizeof(LazyChunk) + protoCount * sizeof(Proto*) + stringCount * sizeof(uint32_t) + (copy ? size : 0);
+        LazyChunk* chunk = (LazyChunk*)luaM_new_(L, memsize, L->activememcat);
+
+        chunk->protos = (Proto**)(chunk + 1);
+        chunk->strings = (uint32_t*)(chunk->protos + protoCount);
+        chunk->data = copy ? (const char*)memcpy(chunk->strings + stringCount, data, size) : data;
+        chunk->size = size;
+        chunk->memsize = memsize;
+        chunk->memcat = L->activememcat;
+        chunk->refs = 0;
+        chunk->program = NULL;
+        chunk->env = envt;
+        chunk->gt = L->gt;
+        chunk->protoCount = protoCount;
+        chunk->stringCount = stringCount;
+
+        offset = stringOffset;
+
+        for (unsigned int i = 0; i < stringCount; ++i)
+        {
+            chunk->strings[i] = (uint32_t)offset;
+
+            unsigned int length = readVarInt(data, size, &offset);
+            offset += length;
+        }
+
+        S.data = chunk->data;
+        S.chunk = chunk;
+        S.protos = protos = chunk->protos;
+    }
+    else
+    {
+        S.strings = luaM_newarray(L, stringCount, TString*, 0);
+
+        for (unsigned int i = 0; i < stringCount; ++i)
+        {
+            unsigned int length = readVarInt(data, size, &offset);
+
+            S.strings[i] = luaS_newlstr(L, data + offset, length);
+            offset += length;
+        }
     }
 
     // proto table
     unsigned int protoCount = readVarInt(data, size, &offset);
-    Proto** protos = luaM_newarray(L, protoCount, Proto*, 0);
+
+    if (!lazy)
+        S.protos = protos = luaM_newarray(L, protoCount, Proto*, 0);
 
     for (unsigned int i = 0; i < protoCount; ++i)
     {
@@ -210,158 +1041,366 @@ int luau_load(lua_State* L, const char* chunkname, const char* data, size_t size
         p->nups = read_uint8_t(data, size, &offset);
         p->is_vararg = read_uint8_t(data, size, &offset);
 
-        p->sizecode = readVarInt(data, size, &offset);
-        p->code = luaM_newarray(L, p->sizecode, Instruction, p->memcat);
-        for (int j = 0; j < p->sizecode; ++j)
-            p->code[j] = read_uint32_t(data, size, &offset);
+        int sizecode = 0;
+
+        if (lazy)
+        {
+            p->lazycode = (uint32_t)offset;
 
-        p->sizek = readVarInt(data, size, &offset);
-        p->k = luaM_newarray(L, p->sizek, TValue, p->memcat);
+            sizecode = readVarInt(data, size, &offset);
+            offset += sizecode * sizeof(Instruction);
 
-#ifdef HARDMEMTESTS
-        // this is redundant during normal runs, but resolveImportSafe can trigger GC checks under HARDMEMTESTS
-        // because p->k isn't fully formed at this point, we pre-fill it with nil to make subsequent setup safe
-        for (int j = 0; j < p->sizek; ++j)
+            skipConstants(data, size, &offset);
+        }
+        else
         {
-            setnilvalue(&p->k[j]);
+            loadCode(&S, p, &offset);
+            loadConstants(&S, p, &offset);
+
+            sizecode = p->sizecode;
         }
-#endif
 
-        for (int j = 0; j < p->sizek; ++j)
+        p->sizep = readVarInt(data, size, &offset);
+        p->p = luaM_newarray(L, p->sizep, Proto*, p->memcat);
+        for (int j = 0; j < p->sizep; ++j)
         {
-            switch (read_uint8_t(data, size, &offset))
-            {
-            case LBC_CONSTANT_NIL:
-                setnilvalue(&p->k[j]);
-                break;
+            uint32_t fid = readVarInt(data, size, &offset);
+            p->p[j] = protos[fid];
+        }
 
-            case LBC_CONSTANT_BOOLEAN:
-            {
-                uint8_t v = read_uint8_t(data, size, &offset);
-                setbvalue(&p->k[j], v);
-                break;
-            }
+        p->linedefined = readVarInt(data, size, &offset);
+        p->debugname = readString(&S, &offset);
 
-            case LBC_CONSTANT_NUMBER:
-            {
-                double v = read_double(data, size, &offset);
-                setnvalue(&p->k[j], v);
-                break;
-            }
+        if (lazy)
+        {
+            p->lazydebug = (uint32_t)offset;
 
-            case LBC_CONSTANT_STRING:
-            {
-                TString* v = readString(strings, data, size, &offset);
-                setsvalue(L, &p->k[j], v);
-                break;
-            }
+            p->lazy = PROTO_LAZYCODE;
+            if (skipDebug(data, size, sizecode, &offset))
+                p->lazy |= PROTO_LAZYDEBUG;
 
-            case LBC_CONSTANT_IMPORT:
-            {
-                uint32_t iid = read_uint32_t(data, size, &offset);
-                resolveImportSafe(L, envt, p->k, iid);
-                setobj(L, &p->k[j], L->top - 1);
-                L->top--;
-                break;
-            }
+            p->chunk = S.chunk;
+            S.chunk->refs++;
+        }
+        else
+        {
+            loadDebug(&S, p, sizecode, &offset);
+        }
 
-            case LBC_CONSTANT_TABLE:
-            {
-                int keys = readVarInt(data, size, &offset);
-                Table* h = luaH_new(L, 0, keys);
-                for (int ikey = 0; ikey < keys; ++ikey)
-                {
-                    int key = readVarInt(data, size, &offset);
-                    TValue* val = luaH_set(L, h, &p->k[key]);
-                    setnvalue(val, 0.0);
-                }
-                sethvalue(L, &p->k[j], h);
-                break;
-            }
+        protos[i] = p;
+    }
 
-            case LBC_CONSTANT_CLOSURE:
-            {
-                uint32_t fid = readVarInt(data, size, &offset);
-                Closure* cl = luaF_newLclosure(L, protos[fid]->nups, envt, protos[fid]);
-                cl->preload = (cl->nupvalues > 0);
-                setclvalue(L, &p->k[j], cl);
-                break;
-            }
+    // "main" proto is pushed to Lua stack
+    uint32_t mainid = readVarInt(data, size, &offset);
+    Proto* main = protos[mainid];
 
-            default:
-                LUAU_ASSERT(0 && "Unexpected constant kind");
-            }
-        }
+    luaC_threadbarrier(L);
 
-        p->sizep = readVarInt(data, size, &offset);
-        p->p = luaM_newarray(L, p->sizep, Proto*, p->memcat);
-        for (int j = 0; j < p->sizep; ++j)
+    Closure* cl = luaF_newLclosure(L, 0, envt, main);
+    setclvalue(L, L->top, cl);
+    incr_top(L);
+
+    if (!lazy)
+    {
+        luaM_freearray(L, S.strings, stringCount, TString*, 0);
+        luaM_freearray(L, protos, protoCount, Proto*, 0);
+    }
+
+    L->global->GCthreshold = GCthreshold;
+
+    return 0;
+}
+
+int luau_load(lua_State* L, const char* chunkname, const char* data, size_t size, int env)
+{
+    return load(L, chunkname, data, size, env, /* lazy= */ 0, /* copy= */ 0);
+}
+
+int luau_loadlazy(lua_State* L, const char* chunkname, const char* data, size_t size, int env, int copy)
+{
+    // lazy functions refer to their bytecode with 32-bit offsets
+    int lazy = size <= UINT32_MAX;
+
+    return load(L, chunkname, data, size, env, lazy, copy);
+}
+
+static void* programalloc(lua_Program* P, size_t size)
+{
+    return P->frealloc(P->ud, NULL, 0, size);
+}
+
+static void programfree(lua_Program* P, void* ptr, size_t size)
+{
+    if (ptr)
+        P->frealloc(P->ud, ptr, size, 0);
+}
+
+static void freeProgram(lua_Program* P)
+{
+    if (P->protos)
+    {
+        for (unsigned int i = 0; i < P->protoCount; ++i)
         {
-            uint32_t fid = readVarInt(data, size, &offset);
-            p->p[j] = protos[fid];
+            ProgramProto* pp = &P->protos[i];
+
+            programfree(P, pp->code, pp->sizecode * sizeof(Instruction));
+            programfree(P, pp->p, pp->sizep * sizeof(uint32_t));
+            programfree(P, pp->lineinfo, pp->sizelineinfo);
         }
 
-        p->linedefined = readVarInt(data, size, &offset);
-        p->debugname = readString(strings, data, size, &offset);
+        programfree(P, P->protos, P->protoCount * sizeof(ProgramProto));
+    }
+
+    programfree(P, P->strings, P->stringCount * sizeof(uint32_t));
+    programfree(P, P->data, P->size);
+    programfree(P, P->chunkname, P->chunknamesize);
+    programfree(P, P, sizeof(lua_Program));
+}
+
+// returns 0 on allocation failure
+static int parseProgram(lua_Program* P)
+{
+    const char* data = P->data;
+    size_t size = P->size;
+    size_t offset = 0;
+
+    // invalid bytecode and compilation errors are reported when the program is loaded
+    uint8_t version = read_uint8_t(data, size, &offset);
+    if (version < LBC_VERSION_MIN || version > LBC_VERSION_MAX)
+        return 1;
+
+    unsigned int stringCount = readVarInt(data, size, &offset);
+
+    if (stringCount > 0 && !(P->strings = (uint32_t*)programalloc(P, stringCount * sizeof(uint32_t))))
+        return 0;
+
+    P->stringCount = stringCount;
+
+    for (unsigned int i = 0; i < stringCount; ++i)
+    {
+        P->strings[i] = (uint32_t)offset;
+
+        unsigned int length = readVarInt(data, size, &offset);
+        offset += length;
+    }
+
+    unsigned int protoCount = readVarInt(data, size, &offset);
+    ProgramProto* protos = (ProgramProto*)programalloc(P, protoCount * sizeof(ProgramProto));
+
+    if (!protos)
+        return 0;
+
+    memset(protos, 0, protoCount * sizeof(ProgramProto));
+    P->protos = protos;
+    P->protoCount = protoCount;
+
+    for (unsigned int i = 0; i < protoCount; ++i)
+    {
+        ProgramProto* pp = &protos[i];
+
+        pp->maxstacksize = read_uint8_t(data, size, &offset);
+        pp->numparams = read_uint8_t(data, size, &offset);
+        pp->nups = read_uint8_t(data, size, &offset);
+        pp->is_vararg = read_uint8_t(data, size, &offset);
+
+        int sizecode = readVarInt(data, size, &offset);
+
+        if (sizecode > 0 && !(pp->code = (Instruction*)programalloc(P, sizecode * sizeof(Instruction))))
+            return 0;
+
+        pp->sizecode = sizecode;
+
+        for (int j = 0; j < sizecode; ++j)
+            pp->code[j] = read_uint32_t(data, size, &offset);
+
+        pp->sizenamecache = numberNamecalls(pp->code, sizecode);
+        pp->coverage = (uint8_t)hasCoverage(pp->code, sizecode);
+        fuseCode(pp->code, sizecode);
+
+        pp->constants = (uint32_t)offset;
+        skipConstants(data, size, &offset);
+
+        int sizep = readVarInt(data, size, &offset);
+
+        if (sizep > 0 && !(pp->p = (uint32_t*)programalloc(P, sizep * sizeof(uint32_t))))
+            return 0;
+
+        pp->sizep = sizep;
+
+        for (int j = 0; j < sizep; ++j)
+            pp->p[j] = readVarInt(data, size, &offset);
+
+        pp->linedefined = readVarInt(data, size, &offset);
+        pp->debugname = readVarInt(data, size, &offset);
 
         uint8_t lineinfo = read_uint8_t(data, size, &offset);
 
         if (lineinfo)
         {
-            p->linegaplog2 = read_uint8_t(data, size, &offset);
+            int linegaplog2 = read_uint8_t(data, size, &offset);
 
-            int intervals = ((p->sizecode - 1) >> p->linegaplog2) + 1;
-            int absoffset = (p->sizecode + 3) & ~3;
+            int absoffset = 0;
+            int sizelineinfo = getLineInfoSize(sizecode, linegaplog2, &absoffset);
 
-            p->sizelineinfo = absoffset + intervals * sizeof(int);
-            p->lineinfo = luaM_newarray(L, p->sizelineinfo, uint8_t, p->memcat);
-            p->abslineinfo = (int*)(p->lineinfo + absoffset);
+            if (!(pp->lineinfo = (uint8_t*)programalloc(P, sizelineinfo)))
+                return 0;
 
-            uint8_t lastoffset = 0;
-            for (int j = 0; j < p->sizecode; ++j)
-            {
-                lastoffset += read_uint8_t(data, size, &offset);
-                p->lineinfo[j] = lastoffset;
-            }
+            pp->linegaplog2 = linegaplog2;
+            pp->sizelineinfo = sizelineinfo;
+            pp->abslineinfo = (int*)(pp->lineinfo + absoffset);
 
-            int lastline = 0;
-            for (int j = 0; j < intervals; ++j)
-            {
-                lastline += read_int32_t(data, size, &offset);
-                p->abslineinfo[j] = lastline;
-            }
+            readLineInfo(data, size, sizecode, linegaplog2, pp->lineinfo, pp->abslineinfo, &offset);
         }
 
-        uint8_t debuginfo = read_uint8_t(data, size, &offset);
+        size_t debuginfo = offset;
+        if (skipDebugInfo(data, size, &offset))
+            pp->debuginfo = (uint32_t)debuginfo;
+    }
 
-        if (debuginfo)
-        {
-            p->sizelocvars = readVarInt(data, size, &offset);
-            p->locvars = luaM_newarray(L, p->sizelocvars, LocVar, p->memcat);
+    P->mainid = readVarInt(data, size, &offset);
 
-            for (int j = 0; j < p->sizelocvars; ++j)
-            {
-                p->locvars[j].varname = readString(strings, data, size, &offset);
-                p->locvars[j].startpc = readVarInt(data, size, &offset);
-                p->locvars[j].endpc = readVarInt(data, size, &offset);
-                p->locvars[j].reg = read_uint8_t(data, size, &offset);
-            }
+    return 1;
+}
 
-            p->sizeupvalues = readVarInt(data, size, &offset);
-            p->upvalues = luaM_newarray(L, p->sizeupvalues, TString*, p->memcat);
+lua_Program* luau_newprogram(const char* chunkname, const char* data, size_t size, lua_Alloc f, void* ud)
+{
+    // programs refer to their bytecode with 32-bit offsets
+    if (size > UINT32_MAX)
+        return NULL;
 
-            for (int j = 0; j < p->sizeupvalues; ++j)
-            {
-                p->upvalues[j] = readString(strings, data, size, &offset);
-            }
+    lua_Program* P = (lua_Program*)f(ud, NULL, 0, sizeof(lua_Program));
+    if (!P)
+        return NULL;
+
+    memset(P, 0, sizeof(lua_Program));
+    P->frealloc = f;
+    P->ud = ud;
+    P->refs = 1;
+
+    size_t chunknamesize = strlen(chunkname) + 1;
+
+    if ((P->chunkname = (char*)programalloc(P, chunknamesize)))
+    {
+        memcpy(P->chunkname, chunkname, chunknamesize);
+        P->chunknamesize = chunknamesize;
+    }
+
+    if ((P->data = (char*)programalloc(P, size)))
+    {
+        memcpy(P->data, data, size);
+        P->size = size;
+    }
+
+    if (!P->chunkname || !P->data || !parseProgram(P))
+    {
+        freeProgram(P);
+        return NULL;
+    }
+
+    return P;
+}
+
+void luau_retainprogram(lua_Program* program)
+{
+    programincref(program);
+}
+
+void luau_releaseprogram(lua_Program* program)
+{
+    if (programdecref(program) == 0)
+        freeProgram(program);
+}
+
+int luau_loadprogram(lua_State* L, lua_Program* program, int env)
+{
+    size_t offset = 0;
+
+    if (loadVersion(L, program->chunkname, program->data, program->size, &offset))
+        return 1;
+
+    LUAU_ASSERT(program->protos);
+
+    // pause GC for the duration of deserialization - some objects we're creating aren't rooted
+    size_t GCthreshold = L->global->GCthreshold;
+    L->global->GCthreshold = SIZE_MAX;
+
+    // env is 0 for current environment and a stack index otherwise
+    Table* envt = (env == 0) ? L->gt : hvalue(luaA_toobject(L, env));
+
+    TString* source = luaS_new(L, program->chunkname);
+
+    unsigned int protoCount = program->protoCount;
+
+    size_t memsize = sizeof(LazyChunk) + protoCount * sizeof(Proto*);
+    LazyChunk* chunk = (LazyChunk*)luaM_new_(L, memsize, L->activememcat);
+
+    chunk->data = program->data;
+    chunk->size = program->size;
+    chunk->memsize = memsize;
+    chunk->memcat = L->activememcat;
+    chunk->refs = 0;
+    chunk->program = program;
+    chunk->env = envt;
+    chunk->gt = L->gt;
+    chunk->protos = (Proto**)(chunk + 1);
+    chunk->protoCount = protoCount;
+    chunk->strings = program->strings;
+    chunk->stringCount = program->stringCount;
+
+    luau_retainprogram(program);
+
+    LoadState S = {L, chunk->data, chunk->size, NULL, chunk->protos, chunk, envt};
+
+    for (unsigned int i = 0; i < protoCount; ++i)
+    {
+        const ProgramProto* pp = &program->protos[i];
+
+        Proto* p = luaF_newproto(L);
+        p->source = source;
+        p->bytecodeid = (int)(i);
+
+        p->maxstacksize = pp->maxstacksize;
+        p->numparams = pp->numparams;
+        p->nups = pp->nups;
+        p->is_vararg = pp->is_vararg;
+
+        p->code = pp->code;
+        p->sizecode = pp->sizecode;
+        p->sizenamecache = pp->sizenamecache;
+
+        p->sizep = pp->sizep;
+        p->p = luaM_newarray(L, p->sizep, Proto*, p->memcat);
+        for (int j = 0; j < p->sizep; ++j)
+            p->p[j] = chunk->protos[pp->p[j]];
+
+        p->linedefined = pp->linedefined;
+        p->debugname = getString(&S, pp->debugname);
+
+        if (pp->lineinfo)
+        {
+            p->linegaplog2 = pp->linegaplog2;
+            p->lineinfo = pp->lineinfo;
+            p->abslineinfo = pp->abslineinfo;
+            p->sizelineinfo = pp->sizelineinfo;
         }
 
-        protos[i] = p;
+        p->shared = 1;
+
+        if (pp->coverage)
+            luaF_unshareproto(L, p);
+
+        p->lazy = PROTO_LAZYCODE;
+        if (pp->debuginfo)
+            p->lazy |= PROTO_LAZYDEBUG;
+
+        p->chunk = chunk;
+        chunk->refs++;
+
+        chunk->protos[i] = p;
     }
 
     // "main" proto is pushed to Lua stack
-    uint32_t mainid = readVarInt(data, size, &offset);
-    Proto* main = protos[mainid];
+    Proto* main = chunk->protos[program->mainid];
 
     luaC_threadbarrier(L);
 
@@ -369,9 +1408,6 @@ int luau_load(lua_State* L, const char* chunkname, const char* data, size_t size
     setclvalue(L, L->top, cl);
     incr_top(L);
 
-    luaM_freearray(L, strings, stringCount, TString*, 0);
-    luaM_freearray(L, protos, protoCount, Proto*, 0);
-
     L->global->GCthreshold = GCthreshold;
 
     return 0;
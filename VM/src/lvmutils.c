@@ -6,6 +6,7 @@
 #include "lstring.h"
 #include "ltable.h"
 #include "lgc.h"
+#include "lmem.h"
 #include "ldo.h"
 #include "lnumutils.h"
 
@@ -21,9 +22,6 @@
 #pragma clang diagnostic ignored "-Wextra-semi-stmt"
 #endif
 
-// limit for table tag-method chains (to avoid loops)
-#define MAXTAGLOOP 100
-
 const TValue* luaV_tonumber(const TValue* obj, TValue* n)
 {
     double num;
@@ -113,6 +111,10 @@ void luaV_gettable(lua_State* L, const TValue* t, TValue* key, StkId val)
         { // `t' is a table?
             Table* h = hvalue(t);
 
+            // packed elements are never nil, so metamethods don't need to be checked
+            if (LUAU_UNLIKELY(ispacked(h)) && luaH_getpacked(h, key, val))
+                return;
+
             const TValue* res = luaH_get(h, key); // do a primitive get
 
             if (res != luaO_nilobject)
@@ -149,6 +151,21 @@ void luaV_settable(lua_State* L, const TValue* t, TValue* key, StkId val)
         { // `t' is a table?
             Table* h = hvalue(t);
 
+            // numbers can be stored in the packed array part without a slot, which also starts packing tables that get a number at index 1
+            if (LUAU_UNLIKELY(ispacked(h)) || (ttisnumber(val) && h->array == NULL && ttisnumber(key) && nvalue(key) == 1.0))
+            {
+                // existing elements are assigned directly, new ones only if __newindex is not set
+                if (luaH_getpacked(h, key, &temp) || fasttm(L, h->metatable, TM_NEWINDEX) == NULL)
+                {
+                    if (h->readonly)
+                        luaG_readonlyerror(L);
+
+                    // if the value can't be stored in the packed array part, luaH_setpacked unpacks the table when needed
+                    if (luaH_setpacked(L, h, key, val))
+                        return;
+                }
+            }
+
             const TValue* oldval = luaH_get(h, key);
 
             // should we assign the key? (if key is valid or __newindex is not set)
@@ -602,6 +619,91 @@ LUAU_NOINLINE void luaV_tryfuncTM(lua_State* L, StkId func)
     setobj2s(L, func, tm); // tag method is the new function to be called
 }
 
+LUAU_NOINLINE void luaV_cachenamecall(lua_State* L, Proto* p, int site, const TValue* obj, TString* key)
+{
+    global_State* g = L->global;
+
+    // instructions past the last site that fits into the C operand aren't cached
+    if (site >= p->sizenamecache)
+        return;
+
+    // watching a table writes to its GC header, which the background sweep could be reading if the table is in one of its pages
+    if (g->sweepjob)
+        return;
+
+    Table* mt = NULL;
+
+    if (ttistable(obj))
+    {
+        // methods that are stored in the receiver itself are found without the cache
+        if (!ttisnil(luaH_getstr(hvalue(obj), key)))
+            return;
+
+        mt = hvalue(obj)->metatable;
+    }
+    else
+    {
+        mt = ttisuserdata(obj) ? uvalue(obj)->metatable : g->mt[ttype(obj)];
+    }
+
+    NamecallEntry e;
+    memset(&e, 0, sizeof(e));
+
+    for (int depth = 0; depth < NAMECALL_MAXDEPTH && mt; ++depth)
+    {
+        // chains that go through an __index function can't be cached
+        const TValue* index = luaH_getstr(mt, g->tmname[TM_INDEX]);
+        if (!ttistable(index))
+            return;
+
+        Table* h = hvalue(index);
+        const TValue* slot = luaH_getstr(h, key);
+
+        if (!luaH_watch(L, mt) || !luaH_watch(L, h))
+            return;
+
+        NamecallLevel* l = &e.levels[depth];
+        l->mt = mt;
+        l->h = h;
+        l->index = index;
+        l->slot = slot == luaO_nilobject ? NULL : slot;
+
+        if (!ttisnil(slot))
+        {
+            e.depth = depth + 1;
+            break;
+        }
+
+        mt = h->metatable;
+    }
+
+    if (e.depth == 0)
+        return;
+
+    e.epoch = g->namecallepoch;
+
+    if (!p->namecache)
+    {
+        p->namecache = luaM_newarray(L, p->sizenamecache, NamecallSite, p->memcat);
+        memset(p->namecache, 0, p->sizenamecache * sizeof(NamecallSite));
+    }
+
+    NamecallSite* s = &p->namecache[site];
+
+    // an entry for the same metatable is out of date, so it's replaced; otherwise, entries are replaced in round-robin order
+    int i = 0;
+    while (i < LUA_NAMECALL_CACHESIZE && s->entries[i].levels[0].mt != e.levels[0].mt)
+        i++;
+
+    if (i == LUA_NAMECALL_CACHESIZE)
+    {
+        i = s->next;
+        s->next = (i + 1) % LUA_NAMECALL_CACHESIZE;
+    }
+
+    s->entries[i] = e;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -0,0 +1,36 @@
+-- Measures the cost of sweeping a large heap where most pages hold a mix of live and dead objects.
+--
+-- Run it with and without the background sweep and compare the time of the sweep steps:
+--   luau --gcstats bench/gc/test_GC_Sweep_LargeHeap.lua
+--   luau --gcstats --bgsweep bench/gc/test_GC_Sweep_LargeHeap.lua
+-- The helper thread only reduces sweep time when it can run on a core that the mutator isn't using.
+
+local liveObjects = 4000000 -- roughly 100 bytes per object with its closure
+local rounds = 8
+
+local live = table.create(liveObjects)
+
+local function make(i)
+    local t = { i, i + 1, x = i }
+    return function()
+        return t
+    end
+end
+
+for i = 1, liveObjects do
+    live[i] = make(i)
+end
+
+local start = os.clock()
+
+for round = 1, rounds do
+    -- replace a part of the live set so that dead objects are spread over all pages
+    for i = round, liveObjects, rounds do
+        live[i] = make(i)
+
+        -- short-lived garbage that fills pages which are freed entirely
+        local _ = { i }
+    end
+end
+
+print(string.format("%d live objects, %d rounds: %.3f s", liveObjects, rounds, os.clock() - start))
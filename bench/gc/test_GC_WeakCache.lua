@@ -0,0 +1,34 @@
+-- Measures the atomic pause of a collector that has a large cache with weak keys to process.
+--
+-- Run it and compare the time of the atomic and clearweak steps:
+--   luau --gcstats bench/gc/test_GC_WeakCache.lua
+-- Tables with weak keys are cleared in incremental steps after the atomic stage, so the maximum atomic step time shouldn't grow
+-- with the size of the cache.
+
+local cacheSize = 1000000
+local rounds = 8
+
+local cache = setmetatable({}, { __mode = "k" })
+local keys = table.create(cacheSize)
+
+for i = 1, cacheSize do
+    local key = { i }
+    keys[i] = key
+    cache[key] = { key, i }
+end
+
+local start = os.clock()
+
+for round = 1, rounds do
+    -- replace a part of the keys so that every cycle has dead entries to clear
+    for i = round, cacheSize, rounds do
+        local key = { i }
+        keys[i] = key
+        cache[key] = { key, i }
+
+        -- short-lived garbage that keeps the collector running
+        local _ = { i }
+    end
+end
+
+print(string.format("%d cached objects, %d rounds: %.3f s", cacheSize, rounds, os.clock() - start))
@@ -0,0 +1,53 @@
+-- Measures inserting string keys into a large hash part, and building many small objects field by field.
+--
+-- Build the VM with and without LUA_TABLE_CONTROLBYTES and compare the times and the heap size:
+--   luau bench/tables/test_Table_HashInsert.lua
+-- Control bytes are only used by hash parts with more than 16 nodes, so small objects should take the same time and memory in both builds.
+
+local tableSize = 100000
+local objects = 100000
+local rounds = 10
+
+local keys = table.create(tableSize)
+for i = 1, tableSize do
+    keys[i] = "key" .. i
+end
+
+local start = os.clock()
+
+for round = 1, rounds do
+    local t = {}
+    for i = 1, tableSize do
+        t[keys[i]] = i
+    end
+end
+
+local insertTime = os.clock() - start
+
+local list = table.create(objects)
+
+start = os.clock()
+
+for i = 1, objects do
+    local o = {}
+    o.name = keys[i]
+    o.x = i
+    o.y = i
+    o.z = i
+    o.w = i
+    o.id = i
+    list[i] = o
+end
+
+local buildTime = os.clock() - start
+
+print(
+    string.format(
+        "%d inserts into a large table: %.3f s; %d small objects: %.3f s, %d KB",
+        tableSize * rounds,
+        insertTime,
+        objects,
+        buildTime,
+        gcinfo()
+    )
+)
@@ -0,0 +1,40 @@
+-- Measures lookups of keys that are absent from the hash part, in a large table and in a small one.
+--
+-- Build the VM with and without LUA_TABLE_CONTROLBYTES and compare the times:
+--   luau bench/tables/test_Table_HashMiss.lua
+-- Control bytes are only used by hash parts with more than 16 nodes, so the small table should take the same time in both builds.
+
+local tableSize = 100000
+local lookups = 100000
+local rounds = 20
+
+local large = {}
+for i = 1, tableSize do
+    large["key" .. i] = i
+end
+
+local small = {}
+for i = 1, 6 do
+    small["key" .. i] = i
+end
+
+local missing = table.create(lookups)
+for i = 1, lookups do
+    missing[i] = "miss" .. i
+end
+
+local function run(t)
+    local start = os.clock()
+
+    for round = 1, rounds do
+        for i = 1, lookups do
+            if t[missing[i]] then
+                error("unexpected key " .. missing[i])
+            end
+        end
+    end
+
+    return os.clock() - start
+end
+
+print(string.format("%d misses: large table %.3f s, small table %.3f s", lookups * rounds, run(large), run(small)))
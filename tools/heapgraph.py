@@ -6,6 +6,7 @@
 # This tool can also be ran with just one snapshot, in which case it displays all allocated objects
 # The result of analysis is a .svg file which can be viewed in a browser
 # To generate these dumps, use luaC_dump, ideally preceded by luaC_fullgc
+# For large heaps, binary snapshots produced by lua_heapsnapshot are much faster to write and can be compared with luau --heapdiff
 
 import argparse
 import json
@@ -3,6 +3,7 @@
 
 # Given a heap snapshot, this tool gathers basic statistics about the allocated objects
 # To generate a snapshot, use luaC_dump, ideally preceded by luaC_fullgc
+# For large heaps, binary snapshots produced by lua_heapsnapshot are much faster to write and can be compared with luau --heapdiff
 
 import json
 import sys
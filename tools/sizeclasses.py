@@ -0,0 +1,116 @@
+#!/usr/bin/python3
+# This file is part of the Luau programming language and is licensed under MIT License; see LICENSE.txt for details
+
+# Given an allocation histogram, this tool derives a size class table for lua_newstatewithsizeclasses that minimizes internal fragmentation
+# The histogram is a text file with "size count" lines, as written by luau --allochistogram (see lua_getallochistogram)
+
+import argparse
+
+# these need to match lmem.c
+kMaxSmallSize = 512
+kPageSize = 16 * 1024 - 24
+kPageHeader = 56
+
+def defaultclasses():
+    return list(range(8, 64, 8)) + list(range(64, 256, 16)) + list(range(256, kMaxSmallSize + 1, 32))
+
+# bytes lost per block to the unused tail of the page
+def tailwaste(size):
+    usable = kPageSize - kPageHeader
+    return (usable % size) / (usable // size)
+
+def waste(histogram, classes):
+    total = 0
+    for size, count in histogram.items():
+        klass = next(c for c in classes if c >= size)
+        total += count * (klass - size + tailwaste(klass))
+    return total
+
+def optimize(histogram, maxclasses):
+    candidates = list(range(8, kMaxSmallSize + 1, 8))
+
+    # count and total size of allocations that fall between two consecutive candidates
+    counts = [0] * len(candidates)
+    sizes = [0] * len(candidates)
+
+    for size, count in histogram.items():
+        index = (size + 7) // 8 - 1
+        counts[index] += count
+        sizes[index] += count * size
+
+    # cost of serving candidates (i, j] with class candidates[j]
+    def cost(i, j):
+        n = sum(counts[i + 1 : j + 1])
+        s = sum(sizes[i + 1 : j + 1])
+        return n * (candidates[j] + tailwaste(candidates[j])) - s
+
+    inf = float("inf")
+    last = len(candidates) - 1
+
+    # best[k][j] is the smallest waste for all allocations up to candidates[j] using k classes with the largest one being candidates[j]
+    best = [[inf] * len(candidates) for _ in range(maxclasses + 1)]
+    prev = [[-1] * len(candidates) for _ in range(maxclasses + 1)]
+
+    for j in range(len(candidates)):
+        best[1][j] = cost(-1, j)
+
+    for k in range(2, maxclasses + 1):
+        for j in range(len(candidates)):
+            for i in range(j):
+                if best[k - 1][i] < inf:
+                    c = best[k - 1][i] + cost(i, j)
+                    if c < best[k][j]:
+                        best[k][j] = c
+                        prev[k][j] = i
+
+    # the largest class has to be kMaxSmallSize; fewer classes are preferred when they don't add any waste
+    k = min(range(1, maxclasses + 1), key = lambda k: (best[k][last], k))
+
+    classes = []
+    j = last
+    while k > 0:
+        classes.append(candidates[j])
+        j = prev[k][j]
+        k -= 1
+
+    return classes[::-1]
+
+argumentParser = argparse.ArgumentParser(description='Derive Luau allocator size classes from an allocation histogram')
+argumentParser.add_argument('histogram', type=open)
+argumentParser.add_argument('--classes', dest='classes', type=int, default=32, help='Maximum number of size classes (LUA_SIZECLASSES)')
+
+arguments = argumentParser.parse_args()
+
+histogram = {}
+large = 0
+
+for line in arguments.histogram:
+    fields = line.split()
+    if len(fields) != 2:
+        continue
+
+    size, count = int(fields[0]), int(fields[1])
+
+    if size > kMaxSmallSize:
+        large += count
+    elif size > 0:
+        histogram[size] = histogram.get(size, 0) + count
+
+allocations = sum(histogram.values())
+requested = sum(size * count for size, count in histogram.items())
+
+if allocations == 0:
+    print("No small allocations in the histogram")
+    exit(1)
+
+default = defaultclasses()
+tuned = optimize(histogram, arguments.classes)
+
+defaultwaste = waste(histogram, default)
+tunedwaste = waste(histogram, tuned)
+
+print("{} small allocations, {} bytes requested; {} large allocations".format(allocations, requested, large))
+print("default: {} classes, {:.0f} bytes wasted ({:.1f}%)".format(len(default), defaultwaste, defaultwaste * 100 / requested))
+print("tuned:   {} classes, {:.0f} bytes wasted ({:.1f}%)".format(len(tuned), tunedwaste, tunedwaste * 100 / requested))
+print()
+print("static const int kSizeClasses[] = {{{}}};".format(", ".join(str(c) for c in tuned)))